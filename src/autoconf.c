@@ -79,6 +79,7 @@
 #include "dvb.h"
 #include "network.h"
 #include "autoconf.h"
+#include "autoconf_cache.h"
 #include "rtp.h"
 #include "log.h"
 #ifdef ENABLE_SCAM_SUPPORT
@@ -252,6 +253,22 @@ int read_autoconfiguration_configuration(auto_p_t *auto_p, char *substring)
 			auto_p->num_service_id_ignore++;
 		}
 	}
+	else if (!strcmp (substring, "autoconf_cache"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		auto_p->cache = atoi (substring);
+	}
+	else if (!strcmp (substring, "autoconf_cache_file"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		if(strlen(substring)>=DEFAULT_PATH_LEN)
+		{
+			log_message( log_module,  MSG_ERROR,
+					"The autoconf_cache_file is too long\n");
+			return -1;
+		}
+		sscanf (substring, "%s\n", auto_p->cache_file);
+	}
 	else if (!strcmp (substring, "autoconf_name_template"))
 	{
 		// other substring extraction method in order to keep spaces
@@ -508,7 +525,7 @@ void autoconf_update_chan_name(mumu_chan_p_t *chan_p, auto_p_t *auto_p)
 
 		//No we apply the templates
 		int len=MAX_NAME_LEN;
-		char number[10];
+		char number[12];
 		mumu_string_replace(chan_p->channels[ichan].name,&len,0,"%name",chan_p->channels[ichan].service_name);
 		sprintf(number,"%d",ichan+1);
 		mumu_string_replace(chan_p->channels[ichan].name,&len,0,"%number",number);
@@ -652,6 +669,7 @@ int autoconf_new_packet(int pid, unsigned char *ts_packet, auto_p_t *auto_p, fds
 						//We update the names for the %lcn
 						log_message( log_module, MSG_INFO,"We got the NIT, we update the channel names");
 						autoconf_update_chan_name(chan_p, auto_p);
+						autoconf_cache_changed(auto_p);
 					}
 
 				}
@@ -669,13 +687,14 @@ int autoconf_new_packet(int pid, unsigned char *ts_packet, auto_p_t *auto_p, fds
 			log_message( log_module, MSG_INFO,"We update the channel networking");
 			update_chan_net(chan_p, auto_p, multi_p, unicast_vars, server_id, tune_p->card, tune_p->tuner);
 			auto_p->need_filter_chan_update=0;
+			autoconf_cache_changed(auto_p);
 		}
 		//PMT PID analysis, only for channels being marked as ready
 		if(auto_p->pat_all_sections_seen)
 		{
 			int ichan;
 			int channel_updated=0;
-			for(ichan=0;ichan<MAX_CHANNELS;ichan++)
+			for(ichan=0;ichan<chan_p->number_of_channels;ichan++)
 			{
 				if(pid &&
 						(chan_p->channels[ichan].pid_i.pmt_pid==pid)&&
@@ -698,15 +717,18 @@ int autoconf_new_packet(int pid, unsigned char *ts_packet, auto_p_t *auto_p, fds
 			{
 				//check if all PMT PIDs seen and show channels
 				int channel_left=0;
-				for(ichan=0;ichan<MAX_CHANNELS;ichan++)
+				for(ichan=0;ichan<chan_p->number_of_channels;ichan++)
 				{
 					if(chan_p->channels[ichan].autoconf_pmt_need_update)
 						channel_left=1;
 				}
 				if(!channel_left)
 						log_streamed_channels(log_module,chan_p->number_of_channels, chan_p->channels, multi_p->multicast_ipv4, multi_p->multicast_ipv6, unicast_vars->unicast, unicast_vars->portOut, unicast_vars->ipOut);
+				autoconf_cache_changed(auto_p);
 			}
 		}
+		//We save the services for the next start
+		autoconf_cache_update(auto_p, chan_p, tune_p);
 
 	}
 	//TODO : put PMT information in the pid_i structure of the channel
@@ -146,6 +146,16 @@ Possible values for this variable
 
 	/** The CA systems */
 	mumudvb_ca_system_t ca_system_list[MAX_CA_SYSTEMS];
+
+	/** Do we save the autoconfigured services to restore them at the next start ?*/
+	int cache;
+	/** The file of the saved services */
+	char cache_file[DEFAULT_PATH_LEN];
+	/** The services changed since they were saved, and when */
+	int cache_dirty;
+	long cache_changed_time;
+	/** The number of services restored at startup */
+	int cache_restored;
 }auto_p_t;
 
 
@@ -155,6 +165,8 @@ void autoconf_freeing(auto_p_t *);
 int read_autoconfiguration_configuration(auto_p_t *auto_p, char *substring);
 int autoconf_new_packet(int pid, unsigned char *ts_packet, auto_p_t *auto_p, fds_t *fds, mumu_chan_p_t *chan_p, tune_p_t *tune_p, multi_p_t *multi_p,  unicast_parameters_t *unicast_vars, int server_id, void *scam_vars);
 int autoconf_poll(long now, auto_p_t *auto_p, mumu_chan_p_t *chan_p, tune_p_t *tune_p, multi_p_t *multi_p, fds_t *fds, unicast_parameters_t *unicast_vars, int server_id, void *scam_vars);
+void autoconf_update_chan_name(mumu_chan_p_t *chan_p, auto_p_t *auto_p);
+void autoconf_update_chan_status(auto_p_t *auto_p, mumu_chan_p_t *chan_p);
 void autoconf_pmt_follow( unsigned char *ts_packet, fds_t *fds, mumudvb_channel_t *actual_channel, char *card_base_path, int tuner, mumu_chan_p_t *chan_p );
 
 #endif
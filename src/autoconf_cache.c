@@ -0,0 +1,278 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2013 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief Cache of the autoconfigured services
+ *
+ * With full autoconfiguration, the channels are streamed only after the PAT, the SDT and the
+ * PMT of each service are read. The services found are saved in a file, for each tuner and
+ * transponder. At the next start, the channels are restored from this file and streamed
+ * at once. The tables are read as usual : the PAT removes the services which disappeared,
+ * and the PMT, SDT and NIT update the PIDs, the names and the LCN.
+ *
+ * The channels keep their number, the addresses and the ports are computed again from the
+ * templates of the configuration.
+ *
+ * The file is a text file, one "key=value" per line. A "channel" line starts a service.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include "autoconf_cache.h"
+#include "log.h"
+
+extern long now;
+
+static char *log_module="Autoconf: ";
+
+/** @brief Set the default path of the cache file, one per tuner (and per PLP for the T2-MI) */
+static void autoconf_cache_path(auto_p_t *auto_p, mumu_chan_p_t *chan_p, tune_p_t *tune_p)
+{
+	int len;
+
+	if(strlen(auto_p->cache_file))
+		return;
+	len=snprintf(auto_p->cache_file, DEFAULT_PATH_LEN, AUTOCONF_CACHE_PATH, tune_p->card, tune_p->tuner);
+	if(chan_p->t2mi_pid && len>0 && len<DEFAULT_PATH_LEN)
+		snprintf(auto_p->cache_file+len, DEFAULT_PATH_LEN-len, "_plp%d", chan_p->t2mi_plp);
+}
+
+/** @brief Describe what we receive, the cache is used only if it was saved for the same transponder */
+static void autoconf_cache_transponder(mumu_chan_p_t *chan_p, tune_p_t *tune_p, char *transponder, int len)
+{
+	int pos;
+
+	pos=snprintf(transponder, len, "freq %.3f pol %d srate %u", tune_p->freq, tune_p->pol, tune_p->srate);
+#if STREAM_ID
+	if(pos>0 && pos<len)
+		pos+=snprintf(transponder+pos, len-pos, " stream_id %d", tune_p->stream_id);
+#endif
+	if(pos>0 && pos<len && strlen(tune_p->read_file_path))
+		pos+=snprintf(transponder+pos, len-pos, " file %s", tune_p->read_file_path);
+	if(pos>0 && pos<len && strlen(tune_p->source_addr))
+		pos+=snprintf(transponder+pos, len-pos, " source %s:%d", tune_p->source_addr, tune_p->source_port);
+	if(pos>0 && pos<len && chan_p->t2mi_pid)
+		snprintf(transponder+pos, len-pos, " t2mi %d plp %d", chan_p->t2mi_pid, chan_p->t2mi_plp);
+}
+
+/** @brief Restore the services saved for this transponder
+ *
+ * Only with full autoconfiguration and if no channel is defined in the configuration.
+ * The restored channels are made ready to stream by the usual initialization (filters and network).
+ *
+ * @return the number of channels restored
+ */
+int autoconf_cache_load(auto_p_t *auto_p, mumu_chan_p_t *chan_p, tune_p_t *tune_p)
+{
+	FILE *cache_file;
+	char line[CONF_LINELEN];
+	char transponder[CONF_LINELEN];
+	char *value;
+	mumudvb_channel_t *chan=NULL;
+	int version=0;
+	int transponder_ok=0;
+	int num_removed=0;
+
+	if(!auto_p->cache || auto_p->autoconfiguration!=AUTOCONF_MODE_FULL)
+		return 0;
+	autoconf_cache_path(auto_p, chan_p, tune_p);
+	if(chan_p->number_of_channels)
+	{
+		log_message( log_module, MSG_INFO,"Channels are defined in the configuration, the autoconfiguration cache is not loaded\n");
+		return 0;
+	}
+	cache_file=fopen(auto_p->cache_file, "r");
+	if(cache_file==NULL)
+	{
+		log_message( log_module, MSG_INFO,"No autoconfiguration cache loaded, %s: %s\n", auto_p->cache_file, strerror(errno));
+		return 0;
+	}
+	autoconf_cache_transponder(chan_p, tune_p, transponder, CONF_LINELEN);
+
+	while(fgets(line, CONF_LINELEN, cache_file))
+	{
+		line[strcspn(line, "\r\n")]='\0';
+		if(line[0]=='#' || (value=strchr(line, '='))==NULL)
+			continue;
+		*value++='\0';
+		if(!strcmp(line, "version"))
+			version=atoi(value);
+		else if(!strcmp(line, "transponder"))
+			transponder_ok=!strcmp(value, transponder);
+		else if(version!=AUTOCONF_CACHE_VERSION || !transponder_ok)
+			break;
+		else if(!strcmp(line, "channel"))
+		{
+			if(chan_p->number_of_channels>=(MAX_CHANNELS-1))
+			{
+				log_message( log_module, MSG_WARN,"Autoconfiguration cache : too many channels, the others are not restored\n");
+				break;
+			}
+			chan=&chan_p->channels[chan_p->number_of_channels];
+			chan_p->number_of_channels++;
+			chan->service_id=atoi(value);
+			MU_F(chan->service_id)=F_DETECTED;
+			MU_F(chan->pid_i.pmt_pid)=F_DETECTED;
+			chan->pid_i.pid_f=F_DETECTED;
+			chan->channel_ready=NOT_READY;
+			//The PMT will be read again
+			chan->pmt_version=-1;
+		}
+		else if(chan==NULL)
+			continue;
+		else if(!strcmp(line, "status") && !strcmp(value, "removed"))
+		{
+			chan->channel_ready=REMOVED;
+			num_removed++;
+		}
+		else if(!strcmp(line, "service_name"))
+		{
+			strncpy(chan->service_name, value, MAX_NAME_LEN-1);
+			chan->service_name[MAX_NAME_LEN-1]='\0';
+		}
+		else if(!strcmp(line, "service_type"))
+			chan->service_type=atoi(value);
+		else if(!strcmp(line, "free_ca_mode"))
+			chan->free_ca_mode=atoi(value);
+		else if(!strcmp(line, "lcn"))
+			chan->logical_channel_number=atoi(value);
+		else if(!strcmp(line, "pmt_pid"))
+			chan->pid_i.pmt_pid=atoi(value);
+		else if(!strcmp(line, "pcr_pid"))
+			chan->pid_i.pcr_pid=atoi(value);
+		else if(!strcmp(line, "pid") && chan->pid_i.num_pids<MAX_PIDS)
+		{
+			int ipid=chan->pid_i.num_pids;
+			if(sscanf(value, "%d %d %3s", &chan->pid_i.pids[ipid], &chan->pid_i.pids_type[ipid], chan->pid_i.pids_language[ipid])>=2)
+				chan->pid_i.num_pids++;
+		}
+		else if(!strcmp(line, "ca_sys_id"))
+		{
+			for(int i=0;i<32;i++)
+				if(!chan->ca_sys_id[i])
+				{
+					chan->ca_sys_id[i]=atoi(value);
+					break;
+				}
+		}
+	}
+	fclose(cache_file);
+
+	if(version!=AUTOCONF_CACHE_VERSION)
+		log_message( log_module, MSG_INFO,"The autoconfiguration cache %s has an unknown version, it is not used\n", auto_p->cache_file);
+	else if(!transponder_ok)
+		log_message( log_module, MSG_INFO,"The autoconfiguration cache %s was saved for another transponder, it is not used\n", auto_p->cache_file);
+	else
+		log_message( log_module, MSG_INFO,"%d services restored from the autoconfiguration cache %s (%d removed), they will be checked with the tables\n",
+				chan_p->number_of_channels-num_removed, auto_p->cache_file, num_removed);
+	if(chan_p->number_of_channels)
+	{
+		//The channels become ALMOST_READY, they will be READY when the network is up
+		autoconf_update_chan_name(chan_p, auto_p);
+		autoconf_update_chan_status(auto_p, chan_p);
+	}
+	auto_p->cache_restored=chan_p->number_of_channels-num_removed;
+	return auto_p->cache_restored;
+}
+
+/** @brief Save the services of the transponder
+ *
+ * The file is written under another name then renamed, a reader never sees a partial file.
+ */
+int autoconf_cache_save(auto_p_t *auto_p, mumu_chan_p_t *chan_p, tune_p_t *tune_p)
+{
+	FILE *cache_file;
+	char temp_name[DEFAULT_PATH_LEN+8];
+	char transponder[CONF_LINELEN];
+
+	autoconf_cache_path(auto_p, chan_p, tune_p);
+	autoconf_cache_transponder(chan_p, tune_p, transponder, CONF_LINELEN);
+	snprintf(temp_name, sizeof(temp_name), "%s.tmp", auto_p->cache_file);
+	cache_file=fopen(temp_name, "w");
+	if(cache_file==NULL)
+	{
+		log_message( log_module, MSG_WARN,"Cannot write the autoconfiguration cache %s: %s\n", temp_name, strerror(errno));
+		return -1;
+	}
+
+	fprintf(cache_file, "# MuMuDVB autoconfiguration cache, it is rewritten when the services change\n");
+	fprintf(cache_file, "version=%d\n", AUTOCONF_CACHE_VERSION);
+	fprintf(cache_file, "transponder=%s\n", transponder);
+	pthread_mutex_lock(&chan_p->lock);
+	for (int ichan = 0; ichan < chan_p->number_of_channels; ichan++)
+	{
+		mumudvb_channel_t *chan=&chan_p->channels[ichan];
+		fprintf(cache_file, "channel=%d\n", chan->service_id);
+		if(chan->channel_ready==REMOVED)
+			fprintf(cache_file, "status=removed\n");
+		fprintf(cache_file, "service_name=%s\n", chan->service_name);
+		fprintf(cache_file, "service_type=%d\n", chan->service_type);
+		fprintf(cache_file, "free_ca_mode=%d\n", chan->free_ca_mode);
+		fprintf(cache_file, "lcn=%d\n", chan->logical_channel_number);
+		fprintf(cache_file, "pmt_pid=%d\n", chan->pid_i.pmt_pid);
+		fprintf(cache_file, "pcr_pid=%d\n", chan->pid_i.pcr_pid);
+		for (int ipid = 0; ipid < chan->pid_i.num_pids; ipid++)
+			fprintf(cache_file, "pid=%d %d %s\n", chan->pid_i.pids[ipid], chan->pid_i.pids_type[ipid],
+					strlen(chan->pid_i.pids_language[ipid]) ? chan->pid_i.pids_language[ipid] : "---");
+		for (int i = 0; i < 32 && chan->ca_sys_id[i]; i++)
+			fprintf(cache_file, "ca_sys_id=%d\n", chan->ca_sys_id[i]);
+	}
+	pthread_mutex_unlock(&chan_p->lock);
+
+	if(fclose(cache_file) || rename(temp_name, auto_p->cache_file))
+	{
+		log_message( log_module, MSG_WARN,"Cannot write the autoconfiguration cache %s: %s\n", auto_p->cache_file, strerror(errno));
+		remove(temp_name);
+		return -1;
+	}
+	log_message( log_module, MSG_DETAIL,"%d services saved in the autoconfiguration cache %s\n", chan_p->number_of_channels, auto_p->cache_file);
+	return 0;
+}
+
+/** @brief The services changed, they will be saved */
+void autoconf_cache_changed(auto_p_t *auto_p)
+{
+	auto_p->cache_dirty=1;
+	auto_p->cache_changed_time=now;
+}
+
+/** @brief Save the services if they changed and the tables are complete
+ *
+ * We wait AUTOCONF_CACHE_DELAY seconds without change, the PMT of the services arrive one after the other.
+ */
+void autoconf_cache_update(auto_p_t *auto_p, mumu_chan_p_t *chan_p, tune_p_t *tune_p)
+{
+	if(!auto_p->cache || !auto_p->cache_dirty)
+		return;
+	if(!auto_p->pat_all_sections_seen || !(auto_p->sdt_all_sections_seen || auto_p->psip_all_sections_seen))
+		return;
+	if(now-auto_p->cache_changed_time<AUTOCONF_CACHE_DELAY)
+		return;
+	auto_p->cache_dirty=0;
+	autoconf_cache_save(auto_p, chan_p, tune_p);
+}
@@ -0,0 +1,47 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2013 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief Cache of the autoconfigured services, used to start streaming before the tables are read
+ */
+
+#ifndef _AUTOCONF_CACHE_H
+#define _AUTOCONF_CACHE_H
+
+#include "mumudvb.h"
+#include "autoconf.h"
+#include "tune.h"
+
+/** The version of the format of the cache file */
+#define AUTOCONF_CACHE_VERSION 1
+/** The number of seconds without change before the services are saved */
+#define AUTOCONF_CACHE_DELAY 2
+
+int autoconf_cache_load(auto_p_t *auto_p, mumu_chan_p_t *chan_p, tune_p_t *tune_p);
+int autoconf_cache_save(auto_p_t *auto_p, mumu_chan_p_t *chan_p, tune_p_t *tune_p);
+void autoconf_cache_changed(auto_p_t *auto_p);
+void autoconf_cache_update(auto_p_t *auto_p, mumu_chan_p_t *chan_p, tune_p_t *tune_p);
+
+#endif
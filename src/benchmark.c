@@ -0,0 +1,194 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2010 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief Benchmark mode : measures of the packet processing
+ *
+ * The main loop reads the input file in a loop as fast as possible and gives the
+ * time spent reading and processing to the functions of this file. One batch out of
+ * BENCHMARK_SAMPLE_INTERVAL is timed packet by packet to split the processing time
+ * between the global part (CC check, PMT, autoconfiguration, PAT/SDT/EIT rewrite)
+ * and the channels (rewrite, buffering and sending).
+ *
+ * With the GNU libc, the memory allocations are counted by wrapping malloc.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mumudvb.h"
+#include "benchmark.h"
+#include "log.h"
+#include "crc32.h"
+
+static char *log_module="Benchmark: ";
+
+benchmark_params_t benchmark_params;
+
+#ifdef HAVE___LIBC_MALLOC
+/** The number of memory allocations since the start */
+static uint64_t benchmark_allocations;
+static uint64_t benchmark_start_allocations;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+	__atomic_fetch_add(&benchmark_allocations, 1, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	__atomic_fetch_add(&benchmark_allocations, 1, __ATOMIC_RELAXED);
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	__atomic_fetch_add(&benchmark_allocations, 1, __ATOMIC_RELAXED);
+	return __libc_realloc(ptr, size);
+}
+#endif
+
+/** @brief The monotonic time in nanoseconds */
+uint64_t benchmark_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void benchmark_start(benchmark_t *bench)
+{
+	memset(bench, 0, sizeof(benchmark_t));
+	bench->start_ns=benchmark_now_ns();
+	for(int i=0;i<1000;i++)
+		benchmark_now_ns();
+	bench->clock_ns=(benchmark_now_ns()-bench->start_ns)/1001.0;
+	bench->start_ns=benchmark_now_ns();
+#ifdef HAVE___LIBC_MALLOC
+	benchmark_start_allocations=__atomic_load_n(&benchmark_allocations, __ATOMIC_RELAXED);
+#endif
+	log_message( log_module, MSG_INFO, "The input is read in a loop during %.1fs, the datagrams are %s\n",
+			benchmark_params.duration,
+			benchmark_params.network ? "sent to the network" : "dropped");
+}
+
+/** @brief Is the benchmark duration elapsed */
+int benchmark_finished(benchmark_t *bench)
+{
+	if(!bench->start_ns)
+		return 0;
+	return benchmark_now_ns()-bench->start_ns >= benchmark_params.duration*1e9;
+}
+
+/** @brief Display the results of the benchmark of an adapter */
+void benchmark_report(benchmark_t *bench, int card)
+{
+	double elapsed=(benchmark_now_ns()-bench->start_ns)/1e9;
+	double packets=bench->packets ? bench->packets : 1;
+	double global_ns=0, channels_ns=0;
+
+	if(bench->sampled_packets)
+	{
+		//The channels are timed for each packet, with two calls to the clock
+		global_ns=(double)(bench->sampled_loop_ns-bench->sampled_channels_ns)/bench->sampled_packets-bench->clock_ns;
+		channels_ns=(double)bench->sampled_channels_ns/bench->sampled_packets-bench->clock_ns;
+		if(global_ns<0)
+			global_ns=0;
+		if(channels_ns<0)
+			channels_ns=0;
+	}
+	channels_ns+=bench->batch_run_ns/packets;
+
+	log_message( log_module, MSG_INFO, "Card %d: %llu packets in %.2fs (%d loops on the file, %llu reads), %.0f packets/s, %.1f Mbit/s\n",
+			card,
+			(unsigned long long) bench->packets,
+			elapsed,
+			bench->loops,
+			(unsigned long long) bench->reads,
+			bench->packets/elapsed,
+			bench->bytes*8/elapsed/1e6);
+	log_message( log_module, MSG_INFO, "Card %d: ns per packet : read %.1f, global %.1f (CC, PMT, autoconf, PAT/SDT/EIT), channels %.1f (rewrite, buffer, send), total %.1f\n",
+			card,
+			bench->read_ns/packets,
+			global_ns,
+			channels_ns,
+			(bench->read_ns+bench->process_ns)/packets);
+	if(bench->t2mi_packets)
+		log_message( log_module, MSG_INFO, "Card %d: T2-MI extraction : %.1f ns per input packet, %.1f Mbit/s of input\n",
+				card,
+				(double)bench->t2mi_ns/bench->t2mi_packets,
+				bench->t2mi_ns ? bench->t2mi_packets*TS_PACKET_SIZE*8*1e3/bench->t2mi_ns : 0);
+#ifdef HAVE___LIBC_MALLOC
+	log_message( log_module, MSG_INFO, "%.0f allocations/s\n",
+			(__atomic_load_n(&benchmark_allocations, __ATOMIC_RELAXED)-benchmark_start_allocations)/elapsed);
+#else
+	log_message( log_module, MSG_INFO, "The allocations are counted only with the GNU libc\n");
+#endif
+}
+
+/** @brief Display the throughput of the CRC32 engines usable on this CPU, on buffers of the size of the sections */
+void benchmark_crc32(void)
+{
+	static const size_t sizes[]={TS_PACKET_SIZE, 1024, 4096};
+	unsigned char data[4096];
+	volatile uint32_t crc=0;
+
+	for(size_t i=0;i<sizeof(data);i++)
+		data[i]=(i*7+(i>>8))&0xff;
+	for(int e=0;crc32_engines[e].update;e++)
+	{
+		char line[256];
+		int pos;
+
+		if(!crc32_engines[e].available)
+			continue;
+		pos=snprintf(line, sizeof(line), "CRC32 %s%s :", crc32_engines[e].name,
+				strcmp(crc32_engines[e].name, crc32_engine_name()) ? "" : " (used)");
+		for(size_t s=0;s<sizeof(sizes)/sizeof(sizes[0]);s++)
+		{
+			uint64_t start, bytes=0, elapsed;
+			start=benchmark_now_ns();
+			do{
+				for(int n=0;n<1000;n++)
+					crc^=crc32_engines[e].update(CRC32_INIT, data, sizes[s]);
+				bytes+=1000*sizes[s];
+				elapsed=benchmark_now_ns()-start;
+			}while(elapsed<20000000);
+			pos+=snprintf(line+pos, sizeof(line)-pos, " %.0f MB/s (%d bytes)%s",
+					bytes*1e3/elapsed, (int)sizes[s],
+					s+1<sizeof(sizes)/sizeof(sizes[0]) ? "," : "");
+		}
+		log_message( log_module, MSG_INFO, "%s\n", line);
+	}
+}
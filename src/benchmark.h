@@ -0,0 +1,82 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2010 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief Benchmark mode (built with --enable-benchmark) : the input file is read in a loop
+ * as fast as possible and the time spent in each part of the processing is measured
+ */
+
+#ifndef _BENCHMARK_H
+#define _BENCHMARK_H
+
+#include <stdint.h>
+
+/** One batch out of BENCHMARK_SAMPLE_INTERVAL is timed packet by packet */
+#define BENCHMARK_SAMPLE_INTERVAL 16
+
+/** @brief The benchmark options, from the command line */
+typedef struct benchmark_params_t{
+	/** The duration of the benchmark in seconds, 0 if not benchmarking */
+	double duration;
+	/** Do we send the datagrams to the network (1) or drop them (0, null sink) */
+	int network;
+}benchmark_params_t;
+
+/** @brief The measures for one adapter */
+typedef struct benchmark_t{
+	uint64_t start_ns;
+	uint64_t packets;
+	uint64_t bytes;
+	uint64_t reads;
+	/** Number of times the input file was read */
+	int loops;
+	/** Time spent reading the input */
+	uint64_t read_ns;
+	/** Time spent processing the packets */
+	uint64_t process_ns;
+	/** Time spent in demux_batch_run (channels with several demux threads) */
+	uint64_t batch_run_ns;
+	/** Time spent extracting the T2-MI PLPs, and number of input packets given to the extraction */
+	uint64_t t2mi_ns;
+	uint64_t t2mi_packets;
+	/** The timed batches: number of packets, time of the loop on the packets and time given to the channels */
+	uint64_t sampled_packets;
+	uint64_t sampled_loop_ns;
+	uint64_t sampled_channels_ns;
+	/** Set if the current batch is timed packet by packet */
+	int sample;
+	/** The time taken by benchmark_now_ns, removed from the packet by packet measures */
+	double clock_ns;
+}benchmark_t;
+
+extern benchmark_params_t benchmark_params;
+
+uint64_t benchmark_now_ns(void);
+void benchmark_start(benchmark_t *bench);
+int benchmark_finished(benchmark_t *bench);
+void benchmark_report(benchmark_t *bench, int card);
+void benchmark_crc32(void);
+
+#endif
@@ -25,9 +25,21 @@
 /** @file
  * @brief File for CRC32 calculation
  * it contains the precomputed table
+ *
+ * The CRC32 is computed one byte at a time with the table, eight bytes at a time
+ * with the slicing-by-8 tables, or with the carry-less multiplication (PCLMULQDQ)
+ * on the x86 processors which have it. crc32_init chooses the fastest engine
+ * which gives the same results as the table.
  */
 
 #include <stdint.h>
+#include <string.h>
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CRC32_HAVE_PCLMUL
+#include <immintrin.h>
+#endif
+
+#include "crc32.h"
 
 /**CRC table for PAT rebuilding, cam support and autoconfiguration*/
 uint32_t crc32_table[256] =
@@ -98,3 +110,180 @@ uint32_t crc32_table[256] =
 	0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
 
+
+/** The slicing-by-8 tables : crc32_slice8[k][b] is the CRC32 of the byte b followed by k null bytes */
+static uint32_t crc32_slice8[8][256];
+
+/** @brief CRC32 one byte at a time */
+static uint32_t crc32_bytewise(uint32_t crc, const unsigned char *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+		crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ data[i]) & 0xff];
+	return crc;
+}
+
+/** @brief CRC32 eight bytes at a time */
+static uint32_t crc32_slicing_by_8(uint32_t crc, const unsigned char *data, size_t len)
+{
+	uint32_t a, b;
+
+	for (; len >= 8; len -= 8, data += 8) {
+		a = crc ^ ((uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3]);
+		b = (uint32_t)data[4] << 24 | (uint32_t)data[5] << 16 | (uint32_t)data[6] << 8 | data[7];
+		crc = crc32_slice8[7][a >> 24] ^ crc32_slice8[6][(a >> 16) & 0xff] ^
+		      crc32_slice8[5][(a >> 8) & 0xff] ^ crc32_slice8[4][a & 0xff] ^
+		      crc32_slice8[3][b >> 24] ^ crc32_slice8[2][(b >> 16) & 0xff] ^
+		      crc32_slice8[1][(b >> 8) & 0xff] ^ crc32_slice8[0][b & 0xff];
+	}
+	return crc32_bytewise(crc, data, len);
+}
+
+#ifdef CRC32_HAVE_PCLMUL
+/** The folding constants x^n mod P, for n = 128, 192 (fold by 16 bytes) and 512, 576 (fold by 64 bytes) */
+static uint64_t crc32_k128, crc32_k192, crc32_k512, crc32_k576;
+
+/** @brief x^n modulo the CRC32 polynomial */
+static uint64_t crc32_xpow_mod(int n)
+{
+	uint32_t r = 1;
+
+	while (n--)
+		r = (r & 0x80000000) ? (r << 1) ^ 0x04c11db7 : r << 1;
+	return r;
+}
+
+/** @brief Move the 128 bits of x forward by S bits modulo P (the result has up to 96 bits), k holds x^(S+64) mod P and x^S mod P */
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i crc32_fold(__m128i x, __m128i k)
+{
+	return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00));
+}
+
+/** @brief CRC32 with the carry-less multiplication
+ *
+ * The data is read by blocks of 16 bytes, in the big endian order, so the bit n of the
+ * register is the coefficient of x^n. The blocks are folded together (four at a time, then one),
+ * the last block is reduced with the table, it gives the same result as the bytes it replaces.
+ */
+__attribute__((target("pclmul,ssse3")))
+static uint32_t crc32_pclmul(uint32_t crc, const unsigned char *data, size_t len)
+{
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i k16 = _mm_set_epi64x(crc32_k192, crc32_k128);
+	const __m128i k64 = _mm_set_epi64x(crc32_k576, crc32_k512);
+	unsigned char last[16];
+	__m128i x0, x1, x2, x3;
+
+	if (len < 32)
+		return crc32_slicing_by_8(crc, data, len);
+
+	//The CRC is the coefficient of the first 32 bits of the data
+	x0 = _mm_xor_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), bswap), _mm_set_epi32(crc, 0, 0, 0));
+	data += 16;
+	len -= 16;
+	if (len >= 112) {
+		x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), bswap);
+		x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)), bswap);
+		x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)), bswap);
+		data += 48;
+		len -= 48;
+		for (; len >= 64; len -= 64, data += 64) {
+			x0 = _mm_xor_si128(crc32_fold(x0, k64), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), bswap));
+			x1 = _mm_xor_si128(crc32_fold(x1, k64), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)), bswap));
+			x2 = _mm_xor_si128(crc32_fold(x2, k64), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)), bswap));
+			x3 = _mm_xor_si128(crc32_fold(x3, k64), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)), bswap));
+		}
+		x0 = _mm_xor_si128(crc32_fold(x0, k16), x1);
+		x0 = _mm_xor_si128(crc32_fold(x0, k16), x2);
+		x0 = _mm_xor_si128(crc32_fold(x0, k16), x3);
+	}
+	for (; len >= 16; len -= 16, data += 16)
+		x0 = _mm_xor_si128(crc32_fold(x0, k16), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), bswap));
+
+	_mm_storeu_si128((__m128i *) last, _mm_shuffle_epi8(x0, bswap));
+	crc = crc32_slicing_by_8(0, last, 16);
+	return crc32_bytewise(crc, data, len);
+}
+#endif
+
+crc32_engine_t crc32_engines[] = {
+	{ "table", crc32_bytewise, 1 },
+	{ "slicing-by-8", crc32_slicing_by_8, 0 },
+#ifdef CRC32_HAVE_PCLMUL
+	{ "pclmul", crc32_pclmul, 0 },
+#endif
+	{ "", NULL, 0 },
+};
+
+/** The engine used by crc32_update */
+static crc32_engine_t *crc32_engine = crc32_engines;
+
+/** @brief Compare an engine with the table on different lengths and alignments */
+static int crc32_self_check(crc32_engine_t *engine)
+{
+	unsigned char data[4096 + 16];
+	uint32_t seed = 0x12345678;
+	size_t len;
+
+	for (size_t i = 0; i < sizeof(data); i++) {
+		seed = seed * 1103515245 + 12345;
+		data[i] = seed >> 16;
+	}
+	for (len = 0; len <= sizeof(data) - 16; len = (len < 300) ? len + 1 : len * 2) {
+		for (int offset = 0; offset < 16; offset += 5) {
+			if (engine->update(CRC32_INIT, data + offset, len) != crc32_bytewise(CRC32_INIT, data + offset, len))
+				return -1;
+			if (engine->update(seed, data + offset, len) != crc32_bytewise(seed, data + offset, len))
+				return -1;
+		}
+	}
+	return 0;
+}
+
+/** @brief Build the tables and choose the fastest engine available
+ *
+ * @return -1 if an engine available on this CPU doesn't give the same results as the table (it is not used)
+ */
+int crc32_init(void)
+{
+	int ret = 0;
+
+	memcpy(crc32_slice8[0], crc32_table, sizeof(crc32_table));
+	for (int k = 1; k < 8; k++)
+		for (int b = 0; b < 256; b++)
+			crc32_slice8[k][b] = (crc32_slice8[k - 1][b] << 8) ^ crc32_table[crc32_slice8[k - 1][b] >> 24];
+	crc32_engines[1].available = 1;
+#ifdef CRC32_HAVE_PCLMUL
+	crc32_k128 = crc32_xpow_mod(128);
+	crc32_k192 = crc32_xpow_mod(192);
+	crc32_k512 = crc32_xpow_mod(512);
+	crc32_k576 = crc32_xpow_mod(576);
+	crc32_engines[2].available = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+#endif
+	for (crc32_engine_t *engine = crc32_engines; engine->update; engine++) {
+		if (!engine->available)
+			continue;
+		if (crc32_self_check(engine)) {
+			engine->available = 0;
+			ret = -1;
+			continue;
+		}
+		crc32_engine = engine;
+	}
+	return ret;
+}
+
+/** @brief The name of the engine used */
+const char *crc32_engine_name(void)
+{
+	return crc32_engine->name;
+}
+
+/** @brief Continue the CRC32 computation with len bytes, start with CRC32_INIT.
+ *
+ * The CRC32 of a section including its CRC is 0
+ */
+uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t len)
+{
+	return crc32_engine->update(crc, data, len);
+}
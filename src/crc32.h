@@ -0,0 +1,56 @@
+/*
+ * mumudvb - UDP-ize a DVB transport stream.
+ *
+ * (C) 2004-2009 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/** @file
+ * @brief CRC32 of the MPEG-2 sections (polynomial 0x04C11DB7, MSB first)
+ */
+
+#ifndef _CRC32_H
+#define _CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** The CRC32 to start with */
+#define CRC32_INIT 0xffffffff
+
+typedef uint32_t (*crc32_func_t)(uint32_t crc, const unsigned char *data, size_t len);
+
+/** @brief A way to compute the CRC32 */
+typedef struct crc32_engine_t{
+	const char *name;
+	crc32_func_t update;
+	/** Can this engine be used on this CPU (set by crc32_init) */
+	int available;
+}crc32_engine_t;
+
+/** The engines, from the slowest to the fastest, ended by an empty name */
+extern crc32_engine_t crc32_engines[];
+extern uint32_t crc32_table[256];
+
+int crc32_init(void);
+const char *crc32_engine_name(void);
+uint32_t crc32_update(uint32_t crc, const unsigned char *data, size_t len);
+
+#endif
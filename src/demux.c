@@ -0,0 +1,611 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2010 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief Channel demultiplexing
+ *
+ * For each packet, we look in the routing table which channels carry its PID,
+ * apply the per channel processing (CAM, rewrites, filtering) and buffer it.
+ * The channels can be shared between several threads, see demux_parameters_t
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "demux.h"
+#include "errors.h"
+#include "log.h"
+#ifdef ENABLE_CAM_SUPPORT
+#include "cam.h"
+#endif
+#ifdef ENABLE_SCAM_SUPPORT
+#include "scam_common.h"
+#endif
+
+static char *log_module="Demux: ";
+
+extern long now;
+
+/** @brief Initialize the demux parameters */
+void init_demux_v(demux_parameters_t *demux_p)
+{
+	memset(demux_p, 0, sizeof(demux_parameters_t));
+	demux_p->num_threads=1;
+	for (int ithread = 0; ithread < MAX_DEMUX_THREADS; ithread++)
+	{
+		demux_p->threads[ithread].id=ithread;
+		demux_p->threads[ithread].route_reader=-1;
+		demux_p->threads[ithread].demux_p=demux_p;
+	}
+}
+
+/** @brief Read a line of the configuration file to check if there is a demux parameter
+ *
+ * @param demux_p the demux parameters
+ * @param c_chan the channel being configured, NULL if none
+ * @param substring The currrent line
+ */
+int read_demux_configuration(demux_parameters_t *demux_p, mumudvb_channel_t *c_chan, char *substring)
+{
+	char delimiteurs[] = CONFIG_FILE_SEPARATOR;
+	if (!strcmp (substring, "demux_threads"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		demux_p->num_threads = atoi (substring);
+		if(demux_p->num_threads < 1)
+			demux_p->num_threads = 1;
+		if(demux_p->num_threads > MAX_DEMUX_THREADS)
+		{
+			log_message( log_module, MSG_WARN,"Too many demux threads, we use %d\n", MAX_DEMUX_THREADS);
+			demux_p->num_threads = MAX_DEMUX_THREADS;
+		}
+		if(demux_p->num_threads > 1)
+			log_message( log_module, MSG_INFO,"The channels will be sent using %d threads\n", demux_p->num_threads);
+	}
+	else if (!strcmp (substring, "max_buffer_delay"))
+	{
+		int delay;
+		substring = strtok (NULL, delimiteurs);
+		delay = atoi (substring);
+		if(delay < 0)
+			delay = 0;
+		//In a channel section it is only for this channel
+		if(c_chan != NULL)
+		{
+			c_chan->max_buffer_delay = delay;
+			MU_F(c_chan->max_buffer_delay) = F_USER;
+		}
+		else
+			demux_p->max_buffer_delay = delay;
+		if(delay)
+			demux_p->buffer_delay_used = 1;
+	}
+	else
+		return 0; //Nothing concerning demux, we return 0 to explore the other possibilities
+
+	return 1;//We found something for demux, we tell main to go for the next line
+}
+
+
+/** @brief Do the per channel processing of a packet and buffer it if it has to be sent
+ */
+static void demux_channel_packet(demux_thread_t *thread, unsigned char *ts_packet, int pid, pid_route_entry_t *entry, const demux_packet_info_t *info)
+{
+	demux_parameters_t *demux_p=thread->demux_p;
+	rewrite_parameters_t *rewrite_vars=demux_p->rewrite_vars;
+	int ichan=entry->channel;
+	mumudvb_channel_t *channel = &demux_p->chan_p->channels[ichan];
+	int send_packet;
+#ifdef ENABLE_CAM_SUPPORT
+	cam_p_t *cam_p=(cam_p_t *)demux_p->cam_p_v;
+#endif
+#ifdef ENABLE_SCAM_SUPPORT
+	scam_parameters_t *scam_vars=(scam_parameters_t *)demux_p->scam_vars_v;
+#endif
+
+	//We test if the channel is ready (manually configured or autoconf)
+	if(!(channel->channel_ready>0))
+		return;
+
+	//The channel carries this PID (mandatory PIDs and TS padding are handled by the routing table)
+	send_packet=1;
+
+	/******************************************************/
+	//cam support
+	// If we send the packet, we look if it's a cam pmt pid
+	/******************************************************/
+#ifdef ENABLE_CAM_SUPPORT
+	if((cam_p->cam_support && send_packet==1) &&  //no need to check packets we don't send
+			cam_p->ca_resource_connected &&
+			((now-cam_p->cam_pmt_send_time)>=cam_p->cam_interval_pmt_send ))
+	{
+		if(cam_new_packet(pid, ichan, cam_p, channel))
+			cam_p->cam_pmt_send_time=now; //A packet was sent to the CAM
+	}
+#endif
+
+	/******************************************************/
+	//Scam support
+	// copy proper pmt to scam_pmt_packet
+	/******************************************************/
+#ifdef ENABLE_SCAM_SUPPORT
+	if (scam_vars->scam_support && send_packet==1)  //no need to check packets we don't send
+	{
+		scam_new_packet(pid, channel);
+	}
+#endif
+
+	/******************************************************/
+	//Rewrite PMT
+	/******************************************************/
+	if((send_packet==1) && //no need to check packets we don't send
+			(pid == channel->pid_i.pmt_pid) && //This is a PMT PID
+			(channel->pid_i.pmt_pid) && //we have the pmt_pid
+			(rewrite_vars->rewrite_pmt == OPTION_ON ) && //AND we asked for rewrite
+			(channel->pmt_rewrite == 1))  //AND this channel's PMT shouldn't be skipped
+	{
+		send_packet=pmt_rewrite_new_channel_packet(ts_packet, thread->pmt_ts_packet, channel, ichan);
+	}
+
+	/******************************************************/
+	//Rewrite PAT
+	//The rewrite modifies the packet, we work on our copy
+	/******************************************************/
+	if((send_packet==1) && //no need to check packets we don't send
+			(pid == 0) && //This is a PAT PID
+			rewrite_vars->rewrite_pat == OPTION_ON )  //AND we asked for rewrite
+	{
+		memcpy(thread->rewritten_ts_packet, ts_packet, TS_PACKET_SIZE);
+		ts_packet=thread->rewritten_ts_packet;
+		send_packet=pat_rewrite_new_channel_packet(ts_packet, rewrite_vars, channel, ichan, info->pat_continuity_counter);
+	}
+
+	/******************************************************/
+	//Rewrite SDT
+	/******************************************************/
+	if((send_packet==1) && //no need to check packets we don't send
+			(pid == 17) && //This is a SDT PID
+			rewrite_vars->rewrite_sdt == OPTION_ON &&  //AND we asked for rewrite
+			!channel->sdt_rewrite_skip ) //AND the generation was successful
+	{
+		memcpy(thread->rewritten_ts_packet, ts_packet, TS_PACKET_SIZE);
+		ts_packet=thread->rewritten_ts_packet;
+		send_packet=sdt_rewrite_new_channel_packet(ts_packet, rewrite_vars, channel, ichan, info->sdt_continuity_counter);
+	}
+
+	/******************************************************/
+	//Rewrite EIT
+	/******************************************************/
+	if((send_packet==1) &&//no need to check packets we don't send
+			(pid == 18) && //This is a EIT PID
+			(channel->service_id) && //we have the service_id
+			rewrite_vars->rewrite_eit == OPTION_ON) //AND we asked for EIT sorting
+	{
+		eit_rewrite_new_channel_packet(ts_packet, rewrite_vars, channel,
+				demux_p->unicast_vars, demux_p->scam_vars_v);
+		send_packet=0; //for EIT it is sent by the rewrite function itself
+	}
+
+	/******************************************************/
+	// Test if PSI tables filtering is activated
+	/******************************************************/
+	if (send_packet==1 && demux_p->chan_p->psi_tables_filtering>0 && pid<32)
+	{
+		// Keep only PAT and CAT
+		if (demux_p->chan_p->psi_tables_filtering==1 && pid>1) send_packet=0;
+		// Keep only PAT
+		if (demux_p->chan_p->psi_tables_filtering==2 && pid>0) send_packet=0;
+	}
+	/******************************************************/
+	//Ok we must send this packet,
+	// we add it to the channel buffer
+	/******************************************************/
+	if(send_packet==1)
+	{
+		/**Special PMT case*/
+		if((pid == channel->pid_i.pmt_pid) && (rewrite_vars->rewrite_pmt == OPTION_ON ) && (channel->pmt_rewrite == 1))
+			buffer_func(channel, thread->pmt_ts_packet, entry->pid_index, demux_p->unicast_vars, demux_p->scam_vars_v);
+		else
+			buffer_func(channel, ts_packet, entry->pid_index, demux_p->unicast_vars, demux_p->scam_vars_v);
+	}
+}
+
+/** @brief Send a packet to the channels of this thread which carry its PID
+ */
+static void demux_packet(demux_thread_t *thread, unsigned char *ts_packet, const demux_packet_info_t *info)
+{
+	demux_parameters_t *demux_p=thread->demux_p;
+	chan_route_t *route;
+	int iroute;
+	int pid=info->pid;
+
+	//The routing table gives directly the channels carrying this PID
+	//No need for chan_p.lock : the main thread is the only one modifying the channels
+	//configuration and the routing table is read-copy-update
+	route = chan_route_get(demux_p->chan_p);
+	if(route==NULL)
+		return;
+	for (iroute = route->start[pid]; iroute < route->start[pid+1]; iroute++)
+	{
+		//Is this channel ours ?
+		if(demux_p->num_threads>1 && (route->entries[iroute].channel % demux_p->num_threads)!=thread->id)
+			continue;
+		demux_channel_packet(thread, ts_packet, pid, &route->entries[iroute], info);
+	}
+}
+
+/** @brief Send the partial buffers of the channels of the thread which waited more than their maximum delay
+ * A low bitrate channel would otherwise keep its packets until it has a full datagram
+ */
+static void demux_thread_flush(demux_thread_t *thread, uint64_t now_time)
+{
+	demux_parameters_t *demux_p=thread->demux_p;
+	mumu_chan_p_t *chan_p=demux_p->chan_p;
+	for (int ichan = thread->id; ichan < demux_p->batch_assigned_channels; ichan += demux_p->num_threads)
+	{
+		mumudvb_channel_t *channel=&chan_p->channels[ichan];
+		if(!channel->nb_bytes || !channel->max_buffer_delay)
+			continue;
+#ifdef ENABLE_SCAM_SUPPORT
+		//The buffer belongs to the scam send thread
+		if(channel->scam_support && channel->scam_support_started)
+			continue;
+#endif
+		if(now_time - channel->buf_time >= (uint64_t)channel->max_buffer_delay)
+			send_func(channel, now_time, demux_p->unicast_vars, channel->multicast_batch, SEND_DELAY);
+	}
+}
+
+/** @brief Send the current batch to the channels of the thread */
+static void demux_thread_batch(demux_thread_t *thread)
+{
+	demux_parameters_t *demux_p=thread->demux_p;
+	uint64_t now_time;
+	for (int ipacket = 0; ipacket < demux_p->batch_num_packets; ipacket++)
+	{
+		if(demux_p->batch_info[ipacket].pid<0)
+			continue;
+		demux_packet(thread, demux_p->batch_buffer+ipacket*TS_PACKET_SIZE, &demux_p->batch_info[ipacket]);
+	}
+	//We don't hold any routing table between two batches
+	chan_route_quiescent(demux_p->chan_p, thread->route_reader);
+	if(!demux_p->buffer_delay_used && !thread->multicast_batch)
+		return;
+	now_time=get_time();
+	if(demux_p->buffer_delay_used)
+		demux_thread_flush(thread, now_time);
+	if(thread->multicast_batch)
+		multicast_batch_check(thread->multicast_batch, now_time);
+}
+
+/** @brief The demux threads, they wait for a batch and send it to their channels */
+static void *demux_thread_func(void* arg)
+{
+	demux_thread_t *thread=(demux_thread_t *)arg;
+	demux_parameters_t *demux_p=thread->demux_p;
+	unsigned int batch_done;
+
+	log_message( log_module, MSG_DEBUG,"Demux thread %d started\n", thread->id);
+	pthread_mutex_lock(&demux_p->lock);
+	batch_done=demux_p->batch_number;
+	while(1)
+	{
+		while(!demux_p->threadshutdown && demux_p->batch_number==batch_done)
+			pthread_cond_wait(&demux_p->work_cond, &demux_p->lock);
+		if(demux_p->threadshutdown)
+			break;
+		batch_done=demux_p->batch_number;
+		pthread_mutex_unlock(&demux_p->lock);
+
+		demux_thread_batch(thread);
+
+		pthread_mutex_lock(&demux_p->lock);
+		demux_p->batch_pending--;
+		if(!demux_p->batch_pending)
+			pthread_cond_signal(&demux_p->done_cond);
+	}
+	pthread_mutex_unlock(&demux_p->lock);
+	log_message( log_module, MSG_DEBUG,"Demux thread %d stopped\n", thread->id);
+	return 0;
+}
+
+/** @brief Start the demux threads
+ * The thread 0 is the main thread, which already reads the routing table as main_route_reader
+ */
+int demux_start(demux_parameters_t *demux_p, int main_route_reader)
+{
+	int iRet;
+	demux_p->threads[0].route_reader=main_route_reader;
+
+#ifdef ENABLE_CAM_SUPPORT
+	if(demux_p->num_threads>1 && ((cam_p_t *)demux_p->cam_p_v)->cam_support)
+	{
+		log_message( log_module, MSG_WARN,"The CAM support needs a single demux thread, demux_threads ignored\n");
+		demux_p->num_threads=1;
+	}
+#endif
+
+	//The multicast datagrams are copied into the ring of their channel and sent by the output thread
+	if(demux_p->multi_p->multicast && demux_p->multi_p->output_thread)
+	{
+		if(demux_p->multi_p->pacing)
+			log_message( log_module, MSG_WARN,"The multicast pacing sends the datagrams itself, multicast_output_thread ignored\n");
+		else
+		{
+			demux_p->multicast_output=multicast_output_new(demux_p->multi_p);
+			if(demux_p->multicast_output)
+				log_message( log_module, MSG_INFO,"The multicast datagrams are sent by an output thread, %d datagrams per channel\n", demux_p->multi_p->output_ring_size);
+			else
+				log_message( log_module, MSG_WARN,"Cannot start the multicast output thread, the datagrams will be sent by the demux threads\n");
+		}
+	}
+
+	//Each thread sends the multicast datagrams of its channels by batches
+	if(demux_p->multi_p->multicast && demux_p->multi_p->batch && !demux_p->multicast_output)
+	{
+		for (int ithread = 0; ithread < demux_p->num_threads; ithread++)
+		{
+			demux_p->threads[ithread].multicast_batch=multicast_batch_new(demux_p->multi_p);
+			if(demux_p->threads[ithread].multicast_batch==NULL)
+			{
+				log_message( log_module, MSG_WARN,"Cannot create the multicast batch for thread %d, its datagrams will be sent one by one\n", ithread);
+			}
+		}
+		log_message( log_module, MSG_INFO,"The multicast datagrams are sent by batches, maximum delay %d us\n", demux_p->multi_p->batch_delay);
+	}
+
+	if(demux_p->num_threads<=1)
+		return 0;
+
+	pthread_mutex_init(&demux_p->lock,NULL);
+	pthread_cond_init(&demux_p->work_cond,NULL);
+	pthread_cond_init(&demux_p->done_cond,NULL);
+	demux_p->threads_running=1;
+	for (int ithread = 1; ithread < demux_p->num_threads; ithread++)
+	{
+		demux_p->threads[ithread].route_reader=chan_route_register_reader(demux_p->chan_p);
+		iRet=pthread_create(&demux_p->threads[ithread].thread, NULL, demux_thread_func, &demux_p->threads[ithread]);
+		if(iRet)
+		{
+			log_message( log_module, MSG_ERROR,"Cannot start the demux thread %d : %s\n", ithread, strerror(iRet));
+			demux_p->num_threads=ithread;
+			demux_stop(demux_p);
+			return -1;
+		}
+	}
+	log_message( log_module, MSG_INFO,"%d demux threads started\n", demux_p->num_threads);
+	return 0;
+}
+
+/** @brief Send what is waiting in the multicast batches and the rings and free them
+ * Called when the demux threads don't run
+ */
+static void demux_free_multicast_batches(demux_parameters_t *demux_p)
+{
+	multicast_output_free(demux_p->multicast_output);
+	demux_p->multicast_output=NULL;
+	for (int ithread = 0; ithread < demux_p->num_threads; ithread++)
+	{
+		if(demux_p->threads[ithread].multicast_batch)
+		{
+			multicast_batch_flush(demux_p->threads[ithread].multicast_batch);
+			multicast_batch_free(demux_p->threads[ithread].multicast_batch);
+			demux_p->threads[ithread].multicast_batch=NULL;
+		}
+	}
+}
+
+/** @brief Give the new channels the multicast batch of the thread which handles them
+ * or their ring of the output thread, and the default buffering delay if they don't have their own.
+ * Called by the main thread when no demux thread runs
+ */
+static void demux_assign_channels(demux_parameters_t *demux_p)
+{
+	mumu_chan_p_t *chan_p=demux_p->chan_p;
+	if(chan_p->number_of_channels < demux_p->batch_assigned_channels)
+		demux_p->batch_assigned_channels=chan_p->number_of_channels;
+	for (int ichan = demux_p->batch_assigned_channels; ichan < chan_p->number_of_channels; ichan++)
+	{
+		chan_p->channels[ichan].multicast_batch=demux_p->threads[ichan % demux_p->num_threads].multicast_batch;
+		if(demux_p->multicast_output && multicast_output_add_channel(demux_p->multicast_output, &chan_p->channels[ichan]))
+			log_message( log_module, MSG_WARN,"Cannot create the multicast ring of the channel %d, its datagrams will be sent by the demux thread\n", ichan);
+		if(MU_F(chan_p->channels[ichan].max_buffer_delay)!=F_USER)
+			chan_p->channels[ichan].max_buffer_delay=demux_p->max_buffer_delay;
+	}
+	demux_p->batch_assigned_channels=chan_p->number_of_channels;
+}
+
+/** @brief Stop the demux threads */
+void demux_stop(demux_parameters_t *demux_p)
+{
+	//The channels don't use the batches anymore
+	for (int ichan = 0; ichan < demux_p->batch_assigned_channels; ichan++)
+		demux_p->chan_p->channels[ichan].multicast_batch=NULL;
+	demux_p->batch_assigned_channels=0;
+	if(!demux_p->threads_running)
+	{
+		demux_free_multicast_batches(demux_p);
+		return;
+	}
+	pthread_mutex_lock(&demux_p->lock);
+	demux_p->threadshutdown=1;
+	pthread_cond_broadcast(&demux_p->work_cond);
+	pthread_mutex_unlock(&demux_p->lock);
+	for (int ithread = 1; ithread < demux_p->num_threads; ithread++)
+		pthread_join(demux_p->threads[ithread].thread, NULL);
+	demux_p->threads_running=0;
+	pthread_mutex_destroy(&demux_p->lock);
+	pthread_cond_destroy(&demux_p->work_cond);
+	pthread_cond_destroy(&demux_p->done_cond);
+	if(demux_p->batch_info)
+		free(demux_p->batch_info);
+	demux_p->batch_info=NULL;
+	demux_free_multicast_batches(demux_p);
+	demux_p->num_threads=1;
+}
+
+/** @brief Start a new batch of packets
+ * With a single thread there is no batch, the packets are sent as they come
+ */
+int demux_batch_start(demux_parameters_t *demux_p, unsigned char *buffer, int num_packets)
+{
+	if(demux_p->batch_assigned_channels!=demux_p->chan_p->number_of_channels)
+		demux_assign_channels(demux_p);
+	if(!demux_p->threads_running)
+		return 0;
+	if(num_packets > demux_p->batch_info_size)
+	{
+		demux_packet_info_t *new_info;
+		new_info=realloc(demux_p->batch_info, num_packets*sizeof(demux_packet_info_t));
+		if(new_info==NULL)
+		{
+			log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+			set_interrupted(ERROR_MEMORY<<8);
+			return -1;
+		}
+		demux_p->batch_info=new_info;
+		demux_p->batch_info_size=num_packets;
+	}
+	demux_p->batch_buffer=buffer;
+	demux_p->batch_num_packets=num_packets;
+	//By default the packets are not sent
+	for (int ipacket = 0; ipacket < num_packets; ipacket++)
+		demux_p->batch_info[ipacket].pid=-1;
+	return 0;
+}
+
+/** @brief A new packet, which went through the global processing, has to be sent to the channels
+ * With several threads it is stored in the batch, otherwise it is sent immediately
+ */
+void demux_new_packet(demux_parameters_t *demux_p, int num_packet, unsigned char *ts_packet, int pid)
+{
+	demux_packet_info_t info;
+	info.pid=pid;
+	info.pat_continuity_counter=demux_p->rewrite_vars->pat_continuity_counter;
+	info.sdt_continuity_counter=demux_p->rewrite_vars->sdt_continuity_counter;
+	if(demux_p->threads_running)
+		demux_p->batch_info[num_packet]=info;
+	else
+		demux_packet(&demux_p->threads[0], ts_packet, &info);
+}
+
+/** @brief All the threads send the batch to their channels, we return when all of them are done */
+void demux_batch_run(demux_parameters_t *demux_p)
+{
+	if(!demux_p->threads_running)
+	{
+		//The packets were already sent, we check the delays and if the multicast batch has to be sent
+		if(demux_p->buffer_delay_used || demux_p->threads[0].multicast_batch)
+		{
+			uint64_t now_time=get_time();
+			if(demux_p->buffer_delay_used)
+				demux_thread_flush(&demux_p->threads[0], now_time);
+			if(demux_p->threads[0].multicast_batch)
+				multicast_batch_check(demux_p->threads[0].multicast_batch, now_time);
+		}
+		if(demux_p->multicast_output)
+			multicast_output_wake(demux_p->multicast_output);
+		return;
+	}
+	pthread_mutex_lock(&demux_p->lock);
+	demux_p->batch_number++;
+	demux_p->batch_pending=demux_p->num_threads-1;
+	pthread_cond_broadcast(&demux_p->work_cond);
+	pthread_mutex_unlock(&demux_p->lock);
+
+	//The main thread is the thread 0
+	demux_thread_batch(&demux_p->threads[0]);
+
+	pthread_mutex_lock(&demux_p->lock);
+	while(demux_p->batch_pending)
+		pthread_cond_wait(&demux_p->done_cond, &demux_p->lock);
+	pthread_mutex_unlock(&demux_p->lock);
+	//The datagrams of the batch are waiting in the rings
+	if(demux_p->multicast_output)
+		multicast_output_wake(demux_p->multicast_output);
+}
+
+/** @brief Send the partial buffers and the multicast batches which waited too long when there is no new data
+ * Called by the main thread between two batches, so the demux threads don't run
+ */
+void demux_flush_delayed(demux_parameters_t *demux_p)
+{
+	uint64_t now_time=0;
+	for (int ithread = 0; ithread < demux_p->num_threads; ithread++)
+	{
+		demux_thread_t *thread=&demux_p->threads[ithread];
+		if(!demux_p->buffer_delay_used && !thread->multicast_batch)
+			continue;
+		if(!now_time)
+			now_time=get_time();
+		if(demux_p->buffer_delay_used)
+			demux_thread_flush(thread, now_time);
+		//The queued datagrams are sent after the batch delay, even if the input paused
+		if(thread->multicast_batch)
+			multicast_batch_check(thread->multicast_batch, now_time);
+	}
+	if(demux_p->buffer_delay_used && demux_p->multicast_output)
+		multicast_output_wake(demux_p->multicast_output);
+}
+
+/** @brief How long the main thread can wait for new data before a partial buffer or a multicast batch has to be sent
+ * Called by the main thread between two batches
+ *
+ * @param max_timeout the usual poll timeout (ms)
+ * @return the poll timeout in ms
+ */
+int demux_poll_timeout(demux_parameters_t *demux_p, int max_timeout)
+{
+	mumu_chan_p_t *chan_p=demux_p->chan_p;
+	uint64_t now_time, wait, min_wait, deadline;
+	now_time=get_time();
+	min_wait=(uint64_t)max_timeout*1000;
+	for (int ichan = 0; demux_p->buffer_delay_used && ichan < demux_p->batch_assigned_channels; ichan++)
+	{
+		mumudvb_channel_t *channel=&chan_p->channels[ichan];
+		if(!channel->nb_bytes || !channel->max_buffer_delay)
+			continue;
+		if(now_time - channel->buf_time >= (uint64_t)channel->max_buffer_delay)
+			return 0;
+		wait=channel->buf_time + channel->max_buffer_delay - now_time;
+		if(wait < min_wait)
+			min_wait=wait;
+	}
+	//The multicast batches which are not empty have to be sent at their deadline
+	for (int ithread = 0; ithread < demux_p->num_threads; ithread++)
+	{
+		if(!demux_p->threads[ithread].multicast_batch)
+			continue;
+		deadline=multicast_batch_deadline(demux_p->threads[ithread].multicast_batch);
+		if(!deadline)
+			continue;
+		if(deadline <= now_time)
+			return 0;
+		if(deadline - now_time < min_wait)
+			min_wait=deadline - now_time;
+	}
+	return (int)((min_wait+999)/1000);
+}
@@ -0,0 +1,119 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2010 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief Channel demultiplexing : sending the packets to the channels, possibly with several threads
+ */
+
+#ifndef _DEMUX_H
+#define _DEMUX_H
+
+#include "mumudvb.h"
+#include "rewrite.h"
+#include "unicast_http.h"
+
+/**the maximum number of demux threads*/
+#define MAX_DEMUX_THREADS 32
+
+/** @brief What the main thread computed for a packet of the batch */
+typedef struct demux_packet_info_t{
+	/** The packet PID, -1 if the packet is not sent to the channels*/
+	int16_t pid;
+	/** The PAT and SDT continuity counters when the packet was received*/
+	uint8_t pat_continuity_counter;
+	uint8_t sdt_continuity_counter;
+}demux_packet_info_t;
+
+struct demux_parameters_t;
+
+/** @brief One demux thread, it handles the channels whose number modulo the number of threads is its id */
+typedef struct demux_thread_t{
+	int id;
+	pthread_t thread;
+	/** Our reader number for the routing table*/
+	int route_reader;
+	/**We must get a little bit special for PMT rewrite*/
+	unsigned char pmt_ts_packet[TS_PACKET_SIZE];
+	/** The PAT/SDT rewrite modifies the packet, this is our private copy*/
+	unsigned char rewritten_ts_packet[TS_PACKET_SIZE];
+	/** The multicast datagrams of our channels waiting to be sent, NULL if not batched*/
+	multicast_batch_t *multicast_batch;
+	struct demux_parameters_t *demux_p;
+}demux_thread_t;
+
+/** @brief The demux parameters and the state of the thread pool
+ *
+ * With one thread, the main thread sends the packets to the channels as it reads them.
+ * With several threads, the main thread does the global work on a batch of packets
+ * (autoconfiguration, global tables) and then every thread sends the batch to its own
+ * channels, the main thread being the thread 0. The main thread waits for all the
+ * threads to finish the batch before going on, so the channels configuration, the
+ * global tables and the unicast clients are never modified while the threads run.
+ */
+typedef struct demux_parameters_t{
+	/** Number of demux threads (including the main thread) */
+	int num_threads;
+	demux_thread_t threads[MAX_DEMUX_THREADS];
+	mumu_chan_p_t *chan_p;
+	multi_p_t *multi_p;
+	rewrite_parameters_t *rewrite_vars;
+	unicast_parameters_t *unicast_vars;
+	void *cam_p_v;
+	void *scam_vars_v;
+	/** The thread sending the multicast datagrams of the channels, NULL if they are sent by the demux threads */
+	multicast_output_t *multicast_output;
+	/** Number of channels which were given their multicast batch and buffering delay */
+	int batch_assigned_channels;
+	/** The default maximum time a packet waits in a channel buffer (us), 0 to wait for a full buffer */
+	int max_buffer_delay;
+	/** Set if a channel has a maximum buffering delay, the buffers have to be checked */
+	int buffer_delay_used;
+	/** The batch being processed */
+	unsigned char *batch_buffer;
+	int batch_num_packets;
+	demux_packet_info_t *batch_info;
+	int batch_info_size;
+	/** Incremented for each new batch */
+	unsigned int batch_number;
+	/** Number of threads still working on the batch */
+	int batch_pending;
+	int threadshutdown;
+	int threads_running;
+	pthread_mutex_t lock;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+}demux_parameters_t;
+
+void init_demux_v(demux_parameters_t *demux_p);
+int read_demux_configuration(demux_parameters_t *demux_p, mumudvb_channel_t *c_chan, char *substring);
+int demux_start(demux_parameters_t *demux_p, int main_route_reader);
+void demux_stop(demux_parameters_t *demux_p);
+int demux_batch_start(demux_parameters_t *demux_p, unsigned char *buffer, int num_packets);
+void demux_new_packet(demux_parameters_t *demux_p, int num_packet, unsigned char *ts_packet, int pid);
+void demux_batch_run(demux_parameters_t *demux_p);
+void demux_flush_delayed(demux_parameters_t *demux_p);
+int demux_poll_timeout(demux_parameters_t *demux_p, int max_timeout);
+
+#endif
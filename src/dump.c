@@ -0,0 +1,311 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2010 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief Dump of the received stream
+ *
+ * The main loop copies the packets it reads into a ring buffer and never waits
+ * for the disk: if the ring buffer is full, the packets are dropped and counted.
+ * A thread writes the ring buffer to the file by big aligned chunks, and starts
+ * a new file when the size or time limit is reached.
+ */
+
+#define _GNU_SOURCE //in order to use O_DIRECT
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "dump.h"
+#include "errors.h"
+#include "log.h"
+
+static char *log_module="Dump: ";
+
+dump_params_t dump_params={
+		.ring_size=DUMP_DEFAULT_RING_SIZE,
+};
+
+/** @brief Open the current dump file, the files are numbered if the dump is rotated */
+static int dump_open_file(dump_t *dump)
+{
+	char filename[1024];
+	int flags=O_WRONLY|O_CREAT|O_TRUNC;
+
+	if(dump_params.rotate_size||dump_params.rotate_time)
+		snprintf(filename, sizeof(filename), "%s.%d", dump->filename, dump->file_number);
+	else
+		snprintf(filename, sizeof(filename), "%s", dump->filename);
+#ifdef O_DIRECT
+	if(dump->direct)
+	{
+		dump->fd=open(filename, flags|O_DIRECT, 0644);
+		if(dump->fd<0 && errno==EINVAL)
+		{
+			log_message( log_module, MSG_WARN, "The file system of %s does not support O_DIRECT, the dump is written through the page cache\n", filename);
+			dump->direct=0;
+		}
+	}
+	if(!dump->direct)
+#endif
+		dump->fd=open(filename, flags, 0644);
+	if(dump->fd<0)
+	{
+		log_message( log_module, MSG_ERROR, "%s: %s\n", filename, strerror(errno));
+		return -1;
+	}
+	dump->file_bytes=0;
+	dump->file_start=time(NULL);
+	log_message( log_module, MSG_DEBUG, "Dumping the stream into %s\n", filename);
+	return 0;
+}
+
+/** @brief Write up to len bytes from the tail of the ring buffer, called without the lock
+ *
+ * @return the number of bytes taken from the ring buffer (the write stops at the end of the buffer)
+ */
+static uint64_t dump_write(dump_t *dump, uint64_t tail, uint64_t len)
+{
+	uint64_t pos=tail%dump->ring_size;
+	uint64_t left;
+	ssize_t ret;
+
+	if(dump->fd>=0 &&
+			((dump_params.rotate_size && dump->file_bytes>=(uint64_t)dump_params.rotate_size*1024*1024) ||
+			(dump_params.rotate_time && time(NULL)-dump->file_start>=dump_params.rotate_time)))
+	{
+		close(dump->fd);
+		dump->file_number++;
+		dump_open_file(dump);
+	}
+	//The ring buffer size is a multiple of DUMP_ALIGN so the writes which don't wrap stay aligned
+	if(len>dump->ring_size-pos)
+		len=dump->ring_size-pos;
+	if(dump->fd<0)
+	{
+		dump->write_errors++;
+		return len;
+	}
+	left=len;
+	while(left)
+	{
+		ret=write(dump->fd, dump->ring+pos, left);
+		if(ret<0)
+		{
+			if(errno==EINTR)
+				continue;
+			if(!dump->write_errors)
+				log_message( log_module, MSG_WARN, "Error while writing the dump : %s\n", strerror(errno));
+			dump->write_errors++;
+			return len;
+		}
+		pos+=ret;
+		left-=ret;
+		dump->written_bytes+=ret;
+		dump->file_bytes+=ret;
+	}
+	return len;
+}
+
+/** @brief The writer thread: writes the chunks as soon as they are full, the rest after DUMP_FLUSH_DELAY */
+static void *dump_thread_func(void* arg)
+{
+	dump_t *dump=(dump_t *) arg;
+	uint64_t chunk=DUMP_ALIGN*DUMP_CHUNK_ALIGNS;
+	uint64_t reported_drops=0;
+	long reported_time=0;
+
+	pthread_mutex_lock(&dump->lock);
+	while(1)
+	{
+		uint64_t tail=dump->tail;
+		uint64_t len=dump->head-tail;
+		int timeout=0;
+
+		if(dump->dropped_packets!=reported_drops && time(NULL)-reported_time>=10)
+		{
+			log_message( log_module, MSG_WARN, "The dump buffer is full, the disk is too slow. %llu packets dropped\n",
+					(unsigned long long) dump->dropped_packets);
+			reported_drops=dump->dropped_packets;
+			reported_time=time(NULL);
+		}
+		if(dump->shutdown)
+			break;
+		if(len<chunk)
+		{
+			struct timeval tv;
+			struct timespec ts;
+			gettimeofday(&tv, NULL);
+			ts.tv_sec=tv.tv_sec+DUMP_FLUSH_DELAY;
+			ts.tv_nsec=tv.tv_usec*1000;
+			timeout=(pthread_cond_timedwait(&dump->cond, &dump->lock, &ts)==ETIMEDOUT);
+			tail=dump->tail;
+			len=dump->head-tail;
+			if(dump->shutdown)
+				break;
+			if(len<chunk && !timeout)
+				continue;
+		}
+		if(len>=chunk)
+			len=chunk;
+		else if(dump->direct)
+			len-=len%DUMP_ALIGN;
+		if(!len)
+			continue;
+		pthread_mutex_unlock(&dump->lock);
+		len=dump_write(dump, tail, len);
+		pthread_mutex_lock(&dump->lock);
+		//We give the space back to the main loop, even if the write failed
+		dump->tail=tail+len;
+	}
+	pthread_mutex_unlock(&dump->lock);
+
+	//End of the dump : we write what is left, the last write is not aligned
+#ifdef O_DIRECT
+	if(dump->direct && dump->fd>=0)
+		fcntl(dump->fd, F_SETFL, fcntl(dump->fd, F_GETFL)&~O_DIRECT);
+	dump->direct=0;
+#endif
+	while(dump->head>dump->tail)
+		dump->tail+=dump_write(dump, dump->tail, dump->head-dump->tail);
+	return NULL;
+}
+
+/** @brief Open the dump file and start the writer thread
+ *
+ * @return the dump, NULL if it cannot be opened
+ */
+dump_t *dump_open(char *filename)
+{
+	dump_t *dump;
+	uint64_t chunk=DUMP_ALIGN*DUMP_CHUNK_ALIGNS;
+	void *ring=NULL;
+
+	dump=calloc(1, sizeof(dump_t));
+	if(dump==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return NULL;
+	}
+	dump->filename=filename;
+	dump->direct=dump_params.direct;
+	//The ring buffer holds a whole number of chunks, at least two
+	dump->ring_size=((uint64_t)dump_params.ring_size*1024*1024/chunk)*chunk;
+	if(dump->ring_size<2*chunk)
+		dump->ring_size=2*chunk;
+	if(posix_memalign(&ring, 4096, dump->ring_size))
+	{
+		log_message( log_module, MSG_ERROR,"Problem with posix_memalign : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		free(dump);
+		return NULL;
+	}
+	dump->ring=ring;
+	if(dump_open_file(dump))
+	{
+		free(dump->ring);
+		free(dump);
+		return NULL;
+	}
+	pthread_mutex_init(&dump->lock, NULL);
+	pthread_cond_init(&dump->cond, NULL);
+	if(pthread_create(&dump->thread, NULL, dump_thread_func, dump))
+	{
+		log_message( log_module, MSG_ERROR,"Cannot start the dump thread : %s\n", strerror(errno));
+		close(dump->fd);
+		free(dump->ring);
+		free(dump);
+		return NULL;
+	}
+	log_message( log_module, MSG_INFO, "Dump buffer of %llu MB%s%s\n",
+			(unsigned long long) dump->ring_size/(1024*1024),
+			dump->direct ? ", O_DIRECT" : "",
+			(dump_params.rotate_size||dump_params.rotate_time) ? ", the files are rotated" : "");
+	return dump;
+}
+
+/** @brief Give packets to the dump, called by the main loop
+ *
+ * The packets are dropped if there is not enough room in the ring buffer
+ */
+void dump_packets(dump_t *dump, unsigned char *buffer, int len)
+{
+	uint64_t head=dump->head;
+	uint64_t pos, first;
+
+	len-=len%TS_PACKET_SIZE;
+	if(len<=0)
+		return;
+	pthread_mutex_lock(&dump->lock);
+	if(dump->ring_size-(head-dump->tail)<(uint64_t)len)
+	{
+		dump->dropped_packets+=len/TS_PACKET_SIZE;
+		pthread_mutex_unlock(&dump->lock);
+		return;
+	}
+	pthread_mutex_unlock(&dump->lock);
+
+	//The writer thread doesn't touch the free part of the ring buffer, we copy without the lock
+	pos=head%dump->ring_size;
+	first=dump->ring_size-pos;
+	if(first>(uint64_t)len)
+		first=len;
+	memcpy(dump->ring+pos, buffer, first);
+	if(first<(uint64_t)len)
+		memcpy(dump->ring, buffer+first, len-first);
+
+	pthread_mutex_lock(&dump->lock);
+	dump->head=head+len;
+	if(dump->head-dump->tail>=DUMP_ALIGN*DUMP_CHUNK_ALIGNS)
+		pthread_cond_signal(&dump->cond);
+	pthread_mutex_unlock(&dump->lock);
+}
+
+/** @brief Write what is left in the ring buffer, stop the writer thread and close the file */
+void dump_close(dump_t *dump)
+{
+	if(dump==NULL)
+		return;
+	pthread_mutex_lock(&dump->lock);
+	dump->shutdown=1;
+	pthread_cond_signal(&dump->cond);
+	pthread_mutex_unlock(&dump->lock);
+	pthread_join(dump->thread, NULL);
+	log_message( log_module, MSG_INFO, "%.1f MB written in %d file(s), %llu packets dropped (buffer full), %llu write errors\n",
+			dump->written_bytes/(1024.0*1024.0),
+			dump->file_number+1,
+			(unsigned long long) dump->dropped_packets,
+			(unsigned long long) dump->write_errors);
+	if(dump->fd>=0)
+		close(dump->fd);
+	pthread_mutex_destroy(&dump->lock);
+	pthread_cond_destroy(&dump->cond);
+	free(dump->ring);
+	free(dump);
+}
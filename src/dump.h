@@ -0,0 +1,92 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2010 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief Dump of the received stream (--dumpfile), written by a dedicated thread
+ */
+
+#ifndef _DUMP_H
+#define _DUMP_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "ts.h"
+
+/** The writes are a multiple of 4096 bytes (for O_DIRECT) and of the packet size,
+ * so the rotated files never cut a packet */
+#define DUMP_ALIGN (4096*TS_PACKET_SIZE/4)
+/** The size of the writes to the disk, in DUMP_ALIGN units */
+#define DUMP_CHUNK_ALIGNS 5
+/** The default size of the ring buffer, in MB */
+#define DUMP_DEFAULT_RING_SIZE 32
+/** The data waiting less than a chunk is written after this delay (seconds) */
+#define DUMP_FLUSH_DELAY 1
+
+/** @brief The dump options, from the command line */
+typedef struct dump_params_t{
+	/** The size of the ring buffer between the main loop and the writer, in MB */
+	int ring_size;
+	/** Start a new file after this size (MB), 0 for no rotation on size */
+	int rotate_size;
+	/** Start a new file after this time (seconds), 0 for no rotation on time */
+	int rotate_time;
+	/** Open the files with O_DIRECT */
+	int direct;
+}dump_params_t;
+
+/** @brief The dump of the stream */
+typedef struct dump_t{
+	char *filename;
+	int fd;
+	/** The index of the current file when the dump is rotated */
+	int file_number;
+	uint64_t file_bytes;
+	long file_start;
+	int direct;
+	/** The ring buffer, the main loop writes at head, the writer thread reads at tail.
+	 * Both positions only grow, the position in the buffer is modulo ring_size */
+	unsigned char *ring;
+	uint64_t ring_size;
+	uint64_t head;
+	uint64_t tail;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int shutdown;
+	//statistics
+	uint64_t written_bytes;
+	/** Packets dropped because the ring buffer was full */
+	uint64_t dropped_packets;
+	uint64_t write_errors;
+}dump_t;
+
+extern dump_params_t dump_params;
+
+dump_t *dump_open(char *filename);
+void dump_packets(dump_t *dump, unsigned char *buffer, int len);
+void dump_close(dump_t *dump);
+
+#endif
@@ -40,6 +40,7 @@
 #ifndef _WIN32
 #include <dirent.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #else
 #include <io.h>
 #endif
@@ -130,6 +131,79 @@ set_ts_filt (int fd, uint16_t pid)
 #endif
 }
 
+#if !defined(DISABLE_DVB_API) && defined(DMX_ADD_PID)
+/**
+ * @brief Check if the demuxer can filter several PIDs with one file descriptor (DMX_ADD_PID).
+ * The filter is set but not started, the first set_ts_filt on this descriptor replaces its PIDs
+ * @param fd the demuxer file descriptor
+ */
+static int demux_add_pid_supported(int fd)
+{
+	struct dmx_pes_filter_params pesFilterParams;
+	uint16_t pid = 0x1ffe;
+
+	memset(&pesFilterParams, 0, sizeof(pesFilterParams));
+	pesFilterParams.pid = 0x1fff;
+	pesFilterParams.input = DMX_IN_FRONTEND;
+	pesFilterParams.output = DMX_OUT_TS_TAP;
+	pesFilterParams.pes_type = DMX_PES_OTHER;
+	if (ioctl (fd, DMX_SET_PES_FILTER, &pesFilterParams) < 0)
+		return 0;
+	if (ioctl (fd, DMX_ADD_PID, &pid) < 0)
+		return 0;
+	return 1;
+}
+#endif
+
+/**
+ * @brief Add a PID to the single demuxer file descriptor. The first PID sets the filter
+ * @param fds the structure with the file descriptors
+ * @param pid the pid for the filter
+ */
+static void add_ts_filt(fds_t *fds, uint16_t pid)
+{
+#if !defined(DISABLE_DVB_API) && defined(DMX_ADD_PID)
+	if (!fds->demux_filter_set)
+	{
+		set_ts_filt (fds->fd_demux, pid);
+		fds->demux_filter_set = 1;
+		return;
+	}
+	log_message( log_module,  MSG_DEBUG, "Adding PID %d to the filter\n", pid);
+	if (ioctl (fds->fd_demux, DMX_ADD_PID, &pid) < 0)
+	{
+		log_message( log_module,  MSG_ERROR, "FILTER %i: ", pid);
+		log_message( log_module,  MSG_ERROR, "DMX ADD PID : %s\n", strerror(errno));
+	}
+#else
+	(void)fds;
+	(void)pid;
+#endif
+}
+
+/**
+ * @brief Stop filtering a PID : remove it from the single demuxer file descriptor or close its own descriptor
+ * @param fds the structure with the file descriptors
+ * @param pid the pid
+ */
+void unset_filter(fds_t *fds, uint16_t pid)
+{
+#if !defined(DISABLE_DVB_API) && defined(DMX_REMOVE_PID)
+	if (fds->fd_demux > 0 && pid < 8192)
+	{
+		if (ioctl (fds->fd_demux, DMX_REMOVE_PID, &pid) < 0)
+		{
+			log_message( log_module,  MSG_ERROR, "FILTER %i: ", pid);
+			log_message( log_module,  MSG_ERROR, "DMX REMOVE PID : %s\n", strerror(errno));
+		}
+		return;
+	}
+#endif
+	if (fds->fd_demuxer[pid] > 0)
+		close(fds->fd_demuxer[pid]);
+	fds->fd_demuxer[pid]=0;
+}
+
 /**
  * @brief Show the reception power.
  * This information is not alway reliable
@@ -246,7 +320,7 @@ void *show_power_func(void* arg)
 
 
 /**
- * @brief Open file descriptors for the card. open dvr and one demuxer fd per asked pid. This function can be called
+ * @brief Open file descriptors for the card. open dvr and one demuxer fd for all the pids (DMX_ADD_PID) or per asked pid. This function can be called
  * more than one time if new pids are added (typical case autoconf)
  * return -1 in case of error
  * @param card the card number
@@ -273,10 +347,31 @@ create_card_fd(char *base_path, int tuner, uint8_t *asked_pid, fds_t *fds)
 			return -1;
 	}
 
+#if !defined(DISABLE_DVB_API) && defined(DMX_ADD_PID)
+	//One file descriptor for all the PIDs, if the demuxer can do it. The whole transponder (8192) keeps its own
+	if (fds->demux_single_fd && fds->fd_demux == 0) {
+		if ((fds->fd_demux = open(demuxdev_name, O_RDWR)) < 0) {
+			log_message(log_module, MSG_ERROR, "DEMUX DEVICE: %s : %s\n", demuxdev_name, strerror(errno));
+			fds->fd_demux = 0;
+			free(demuxdev_name);
+			return -1;
+		}
+		if (!demux_add_pid_supported(fds->fd_demux)) {
+			log_message(log_module, MSG_INFO, "The demuxer cannot filter several PIDs on one descriptor (DMX_ADD_PID), we use one descriptor per PID\n");
+			close(fds->fd_demux);
+			fds->fd_demux = 0;
+			fds->demux_single_fd = 0;
+		}
+		else
+			log_message(log_module, MSG_DEBUG, "One demuxer descriptor for all the PIDs\n");
+	}
+#endif
+
 	for(curr_pid=0;curr_pid<8193;curr_pid++)
 		//file descriptors for the demuxer (used to set the filters)
 		//we check if we need to open the file descriptor (some cards are limited)
-		if ((asked_pid[curr_pid] != 0) && (fds->fd_demuxer[curr_pid] == 0)) {
+		if ((asked_pid[curr_pid] != 0) && (fds->fd_demuxer[curr_pid] == 0)
+				&& !(fds->fd_demux > 0 && curr_pid < 8192)) {
 #ifndef DISABLE_DVB_API
 			if ((fds->fd_demuxer[curr_pid] = open(demuxdev_name, O_RDWR)) < 0) {
 				log_message(log_module, MSG_ERROR, "FD PID %i: ", curr_pid);
@@ -329,7 +424,10 @@ void set_filters(uint8_t *asked_pid, fds_t *fds)
 	for(int curr_pid=0;curr_pid<8193;curr_pid++)
 		if (asked_pid[curr_pid] == PID_ASKED )
 		{
-			set_ts_filt (fds->fd_demuxer[curr_pid], curr_pid);
+			if (fds->fd_demux > 0 && curr_pid < 8192)
+				add_ts_filt (fds, curr_pid);
+			else
+				set_ts_filt (fds->fd_demuxer[curr_pid], curr_pid);
 			asked_pid[curr_pid] = PID_FILTERED;
 		}
 
@@ -352,6 +450,10 @@ void close_card_fd(fds_t *fds)
 			fds->fd_demuxer[curr_pid]=0;
 		}
 	}
+	if(fds->fd_demux > 0)
+		close(fds->fd_demux);
+	fds->fd_demux=0;
+	fds->demux_filter_set=0;
 
 	if(fds->fd_dvr)
 #ifndef _WIN32
@@ -370,25 +472,180 @@ void close_card_fd(fds_t *fds)
 	fds->fd_frontend=0;
 }
 
+/**
+ * @brief Allocate the ring between the reading thread and the main thread
+ * @param ring the ring
+ * @param slot_packets the biggest read, in packets
+ * @param total_packets the size of the ring in packets
+ * Return 0, -1 if the allocation failed
+ */
+int dvr_ring_init(dvr_ring_t *ring, int slot_packets, int total_packets)
+{
+	int psi_priority=ring->psi_priority;
+
+	memset(ring, 0, sizeof(dvr_ring_t));
+	ring->psi_priority=psi_priority;
+	ring->slot_size=slot_packets*TS_PACKET_SIZE;
+	ring->num_slots=total_packets/slot_packets;
+	if(ring->num_slots<DVR_RING_MIN_SLOTS)
+		ring->num_slots=DVR_RING_MIN_SLOTS;
+	ring->data=malloc((size_t)ring->num_slots*ring->slot_size);
+	ring->slot_bytes=calloc(ring->num_slots, sizeof(int));
+	ring->shed_read=malloc(ring->slot_size);
+	ring->shed_kept=malloc(ring->slot_size);
+	if(!ring->data || !ring->slot_bytes || !ring->shed_read || !ring->shed_kept)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		dvr_ring_free(ring);
+		return -1;
+	}
+	log_message( log_module,  MSG_DEBUG, "Thread ring of %d reads of %d packets\n", ring->num_slots, slot_packets);
+	return 0;
+}
+
+void dvr_ring_free(dvr_ring_t *ring)
+{
+	free(ring->data);
+	free(ring->slot_bytes);
+	free(ring->shed_read);
+	free(ring->shed_kept);
+	ring->data=NULL;
+	ring->slot_bytes=NULL;
+	ring->shed_read=NULL;
+	ring->shed_kept=NULL;
+}
+
+/** @brief The number of slots waiting for the main thread */
+int dvr_ring_used(dvr_ring_t *ring)
+{
+	return __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST)-__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+}
+
+/** @brief Main thread : get the oldest read of the ring
+ * The buffer is valid until dvr_ring_release
+ * Return the number of bytes, 0 if the ring is empty
+ */
+int dvr_ring_get(dvr_ring_t *ring, unsigned char **buffer)
+{
+	unsigned int tail=ring->tail;
+	int slot;
+
+	if(__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST)==tail)
+		return 0;
+	slot=tail%ring->num_slots;
+	*buffer=ring->data+(size_t)slot*ring->slot_size;
+	return ring->slot_bytes[slot];
+}
+
+/** @brief Main thread : give the slot returned by dvr_ring_get back to the reading thread */
+void dvr_ring_release(dvr_ring_t *ring)
+{
+	__atomic_store_n(&ring->tail, ring->tail+1, __ATOMIC_SEQ_CST);
+}
+
+/** @brief Reading thread : publish the slot at head, filled with bytes bytes */
+static void dvr_ring_push(dvr_ring_t *ring, int bytes)
+{
+	int used;
+
+	ring->slot_bytes[ring->head%ring->num_slots]=bytes;
+	__atomic_store_n(&ring->head, ring->head+1, __ATOMIC_SEQ_CST);
+	used=dvr_ring_used(ring);
+	if(used>ring->high_water)
+		ring->high_water=used;
+}
+
+/** @brief Reading thread : drop the packets of a read done while the ring is full
+ * With psi_priority, the packets of the PIDs 0 to 31 and of the PMTs are kept to be given to the main thread later
+ */
+static void dvr_ring_shed(dvr_ring_t *ring, unsigned char *buffer, int bytes)
+{
+	for(int pos=0; pos+TS_PACKET_SIZE<=bytes; pos+=TS_PACKET_SIZE)
+	{
+		unsigned char *packet=buffer+pos;
+		int pid=((packet[1] & 0x1f) << 8) | packet[2];
+		int keep=0;
+
+		if(ring->psi_priority)
+		{
+			if(pid<32 || ring->pmt_pid[pid])
+				keep=1;
+			else if(packet[1] & 0x40)
+			{
+				//Start of a section : we look for a PMT (table id 2)
+				int offset=4;
+				if(packet[3] & 0x20)
+					offset+=1+packet[4];
+				if(offset<TS_PACKET_SIZE-1)
+				{
+					offset+=1+packet[offset];
+					if(offset<TS_PACKET_SIZE && packet[offset]==0x02)
+						keep=ring->pmt_pid[pid]=1;
+				}
+			}
+		}
+		if(keep && ring->shed_kept_bytes+TS_PACKET_SIZE<=ring->slot_size)
+		{
+			memcpy(ring->shed_kept+ring->shed_kept_bytes, packet, TS_PACKET_SIZE);
+			ring->shed_kept_bytes+=TS_PACKET_SIZE;
+			ring->kept_packets++;
+			continue;
+		}
+		ring->dropped_packets++;
+		ring->dropped_bytes+=TS_PACKET_SIZE;
+	}
+}
+
+/** @brief Wake the main thread if it is waiting for data */
+static void read_card_thread_wake(card_thread_parameters_t *threadparams)
+{
+	if(__atomic_load_n(threadparams->main_waiting, __ATOMIC_SEQ_CST))
+	{
+		pthread_mutex_lock(threadparams->carddatamutex);
+		pthread_cond_signal(threadparams->threadcond);
+		pthread_mutex_unlock(threadparams->carddatamutex);
+	}
+}
+
 /**
  * @brief Function for the tread reading data from the card
+ * The reads go to the ring of the card buffer, see dvr_ring_t
  * @param arg the structure with the thread parameters
  */
 void *read_card_thread_func(void* arg)
 {
 	card_thread_parameters_t  *threadparams;
 	threadparams= (card_thread_parameters_t  *) arg;
-
+	card_buffer_t *card_buffer=threadparams->card_buffer;
+	dvr_ring_t *ring=&card_buffer->ring;
 	int poll_ret;
-	pthread_mutex_lock(&threadparams->carddatamutex);
-	threadparams->card_buffer->bytes_in_write_buffer=0;
-	pthread_mutex_unlock(&threadparams->carddatamutex);
-	int throwing_packets=0;
+	int bytes;
+	int full_wait=0;
 	log_message( log_module,  MSG_DEBUG, "Reading thread start\n");
 
-	usleep(100000); //some waiting to be sure the main program is waiting //it is probably useless
 	while(!threadparams->threadshutdown&& !get_interrupted())
 	{
+		//The PSI packets kept while shedding go first
+		if(ring->shed_kept_bytes && dvr_ring_used(ring)<ring->num_slots)
+		{
+			memcpy(ring->data+(size_t)(ring->head%ring->num_slots)*ring->slot_size, ring->shed_kept, ring->shed_kept_bytes);
+			dvr_ring_push(ring, ring->shed_kept_bytes);
+			ring->shed_kept_bytes=0;
+			read_card_thread_wake(threadparams);
+		}
+		if(dvr_ring_used(ring)>=ring->num_slots)
+		{
+			if(!full_wait)
+				card_buffer->thread_full_number++;
+			read_card_thread_wake(threadparams);
+			//Back pressure : the packets wait in the kernel buffer while the main thread catches up
+			if(full_wait<DVR_RING_BACKPRESSURE_DELAY)
+			{
+				full_wait++;
+				usleep(1000);
+				continue;
+			}
+		}
 		//Poll the DVB descriptors
 		poll_ret=mumudvb_poll(threadparams->fds->pfds,threadparams->fds->pfdsnum,DVB_POLL_TIMEOUT);
 		if(poll_ret<0)
@@ -399,42 +656,270 @@ void *read_card_thread_func(void* arg)
 		}
 		if((!(threadparams->fds->pfds[0].revents&POLLIN)) && (!(threadparams->fds->pfds[0].revents&POLLPRI))) //Timeout, we give the ball back to the main for unicast polling
 		{
-			if(threadparams->main_waiting)
-			{
-				pthread_cond_signal(&threadparams->threadcond);
-			}
+			read_card_thread_wake(threadparams);
 			//no DVB packet, we continue
 			continue;
 		}
-		if((threadparams->card_buffer->bytes_in_write_buffer+TS_PACKET_SIZE*threadparams->card_buffer->dvr_buffer_size)>threadparams->card_buffer->write_buffer_size)
+		if(dvr_ring_used(ring)>=ring->num_slots)
 		{
-			/**@todo : use a dynamic buffer ?*/
-			if(!throwing_packets)
+			//The main thread is too slow, we drop the packets instead of letting the kernel buffer overflow
+			if(full_wait==DVR_RING_BACKPRESSURE_DELAY)
 			{
-				throwing_packets=1; /** @todo count them*/
+				full_wait++;
 				log_message( log_module,  MSG_INFO, "Thread trowing dvb packets\n");
 			}
-			if(threadparams->main_waiting)
-			{
-				pthread_cond_signal(&threadparams->threadcond);
-			}
+			bytes=card_read(threadparams->fds->fd_dvr, ring->shed_read, card_buffer);
+			dvr_ring_shed(ring, ring->shed_read, bytes);
 			continue;
 		}
-		throwing_packets=0;
-		pthread_mutex_lock(&threadparams->carddatamutex);
-		threadparams->card_buffer->bytes_in_write_buffer+=card_read(threadparams->fds->fd_dvr,
-				threadparams->card_buffer->writing_buffer+threadparams->card_buffer->bytes_in_write_buffer,
-				threadparams->card_buffer);
-
-		if(threadparams->main_waiting)
+		full_wait=0;
+		bytes=card_read(threadparams->fds->fd_dvr,
+				ring->data+(size_t)(ring->head%ring->num_slots)*ring->slot_size,
+				card_buffer);
+		if(bytes>0)
 		{
-			pthread_cond_signal(&threadparams->threadcond);
+			dvr_ring_push(ring, bytes);
+			read_card_thread_wake(threadparams);
 		}
-		pthread_mutex_unlock(&threadparams->carddatamutex);
 	}
 	return NULL;
 }
 
+#ifndef _WIN32
+#if !defined(DISABLE_DVB_API) && defined(DMX_REQBUFS)
+/** @brief Map the DVR buffers with the DVB mmap API
+ * The driver fills the buffers and we read the packets directly from them, without the copy done by read()
+ * Return 0 if the buffers are mapped, -1 if we have to use read()
+ */
+int card_mmap_init(int fd_dvr, card_buffer_t *card_buffer)
+{
+	struct dmx_requestbuffers req;
+	struct dmx_buffer buf;
+	int ibuf;
+
+	card_buffer->mmap_num_buffers=0;
+	card_buffer->mmap_dequeued=-1;
+	memset(&req, 0, sizeof(req));
+	req.count=card_buffer->dvr_mmap_buffers;
+	req.size=TS_PACKET_SIZE*card_buffer->dvr_buffer_size;
+	if(ioctl(fd_dvr, DMX_REQBUFS, &req) < 0)
+	{
+		log_message( log_module,  MSG_INFO, "The DVR doesn't support the mmap API (%s), we use read()\n", strerror(errno));
+		return -1;
+	}
+	if(req.count > DVR_MMAP_MAX_BUFFERS)
+		req.count=DVR_MMAP_MAX_BUFFERS;
+	for(ibuf=0; ibuf<(int)req.count; ibuf++)
+	{
+		memset(&buf, 0, sizeof(buf));
+		buf.index=ibuf;
+		if(ioctl(fd_dvr, DMX_QUERYBUF, &buf) < 0)
+		{
+			log_message( log_module,  MSG_WARN, "DMX_QUERYBUF failed : %s, we use read()\n", strerror(errno));
+			card_mmap_free(card_buffer);
+			return -1;
+		}
+		card_buffer->mmap_buffers[ibuf]=mmap(NULL, buf.length, PROT_READ, MAP_SHARED, fd_dvr, buf.offset);
+		if(card_buffer->mmap_buffers[ibuf]==MAP_FAILED)
+		{
+			log_message( log_module,  MSG_WARN, "Cannot map the DVR buffer : %s, we use read()\n", strerror(errno));
+			card_mmap_free(card_buffer);
+			return -1;
+		}
+		card_buffer->mmap_buffers_length[ibuf]=buf.length;
+		card_buffer->mmap_num_buffers++;
+	}
+	//We give all the buffers to the driver
+	for(ibuf=0; ibuf<card_buffer->mmap_num_buffers; ibuf++)
+	{
+		memset(&buf, 0, sizeof(buf));
+		buf.index=ibuf;
+		if(ioctl(fd_dvr, DMX_QBUF, &buf) < 0)
+		{
+			log_message( log_module,  MSG_WARN, "DMX_QBUF failed : %s, we use read()\n", strerror(errno));
+			card_mmap_free(card_buffer);
+			return -1;
+		}
+	}
+	log_message( log_module,  MSG_INFO, "The DVR is read with the mmap API, %d buffers of %d bytes\n",
+			card_buffer->mmap_num_buffers, card_buffer->mmap_buffers_length[0]);
+	return 0;
+}
+
+/** @brief Get the next buffer filled by the driver
+ * The previous buffer is given back to the driver, so the packets of reading_buffer are valid until the next call
+ * This function have to be called after a poll to ensure there is data to read
+ */
+int card_read_mmap(int fd_dvr, card_buffer_t *card_buffer)
+{
+	struct dmx_buffer buf;
+	int bytes_read;
+
+	//The main loop is done with the previous buffer
+	if(card_buffer->mmap_dequeued >= 0)
+	{
+		memset(&buf, 0, sizeof(buf));
+		buf.index=card_buffer->mmap_dequeued;
+		if(ioctl(fd_dvr, DMX_QBUF, &buf) < 0)
+			log_message( log_module,  MSG_WARN, "DMX_QBUF failed : %s\n", strerror(errno));
+		card_buffer->mmap_dequeued=-1;
+	}
+	memset(&buf, 0, sizeof(buf));
+	if(ioctl(fd_dvr, DMX_DQBUF, &buf) < 0)
+	{
+		if(errno==EOVERFLOW)
+		{
+			log_message( log_module,  MSG_WARN,"Error : DVR buffer overrun \n");
+			card_buffer->overflow_number++;
+		} else if(errno!=EAGAIN)
+			log_message( log_module,  MSG_WARN,"Error : DVR mmap read error : %s \n",strerror(errno));
+		return 0;
+	}
+	card_buffer->mmap_dequeued=buf.index;
+	card_buffer->reading_buffer=card_buffer->mmap_buffers[buf.index];
+	bytes_read=buf.bytesused;
+	if(bytes_read % TS_PACKET_SIZE)
+	{
+		log_message( log_module,  MSG_WARN, "Warning : partial packet received len %d\n", bytes_read);
+		card_buffer->partial_packet_number++;
+		bytes_read-=bytes_read % TS_PACKET_SIZE;
+	}
+	return bytes_read;
+}
+
+/** @brief Unmap the DVR buffers, they are released by the driver when the DVR is closed */
+void card_mmap_free(card_buffer_t *card_buffer)
+{
+	for(int ibuf=0; ibuf<card_buffer->mmap_num_buffers; ibuf++)
+		munmap(card_buffer->mmap_buffers[ibuf], card_buffer->mmap_buffers_length[ibuf]);
+	card_buffer->mmap_num_buffers=0;
+	card_buffer->mmap_dequeued=-1;
+	card_buffer->reading_buffer=NULL;
+}
+#else
+int card_mmap_init(int fd_dvr, card_buffer_t *card_buffer)
+{
+	(void) fd_dvr;
+	card_buffer->mmap_num_buffers=0;
+	log_message( log_module,  MSG_INFO, "The DVB mmap API is not available, we use read()\n");
+	return -1;
+}
+
+int card_read_mmap(int fd_dvr, card_buffer_t *card_buffer)
+{
+	(void) fd_dvr;
+	(void) card_buffer;
+	return 0;
+}
+
+void card_mmap_free(card_buffer_t *card_buffer)
+{
+	card_buffer->mmap_num_buffers=0;
+}
+#endif
+#endif
+
+/** @brief Set the size of the kernel DVR buffer
+ * Return 0 if the size is set, -1 if the DVR doesn't support it (file input for example)
+ */
+static int card_set_kernel_buffer(int fd_dvr, card_buffer_t *card_buffer, int size)
+{
+#if !defined(DISABLE_DVB_API) && defined(DMX_SET_BUFFER_SIZE)
+	if(ioctl(fd_dvr, DMX_SET_BUFFER_SIZE, size) < 0)
+	{
+		log_message( log_module,  MSG_DETAIL, "Cannot set the size of the DVR buffer : %s\n", strerror(errno));
+		card_buffer->kernel_buffer_size=-1;
+		return -1;
+	}
+	card_buffer->kernel_buffer_size=size;
+	return 0;
+#else
+	(void) fd_dvr;
+	(void) size;
+	card_buffer->kernel_buffer_size=-1;
+	return -1;
+#endif
+}
+
+/** @brief Set up the sizes of the DVR buffers before the first read
+ * The kernel buffer gets dvr_kernel_buffer_size if given, with dvr_buffer_auto the read size starts at dvr_buffer_size
+ */
+void card_buffer_auto_init(int fd_dvr, card_buffer_t *card_buffer)
+{
+	card_buffer->kernel_buffer_size=DVR_KERNEL_BUFFER_DEFAULT;
+	if(card_buffer->dvr_kernel_buffer_size>0)
+	{
+		if(card_set_kernel_buffer(fd_dvr, card_buffer, card_buffer->dvr_kernel_buffer_size)==0)
+			log_message( log_module,  MSG_INFO, "The kernel DVR buffer is set to %d bytes\n", card_buffer->dvr_kernel_buffer_size);
+		else
+			log_message( log_module,  MSG_WARN, "Cannot set the kernel DVR buffer size\n");
+	}
+	if(!card_buffer->dvr_buffer_auto)
+		return;
+#ifndef _WIN32
+	if(card_buffer->mmap_num_buffers)
+	{
+		log_message( log_module,  MSG_INFO, "The DVR buffer size is not adapted with the DVR mmap API\n");
+		card_buffer->dvr_buffer_auto=0;
+		return;
+	}
+#endif
+	card_buffer->dvr_buffer_min=card_buffer->dvr_buffer_size;
+	if(card_buffer->dvr_buffer_max<card_buffer->dvr_buffer_min)
+		card_buffer->dvr_buffer_max=card_buffer->dvr_buffer_min;
+	log_message( log_module,  MSG_INFO, "The DVR read size is adapted between %d and %d packets, the kernel DVR buffer up to %d bytes\n",
+			card_buffer->dvr_buffer_min, card_buffer->dvr_buffer_max, card_buffer->dvr_kernel_buffer_max);
+}
+
+/** @brief Measure the reads and adapt the buffers (dvr_buffer_auto)
+ *
+ * When half of the reads of a window fill the buffer, the data waits in the kernel: the read size is doubled.
+ * After an overrun the kernel buffer is doubled too.
+ * @param bytes_read the size of the read, -1 for an overrun
+ */
+static void card_buffer_adapt(int fd_dvr, card_buffer_t *card_buffer, int bytes_read)
+{
+	if(bytes_read<0)
+	{
+		if(!card_buffer->dvr_buffer_auto)
+			return;
+		if(card_buffer->kernel_buffer_size>0 && card_buffer->kernel_buffer_size<card_buffer->dvr_kernel_buffer_max)
+		{
+			int size=card_buffer->kernel_buffer_size*2;
+			if(size>card_buffer->dvr_kernel_buffer_max)
+				size=card_buffer->dvr_kernel_buffer_max;
+			if(card_set_kernel_buffer(fd_dvr, card_buffer, size)==0)
+				log_message( log_module,  MSG_INFO, "DVR buffer overrun, the kernel DVR buffer is increased to %d bytes\n", size);
+		}
+		if(card_buffer->dvr_buffer_size<card_buffer->dvr_buffer_max)
+		{
+			card_buffer->dvr_buffer_size*=2;
+			if(card_buffer->dvr_buffer_size>card_buffer->dvr_buffer_max)
+				card_buffer->dvr_buffer_size=card_buffer->dvr_buffer_max;
+		}
+		return;
+	}
+	card_buffer->window_reads++;
+	card_buffer->window_packets+=bytes_read/TS_PACKET_SIZE;
+	if(bytes_read==TS_PACKET_SIZE*card_buffer->dvr_buffer_size)
+		card_buffer->window_full_reads++;
+	if(card_buffer->window_reads<DVR_BUFFER_AUTO_WINDOW)
+		return;
+	card_buffer->full_reads_percent=card_buffer->window_full_reads*100/card_buffer->window_reads;
+	card_buffer->avg_read_packets=card_buffer->window_packets/card_buffer->window_reads;
+	card_buffer->window_reads=0;
+	card_buffer->window_full_reads=0;
+	card_buffer->window_packets=0;
+	if(card_buffer->dvr_buffer_auto && card_buffer->full_reads_percent>=50 && card_buffer->dvr_buffer_size<card_buffer->dvr_buffer_max)
+	{
+		card_buffer->dvr_buffer_size*=2;
+		if(card_buffer->dvr_buffer_size>card_buffer->dvr_buffer_max)
+			card_buffer->dvr_buffer_size=card_buffer->dvr_buffer_max;
+		log_message( log_module,  MSG_DEBUG, "%d%% of the reads fill the buffer, the DVR read size is increased to %d packets\n",
+				card_buffer->full_reads_percent, card_buffer->dvr_buffer_size);
+	}
+}
+
 /** @brief : Read data from the card
  * This function have to be called after a poll to ensure there is data to read
  *
@@ -460,10 +945,12 @@ int card_read(int fd_dvr, unsigned char *dest_buffer, card_buffer_t *card_buffer
 		{
 			log_message( log_module,  MSG_WARN,"Error : DVR buffer overrun \n");
 			card_buffer->overflow_number++;
+			card_buffer_adapt(fd_dvr, card_buffer, -1);
 		} else if(errno!=EAGAIN)
 			log_message( log_module,  MSG_WARN,"Error : DVR Read error : %s \n",strerror(errno));
 		return 0;
 	}
+	card_buffer_adapt(fd_dvr, card_buffer, bytes_read);
 	return bytes_read;
 }
 
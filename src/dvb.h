@@ -77,14 +77,20 @@ typedef struct strength_parameters_t{
 	fe_status_t festatus;
 	int strength, ber, snr, ub;
 	unsigned int ts_discontinuities, lock_loss_events;
+	/** The UDP/RTP source, NULL if we don't read from the network */
+	struct udp_source_t *udp_source;
+	/** The DVR buffers, NULL if we read from the network */
+	struct card_buffer_t *card_buffer;
+	/** The cache of the EIT sections, NULL if the EIT are not rewritten nor stored */
+	struct psi_cache_t *eit_cache;
 } strength_parameters_t;
 
 /** The parameters for the thread for reading the data from the card */
 typedef struct card_thread_parameters_t {
-	//mutex for the data buffer
-	pthread_mutex_t carddatamutex;
+	//mutex and condition to wake the main thread when it waits for data, shared by the reading threads of all the adapters
+	pthread_mutex_t *carddatamutex;
 	//Condition variable for locking the main program in order to wait for new data
-	pthread_cond_t threadcond;
+	pthread_cond_t *threadcond;
 	//file descriptors
 	fds_t *fds;
 	//The shutdown for the thread
@@ -93,11 +99,16 @@ typedef struct card_thread_parameters_t {
 	card_buffer_t *card_buffer;
 	//
 	int thread_running;
-	/** Is main waiting ?*/
-	int main_waiting;
+	/** Is main waiting ? (atomic, see read_card_thread_wake), shared like the condition*/
+	int *main_waiting;
 } card_thread_parameters_t;
 
 void *read_card_thread_func(void* arg);
+int dvr_ring_init(dvr_ring_t *ring, int slot_packets, int total_packets);
+void dvr_ring_free(dvr_ring_t *ring);
+int dvr_ring_used(dvr_ring_t *ring);
+int dvr_ring_get(dvr_ring_t *ring, unsigned char **buffer);
+void dvr_ring_release(dvr_ring_t *ring);
 
 #ifndef _WIN32
 int open_fe (int *fd_frontend, char *base_path, int tuner, int rw, int full_path);
@@ -107,13 +118,20 @@ int open_fe(HANDLE *fd_frontend, char *base_path, int tuner, int rw, int full_pa
 void set_ts_filt(int fd,uint16_t pid);
 int create_card_fd(char *base_path, int tuner, uint8_t *asked_pid, fds_t *fds);
 void set_filters(uint8_t *asked_pid, fds_t *fds);
+void unset_filter(fds_t *fds, uint16_t pid);
 void close_card_fd(fds_t *fds);
 void *show_power_func(void* arg);
 #ifndef _WIN32
 int card_read(int fd_dvr, unsigned char *dest_buffer, card_buffer_t *card_buffer);
+void card_buffer_auto_init(int fd_dvr, card_buffer_t *card_buffer);
 #else
 int card_read(HANDLE fd_dvr, unsigned char *dest_buffer, card_buffer_t *card_buffer);
 int dvb_poll(HANDLE fd_dvr, int timeout);
 #endif
 void list_dvb_cards(void);
+#ifndef _WIN32
+int card_mmap_init(int fd_dvr, card_buffer_t *card_buffer);
+int card_read_mmap(int fd_dvr, card_buffer_t *card_buffer);
+void card_mmap_free(card_buffer_t *card_buffer);
+#endif
 #endif
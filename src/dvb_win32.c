@@ -158,6 +158,11 @@ void set_filters(uint8_t *asked_pid, fds_t *fds)
     }
 }
 
+void unset_filter(fds_t *fds, uint16_t pid)
+{
+    fds->fd_demuxer[pid] = 0;
+}
+
 void close_card_fd(fds_t *fds)
 {
     if (fds->fd_dvr)
@@ -28,8 +28,26 @@
 
 static char *log_module="HLS : ";
 
+/** @brief A file to remove from the storage dir */
+typedef struct hls_removal {
+    char path[PATH_MAX];
+    struct hls_removal *next;
+} hls_removal_t;
+
 pthread_mutex_t hls_periodic_lock;
-hls_open_fds_t hls_fds[MAX_CHANNELS];
+// taken by the persistence task while it writes files, so hls_stop doesn't clean the storage dir at the same time
+static pthread_mutex_t hls_persist_lock;
+hls_open_fds_t hls_fds[HLS_MAX_ENTRIES];
+// the master playlist served by the HTTP server and written by the persistence task
+static char *hls_master_playlist = NULL;
+static int hls_master_playlist_size = 0;
+static int hls_master_playlist_persisted = 0;
+// the files to remove at the next persistence run
+static hls_removal_t *hls_removals = NULL;
+static int hls_persist = 0;
+static int hls_stopped = 0;
+static char hls_storage_dir[MAX_NAME_LEN];
+static char hls_master_playlist_name[LEN_MAX];
 extern int dont_send_scrambled;
 
 #ifndef _WIN32
@@ -108,11 +126,11 @@ int hls_entry_find(int service_id, hls_open_fds_t *hls_fds)
 {
 	int entry;
 	// search for used entry
-	for (entry = 0; entry < MAX_CHANNELS; entry++){
+	for (entry = 0; entry < HLS_MAX_ENTRIES; entry++){
 	    if (hls_fds[entry].initialized && hls_fds[entry].service_id == service_id) goto entry_found;
 	}
 	// if not, search for first uninitialized entry
-	for (entry = 0; entry < MAX_CHANNELS; entry++){
+	for (entry = 0; entry < HLS_MAX_ENTRIES; entry++){
 	    if (!hls_fds[entry].initialized) {
 		    log_message( log_module, MSG_FLOOD,"Found unused entry %d for service id %d.\n", entry, service_id);
 		    goto entry_found;
@@ -126,31 +144,113 @@ int hls_entry_find(int service_id, hls_open_fds_t *hls_fds)
         return entry;
 };
 
+/** @brief Create an empty segment, with one reference for the channel ring
+ * The buffer is sized from the previous segment to avoid reallocations while the segment grows
+ */
+static hls_segment_t *hls_segment_new(int service_id, unsigned int access_time, unsigned int size_hint, unsigned int max_size)
+{
+	hls_segment_t *segment = calloc(1, sizeof(hls_segment_t));
+	if (segment == NULL) {
+	    log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+	    return NULL;
+	}
+	snprintf(segment->name, sizeof(segment->name), "%d_%u.ts", service_id, access_time);	// construct uniq filename here
+
+	segment->capacity = size_hint + size_hint / 8;
+	if (segment->capacity < HLS_SEGMENT_MIN_CAPACITY) segment->capacity = HLS_SEGMENT_MIN_CAPACITY;
+	if (segment->capacity > max_size) segment->capacity = max_size;
+	segment->data = malloc(segment->capacity);
+	if (segment->data == NULL) {
+	    log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+	    free(segment);
+	    return NULL;
+	}
+	segment->refcount = 1;
+	return segment;
+}
+
+/** @brief Copy data at the end of the segment being written, growing its buffer up to max_size */
+static unsigned int hls_segment_append(hls_segment_t *segment, unsigned char *buf, unsigned int size, unsigned int max_size)
+{
+	if (segment->size + size > segment->capacity && segment->capacity < max_size) {
+	    unsigned int capacity = segment->capacity;
+	    while (capacity < segment->size + size && capacity < max_size / 2)
+		capacity *= 2;
+	    if (capacity < segment->size + size)
+		capacity = max_size;
+	    unsigned char *data = realloc(segment->data, capacity);
+	    if (data == NULL) {
+		log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+	    } else {
+		segment->data = data;
+		segment->capacity = capacity;
+	    }
+	}
+	if (segment->size + size > segment->capacity) {
+	    if (!segment->truncated)
+		log_message( log_module, MSG_WARN,"Segment \"%s\" is full (%u bytes), data dropped until the next rotation. You can increase hls_segment_max_size\n", segment->name, segment->size);
+	    segment->truncated = 1;
+	    size = segment->capacity - segment->size;
+	    size -= size % TS_PACKET_SIZE;
+	}
+	memcpy(segment->data + segment->size, buf, size);
+	segment->size += size;
+	return size;
+}
+
+/** @brief Add a file to remove by the persistence task, must be called with hls_periodic_lock held */
+static void hls_removal_add(char *name)
+{
+	if (!hls_persist)
+	    return;
+	hls_removal_t *removal = malloc(sizeof(hls_removal_t));
+	if (removal == NULL) {
+	    log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+	    return;
+	}
+	snprintf(removal->path, sizeof(removal->path), "%s/%s", hls_storage_dir, name);
+	if (hls_stopped) {
+	    // nothing will run the persistence task anymore
+	    log_message( log_module, MSG_FLOOD,"Removing file \"%s\"\n", removal->path);
+	    remove(removal->path);
+	    free(removal);
+	    return;
+	}
+	removal->next = hls_removals;
+	hls_removals = removal;
+}
+
+/** @brief Drop a reference on a segment, must be called with hls_periodic_lock held */
+static void hls_segment_unref(hls_segment_t *segment)
+{
+	if (--segment->refcount > 0)
+	    return;
+	if (segment->persisted)
+	    hls_removal_add(segment->name);
+	free(segment->data);
+	free(segment);
+}
+
 int hls_entry_initialize(mumudvb_channel_t *actual_channel, hls_open_fds_t *hls_entry, unicast_parameters_t *unicast_vars, unsigned int access_time)
 {
 	memset(hls_entry, 0, sizeof(*hls_entry));
-	hls_entry->filenames_num = unicast_vars->hls_rotate_count + 2; // names count for all chunks plus stream and delete names
-	hls_entry->filenames = calloc(1, hls_entry->filenames_num * sizeof(hls_file_t)); // allocate and clear
+	hls_entry->segments_num = unicast_vars->hls_rotate_count + 1; // the segment being written plus the segments of the playlist
+	hls_entry->segments = calloc(hls_entry->segments_num, sizeof(hls_segment_t *)); // allocate and clear
+	if (hls_entry->segments == NULL) {
+	    log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+	    return -1;
+	}
 
 	strncpy(hls_entry->path, unicast_vars->hls_storage_dir, LEN_MAX);
 	sprintf(hls_entry->name_playlist, "%d.m3u8", actual_channel->service_id);
 
-	sprintf(hls_entry->filenames[0].name, "%d_%u.ts", actual_channel->service_id, access_time);	// construct uniq filename here
-
 	if (strlen(actual_channel->user_name)) {
 	    strncpy(hls_entry->name, actual_channel->user_name, LEN_MAX);
 	} else {
 	    strncpy(hls_entry->name, actual_channel->name, LEN_MAX);
 	}
 
-	char path_stream[PATH_MAX];
-	snprintf(path_stream, sizeof(path_stream), "%s/%s", hls_entry->path, hls_entry->filenames[0].name);
-
-	hls_entry->stream = fopen(path_stream, "wb");
-	if (hls_entry->stream == 0) {
-	    perror("Cannot open output file for write");
-	    return -1;
-	}
+	hls_entry->segments[0] = hls_segment_new(actual_channel->service_id, access_time, 0, unicast_vars->hls_segment_max_size);
 
 	hls_entry->service_id = actual_channel->service_id;
 	hls_entry->access_time = access_time;
@@ -167,19 +267,25 @@ int hls_entry_rotate(hls_open_fds_t *hls_entry, unicast_parameters_t *unicast_va
 		return -1;
 	}
 
-	if (hls_entry->stream) fclose(hls_entry->stream);
+	// the oldest segment leaves the playlist, the HTTP clients still sending it keep their reference
+	if (hls_entry->segments[hls_entry->segments_num - 1])
+	    hls_segment_unref(hls_entry->segments[hls_entry->segments_num - 1]);
 
-	// shift names in array
-	memmove(&hls_entry->filenames[1], &hls_entry->filenames[0], sizeof(hls_entry->filenames[0]) * (hls_entry->filenames_num - 1));
-	snprintf(hls_entry->filenames[0].name, sizeof(hls_entry->filenames[0].name), "%d_%u.ts", hls_entry->service_id, access_time);	// construct uniq filename here
+	// shift segments in array
+	memmove(&hls_entry->segments[1], &hls_entry->segments[0], sizeof(hls_entry->segments[0]) * (hls_entry->segments_num - 1));
+	hls_entry->segments[0] = hls_segment_new(hls_entry->service_id, access_time,
+						hls_entry->segments[1] ? hls_entry->segments[1]->size : 0,
+						unicast_vars->hls_segment_max_size);
 
-	if (hls_entry->sequence >= hls_entry->filenames_num - 3) { // generate playlist only if we have all chunks written
+	if (hls_entry->sequence + 2 >= hls_entry->segments_num) { // generate playlist only if we have all chunks written
 	    unsigned int playlist_size;
-	    char path_playlist[PATH_MAX];
-	    snprintf(path_playlist, sizeof(path_playlist), "%s/%s", hls_entry->path, hls_entry->name_playlist);
 
 	    // allocate memory for all filenames and playlist text structure
-	    char *outbuf = malloc(1024 + hls_entry->filenames_num * (sizeof(hls_entry->filenames[0]) + 64));
+	    char *outbuf = malloc(1024 + hls_entry->segments_num * (LEN_MAX + 64));
+	    if (outbuf == NULL) {
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return -1;
+	    }
 
 	    playlist_size = sprintf(
 		outbuf,
@@ -190,55 +296,27 @@ int hls_entry_rotate(hls_open_fds_t *hls_entry, unicast_parameters_t *unicast_va
 		unicast_vars->hls_rotate_time, hls_entry->sequence
 	    );
 
-	    // cycle via all file entries excluding delete and stream
+	    // cycle via all completed segments, oldest first
 	    unsigned int x;
-	    for (x = hls_entry->filenames_num - 2; x > 0; x--) {
-		if(*hls_entry->filenames[x].name) {
+	    for (x = hls_entry->segments_num - 1; x > 0; x--) {
+		if(hls_entry->segments[x]) {
 		    playlist_size += sprintf(
 			outbuf + playlist_size,
 			"#EXTINF:%d.0,\n"
 			"%s\n",
-			unicast_vars->hls_rotate_time, hls_entry->filenames[x].name
+			unicast_vars->hls_rotate_time, hls_entry->segments[x]->name
 		    );
 		}
 	    }
 
-	    FILE *playlist = fopen(path_playlist, "wb");
-	    if (playlist == 0) {
-		perror("Cannot open output file for write");
-		free(outbuf);
-		return -1;
-
-	    }
-
-	    fwrite(outbuf, playlist_size, 1, playlist);
-
-	    ftruncate(fileno(playlist), playlist_size);
-	    fclose(playlist);
-	    free(outbuf);
+	    if (hls_entry->playlist) free(hls_entry->playlist);
+	    hls_entry->playlist = outbuf;
+	    hls_entry->playlist_size = playlist_size;
+	    hls_entry->playlist_persisted = 0;
 	}
 
-	log_message( log_module, MSG_FLOOD,"Rotate event for service_id %d, writing stream to \"%s\"\n", hls_entry->service_id, hls_entry->filenames[0].name);
-
-	char path_stream[PATH_MAX];
-	snprintf(path_stream, sizeof(path_stream), "%s/%s", hls_entry->path, hls_entry->filenames[0].name);
-	hls_entry->stream = fopen(path_stream, "wb");
-
-	if (hls_entry->stream == 0) {
-	    perror("Cannot open output file for write");
-	    return -1;
-	}
-
-	int delete_pos = hls_entry->filenames_num - 1; //delete file at last array position
-	if (strlen(hls_entry->filenames[delete_pos].name)) {
-
-		char path_delete[PATH_MAX];
-		snprintf(path_delete, sizeof(path_delete), "%s/%s", hls_entry->path, hls_entry->filenames[delete_pos].name);
-
-		log_message( log_module, MSG_FLOOD,"Removing file \"%s\"\n", path_delete);
-	 	remove(path_delete);
-	 	*hls_entry->filenames[delete_pos].name = 0;
-	}
+	if (hls_entry->segments[0])
+	    log_message( log_module, MSG_FLOOD,"Rotate event for service_id %d, writing stream to \"%s\"\n", hls_entry->service_id, hls_entry->segments[0]->name);
 
 	hls_entry->rotate_time = access_time;
 	hls_entry->need_rotate = 0;
@@ -251,12 +329,12 @@ int hls_playlist_master(hls_open_fds_t *hls_fds, unicast_parameters_t *unicast_v
 {
 	int entry, active_entry;
 	int num_active = 0;
-	int sids[MAX_CHANNELS][2]; // array for playlist sorting
+	int sids[HLS_MAX_ENTRIES][2]; // array for playlist sorting
 	unsigned int master_playlist_calc_checksum;
 
 	// generate new playlist crc and active sids database
 	master_playlist_calc_checksum = 0;
-	for (entry = 0; entry < MAX_CHANNELS; entry++) {
+	for (entry = 0; entry < HLS_MAX_ENTRIES; entry++) {
 	    if (hls_fds[entry].initialized && hls_fds[entry].sequence > 0 && strlen(hls_fds[entry].name_playlist)
 	        && (!unicast_vars->playlist_ignore_dead || hls_fds[entry].has_traffic) ) {
 		master_playlist_calc_checksum += entry + hls_fds[entry].service_id; // TODO: check for CRC collisions!
@@ -273,11 +351,12 @@ int hls_playlist_master(hls_open_fds_t *hls_fds, unicast_parameters_t *unicast_v
 	    log_message( log_module, MSG_FLOOD,"Refresh master playlist, crc: %u -> %u\n", *master_playlist_checksum, master_playlist_calc_checksum);
 
 	    int playlist_size;
-	    char path_playlist[PATH_MAX];
-
-	    snprintf(path_playlist, sizeof(path_playlist), "%s/%s", unicast_vars->hls_storage_dir, unicast_vars->hls_playlist_name);
 
 	    char *outbuf = malloc((num_active + 1) * (LEN_MAX + 16)); // allocate memory for playlist
+	    if (outbuf == NULL) {
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return -1;
+	    }
 
 	    // packets arrive in chaotic order, so sort playlist by service_id here
 	    qsort(sids, num_active, sizeof(sids[0]), hls_sid_entry_compare);
@@ -294,60 +373,37 @@ int hls_playlist_master(hls_open_fds_t *hls_fds, unicast_parameters_t *unicast_v
 		    );
 	    }
 
-	    FILE *playlist = fopen(path_playlist, "wb");
-	    if (playlist == 0) {
-		perror("Cannot open output file for write");
-		free(outbuf);
-		return -1;
-
-	    }
-
-	    fwrite(outbuf, playlist_size, 1, playlist);
-
-	    ftruncate(fileno(playlist), playlist_size);
-	    fclose(playlist);
-	    free(outbuf);
+	    if (hls_master_playlist) free(hls_master_playlist);
+	    hls_master_playlist = outbuf;
+	    hls_master_playlist_size = playlist_size;
+	    hls_master_playlist_persisted = 0;
 	}
 
         return 0;
 };
 
-void hls_cleanup_files(hls_open_fds_t *hls_entry)
+void hls_entry_destroy(hls_open_fds_t *hls_entry)
 {
-	log_message( log_module, MSG_FLOOD,"Closing FD and removing files for \"%s\"\n", hls_entry->name);
-
-	if (hls_entry->stream) fclose(hls_entry->stream);
-
-	char path_delete[PATH_MAX];
+	log_message( log_module, MSG_FLOOD,"Releasing segments and removing files for \"%s\"\n", hls_entry->name);
 
 	unsigned int i;
-	for(i = 0; i < hls_entry->filenames_num; i++)
+	for(i = 0; i < hls_entry->segments_num; i++)
 	{
-	    if (*hls_entry->filenames[i].name) {
-		snprintf(path_delete, sizeof(path_delete), "%s/%s", hls_entry->path, hls_entry->filenames[i].name);
-		log_message( log_module, MSG_FLOOD,"Removing file \"%s\"\n", path_delete);
-		remove(path_delete);
-	    }
-	}
-	if (*hls_entry->name_playlist) {
-	    snprintf(path_delete, sizeof(path_delete), "%s/%s", hls_entry->path, hls_entry->name_playlist);
-	    log_message( log_module, MSG_FLOOD,"Removing file \"%s\"\n", path_delete);
-	    remove(path_delete);
+	    if (hls_entry->segments[i])
+		hls_segment_unref(hls_entry->segments[i]);
 	}
-}
-
+	if (hls_entry->playlist_persisted)
+	    hls_removal_add(hls_entry->name_playlist);
 
-void hls_entry_destroy(hls_open_fds_t *hls_entry)
-{
-	hls_cleanup_files(hls_entry);
-	if (hls_entry->filenames) free(hls_entry->filenames);
+	if (hls_entry->segments) free(hls_entry->segments);
+	if (hls_entry->playlist) free(hls_entry->playlist);
 	memset(hls_entry, 0, sizeof(*hls_entry));
 }
 
 void hls_array_cleanup(hls_open_fds_t *hls_fds, unsigned int hls_rotate_time, unsigned int cur_time)
 {
 	int entry;
-	for (entry = 0; entry < MAX_CHANNELS; entry++) {
+	for (entry = 0; entry < HLS_MAX_ENTRIES; entry++) {
 	    if (hls_fds[entry].initialized && hls_fds[entry].access_time < cur_time - (hls_rotate_time * 3)) {
 	    	log_message( log_module, MSG_DEBUG,"Entry for \"%s\" is too old, removing it\n", hls_fds[entry].name);
 	    	hls_entry_destroy(&hls_fds[entry]);
@@ -355,9 +411,10 @@ void hls_array_cleanup(hls_open_fds_t *hls_fds, unsigned int hls_rotate_time, un
 	}
 }
 
-int hls_write_metrics(strength_parameters_t *strengthparams, unicast_parameters_t *unicast_vars)
+int hls_write_metrics(unicast_adapter_t *adapters, int num_adapters, unicast_parameters_t *unicast_vars)
 {
 	char path_metrics[PATH_MAX];
+	int i;
 	snprintf(path_metrics, sizeof(path_metrics), "%s/%s", unicast_vars->hls_storage_dir, "metrics"); // construct metrics filename
 
 	FILE *file = fopen(path_metrics, "wb");
@@ -365,33 +422,156 @@ int hls_write_metrics(strength_parameters_t *strengthparams, unicast_parameters_
 	    return -1;
 	}
 
-	fprintf(file,
-	    "# TYPE bit_error_rate gauge\n"
-	    "bit_error_rate %d\n"
-	    "# TYPE signal_strength gauge\n"
-	    "signal_strength %d\n"
-	    "# TYPE signal_to_noise_ratio gauge\n"
-	    "signal_to_noise_ratio %d\n"
-	    "# TYPE blocks_uncorrected counter\n"
-	    "blocks_uncorrected %d\n"
-	    "# TYPE ts_discontinuities counter\n"
-	    "ts_discontinuities %u\n"
-	    "# TYPE lock_loss_events counter\n"
-	    "lock_loss_events %u\n"
-	    "# TYPE lock_active gauge\n"
-	    "lock_active %u\n",
-	    strengthparams->ber,
-	    strengthparams->strength,
-	    strengthparams->snr,
-	    strengthparams->ub,
-	    strengthparams->ts_discontinuities,
-	    strengthparams->lock_loss_events,
-	    (strengthparams->festatus & FE_HAS_LOCK) ? 1 : 0
-	);
+	// one sample of each metric per adapter, labelled with its number
+	fprintf(file, "# TYPE bit_error_rate gauge\n");
+	for (i = 0; i < num_adapters; i++)
+	    fprintf(file, "bit_error_rate{adapter=\"%d\"} %d\n", adapters[i].id, adapters[i].strengthparams->ber);
+	fprintf(file, "# TYPE signal_strength gauge\n");
+	for (i = 0; i < num_adapters; i++)
+	    fprintf(file, "signal_strength{adapter=\"%d\"} %d\n", adapters[i].id, adapters[i].strengthparams->strength);
+	fprintf(file, "# TYPE signal_to_noise_ratio gauge\n");
+	for (i = 0; i < num_adapters; i++)
+	    fprintf(file, "signal_to_noise_ratio{adapter=\"%d\"} %d\n", adapters[i].id, adapters[i].strengthparams->snr);
+	fprintf(file, "# TYPE blocks_uncorrected counter\n");
+	for (i = 0; i < num_adapters; i++)
+	    fprintf(file, "blocks_uncorrected{adapter=\"%d\"} %d\n", adapters[i].id, adapters[i].strengthparams->ub);
+	fprintf(file, "# TYPE ts_discontinuities counter\n");
+	for (i = 0; i < num_adapters; i++)
+	    fprintf(file, "ts_discontinuities{adapter=\"%d\"} %u\n", adapters[i].id, adapters[i].strengthparams->ts_discontinuities);
+	fprintf(file, "# TYPE lock_loss_events counter\n");
+	for (i = 0; i < num_adapters; i++)
+	    fprintf(file, "lock_loss_events{adapter=\"%d\"} %u\n", adapters[i].id, adapters[i].strengthparams->lock_loss_events);
+	fprintf(file, "# TYPE lock_active gauge\n");
+	for (i = 0; i < num_adapters; i++)
+	    fprintf(file, "lock_active{adapter=\"%d\"} %u\n", adapters[i].id, (adapters[i].strengthparams->festatus & FE_HAS_LOCK) ? 1 : 0);
+	fclose(file);
+	return 0;
+}
+
+/** @brief Write a file of the storage dir */
+static int hls_write_file(char *name, void *data, unsigned int size)
+{
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/%s", hls_storage_dir, name);
+
+	FILE *file = fopen(path, "wb");
+	if (file == 0) {
+	    log_message( log_module, MSG_WARN,"Cannot open \"%s\" for write : %s\n", path, strerror(errno));
+	    return -1;
+	}
+	if (size && fwrite(data, size, 1, file) != 1)
+	    log_message( log_module, MSG_WARN,"Cannot write \"%s\" : %s\n", path, strerror(errno));
 	fclose(file);
 	return 0;
 }
 
+/** @brief Write the new segments and playlists in the storage dir and remove the old files
+ *
+ * The segments and playlists to write are collected under hls_periodic_lock, then the files are
+ * written without it, so the data path never waits for the filesystem.
+ */
+static void hls_persist_files(void)
+{
+	hls_segment_t **segments = NULL;
+	unsigned int segments_count = 0;
+	struct {
+	    char *data;
+	    unsigned int size;
+	    char name[LEN_MAX];
+	} *playlists = NULL;
+	unsigned int playlists_count = 0;
+	hls_removal_t *removals;
+	unsigned int entry, i;
+
+	pthread_mutex_lock(&hls_persist_lock);
+	pthread_mutex_lock(&hls_periodic_lock);
+	if (hls_stopped) {
+	    pthread_mutex_unlock(&hls_periodic_lock);
+	    pthread_mutex_unlock(&hls_persist_lock);
+	    return;
+	}
+
+	for (entry = 0; entry < HLS_MAX_ENTRIES; entry++) {
+	    if (hls_fds[entry].initialized)
+		segments_count += hls_fds[entry].segments_num;
+	}
+	segments = malloc((segments_count + 1) * sizeof(hls_segment_t *));
+	playlists = malloc((HLS_MAX_ENTRIES + 1) * sizeof(*playlists));
+	if (segments == NULL || playlists == NULL) {
+	    log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+	    segments_count = 0;
+	    goto unlock;
+	}
+
+	// the completed segments not written yet, the segment being written (index 0) is skipped
+	segments_count = 0;
+	for (entry = 0; entry < HLS_MAX_ENTRIES; entry++) {
+	    if (!hls_fds[entry].initialized)
+		continue;
+	    for (i = 1; i < hls_fds[entry].segments_num; i++) {
+		hls_segment_t *segment = hls_fds[entry].segments[i];
+		if (segment && !segment->persisted) {
+		    segment->persisted = 1;
+		    segment->refcount++;
+		    segments[segments_count++] = segment;
+		}
+	    }
+	    if (hls_fds[entry].playlist && !hls_fds[entry].playlist_persisted) {
+		playlists[playlists_count].data = malloc(hls_fds[entry].playlist_size);
+		if (playlists[playlists_count].data) {
+		    memcpy(playlists[playlists_count].data, hls_fds[entry].playlist, hls_fds[entry].playlist_size);
+		    playlists[playlists_count].size = hls_fds[entry].playlist_size;
+		    strncpy(playlists[playlists_count].name, hls_fds[entry].name_playlist, LEN_MAX - 1);
+		    playlists[playlists_count].name[LEN_MAX - 1] = '\0';
+		    playlists_count++;
+		    hls_fds[entry].playlist_persisted = 1;
+		}
+	    }
+	}
+	if (hls_master_playlist && !hls_master_playlist_persisted) {
+	    playlists[playlists_count].data = malloc(hls_master_playlist_size);
+	    if (playlists[playlists_count].data) {
+		memcpy(playlists[playlists_count].data, hls_master_playlist, hls_master_playlist_size);
+		playlists[playlists_count].size = hls_master_playlist_size;
+		strncpy(playlists[playlists_count].name, hls_master_playlist_name, LEN_MAX);
+		playlists_count++;
+		hls_master_playlist_persisted = 1;
+	    }
+	}
+  unlock:
+	removals = hls_removals;
+	hls_removals = NULL;
+	pthread_mutex_unlock(&hls_periodic_lock);
+
+	// completed segments don't change, we can read them without the lock while we hold a reference
+	for (i = 0; i < segments_count; i++) {
+	    log_message( log_module, MSG_FLOOD,"Writing segment \"%s\", %u bytes\n", segments[i]->name, segments[i]->size);
+	    hls_write_file(segments[i]->name, segments[i]->data, segments[i]->size);
+	}
+	// the playlists are written after their segments
+	for (i = 0; i < playlists_count; i++) {
+	    hls_write_file(playlists[i].name, playlists[i].data, playlists[i].size);
+	    free(playlists[i].data);
+	}
+	while (removals) {
+	    hls_removal_t *next = removals->next;
+	    log_message( log_module, MSG_FLOOD,"Removing file \"%s\"\n", removals->path);
+	    remove(removals->path);
+	    free(removals);
+	    removals = next;
+	}
+
+	if (segments_count) {
+	    pthread_mutex_lock(&hls_periodic_lock);
+	    for (i = 0; i < segments_count; i++)
+		hls_segment_unref(segments[i]);
+	    pthread_mutex_unlock(&hls_periodic_lock);
+	}
+	pthread_mutex_unlock(&hls_persist_lock);
+	if (segments) free(segments);
+	if (playlists) free(playlists);
+}
+
 void *hls_periodic_task(void* arg)
 {
 	unsigned int cur_time, entry;
@@ -400,7 +580,6 @@ void *hls_periodic_task(void* arg)
 
         hls_thread_parameters_t *params = (hls_thread_parameters_t *) arg;
 	unicast_parameters_t *unicast_vars = (unicast_parameters_t *) params->unicast_vars;
-	strength_parameters_t *strengthparams = (strength_parameters_t *) params->strengthparams;
 
 	while(!params->threadshutdown) {
 	    log_message( log_module, MSG_FLOOD,"Run periodic task...\n");
@@ -408,7 +587,7 @@ void *hls_periodic_task(void* arg)
 	    cur_time = (unsigned int)(get_time() / 1000000ULL);
 
 	    // try to rotate all channels
-	    for (entry = 0; entry < MAX_CHANNELS; entry++){
+	    for (entry = 0; entry < HLS_MAX_ENTRIES; entry++){
 		if (hls_fds[entry].initialized && (hls_fds[entry].rotate_time < cur_time - unicast_vars->hls_rotate_time)) {
 
 		    pthread_mutex_lock(&hls_periodic_lock);
@@ -436,8 +615,11 @@ void *hls_periodic_task(void* arg)
 		pthread_mutex_unlock(&hls_periodic_lock);
 	    }
 
-	    // write metrics file
-	    hls_write_metrics(strengthparams, unicast_vars);
+	    if (hls_persist) {
+		hls_persist_files();
+		// write metrics file
+		hls_write_metrics(params->adapters, params->num_adapters, unicast_vars);
+	    }
 
 	    sleep(unicast_vars->hls_rotate_time);
 	}
@@ -475,14 +657,17 @@ int hls_worker_main(mumudvb_channel_t *actual_channel, unicast_parameters_t *uni
 	if (hls_fds[entry].need_rotate) {
 		int iframe_pos = hls_find_iframe(outbuf, output_size);
 		if (iframe_pos >= 0) {
-			written += fwrite(outbuf, iframe_pos, 1, hls_fds[entry].stream);
+			if (hls_fds[entry].segments[0])
+				written += hls_segment_append(hls_fds[entry].segments[0], outbuf, iframe_pos, unicast_vars->hls_segment_max_size);
 			outbuf += iframe_pos;
 			output_size -= iframe_pos;
 			hls_entry_rotate(&hls_fds[entry], unicast_vars, cur_time);
 			hls_fds[entry].need_rotate = 0;
 		}
 	}
-	written += fwrite(outbuf, output_size, 1, hls_fds[entry].stream);
+	// without segment (allocation failure) the data is lost until the next rotation
+	if (hls_fds[entry].segments[0])
+		written += hls_segment_append(hls_fds[entry].segments[0], outbuf, output_size, unicast_vars->hls_segment_max_size);
 
 	pthread_mutex_unlock(&hls_periodic_lock);
 
@@ -496,31 +681,128 @@ void hls_data_send(mumudvb_channel_t *actual_channel, unicast_parameters_t *unic
 
 int hls_start(unicast_parameters_t *unicast_vars)
 {
-	if (mkpath(unicast_vars->hls_storage_dir, 0755)) {
+	hls_persist = unicast_vars->hls_persist;
+	strncpy(hls_storage_dir, unicast_vars->hls_storage_dir, MAX_NAME_LEN - 1);
+	hls_storage_dir[MAX_NAME_LEN - 1] = '\0';
+	strncpy(hls_master_playlist_name, unicast_vars->hls_playlist_name, LEN_MAX - 1);
+	hls_master_playlist_name[LEN_MAX - 1] = '\0';
+	hls_stopped = 0;
+
+	if (hls_persist && mkpath(unicast_vars->hls_storage_dir, 0755)) {
 	    log_message( log_module, MSG_ERROR,"Cannot create hls storage dir \"%s\".\n", unicast_vars->hls_storage_dir);
 	    return -1;
 	}
 
 	pthread_mutex_init(&hls_periodic_lock, NULL);
+	pthread_mutex_init(&hls_persist_lock, NULL);
 
 	return 0;
 }
 
+/** @brief Stop HLS and clean the storage dir
+ * The locks are not destroyed : the HTTP clients still sending a segment release it later
+ */
 void hls_stop(unicast_parameters_t *unicast_vars)
 {
-	char path_delete[PATH_MAX];
-	char path_metrics[PATH_MAX];
+	hls_removal_t *removals;
+
+	pthread_mutex_lock(&hls_persist_lock);
 	pthread_mutex_lock(&hls_periodic_lock);
 	hls_array_cleanup(&hls_fds[0], 0, ~0);		// pass maximum time value to ensure cleanup
+	hls_stopped = 1;
+	removals = hls_removals;
+	hls_removals = NULL;
 
-	snprintf(path_delete, sizeof(path_delete), "%s/%s", unicast_vars->hls_storage_dir, unicast_vars->hls_playlist_name);
-	log_message( log_module, MSG_FLOOD,"Removing file \"%s\"\n", path_delete);
-	remove(path_delete);
+	if (hls_master_playlist) free(hls_master_playlist);
+	hls_master_playlist = NULL;
+	hls_master_playlist_size = 0;
+	pthread_mutex_unlock(&hls_periodic_lock);
 
-	snprintf(path_metrics, sizeof(path_metrics), "%s/%s", unicast_vars->hls_storage_dir, "metrics");
-	log_message( log_module, MSG_FLOOD,"Removing file \"%s\"\n", path_metrics);
-	remove(path_metrics);
+	while (removals) {
+	    hls_removal_t *next = removals->next;
+	    log_message( log_module, MSG_FLOOD,"Removing file \"%s\"\n", removals->path);
+	    remove(removals->path);
+	    free(removals);
+	    removals = next;
+	}
+	if (hls_persist) {
+	    char path_delete[PATH_MAX];
+	    char path_metrics[PATH_MAX];
 
+	    snprintf(path_delete, sizeof(path_delete), "%s/%s", unicast_vars->hls_storage_dir, unicast_vars->hls_playlist_name);
+	    log_message( log_module, MSG_FLOOD,"Removing file \"%s\"\n", path_delete);
+	    remove(path_delete);
+
+	    snprintf(path_metrics, sizeof(path_metrics), "%s/%s", unicast_vars->hls_storage_dir, "metrics");
+	    log_message( log_module, MSG_FLOOD,"Removing file \"%s\"\n", path_metrics);
+	    remove(path_metrics);
+	}
+	pthread_mutex_unlock(&hls_persist_lock);
+}
+
+/** @brief Write a playlist in a HTTP reply
+ * The master playlist and the channel playlists are served from memory
+ *
+ * @return 0 if found, -1 if there is no such playlist (yet)
+ */
+int hls_playlist_get(unicast_parameters_t *unicast_vars, char *name, struct unicast_reply *reply)
+{
+	int entry;
+	int ret = -1;
+
+	pthread_mutex_lock(&hls_periodic_lock);
+	if (!strcmp(name, unicast_vars->hls_playlist_name)) {
+	    if (hls_master_playlist) {
+		unicast_reply_write(reply, "%.*s", hls_master_playlist_size, hls_master_playlist);
+		ret = 0;
+	    }
+	} else {
+	    for (entry = 0; entry < HLS_MAX_ENTRIES; entry++) {
+		if (hls_fds[entry].initialized && hls_fds[entry].playlist && !strcmp(name, hls_fds[entry].name_playlist)) {
+		    unicast_reply_write(reply, "%.*s", hls_fds[entry].playlist_size, hls_fds[entry].playlist);
+		    ret = 0;
+		    break;
+		}
+	    }
+	}
+	pthread_mutex_unlock(&hls_periodic_lock);
+	return ret;
+}
+
+/** @brief Get a complete HLS segment for the HTTP server
+ * Only the segments announced in the playlists are given, not the one being written.
+ * The segment stays valid after its rotation until it is released with hls_segment_release
+ *
+ * @return the segment, NULL if there is no such segment
+ */
+hls_segment_t *hls_segment_get(char *name)
+{
+	int entry;
+	unsigned int i;
+	hls_segment_t *found = NULL;
+
+	pthread_mutex_lock(&hls_periodic_lock);
+	for (entry = 0; entry < HLS_MAX_ENTRIES && found == NULL; entry++) {
+	    if (!hls_fds[entry].initialized)
+		continue;
+	    // skip the segment being written
+	    for (i = 1; i < hls_fds[entry].segments_num; i++) {
+		if (hls_fds[entry].segments[i] && !strcmp(name, hls_fds[entry].segments[i]->name)) {
+		    found = hls_fds[entry].segments[i];
+		    found->refcount++;
+		    break;
+		}
+	    }
+	}
+	pthread_mutex_unlock(&hls_periodic_lock);
+	return found;
+}
+
+/** @brief Release a segment given by hls_segment_get
+ */
+void hls_segment_release(hls_segment_t *segment)
+{
+	pthread_mutex_lock(&hls_periodic_lock);
+	hls_segment_unref(segment);
 	pthread_mutex_unlock(&hls_periodic_lock);
-	pthread_mutex_destroy(&hls_periodic_lock);
 }
@@ -5,9 +5,27 @@
 
 #define LEN_MAX	64
 
-typedef struct hls_file {
+/** the number of HLS entries, the channels of all the adapters share the table */
+#define HLS_MAX_ENTRIES (MAX_CHANNELS*MAX_ADAPTERS)
+
+/** the initial size of the buffer of a segment, the next ones are sized from the previous segment */
+#define HLS_SEGMENT_MIN_CAPACITY (256*1024)
+/** default value for hls_segment_max_size */
+#define HLS_DEFAULT_SEGMENT_MAX_SIZE (32*1024*1024)
+
+/** @brief A HLS segment kept in memory
+ * Once completed (rotated) the data doesn't change anymore, so it can be read without the lock
+ * while a reference is held. The references are taken and released under hls_periodic_lock.
+ */
+typedef struct hls_segment {
     char name[LEN_MAX];
-} hls_file_t;
+    unsigned char *data;
+    unsigned int size;
+    unsigned int capacity;
+    int refcount;		// the channel ring, the HTTP clients and the persistence task
+    int persisted;		// the segment was written in the storage dir
+    int truncated;		// data was dropped because the segment reached hls_segment_max_size
+} hls_segment_t;
 
 typedef struct hls_open_fds {
     int service_id;
@@ -20,20 +38,26 @@ typedef struct hls_open_fds {
     char name[LEN_MAX];		// channel name for master playlist
     char path[LEN_MAX];		// path for all files
     char name_playlist[LEN_MAX];	// playlist filename
-    hls_file_t *filenames;	// pointer to array of filenames: stream, newest ... oldest, delete
-    unsigned int filenames_num;
-    FILE* stream;
+    hls_segment_t **segments;	// ring of segments: being written, newest ... oldest
+    unsigned int segments_num;
+    char *playlist;		// the playlist, served by the HTTP server and written by the persistence task
+    unsigned int playlist_size;
+    int playlist_persisted;
 } hls_open_fds_t;
 
 typedef struct hls_thread_params {
     volatile int threadshutdown;
     unicast_parameters_t *unicast_vars;
-    strength_parameters_t *strengthparams;
+    unicast_adapter_t *adapters;	// the metrics file has the signal of every adapter
+    int num_adapters;
 } hls_thread_parameters_t;
 
 void hls_data_send(mumudvb_channel_t *actual_channel, struct unicast_parameters_t *unicast_vars, uint64_t now_time);
 int hls_start(unicast_parameters_t *unicast_vars);
 void hls_stop(unicast_parameters_t *unicast_vars);
 void *hls_periodic_task(void* arg);
+int hls_playlist_get(unicast_parameters_t *unicast_vars, char *name, struct unicast_reply *reply);
+hls_segment_t *hls_segment_get(char *name);
+void hls_segment_release(hls_segment_t *segment);
 
 #endif
@@ -1011,7 +1011,7 @@ void usage (char *name)
 	fprintf (stderr, "MuMuDVB is a program who can redistribute stream from DVB on a network, in multicast or in http unicast.\n"
 			"It's main feature is to take a whole transponder and put each channel on a different multicast IP.\n\n"
 			"Usage: %s [options] \n"
-			"-c, --config : Config file\n"
+			"-c, --config : Config file, give it several times to serve several adapters\n"
 			"-s, --signal : Display signal power\n"
 			"-t, --traffic : Display channels traffic\n"
 			"-l, --list-cards : List the DVB cards and exit\n"
@@ -1021,6 +1021,14 @@ void usage (char *name)
 			"-v           : More verbose\n"
 			"-q           : Less verbose\n"
 			"--dumpfile   : Debug option : Dump the stream into the specified file\n"
+			"--dump_buffer_size : Size of the dump buffer in MB, the packets are dropped when it is full (default 32)\n"
+			"--dump_rotate_size : Start a new dump file after the given size in MB\n"
+			"--dump_rotate_time : Start a new dump file after the given number of seconds\n"
+			"--dump_direct : Write the dump with O_DIRECT\n"
+#ifdef ENABLE_BENCHMARK
+			"--benchmark  : Read the input file in a loop as fast as possible during the given number of seconds and display the processing times\n"
+			"--benchmark_network : With --benchmark, send the datagrams to the network instead of dropping them\n"
+#endif
 #ifdef ENABLE_ARIB_SUPPORT
 			"-j --japan   : Enable processing ARIB encoding in SI/EPG data\n"
 #endif
@@ -1029,15 +1037,13 @@ void usage (char *name)
 	print_info ();
 }
 
-void show_traffic( char *log_module, double now, int show_traffic_interval, mumu_chan_p_t *chan_p)
+void show_traffic( char *log_module, double now, stats_infos_t *stats_infos, mumu_chan_p_t *chan_p)
 {
-	static long show_traffic_time=0;
-
-	if(!show_traffic_time)
-		show_traffic_time = (long)now;
-	if((now-show_traffic_time)>=show_traffic_interval)
+	if(!stats_infos->show_traffic_time)
+		stats_infos->show_traffic_time = (long)now;
+	if((now-stats_infos->show_traffic_time)>=stats_infos->show_traffic_interval)
 	{
-		show_traffic_time = (long)now;
+		stats_infos->show_traffic_time = (long)now;
 		for (int curr_channel = 0; curr_channel < chan_p->number_of_channels; curr_channel++)
 		{
 			log_message( log_module,  MSG_INFO, "Traffic :  %.2f kb/s \t  for channel \"%s\"\n",
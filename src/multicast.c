@@ -26,12 +26,39 @@
  */
 
 #define _CRT_SECURE_NO_WARNINGS
+#define _GNU_SOURCE //in order to use sendmmsg
 
 #include "mumudvb.h"
 #include "log.h"
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 #ifndef _WIN32
 #include <net/if.h>
+#include <unistd.h>
+#endif
+#ifdef HAVE_SENDMMSG
+#include <sys/socket.h>
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
+#ifdef __linux__
+#include <sys/socket.h>
+#include <time.h>
+#ifndef SO_MAX_PACING_RATE
+#define SO_MAX_PACING_RATE 47
+#endif
+#ifndef SO_TXTIME
+#define SO_TXTIME 61
+#define SCM_TXTIME SO_TXTIME
+#endif
+/** The SO_TXTIME parameter (struct sock_txtime of linux/net_tstamp.h) */
+struct multicast_sock_txtime {
+	clockid_t clockid;
+	uint32_t flags;
+};
 #endif
 
 static char *log_module = "Multicast: ";
@@ -50,6 +77,12 @@ void init_multicast_v(multi_p_t *multi_p)
         .rtp_header = 0,
         .iface4 = "\0",
         .iface6 = "\0",
+        .batch = 0,
+        .batch_delay = MULTICAST_BATCH_DEFAULT_DELAY,
+        .gso = 1,
+        .pacing = 0,
+        .output_thread = 0,
+        .output_ring_size = MULTICAST_RING_DEFAULT_SIZE,
     };
 
 }
@@ -117,6 +150,34 @@ int read_multicast_configuration(multi_p_t *multi_p, mumudvb_channel_t *c_chan,
         multi_p->rtp_header = atoi(substring);
         if (multi_p->rtp_header == 1)
             log_message(log_module, MSG_INFO, "You decided to send the RTP header (multicast only).\n");
+    } else if (!strcmp(substring, "multicast_batch")) {
+        substring = strtok(NULL, delimiteurs);
+        multi_p->batch = atoi(substring);
+#ifndef HAVE_SENDMMSG
+        if (multi_p->batch) {
+            log_message(log_module, MSG_WARN, "multicast_batch : sendmmsg is not available on this system, the datagrams will be sent one by one\n");
+            multi_p->batch = 0;
+        }
+#endif
+    } else if (!strcmp(substring, "multicast_batch_delay")) {
+        substring = strtok(NULL, delimiteurs);
+        multi_p->batch_delay = atoi(substring);
+        if (multi_p->batch_delay < 0)
+            multi_p->batch_delay = 0;
+    } else if (!strcmp(substring, "multicast_gso")) {
+        substring = strtok(NULL, delimiteurs);
+        multi_p->gso = atoi(substring);
+    } else if (!strcmp(substring, "multicast_pacing")) {
+        substring = strtok(NULL, delimiteurs);
+        multi_p->pacing = atoi(substring);
+    } else if (!strcmp(substring, "multicast_output_thread")) {
+        substring = strtok(NULL, delimiteurs);
+        multi_p->output_thread = atoi(substring);
+    } else if (!strcmp(substring, "multicast_output_ring_size")) {
+        substring = strtok(NULL, delimiteurs);
+        multi_p->output_ring_size = atoi(substring);
+        if (multi_p->output_ring_size < 2)
+            multi_p->output_ring_size = 2;
     } else if (!strcmp(substring, "multicast_iface4")) {
         substring = strtok(NULL, delimiteurs);
         if (strlen(substring) > (IF_NAMESIZE)) {
@@ -137,3 +198,686 @@ int read_multicast_configuration(multi_p_t *multi_p, mumudvb_channel_t *c_chan,
 
     return 1; //We found something for multicast, we tell main to go for the next line
 }
+
+
+
+/************************ Batched sending ************************/
+
+/** The counters of the batched sending, for all the threads */
+multicast_batch_stats_t multicast_batch_stats;
+
+#ifdef HAVE_SENDMMSG
+/** @brief The datagrams waiting to be sent on one socket (one address family)
+ *
+ * A message is a datagram, or with UDP GSO several datagrams of the same size
+ * (the last one can be smaller) for the same group, the kernel splits it.
+ * The order of the datagrams is kept inside a group, not between groups.
+ */
+typedef struct multicast_batch_queue_t{
+	/** The socket shared by all the channels of the batch */
+	int socket;
+	/** Number of datagrams in the queue */
+	int num_datagrams;
+	/** Number of messages in the queue */
+	int num_msgs;
+	unsigned char data[MULTICAST_BATCH_SIZE][MAX_UDP_SIZE];
+	/** The segments of each message */
+	struct iovec iov[MULTICAST_BATCH_SIZE][MULTICAST_GSO_SEGMENTS];
+	struct mmsghdr msgs[MULTICAST_BATCH_SIZE];
+	struct sockaddr_storage dest[MULTICAST_BATCH_SIZE];
+	/** The size of the segments of each message, 0 if the message can't be extended */
+	int segment_size[MULTICAST_BATCH_SIZE];
+	char control[MULTICAST_BATCH_SIZE][CMSG_SPACE(sizeof(uint16_t))];
+}multicast_batch_queue_t;
+
+/** @brief The datagrams of a sending thread waiting to be sent
+ * One batch is used by a single thread, no lock needed */
+struct multicast_batch_t{
+	/** IPv4 and IPv6 queues */
+	multicast_batch_queue_t queue[2];
+	/** Do we group the datagrams of a channel with UDP GSO */
+	int gso;
+	/** The maximum time a datagram waits (us) */
+	int delay;
+	/** When the oldest datagram was added */
+	uint64_t first_time;
+};
+
+/** @brief Create a new batch for a sending thread
+ * Returns NULL if it cannot be created, the datagrams will be sent one by one
+ */
+multicast_batch_t *multicast_batch_new(multi_p_t *multi_p)
+{
+	multicast_batch_t *batch;
+	struct sockaddr_in sOut4;
+	struct sockaddr_in6 sOut6;
+	int segment_size;
+
+	batch = calloc(1, sizeof(multicast_batch_t));
+	if (batch == NULL) {
+		log_message(log_module, MSG_ERROR, "Problem with malloc : %s file : %s line %d\n", strerror(errno), __FILE__, __LINE__);
+		return NULL;
+	}
+	batch->delay = multi_p->batch_delay;
+	batch->gso = multi_p->gso;
+	//The destination is given for each datagram, the address is only for makesocket
+	batch->queue[0].socket = -1;
+	batch->queue[1].socket = -1;
+	if (multi_p->multicast_ipv4)
+		batch->queue[0].socket = makesocket("0.0.0.0", multi_p->common_port, multi_p->ttl, multi_p->iface4, &sOut4);
+	if (multi_p->multicast_ipv6)
+		batch->queue[1].socket = makesocket6("::", multi_p->common_port, multi_p->ttl, multi_p->iface6, &sOut6);
+	if ((multi_p->multicast_ipv4 && batch->queue[0].socket < 0) || (multi_p->multicast_ipv6 && batch->queue[1].socket < 0)) {
+		log_message(log_module, MSG_ERROR, "Cannot create the sockets for batched sending\n");
+		multicast_batch_free(batch);
+		return NULL;
+	}
+	//We check if the kernel knows UDP GSO (Linux >= 4.18)
+	segment_size = 0;
+	if (batch->gso && batch->queue[0].socket >= 0 &&
+			setsockopt(batch->queue[0].socket, IPPROTO_UDP, UDP_SEGMENT, &segment_size, sizeof(int)) < 0) {
+		log_message(log_module, MSG_INFO, "UDP GSO not available (%s), the datagrams will be batched without it\n", strerror(errno));
+		batch->gso = 0;
+	}
+	return batch;
+}
+
+/** @brief Free a batch, the datagrams not sent are lost */
+void multicast_batch_free(multicast_batch_t *batch)
+{
+	if (batch == NULL)
+		return;
+	for (int iqueue = 0; iqueue < 2; iqueue++)
+		if (batch->queue[iqueue].socket >= 0)
+			close(batch->queue[iqueue].socket);
+	free(batch);
+}
+
+/** @brief Send all the messages of a queue */
+static void multicast_batch_queue_flush(multicast_batch_queue_t *queue)
+{
+	int sent = 0;
+	int ret;
+	unsigned long datagrams = 0;
+
+	while (sent < queue->num_msgs) {
+		ret = sendmmsg(queue->socket, queue->msgs + sent, queue->num_msgs - sent, 0);
+		__atomic_fetch_add(&multicast_batch_stats.syscalls, 1, __ATOMIC_RELAXED);
+		if (ret <= 0) {
+			log_message(log_module, MSG_WARN, "sendmmsg failed : %s\n", strerror(errno));
+			break;
+		}
+		sent += ret;
+	}
+	for (int imsg = 0; imsg < sent; imsg++) {
+		datagrams += queue->msgs[imsg].msg_hdr.msg_iovlen;
+		if (queue->msgs[imsg].msg_hdr.msg_iovlen > 1)
+			__atomic_fetch_add(&multicast_batch_stats.gso_messages, 1, __ATOMIC_RELAXED);
+	}
+	__atomic_fetch_add(&multicast_batch_stats.datagrams, datagrams, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&multicast_batch_stats.dropped, queue->num_datagrams - datagrams, __ATOMIC_RELAXED);
+	queue->num_msgs = 0;
+	queue->num_datagrams = 0;
+}
+
+/** @brief Send all the datagrams of the batch */
+void multicast_batch_flush(multicast_batch_t *batch)
+{
+	for (int iqueue = 0; iqueue < 2; iqueue++)
+		if (batch->queue[iqueue].num_msgs)
+			multicast_batch_queue_flush(&batch->queue[iqueue]);
+	batch->first_time = 0;
+}
+
+/** @brief Send the batch if the oldest datagram waited long enough */
+void multicast_batch_check(multicast_batch_t *batch, uint64_t now_time)
+{
+	if (batch->first_time && (now_time - batch->first_time) >= (uint64_t) batch->delay)
+		multicast_batch_flush(batch);
+}
+
+/** @brief When the batch has to be sent (us), 0 if it is empty */
+uint64_t multicast_batch_deadline(multicast_batch_t *batch)
+{
+	if (!batch->first_time)
+		return 0;
+	return batch->first_time + batch->delay;
+}
+
+/** @brief Add a datagram to a queue
+ * If the last message for this group can take it, it's added as a new GSO segment
+ */
+static void multicast_batch_queue_add(multicast_batch_t *batch, multicast_batch_queue_t *queue,
+		const struct sockaddr *dest, socklen_t dest_len, unsigned char *data, int data_len)
+{
+	struct msghdr *hdr;
+	struct cmsghdr *cmsg;
+	int imsg;
+
+	memcpy(queue->data[queue->num_datagrams], data, data_len);
+
+	//We look for the last message of this group
+	imsg = -1;
+	if (batch->gso)
+		for (imsg = queue->num_msgs - 1; imsg >= 0; imsg--)
+			if (queue->msgs[imsg].msg_hdr.msg_namelen == dest_len && !memcmp(&queue->dest[imsg], dest, dest_len))
+				break;
+	//Can it take this datagram ?
+	if (imsg >= 0 &&
+			queue->segment_size[imsg] &&
+			data_len <= queue->segment_size[imsg] &&
+			queue->msgs[imsg].msg_hdr.msg_iovlen < MULTICAST_GSO_SEGMENTS) {
+		hdr = &queue->msgs[imsg].msg_hdr;
+		queue->iov[imsg][hdr->msg_iovlen].iov_base = queue->data[queue->num_datagrams];
+		queue->iov[imsg][hdr->msg_iovlen].iov_len = data_len;
+		hdr->msg_iovlen++;
+		//Several segments, we tell the kernel to split them
+		if (hdr->msg_control == NULL) {
+			hdr->msg_control = queue->control[imsg];
+			hdr->msg_controllen = sizeof(queue->control[imsg]);
+			cmsg = CMSG_FIRSTHDR(hdr);
+			cmsg->cmsg_level = IPPROTO_UDP;
+			cmsg->cmsg_type = UDP_SEGMENT;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			*((uint16_t *) CMSG_DATA(cmsg)) = queue->segment_size[imsg];
+		}
+		//A smaller segment must be the last one
+		if (data_len < queue->segment_size[imsg])
+			queue->segment_size[imsg] = 0;
+	} else {
+		imsg = queue->num_msgs;
+		memcpy(&queue->dest[imsg], dest, dest_len);
+		hdr = &queue->msgs[imsg].msg_hdr;
+		memset(hdr, 0, sizeof(struct msghdr));
+		hdr->msg_name = &queue->dest[imsg];
+		hdr->msg_namelen = dest_len;
+		hdr->msg_iov = queue->iov[imsg];
+		hdr->msg_iovlen = 1;
+		queue->iov[imsg][0].iov_base = queue->data[queue->num_datagrams];
+		queue->iov[imsg][0].iov_len = data_len;
+		queue->segment_size[imsg] = data_len;
+		queue->num_msgs++;
+	}
+	queue->num_datagrams++;
+}
+
+/** @brief Add the datagram of a channel to the batch
+ * The batch is sent when it's full, or later by multicast_batch_check
+ */
+void multicast_batch_add(multicast_batch_t *batch, mumudvb_channel_t *channel, unsigned char *data, int data_len, uint64_t now_time)
+{
+	if ((channel->socketOut4 > 0 && batch->queue[0].num_datagrams == MULTICAST_BATCH_SIZE) ||
+			(channel->socketOut6 > 0 && batch->queue[1].num_datagrams == MULTICAST_BATCH_SIZE))
+		multicast_batch_flush(batch);
+	if (!batch->first_time)
+		batch->first_time = now_time;
+	if (channel->socketOut4 > 0 && batch->queue[0].socket >= 0)
+		multicast_batch_queue_add(batch, &batch->queue[0], (const struct sockaddr *) &channel->sOut4, sizeof(struct sockaddr_in), data, data_len);
+	if (channel->socketOut6 > 0 && batch->queue[1].socket >= 0)
+		multicast_batch_queue_add(batch, &batch->queue[1], (const struct sockaddr *) &channel->sOut6, sizeof(struct sockaddr_in6), data, data_len);
+	if (batch->delay == 0)
+		multicast_batch_flush(batch);
+}
+
+#else
+
+multicast_batch_t *multicast_batch_new(multi_p_t *multi_p)
+{
+	(void) multi_p;
+	return NULL;
+}
+
+void multicast_batch_free(multicast_batch_t *batch)
+{
+	(void) batch;
+}
+
+void multicast_batch_flush(multicast_batch_t *batch)
+{
+	(void) batch;
+}
+
+void multicast_batch_check(multicast_batch_t *batch, uint64_t now_time)
+{
+	(void) batch;
+	(void) now_time;
+}
+
+uint64_t multicast_batch_deadline(multicast_batch_t *batch)
+{
+	(void) batch;
+	return 0;
+}
+
+void multicast_batch_add(multicast_batch_t *batch, mumudvb_channel_t *channel, unsigned char *data, int data_len, uint64_t now_time)
+{
+	(void) batch;
+	(void) channel;
+	(void) data;
+	(void) data_len;
+	(void) now_time;
+}
+#endif
+
+
+
+/************************ Output thread ************************/
+
+/** The size of a slot of a ring, a datagram with its RTP header */
+#define MULTICAST_RING_SLOT_SIZE (MAX_UDP_SIZE + RTP_HEADER_LEN)
+/** Minimum time between two warnings about the full rings (s) */
+#define MULTICAST_OUTPUT_REPORT_INTERVAL 10
+
+/** @brief The multicast datagrams of a channel waiting for the output thread
+ *
+ * Single producer, single consumer : the datagrams are added by the thread sending the
+ * channel (send_func) and taken by the output thread, no lock needed.
+ * The datagrams between tail and head are waiting.
+ */
+struct multicast_ring_t{
+	/** The datagrams, num_slots slots of MULTICAST_RING_SLOT_SIZE bytes */
+	unsigned char *data;
+	/** The length of the datagram of each slot */
+	int *len;
+	int num_slots;
+	/** Next slot to be written, modified by the producer only (atomic) */
+	unsigned int head;
+	/** Next slot to be sent, modified by the output thread only (atomic) */
+	unsigned int tail;
+};
+
+/** @brief The thread sending the multicast datagrams of the channels of an adapter
+ *
+ * The threads sending the channels (demux) only copy the datagrams into the ring of the
+ * channel, the system calls are done by this thread, so a slow network doesn't delay
+ * the demultiplexing. The sockets of a channel are opened before its first datagram and
+ * closed after the thread stopped.
+ */
+struct multicast_output_t{
+	pthread_t thread;
+	/** Mutex and condition to wake the thread when it waits for datagrams */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	/** Is the thread waiting ? (atomic, see multicast_output_wake) */
+	int waiting;
+	int shutdown;
+	/** The size of the rings */
+	int ring_size;
+	/** The datagrams of all the channels are sent together, NULL to send them one by one */
+	multicast_batch_t *batch;
+	/** The channels with a ring, added by the main thread */
+	mumudvb_channel_t *channels[MAX_CHANNELS];
+	multicast_ring_t *rings[MAX_CHANNELS];
+	/** Number of channels with a ring (atomic) */
+	int num_channels;
+};
+
+/** @brief Producer : add a datagram to the ring of a channel, it is dropped if the ring is full */
+void multicast_ring_push(multicast_ring_t *ring, unsigned char *data, int data_len)
+{
+	unsigned int head = ring->head;
+	int slot;
+
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) >= (unsigned int) ring->num_slots) {
+		__atomic_fetch_add(&multicast_batch_stats.output_dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	slot = head % ring->num_slots;
+	memcpy(ring->data + (size_t) slot * MULTICAST_RING_SLOT_SIZE, data, data_len);
+	ring->len[slot] = data_len;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+}
+
+/** @brief Is there a datagram waiting in one of the rings ? */
+static int multicast_output_pending(multicast_output_t *output)
+{
+	int num_channels = __atomic_load_n(&output->num_channels, __ATOMIC_SEQ_CST);
+	for (int ichan = 0; ichan < num_channels; ichan++)
+		if (__atomic_load_n(&output->rings[ichan]->head, __ATOMIC_SEQ_CST) != output->rings[ichan]->tail)
+			return 1;
+	return 0;
+}
+
+/** @brief Send the datagrams waiting in the rings
+ * @return the number of datagrams sent
+ */
+static int multicast_output_send(multicast_output_t *output)
+{
+	int num_channels = __atomic_load_n(&output->num_channels, __ATOMIC_SEQ_CST);
+	uint64_t now_time = get_time();
+	int sent = 0;
+
+	for (int ichan = 0; ichan < num_channels; ichan++) {
+		mumudvb_channel_t *channel = output->channels[ichan];
+		multicast_ring_t *ring = output->rings[ichan];
+		unsigned int tail = ring->tail;
+		unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+
+		for (; tail != head; tail++) {
+			int slot = tail % ring->num_slots;
+			unsigned char *data = ring->data + (size_t) slot * MULTICAST_RING_SLOT_SIZE;
+			//The batch copies the datagram, the slot can be given back
+			if (output->batch)
+				multicast_batch_add(output->batch, channel, data, ring->len[slot], now_time);
+			else {
+				if (channel->socketOut4)
+					sendudp(channel->socketOut4, &channel->sOut4, data, ring->len[slot]);
+				if (channel->socketOut6)
+					sendudp6(channel->socketOut6, &channel->sOut6, data, ring->len[slot]);
+			}
+			sent++;
+		}
+		__atomic_store_n(&ring->tail, tail, __ATOMIC_SEQ_CST);
+	}
+	//Everything which was waiting goes in the same sendmmsg calls
+	if (sent && output->batch)
+		multicast_batch_flush(output->batch);
+	__atomic_fetch_add(&multicast_batch_stats.output_datagrams, sent, __ATOMIC_RELAXED);
+	return sent;
+}
+
+/** @brief The output thread : send the datagrams of the rings, wait when they are empty */
+static void *multicast_output_thread_func(void *arg)
+{
+	multicast_output_t *output = (multicast_output_t *) arg;
+	unsigned long reported_drops = 0;
+	long reported_time = 0;
+
+	log_message(log_module, MSG_DEBUG, "Output thread started\n");
+	while (1) {
+		if (multicast_output_send(output))
+			continue;
+		if (multicast_batch_stats.output_dropped != reported_drops && time(NULL) - reported_time >= MULTICAST_OUTPUT_REPORT_INTERVAL) {
+			log_message(log_module, MSG_WARN, "The multicast rings are full, the network is too slow. %lu datagrams dropped\n",
+					multicast_batch_stats.output_dropped);
+			reported_drops = multicast_batch_stats.output_dropped;
+			reported_time = time(NULL);
+		}
+		pthread_mutex_lock(&output->lock);
+		if (output->shutdown) {
+			pthread_mutex_unlock(&output->lock);
+			break;
+		}
+		__atomic_store_n(&output->waiting, 1, __ATOMIC_SEQ_CST);
+		if (!multicast_output_pending(output))
+			pthread_cond_wait(&output->cond, &output->lock);
+		__atomic_store_n(&output->waiting, 0, __ATOMIC_SEQ_CST);
+		pthread_mutex_unlock(&output->lock);
+	}
+	//The datagrams added before the shutdown are sent
+	multicast_output_send(output);
+	log_message(log_module, MSG_DEBUG, "Output thread stopped\n");
+	return NULL;
+}
+
+/** @brief Start an output thread
+ * Returns NULL if it cannot be started, the datagrams will be sent by the threads sending the channels
+ */
+multicast_output_t *multicast_output_new(multi_p_t *multi_p)
+{
+	multicast_output_t *output;
+	int iRet;
+
+	output = calloc(1, sizeof(multicast_output_t));
+	if (output == NULL) {
+		log_message(log_module, MSG_ERROR, "Problem with calloc : %s file : %s line %d\n", strerror(errno), __FILE__, __LINE__);
+		return NULL;
+	}
+	output->ring_size = multi_p->output_ring_size;
+	if (multi_p->batch)
+		output->batch = multicast_batch_new(multi_p);
+	pthread_mutex_init(&output->lock, NULL);
+	pthread_cond_init(&output->cond, NULL);
+	iRet = pthread_create(&output->thread, NULL, multicast_output_thread_func, output);
+	if (iRet) {
+		log_message(log_module, MSG_ERROR, "Cannot start the multicast output thread : %s\n", strerror(iRet));
+		pthread_mutex_destroy(&output->lock);
+		pthread_cond_destroy(&output->cond);
+		multicast_batch_free(output->batch);
+		free(output);
+		return NULL;
+	}
+	return output;
+}
+
+/** @brief Give a channel a ring, its datagrams will be sent by the output thread
+ * Called by the main thread when the threads sending the channels don't run
+ */
+int multicast_output_add_channel(multicast_output_t *output, mumudvb_channel_t *channel)
+{
+	multicast_ring_t *ring;
+	int num_channels = output->num_channels;
+
+	if (channel->multicast_ring)
+		return 0;
+	if (num_channels == MAX_CHANNELS)
+		return -1;
+	ring = calloc(1, sizeof(multicast_ring_t));
+	if (ring == NULL) {
+		log_message(log_module, MSG_ERROR, "Problem with calloc : %s file : %s line %d\n", strerror(errno), __FILE__, __LINE__);
+		return -1;
+	}
+	ring->num_slots = output->ring_size;
+	ring->data = malloc((size_t) ring->num_slots * MULTICAST_RING_SLOT_SIZE);
+	ring->len = malloc(ring->num_slots * sizeof(int));
+	if (ring->data == NULL || ring->len == NULL) {
+		log_message(log_module, MSG_ERROR, "Problem with malloc : %s file : %s line %d\n", strerror(errno), __FILE__, __LINE__);
+		free(ring->data);
+		free(ring->len);
+		free(ring);
+		return -1;
+	}
+	output->channels[num_channels] = channel;
+	output->rings[num_channels] = ring;
+	__atomic_store_n(&output->num_channels, num_channels + 1, __ATOMIC_SEQ_CST);
+	channel->multicast_ring = ring;
+	return 0;
+}
+
+/** @brief Wake the output thread if it waits, called after the datagrams of a read were added */
+void multicast_output_wake(multicast_output_t *output)
+{
+	if (__atomic_load_n(&output->waiting, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&output->lock);
+		pthread_cond_signal(&output->cond);
+		pthread_mutex_unlock(&output->lock);
+	}
+}
+
+/** @brief Send what is waiting, stop the output thread and free the rings
+ * Called when the threads sending the channels don't run
+ */
+void multicast_output_free(multicast_output_t *output)
+{
+	if (output == NULL)
+		return;
+	pthread_mutex_lock(&output->lock);
+	output->shutdown = 1;
+	pthread_cond_signal(&output->cond);
+	pthread_mutex_unlock(&output->lock);
+	pthread_join(output->thread, NULL);
+	for (int ichan = 0; ichan < output->num_channels; ichan++) {
+		output->channels[ichan]->multicast_ring = NULL;
+		free(output->rings[ichan]->data);
+		free(output->rings[ichan]->len);
+		free(output->rings[ichan]);
+	}
+	pthread_mutex_destroy(&output->lock);
+	pthread_cond_destroy(&output->cond);
+	multicast_batch_free(output->batch);
+	free(output);
+}
+
+
+
+/************************ Pacing ************************/
+
+/** The PCR base is on 33 bits */
+#define PCR_BASE_MASK 0x1FFFFFFFFLL
+
+/** @brief Set up the pacing of a channel whose multicast sockets are opened
+ * We give the departure time of each datagram (SO_TXTIME) if the kernel allows it,
+ * otherwise we limit the rate of the sockets (SO_MAX_PACING_RATE).
+ * In both cases the fq queuing discipline has to be used on the interface.
+ */
+void multicast_pacing_setup(mumudvb_channel_t *channel)
+{
+	multicast_pacing_t *pacing = &channel->pacing;
+
+	pacing->last_pcr = -1;
+	pacing->pcr_bytes = 0;
+	pacing->rate = 0;
+	pacing->socket_rate = 0;
+	pacing->next_departure = 0;
+#ifdef __linux__
+	static int txtime_warned = 0;
+	struct multicast_sock_txtime txtime = {
+		.clockid = CLOCK_MONOTONIC,
+		.flags = 0,
+	};
+
+	if ((channel->socketOut4 <= 0 || !setsockopt(channel->socketOut4, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime))) &&
+			(channel->socketOut6 <= 0 || !setsockopt(channel->socketOut6, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)))) {
+		pacing->mode = PACING_TXTIME;
+		return;
+	}
+	if (!txtime_warned) {
+		log_message(log_module, MSG_INFO, "multicast_pacing : SO_TXTIME not available (%s), the rate of the sockets will be limited instead\n", strerror(errno));
+		txtime_warned = 1;
+	}
+	pacing->mode = PACING_RATE;
+#else
+	static int pacing_warned = 0;
+	if (!pacing_warned) {
+		log_message(log_module, MSG_WARN, "multicast_pacing : pacing is not available on this system, the datagrams will be sent as soon as they are ready\n");
+		pacing_warned = 1;
+	}
+	pacing->mode = PACING_NONE;
+#endif
+}
+
+/** @brief Estimate the rate of the channel from the PCR of the packets it buffers
+ * The rate is the number of bytes between two PCR divided by the PCR difference,
+ * smoothed over a few PCR.
+ */
+void multicast_pacing_packet(mumudvb_channel_t *channel, unsigned char *ts_packet)
+{
+	multicast_pacing_t *pacing = &channel->pacing;
+	int64_t pcr, delta;
+	uint64_t rate;
+	int pid;
+
+	pacing->pcr_bytes += TS_PACKET_SIZE;
+	pid = ((ts_packet[1] & 0x1f) << 8) | (ts_packet[2]);
+	if (pid != channel->pid_i.pcr_pid)
+		return;
+	//Adaptation field with the PCR flag
+	if (!(ts_packet[3] & 0x20) || ts_packet[4] < 7 || !(ts_packet[5] & 0x10))
+		return;
+	pcr = ((int64_t) ts_packet[6] << 25) | ((int64_t) ts_packet[7] << 17) |
+			((int64_t) ts_packet[8] << 9) | ((int64_t) ts_packet[9] << 1) | (ts_packet[10] >> 7);
+	if (pacing->last_pcr >= 0) {
+		delta = (pcr - pacing->last_pcr) & PCR_BASE_MASK;
+		//More than one second between two PCR is a discontinuity, we start again
+		if (delta > 0 && delta < 90000) {
+			//We don't count this packet, it belongs to the next interval
+			rate = (pacing->pcr_bytes - TS_PACKET_SIZE) * 8 * 90000 / delta;
+			if (!pacing->rate)
+				pacing->rate = rate;
+			else
+				pacing->rate = (pacing->rate * 7 + rate) / 8;
+		}
+	}
+	pacing->last_pcr = pcr;
+	pacing->pcr_bytes = TS_PACKET_SIZE;
+}
+
+#ifdef __linux__
+/** @brief Send a datagram with its departure time */
+static void multicast_pacing_sendmsg(int fd, struct sockaddr *dest, socklen_t dest_len, unsigned char *data, int data_len, uint64_t departure)
+{
+	struct msghdr hdr;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char control[CMSG_SPACE(sizeof(uint64_t))];
+	int ret;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memset(control, 0, sizeof(control));
+	iov.iov_base = data;
+	iov.iov_len = data_len;
+	hdr.msg_name = dest;
+	hdr.msg_namelen = dest_len;
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	hdr.msg_control = control;
+	hdr.msg_controllen = sizeof(control);
+	cmsg = CMSG_FIRSTHDR(&hdr);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_TXTIME;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(uint64_t));
+	memcpy(CMSG_DATA(cmsg), &departure, sizeof(uint64_t));
+	ret = sendmsg(fd, &hdr, 0);
+	if (ret < 0)
+		log_message(log_module, MSG_WARN, "sendmsg failed : %s\n", strerror(errno));
+}
+#endif
+
+/** @brief Send a multicast datagram of a channel at its slot
+ * The datagrams are spaced by the time the stream needs to carry them at the PCR rate.
+ * Until the rate is known, they are sent as soon as they are ready.
+ */
+void multicast_pacing_send(mumudvb_channel_t *channel, unsigned char *data, int data_len, uint64_t now_time)
+{
+	multicast_pacing_t *pacing = &channel->pacing;
+	uint64_t now_ns = now_time * 1000;
+	uint64_t departure = 0;
+	uint64_t delay = 0;
+	int resync = 0;
+
+	if (pacing->rate) {
+		departure = pacing->next_departure;
+		if (departure < now_ns)
+			departure = now_ns;
+		else if (departure - now_ns > (uint64_t) MULTICAST_PACING_MAX_DELAY * 1000) {
+			//The data comes faster than the PCR rate, we can't keep up, we start again from now
+			departure = now_ns;
+			resync = 1;
+		}
+		delay = (departure - now_ns) / 1000;
+		pacing->next_departure = departure + (uint64_t) channel->nb_bytes * 8 * 1000000000ULL / pacing->rate;
+		pthread_mutex_lock(&channel->stats_lock);
+		pacing->datagrams++;
+		pacing->resync += resync;
+		pacing->total_delay += delay;
+		if (delay > pacing->max_delay)
+			pacing->max_delay = delay;
+		pthread_mutex_unlock(&channel->stats_lock);
+	}
+#ifdef __linux__
+	if (pacing->mode == PACING_TXTIME && departure) {
+		if (channel->socketOut4 > 0)
+			multicast_pacing_sendmsg(channel->socketOut4, (struct sockaddr *) &channel->sOut4, sizeof(struct sockaddr_in), data, data_len, departure);
+		if (channel->socketOut6 > 0)
+			multicast_pacing_sendmsg(channel->socketOut6, (struct sockaddr *) &channel->sOut6, sizeof(struct sockaddr_in6), data, data_len, departure);
+		return;
+	}
+	//We give the sockets the rate with a small margin, and update it when it changes by more than 1/16
+	if (pacing->mode == PACING_RATE && pacing->rate) {
+		uint64_t socket_rate = pacing->rate / 8 + pacing->rate / 128;
+		if (socket_rate > pacing->socket_rate + pacing->socket_rate / 16 ||
+				socket_rate < pacing->socket_rate - pacing->socket_rate / 16) {
+			uint32_t max_rate = socket_rate > UINT32_MAX ? UINT32_MAX : socket_rate;
+			if (channel->socketOut4 > 0)
+				setsockopt(channel->socketOut4, SOL_SOCKET, SO_MAX_PACING_RATE, &max_rate, sizeof(max_rate));
+			if (channel->socketOut6 > 0)
+				setsockopt(channel->socketOut6, SOL_SOCKET, SO_MAX_PACING_RATE, &max_rate, sizeof(max_rate));
+			pacing->socket_rate = socket_rate;
+		}
+	}
+#endif
+	if (channel->socketOut4 > 0)
+		sendudp(channel->socketOut4, &channel->sOut4, data, data_len);
+	if (channel->socketOut6 > 0)
+		sendudp6(channel->socketOut6, &channel->sOut6, data, data_len);
+}
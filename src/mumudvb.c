@@ -60,7 +60,7 @@
  *
  * cam.c cam.h : code related to the support of scrambled channels
  *
- * crc32.c : the crc32 table
+ * crc32.c crc32.h : the CRC32 of the sections (table, slicing-by-8 and PCLMULQDQ)
  *
  * dvb.c dvb.h functions related to the DVB card : oppening filters, file descriptors etc
  *
@@ -143,14 +143,18 @@
 #include "scam_decsa.h"
 #endif
 #include "ts.h"
+#include "crc32.h"
 #include "errors.h"
 #include "autoconf.h"
+#include "autoconf_cache.h"
 #include "sap.h"
 #include "rewrite.h"
 #include "unicast_http.h"
 #include "rtp.h"
 #include "log.h"
 #include "hls.h"
+#include "demux.h"
+#include "dump.h"
 
 #if defined __UCLIBC__ || defined ANDROID
 #define program_invocation_short_name "mumudvb"
@@ -194,194 +198,96 @@ void init_multicast_v(multi_p_t *multi_p); //in multicast.c
 
 void chan_new_pmt(unsigned char *ts_packet, mumu_chan_p_t *chan_p, int pid);
 
-int processt2(unsigned char* input_buf, unsigned int input_buf_offset, unsigned char* output_buf, unsigned int output_buf_offset, unsigned int output_buf_size, uint8_t plpId);
-
-int main (int argc, char **argv)
+/** @brief Allocate an adapter and set the default values of its parameters
+ */
+static mumudvb_adapter_t *adapter_new(int id)
 {
-	// file descriptors
-	static fds_t fds; /** File descriptors associated with the card */
-	memset(&fds,0,sizeof(fds_t));
-
-#ifdef _WIN32
-	WSADATA wsaData;
-
-	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
-		return -1;
-#endif
-
-	//Thread information
-	pthread_t signalpowerthread = pthread_self();
-	pthread_t cardthread;
-
-	pthread_t monitorthread = pthread_self();
-	pthread_t hlsthread = pthread_self();
-	card_thread_parameters_t cardthreadparams;
-	memset(&cardthreadparams,0,sizeof(card_thread_parameters_t));
+	mumudvb_adapter_t *adapter;
+	adapter=calloc(1,sizeof(mumudvb_adapter_t));
+	if(adapter==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		exit(ERROR_MEMORY);
+	}
+	adapter->id=id;
+	adapter->signalpowerthread=pthread_self();
+	adapter->cardthread=pthread_self();
+	adapter->route_reader=-1;
+	//One demuxer file descriptor for all the PIDs if the card can do it
+	adapter->fds.demux_single_fd=1;
 
 	//Channel information
-	static mumu_chan_p_t chan_p;
-	memset(&chan_p,0,sizeof(chan_p));
-
-	pthread_mutex_init(&chan_p.lock,NULL);
-	chan_p.psi_tables_filtering=PSI_TABLES_FILTERING_NONE;
-
-	//sap announces variables
-	sap_p_t sap_p;
-	init_sap_v(&sap_p);
+	pthread_mutex_init(&adapter->chan_p.lock,NULL);
+	adapter->chan_p.psi_tables_filtering=PSI_TABLES_FILTERING_NONE;
 
 	//Statistics
-	stats_infos_t stats_infos;
-	init_stats_v(&stats_infos);
-
-	//unicast
-	//Parameters for HTTP unicast
-	unicast_parameters_t unic_p;
-	init_unicast_v(&unic_p);
+	init_stats_v(&adapter->stats_infos);
 
-	//multicast
 	//multicast parameters
-	multi_p_t multi_p;
-	init_multicast_v(&multi_p);
+	init_multicast_v(&adapter->multi_p);
 
 	//tuning parameters
-	tune_p_t tune_p;
-	init_tune_v(&tune_p);
-	card_tuned=&tune_p.card_tuned;
+	init_tune_v(&adapter->tune_p);
 
 #ifdef ENABLE_CAM_SUPPORT
 	//CAM (Conditionnal Access Modules : for scrambled channels)
-	cam_p_t cam_p;
-	init_cam_v(&cam_p);
-	cam_p_t *cam_p_ptr=&cam_p;
-#else
-	void *cam_p_ptr=NULL;
+	init_cam_v(&adapter->cam_p);
+	adapter->cam_p_ptr=&adapter->cam_p;
 #endif
 
 #ifdef ENABLE_SCAM_SUPPORT
 	//SCAM (software conditionnal Access Modules : for scrambled channels)
-	scam_parameters_t scam_vars={
-			.scam_support = 0,
-			.getcwthread = 0,
-			.getcwthread_shutdown = 0,
-	};
-	scam_vars.epfd = epoll_create(MAX_CHANNELS);
-	scam_parameters_t *scam_vars_ptr=&scam_vars;
-#else
-	void *scam_vars_ptr=NULL;
+	adapter->scam_vars.scam_support = 0;
+	adapter->scam_vars.getcwthread = 0;
+	adapter->scam_vars.getcwthread_shutdown = 0;
+	adapter->scam_vars.epfd = epoll_create(MAX_CHANNELS);
+	adapter->scam_vars_ptr=&adapter->scam_vars;
 #endif
 
 	//autoconfiguration
-	auto_p_t auto_p;
-	init_aconf_v(&auto_p);
+	init_aconf_v(&adapter->auto_p);
 
 	//Parameters for rewriting
-	rewrite_parameters_t rewrite_vars;
-	init_rewr_v(&rewrite_vars);
-
-	int no_daemon = 0;
-
-	char filename_channels_not_streamed[DEFAULT_PATH_LEN];
-	char filename_channels_streamed[DEFAULT_PATH_LEN];
-	char filename_pid[DEFAULT_PATH_LEN]=PIDFILE_PATH;
-
-	int server_id = 0; /** The server id for the template %server */
-
-	int iRet;
+	init_rewr_v(&adapter->rewrite_vars);
 
+	//Sending the packets to the channels
+	init_demux_v(&adapter->demux_p);
 
-	//MPEG2-TS reception and sort
-	int pid;			/** pid of the current mpeg2 packet */
-	int ScramblingControl;
-	int continuity_counter;
+	//UDP/RTP source
+	init_udp_source_v(&adapter->udp_source);
 
 	/** The buffer for the card */
-	card_buffer_t card_buffer;
-	memset (&card_buffer, 0, sizeof (card_buffer_t));
-	card_buffer.dvr_buffer_size=DEFAULT_TS_BUFFER_SIZE;
-	card_buffer.max_thread_buffer_size=DEFAULT_THREAD_BUFFER_SIZE;
-	unsigned int t2mi_buf_size = 0;
-	/** List of mandatory pids */
-	uint8_t mandatory_pid[MAX_MANDATORY_PID_NUMBER];
-
-	struct timeval tv;
-
-	//files
-	char *conf_filename = NULL;
-	FILE *conf_file;
-	FILE *channels_diff;
-	FILE *channels_not_streamed;
-#ifdef ENABLE_CAM_SUPPORT
-	FILE *cam_info;
-#endif
-	FILE *pidfile;
-	char *dump_filename = NULL;
-	FILE *dump_file;
-
-
-	int listingcards=0;
-	//Getopt
-	parse_cmd_line(argc,argv,
-			&conf_filename,
-			&tune_p,
-			&stats_infos,
-			&server_id,
-			&no_daemon,
-			&dump_filename,
-			&listingcards);
-
-
-	//List the detected cards
-	if(listingcards)
-	{
-		print_info ();
-		list_dvb_cards ();
-		exit(0);
-	}
-
-#ifndef _WIN32
-	// DO NOT REMOVE (make MuMuDVB a deamon)
-	if(!no_daemon)
-		if(daemon(42,0))
-		{
-			log_message( log_module,  MSG_WARN, "Cannot daemonize: %s\n",
-					strerror (errno));
-			exit(666); //Right code for a bad daemon no ?
-		}
-
-	//If the user didn't defined a preferred logging way, and we daemonize, we set to syslog (except windows, where we don't, and log to console)
-	if (!no_daemon)
-	{
-		if(log_params.log_type==LOGGING_UNDEFINED)
-		{
-			openlog ("MUMUDVB", LOG_PID, 0);
-			log_params.log_type=LOGGING_SYSLOG;
-			log_params.syslog_initialised=1;
-		}
-	}
-#else
-	no_daemon = 1;
-	log_params.log_type = LOGGING_CONSOLE;
-	log_params.syslog_initialised = 1;
-#endif
-
-	//Display general information
-	print_info ();
+	adapter->card_buffer.dvr_buffer_size=DEFAULT_TS_BUFFER_SIZE;
+	adapter->card_buffer.dvr_mmap_buffers=DEFAULT_DVR_MMAP_BUFFERS;
+	adapter->card_buffer.max_thread_buffer_size=DEFAULT_THREAD_BUFFER_SIZE;
+	adapter->card_buffer.ring.psi_priority=1;
+	adapter->card_buffer.dvr_buffer_max=DEFAULT_DVR_BUFFER_MAX;
+	adapter->card_buffer.dvr_kernel_buffer_max=DEFAULT_DVR_KERNEL_BUFFER_MAX;
+	return adapter;
+}
 
+/** @brief Read the configuration file of an adapter
+ *
+ * The options of the shared parts (unicast, SAP, logging) go to the common structures,
+ * they can be given in any of the configuration files.
+ */
+static int adapter_read_configuration(mumudvb_adapter_t *adapter, sap_p_t *sap_p, unicast_parameters_t *unic_p, int *server_id, char *filename_pid)
+{
 	// configuration file parsing
+	mumu_chan_p_t *chan_p=&adapter->chan_p;
+	card_buffer_t *card_buffer=&adapter->card_buffer;
+	stats_infos_t *stats_infos=&adapter->stats_infos;
+	char *conf_filename=adapter->conf_filename;
+	FILE *conf_file;
+	int iRet;
 	int ichan = 0;
 	int ipid = 0;
-	int send_packet=0;
 	char current_line[CONF_LINELEN];
 	char *substring=NULL;
 	char delimiteurs[] = CONFIG_FILE_SEPARATOR;
 	/******************************************************/
 	// config file displaying
 	/******************************************************/
-	if (conf_filename == NULL)
-	{
-		log_message( log_module,  MSG_ERROR, "No configuration file specified");
-		exit(ERROR_CONF_FILE);
-	}
 	conf_file = fopen (conf_filename, "r");
 	if (conf_file == NULL)
 	{
@@ -458,53 +364,63 @@ int main (int argc, char **argv)
 		if(ichan<0)
 			c_chan=NULL;
 		else
-			c_chan=&chan_p.channels[ichan];
+			c_chan=&chan_p->channels[ichan];
 
-		if((iRet=read_tuning_configuration(&tune_p, substring))) //Read the line concerning the tuning parameters
+		if((iRet=read_tuning_configuration(&adapter->tune_p, substring))) //Read the line concerning the tuning parameters
 		{
 			if(iRet==-1)
 				exit(ERROR_CONF);
 		}
-		else if((iRet=read_autoconfiguration_configuration(&auto_p, substring))) //Read the line concerning the autoconfiguration parameters
+		else if((iRet=read_autoconfiguration_configuration(&adapter->auto_p, substring))) //Read the line concerning the autoconfiguration parameters
 		{
 			if(iRet==-1)
 				exit(ERROR_CONF);
 		}
-		else if((iRet=read_sap_configuration(&sap_p, c_chan, substring))) //Read the line concerning the sap parameters
+		else if((iRet=read_sap_configuration(sap_p, c_chan, substring))) //Read the line concerning the sap parameters
 		{
 			if(iRet==-1)
 				exit(ERROR_CONF);
 		}
 #ifdef ENABLE_CAM_SUPPORT
-		else if((iRet=read_cam_configuration(&cam_p, c_chan, substring))) //Read the line concerning the cam parameters
+		else if((iRet=read_cam_configuration(&adapter->cam_p, c_chan, substring))) //Read the line concerning the cam parameters
 		{
 			if(iRet==-1)
 				exit(ERROR_CONF);
 		}
 #endif
 #ifdef ENABLE_SCAM_SUPPORT
-		else if((iRet=read_scam_configuration(scam_vars_ptr, c_chan, substring))) //Read the line concerning the software cam parameters
+		else if((iRet=read_scam_configuration(adapter->scam_vars_ptr, c_chan, substring))) //Read the line concerning the software cam parameters
 		{
 			if(iRet==-1)
 				exit(ERROR_CONF);
 		}
 #endif
-		else if((iRet=read_unicast_configuration(&unic_p, c_chan, substring))) //Read the line concerning the unicast parameters
+		else if((iRet=read_unicast_configuration(unic_p, c_chan, substring))) //Read the line concerning the unicast parameters
 		{
 			if(iRet==-1)
 				exit(ERROR_CONF);
 		}
-		else if((iRet=read_multicast_configuration(&multi_p, c_chan, substring))) //Read the line concerning the multicast parameters
+		else if((iRet=read_multicast_configuration(&adapter->multi_p, c_chan, substring))) //Read the line concerning the multicast parameters
 		{
 			if(iRet==-1)
 				exit(ERROR_CONF);
 		}
-		else if((iRet=read_rewrite_configuration(&rewrite_vars, substring))) //Read the line concerning the rewrite parameters
+		else if((iRet=read_rewrite_configuration(&adapter->rewrite_vars, substring))) //Read the line concerning the rewrite parameters
 		{
 			if(iRet==-1)
 				exit(ERROR_CONF);
 		}
-		else if((iRet=read_logging_configuration(&stats_infos, substring))) //Read the line concerning the logging parameters
+		else if((iRet=read_logging_configuration(stats_infos, substring))) //Read the line concerning the logging parameters
+		{
+			if(iRet==-1)
+				exit(ERROR_CONF);
+		}
+		else if((iRet=read_demux_configuration(&adapter->demux_p, c_chan, substring))) //Read the line concerning the demux parameters
+		{
+			if(iRet==-1)
+				exit(ERROR_CONF);
+		}
+		else if((iRet=read_udp_source_configuration(&adapter->udp_source, substring))) //Read the line concerning the UDP source parameters
 		{
 			if(iRet==-1)
 				exit(ERROR_CONF);
@@ -512,7 +428,13 @@ int main (int argc, char **argv)
 		else if (!strcmp (substring, "new_channel"))
 		{
 			ichan++;
-			chan_p.channels[ichan].channel_ready=ALMOST_READY;
+			if (ichan >= MAX_CHANNELS)
+			{
+				log_message( log_module,  MSG_ERROR, "Too many channels : %d limit : %d\n",
+						ichan+1, MAX_CHANNELS);
+				exit(ERROR_TOO_CHANNELS);
+			}
+			chan_p->channels[ichan].channel_ready=ALMOST_READY;
 			log_message( log_module, MSG_INFO,"New channel, current number %d", ichan);
 		}
 		else if (!strcmp (substring, "timeout_no_diff"))
@@ -533,48 +455,97 @@ int main (int argc, char **argv)
 		else if (!strcmp (substring, "filter_transport_error"))
 		{
 			substring = strtok (NULL, delimiteurs);
-			chan_p.filter_transport_error = atoi (substring);
+			chan_p->filter_transport_error = atoi (substring);
 		}
 		else if (!strcmp (substring, "psi_tables_filtering"))
 		{
 			substring = strtok (NULL, delimiteurs);
 			if (!strcmp (substring, "pat"))
-				chan_p.psi_tables_filtering = PSI_TABLES_FILTERING_PAT_ONLY;
+				chan_p->psi_tables_filtering = PSI_TABLES_FILTERING_PAT_ONLY;
 			else if (!strcmp (substring, "pat_cat"))
-				chan_p.psi_tables_filtering = PSI_TABLES_FILTERING_PAT_CAT_ONLY;
+				chan_p->psi_tables_filtering = PSI_TABLES_FILTERING_PAT_CAT_ONLY;
 			else if (!strcmp (substring, "none"))
-				chan_p.psi_tables_filtering = PSI_TABLES_FILTERING_NONE;
-			if (chan_p.psi_tables_filtering == PSI_TABLES_FILTERING_PAT_ONLY)
+				chan_p->psi_tables_filtering = PSI_TABLES_FILTERING_NONE;
+			if (chan_p->psi_tables_filtering == PSI_TABLES_FILTERING_PAT_ONLY)
 				log_message( log_module,  MSG_INFO, "You have enabled PSI tables filtering, only PAT will be send\n");
-			if (chan_p.psi_tables_filtering == PSI_TABLES_FILTERING_PAT_CAT_ONLY)
+			if (chan_p->psi_tables_filtering == PSI_TABLES_FILTERING_PAT_CAT_ONLY)
 				log_message( log_module,  MSG_INFO, "You have enabled PSI tables filtering, only PAT and CAT will be send\n");
 		}
 		else if (!strcmp (substring, "dvr_buffer_size"))
 		{
 			substring = strtok (NULL, delimiteurs);
-			card_buffer.dvr_buffer_size = atoi (substring);
-			if(card_buffer.dvr_buffer_size<=0)
+			card_buffer->dvr_buffer_size = atoi (substring);
+			if(card_buffer->dvr_buffer_size<=0)
 			{
 				log_message( log_module,  MSG_WARN,
 						"The buffer size MUST be >0, forced to 1 packet\n");
-				card_buffer.dvr_buffer_size = 1;
+				card_buffer->dvr_buffer_size = 1;
 			}
-			stats_infos.show_buffer_stats=1;
+			stats_infos->show_buffer_stats=1;
+		}
+		else if (!strcmp (substring, "dvr_buffer_auto"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			card_buffer->dvr_buffer_auto = atoi (substring);
+			stats_infos->show_buffer_stats=1;
+		}
+		else if (!strcmp (substring, "dvr_buffer_max"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			card_buffer->dvr_buffer_max = atoi (substring);
+		}
+		else if (!strcmp (substring, "dvr_kernel_buffer_size"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			card_buffer->dvr_kernel_buffer_size = atoi (substring);
+			if(card_buffer->dvr_kernel_buffer_size<0)
+				card_buffer->dvr_kernel_buffer_size = 0;
+		}
+		else if (!strcmp (substring, "dvr_kernel_buffer_max"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			card_buffer->dvr_kernel_buffer_max = atoi (substring);
 		}
 		else if (!strcmp (substring, "dvr_thread"))
 		{
 			substring = strtok (NULL, delimiteurs);
-			card_buffer.threaded_read = atoi (substring);
-			if(card_buffer.threaded_read)
+			card_buffer->threaded_read = atoi (substring);
+			if(card_buffer->threaded_read)
 			{
 				log_message( log_module,  MSG_WARN,
 						"You want to use a thread for reading the card, please report bugs/problems\n");
 			}
 		}
+		else if (!strcmp (substring, "demux_single_fd"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			adapter->fds.demux_single_fd = atoi (substring);
+		}
+		else if (!strcmp (substring, "dvr_thread_psi_priority"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			card_buffer->ring.psi_priority = atoi (substring);
+		}
+		else if (!strcmp (substring, "dvr_mmap"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			card_buffer->dvr_mmap = atoi (substring);
+		}
+		else if (!strcmp (substring, "dvr_mmap_buffers"))
+		{
+			substring = strtok (NULL, delimiteurs);
+			card_buffer->dvr_mmap_buffers = atoi (substring);
+			if(card_buffer->dvr_mmap_buffers<2 || card_buffer->dvr_mmap_buffers>DVR_MMAP_MAX_BUFFERS)
+			{
+				log_message( log_module,  MSG_WARN,
+						"The number of DVR mmap buffers must be between 2 and %d, forced to %d\n", DVR_MMAP_MAX_BUFFERS, DEFAULT_DVR_MMAP_BUFFERS);
+				card_buffer->dvr_mmap_buffers = DEFAULT_DVR_MMAP_BUFFERS;
+			}
+		}
 		else if (!strcmp (substring, "dvr_thread_buffer_size"))
 		{
 			substring = strtok (NULL, delimiteurs);
-			card_buffer.max_thread_buffer_size = atoi (substring);
+			card_buffer->max_thread_buffer_size = atoi (substring);
 		}
 		else if ((!strcmp (substring, "service_id")) || (!strcmp (substring, "ts_id")))
 		{
@@ -665,7 +636,7 @@ int main (int argc, char **argv)
 		else if (!strcmp (substring, "server_id"))
 		{
 			substring = strtok (NULL, delimiteurs);
-			server_id = atoi (substring);
+			*server_id = atoi (substring);
 		}
 		else if (!strcmp (substring, "filename_pid"))
 		{
@@ -680,23 +651,23 @@ int main (int argc, char **argv)
 		else if (!strcmp (substring, "check_cc"))
 		{
 			substring = strtok (NULL, delimiteurs);
-			chan_p.check_cc = atoi (substring);
+			chan_p->check_cc = atoi (substring);
 		}
 		else if (!strcmp (substring, "t2mi_pid"))
 		{
 			substring = strtok (NULL, delimiteurs);
-			chan_p.t2mi_pid = atoi (substring);
-			log_message(log_module,MSG_INFO,"Demuxing T2-MI stream on pid %d as input\n", chan_p.t2mi_pid);
-			if(chan_p.t2mi_pid < 1 || chan_p.t2mi_pid > 8192)
+			chan_p->t2mi_pid = atoi (substring);
+			log_message(log_module,MSG_INFO,"Demuxing T2-MI stream on pid %d as input\n", chan_p->t2mi_pid);
+			if(chan_p->t2mi_pid < 1 || chan_p->t2mi_pid > 8192)
 			{
 				log_message(log_module,MSG_WARN,"wrong t2mi pid, forced to 4096\n");
-				chan_p.t2mi_pid=4096;
+				chan_p->t2mi_pid=4096;
 			}
 		}
 		else if (!strcmp (substring, "t2mi_plp"))
 		{
 			substring = strtok (NULL, delimiteurs);
-			chan_p.t2mi_plp = atoi (substring);
+			chan_p->t2mi_plp = atoi (substring);
 		}
 
 		else
@@ -707,13 +678,6 @@ int main (int argc, char **argv)
 			continue;
 		}
 
-		if (ichan > MAX_CHANNELS)
-		{
-			log_message( log_module,  MSG_ERROR, "Too many channels : %d limit : %d\n",
-					ichan, MAX_CHANNELS);
-			exit(ERROR_TOO_CHANNELS);
-		}
-
 		//A new channel have been defined
 		if(curr_channel_old != ichan)
 		{
@@ -722,400 +686,326 @@ int main (int argc, char **argv)
 	}
 	fclose (conf_file);
 	free(conf_filename);
+	adapter->conf_filename=NULL;
 
 
 	//Set default card if not specified
-	if(tune_p.card==-1)
-		tune_p.card=0;
-
-
-	/*************************************/
-	//End of configuration file reading
-	/*************************************/
-
+	if(adapter->tune_p.card==-1)
+		adapter->tune_p.card=0;
 
+	// + 1 Because of the new syntax
+	pthread_mutex_lock(&chan_p->lock);
+	chan_p->number_of_channels = ichan+1;
+	pthread_mutex_unlock(&chan_p->lock);
+	return 0;
+}
 
+/** @brief Set the options of an adapter which depend on other options, create the information files
+ */
+static int adapter_configure(mumudvb_adapter_t *adapter, sap_p_t *sap_p, unicast_parameters_t *unic_p)
+{
+	card_buffer_t *card_buffer=&adapter->card_buffer;
+	multi_p_t *multi_p=&adapter->multi_p;
+	tune_p_t *tune_p=&adapter->tune_p;
+	FILE *channels_diff;
+	FILE *channels_not_streamed;
+#ifdef ENABLE_CAM_SUPPORT
+	FILE *cam_info;
+#endif
 
 	//if Autoconfiguration, we set other option default
-	if(auto_p.autoconfiguration!=AUTOCONF_MODE_NONE)
+	if(adapter->auto_p.autoconfiguration!=AUTOCONF_MODE_NONE)
 	{
-		if((sap_p.sap == OPTION_UNDEFINED) && (multi_p.multicast))
+		if((sap_p->sap == OPTION_UNDEFINED) && (multi_p->multicast))
 		{
 			log_message( log_module,  MSG_INFO,
 					"Autoconfiguration, we activate SAP announces. if you want to disable them see the README.\n");
-			sap_p.sap=OPTION_ON;
+			sap_p->sap=OPTION_ON;
 		}
-		if(rewrite_vars.rewrite_pat == OPTION_UNDEFINED)
+		if(adapter->rewrite_vars.rewrite_pat == OPTION_UNDEFINED)
 		{
-			rewrite_vars.rewrite_pat=OPTION_ON;
+			adapter->rewrite_vars.rewrite_pat=OPTION_ON;
 			log_message( log_module,  MSG_INFO,
 					"Autoconfiguration, we activate PAT rewriting. if you want to disable it see the README.\n");
 		}
-		if(rewrite_vars.rewrite_sdt == OPTION_UNDEFINED)
+		if(adapter->rewrite_vars.rewrite_sdt == OPTION_UNDEFINED)
 		{
-			rewrite_vars.rewrite_sdt=OPTION_ON;
+			adapter->rewrite_vars.rewrite_sdt=OPTION_ON;
 			log_message( log_module,  MSG_INFO,
 					"Autoconfiguration, we activate SDT rewriting. if you want to disable it see the README.\n");
 		}
 	}
 
-	if(chan_p.t2mi_pid > 0 && card_buffer.dvr_buffer_size < 20)
+	if(adapter->chan_p.t2mi_pid > 0 && card_buffer->dvr_buffer_size < 20)
 	{
 		log_message( log_module,  MSG_WARN,
 				"Warning : You set a DVR buffer size too low to accept T2-MI frames, I increase your dvr_buffer_size to 20 ...\n");
-		card_buffer.dvr_buffer_size=20;
+		card_buffer->dvr_buffer_size=20;
+	}
+
+	if(card_buffer->dvr_buffer_auto)
+	{
+		//The read size grows from dvr_buffer_size, the buffers are allocated for the biggest reads
+		if(card_buffer->dvr_buffer_max<card_buffer->dvr_buffer_size)
+			card_buffer->dvr_buffer_max=card_buffer->dvr_buffer_size;
+		if(card_buffer->dvr_kernel_buffer_max<card_buffer->dvr_kernel_buffer_size)
+			card_buffer->dvr_kernel_buffer_max=card_buffer->dvr_kernel_buffer_size;
+		if(card_buffer->max_thread_buffer_size<2*card_buffer->dvr_buffer_max)
+			card_buffer->max_thread_buffer_size=2*card_buffer->dvr_buffer_max;
 	}
 
-	if(card_buffer.max_thread_buffer_size<card_buffer.dvr_buffer_size)
+	if(card_buffer->max_thread_buffer_size<card_buffer->dvr_buffer_size)
 	{
 		log_message( log_module,  MSG_WARN,
 				"Warning : You set a thread buffer size lower than your DVR buffer size, it's not possible to use such values. I increase your dvr_thread_buffer_size ...\n");
-		card_buffer.max_thread_buffer_size=card_buffer.dvr_buffer_size;
+		card_buffer->max_thread_buffer_size=card_buffer->dvr_buffer_size;
 	}
 
-
-
 	//Template for the card dev path
 	char number[10];
-	sprintf(number,"%d",tune_p.card);
-	int l=sizeof(tune_p.card_dev_path);
-	mumu_string_replace(tune_p.card_dev_path,&l,0,"%card",number);
-
-	//If we specified a string for the unicast port out, we parse it
-	if(unic_p.portOut_str!=NULL)
-	{
-		int len;
-		len=strlen(unic_p.portOut_str)+1;
-		sprintf(number,"%d",tune_p.card);
-		unic_p.portOut_str=mumu_string_replace(unic_p.portOut_str,&len,1,"%card",number);
-		sprintf(number,"%d",tune_p.tuner);
-		unic_p.portOut_str=mumu_string_replace(unic_p.portOut_str,&len,1,"%tuner",number);
-		sprintf(number,"%d",server_id);
-		unic_p.portOut_str=mumu_string_replace(unic_p.portOut_str,&len,1,"%server",number);
-		unic_p.portOut=string_comput(unic_p.portOut_str);
-		log_message( "Unicast: ", MSG_DEBUG, "computed unicast master port : %d\n",unic_p.portOut);
-	}
-
-	if(log_params.log_file_path!=NULL)
-	{
-		int len;
-		len=strlen(log_params.log_file_path)+1;
-		sprintf(number,"%d",tune_p.card);
-		log_params.log_file_path=mumu_string_replace(log_params.log_file_path,&len,1,"%card",number);
-		sprintf(number,"%d",tune_p.tuner);
-		log_params.log_file_path=mumu_string_replace(log_params.log_file_path,&len,1,"%tuner",number);
-		sprintf(number,"%d",server_id);
-		log_params.log_file_path=mumu_string_replace(log_params.log_file_path,&len,1,"%server",number);
-		log_params.log_file = fopen (log_params.log_file_path, "a");
-		if (log_params.log_file)
-			log_params.log_type |= LOGGING_FILE;
-		else
-			log_message(log_module,MSG_WARN,"Cannot open log file %s: %s\n", substring, strerror (errno));
-	}
-	/******************************************************/
-	//end of config file reading
-	/******************************************************/
-
-	// Show in log that we are starting
-	log_message( log_module,  MSG_INFO,"========== End of configuration, MuMuDVB version %s is starting ==========",VERSION);
-
-	// + 1 Because of the new syntax
-	pthread_mutex_lock(&chan_p.lock);
-	chan_p.number_of_channels = ichan+1;
-	pthread_mutex_unlock(&chan_p.lock);
+	sprintf(number,"%d",tune_p->card);
+	int l=sizeof(tune_p->card_dev_path);
+	mumu_string_replace(tune_p->card_dev_path,&l,0,"%card",number);
 
 	//We disable things depending on multicast if multicast is suppressed
-	if(!multi_p.ttl)
+	if(!multi_p->ttl)
 	{
 		log_message( log_module,  MSG_INFO, "The multicast TTL is set to 0, multicast will be disabled.\n");
-		multi_p.multicast=0;
+		multi_p->multicast=0;
 	}
-	if(!multi_p.multicast)
+	if(!multi_p->multicast)
 	{
-		if(multi_p.rtp_header)
+		if(multi_p->rtp_header)
 		{
-			multi_p.rtp_header=0;
+			multi_p->rtp_header=0;
 			log_message( log_module,  MSG_INFO, "NO Multicast, RTP Header is disabled.\n");
 		}
-		if(sap_p.sap==OPTION_ON)
+		//The SAP announces are sent with the multicast parameters of the first adapter
+		if(adapter->id==0 && sap_p->sap==OPTION_ON)
 		{
 			log_message( log_module,  MSG_INFO, "NO Multicast, SAP announces are disabled.\n");
-			sap_p.sap=OPTION_OFF;
+			sap_p->sap=OPTION_OFF;
 		}
 	}
 
-
-
-	if(!multi_p.multicast && !unic_p.unicast && !unic_p.hls)
+	if(!multi_p->multicast && !unic_p->unicast && !unic_p->hls)
 	{
 		log_message( log_module,  MSG_ERROR, "NO Multicast AND NO unicast or hls. No data can be send :(, Exciting ....\n");
-		set_interrupted(ERROR_CONF<<8);
-		goto mumudvb_close_goto;
+		return -1;
 	}
 
-
+	if(multi_p->pacing && multi_p->batch)
+		log_message( log_module,  MSG_WARN, "multicast_pacing is not used with multicast_batch, the datagrams will be batched\n");
 
 	// we clear them by paranoia
-	sprintf (filename_channels_streamed, STREAMED_LIST_PATH,
-			tune_p.card, tune_p.tuner);
-	sprintf (filename_channels_not_streamed, NOT_STREAMED_LIST_PATH,
-			tune_p.card, tune_p.tuner);
+	sprintf (adapter->filename_channels_streamed, STREAMED_LIST_PATH,
+			tune_p->card, tune_p->tuner);
+	sprintf (adapter->filename_channels_not_streamed, NOT_STREAMED_LIST_PATH,
+			tune_p->card, tune_p->tuner);
 #ifdef ENABLE_CAM_SUPPORT
-	sprintf (cam_p.filename_cam_info, CAM_INFO_LIST_PATH,
-			tune_p.card, tune_p.tuner);
+	sprintf (adapter->cam_p.filename_cam_info, CAM_INFO_LIST_PATH,
+			tune_p->card, tune_p->tuner);
 #endif
-	channels_diff = fopen (filename_channels_streamed, "w");
+	channels_diff = fopen (adapter->filename_channels_streamed, "w");
 	if (channels_diff == NULL)
 	{
 		write_streamed_channels=0;
 		log_message( log_module,  MSG_WARN,
 				"Can't create %s: %s\n",
-				filename_channels_streamed, strerror (errno));
+				adapter->filename_channels_streamed, strerror (errno));
 	}
 	else
 		fclose (channels_diff);
 
-	channels_not_streamed = fopen (filename_channels_not_streamed, "w");
+	channels_not_streamed = fopen (adapter->filename_channels_not_streamed, "w");
 	if (channels_not_streamed == NULL)
 	{
 		write_streamed_channels=0;
 		log_message( log_module,  MSG_WARN,
 				"Can't create %s: %s\n",
-				filename_channels_not_streamed, strerror (errno));
+				adapter->filename_channels_not_streamed, strerror (errno));
 	}
 	else
 		fclose (channels_not_streamed);
 
 #ifdef ENABLE_CAM_SUPPORT
-	if(cam_p.cam_support)
+	if(adapter->cam_p.cam_support)
 	{
-		cam_info = fopen (cam_p.filename_cam_info, "w");
+		cam_info = fopen (adapter->cam_p.filename_cam_info, "w");
 		if (cam_info == NULL)
 		{
 			log_message( log_module,  MSG_WARN,
 					"Can't create %s: %s\n",
-					cam_p.filename_cam_info, strerror (errno));
+					adapter->cam_p.filename_cam_info, strerror (errno));
 		}
 		else
 			fclose (cam_info);
 	}
 #endif
+	return 0;
+}
 
-	log_message( log_module,  MSG_INFO, "Streaming. Freq %f\n", tune_p.freq);
-
-#ifndef DISABLE_DVB_API
-	/******************************************************/
-	// Card tuning
-	/******************************************************/
-	if (signal (SIGALRM, SignalHandler) == SIG_IGN)
-		signal (SIGALRM, SIG_IGN);
-	if (signal (SIGUSR1, SignalHandler) == SIG_IGN)
-		signal (SIGUSR1, SIG_IGN);
-	if (signal (SIGUSR2, SignalHandler) == SIG_IGN)
-		signal (SIGUSR2, SIG_IGN);
-	if (signal (SIGHUP, SignalHandler) == SIG_IGN)
-		signal (SIGHUP, SIG_IGN);
-	// alarm for tuning timeout
-	if(tune_p.tuning_timeout)
-	{
-		alarm (tune_p.tuning_timeout);
-	}
-#endif
-
-	// We tune the card
-	iRet =-1;
+/** @brief Open the input of an adapter: DVB card, file or UDP source
+ * @return >0 if the input is opened
+ */
+static int adapter_open_input(mumudvb_adapter_t *adapter)
+{
+	tune_p_t *tune_p=&adapter->tune_p;
+	fds_t *fds=&adapter->fds;
+	int iRet =-1;
 
-	if (strlen(tune_p.read_file_path)) {
+	if (strlen(tune_p->read_file_path)) {
 		/* file source */
-		log_message( log_module,  MSG_DEBUG, "Opening source file %s", tune_p.read_file_path);
+		log_message( log_module,  MSG_DEBUG, "Opening source file %s", tune_p->read_file_path);
 
-		iRet = open_fe (&fds.fd_dvr, tune_p.read_file_path, tune_p.tuner,1,1);
-	} else if (strlen(tune_p.source_addr)) {
+		iRet = open_fe (&fds->fd_dvr, tune_p->read_file_path, tune_p->tuner,1,1);
+	} else if (strlen(tune_p->source_addr)) {
 		/* receive from UDP source */
-		log_message(log_module, MSG_DEBUG, "Opening UDP source %s:%d", tune_p.source_addr, tune_p.source_port);
+		log_message(log_module, MSG_DEBUG, "Opening UDP source %s:%d", tune_p->source_addr, tune_p->source_port);
 		/* error check */
-		if (tune_p.source_port == 0) {
+		if (tune_p->source_port == 0) {
 			log_message(log_module, MSG_ERROR, "Network input port not specified, please add source_port= to config");
 			exit(ERROR_TUNE);
 		}
 
-		fds.fd_source = makeUDPclientsocket(tune_p.source_addr, tune_p.source_port);
-		if (fds.fd_source < 0) {
+		fds->fd_source = makeUDPclientsocket(tune_p->source_addr, tune_p->source_port);
+		if (fds->fd_source < 0) {
 			log_message(log_module, MSG_ERROR, "Failed to bind to UDP source");
 			exit(ERROR_TUNE);
 		}
+		if (udp_source_open(&adapter->udp_source, fds->fd_source))
+			exit(ERROR_MEMORY);
+		//The reading buffer must hold the datagrams of a read
+		if (adapter->card_buffer.dvr_buffer_size*TS_PACKET_SIZE < udp_source_buffer_size(&adapter->udp_source))
+		{
+			adapter->card_buffer.dvr_buffer_size = (udp_source_buffer_size(&adapter->udp_source)+TS_PACKET_SIZE-1)/TS_PACKET_SIZE;
+			log_message(log_module, MSG_DEBUG, "The DVR buffer size is set to %d packets for the UDP source", adapter->card_buffer.dvr_buffer_size);
+		}
 		/* "Tune" successful */
 		iRet = 1;
 	} else {
 		/* normal DVR input (or pipe on win32) */
 #ifndef _WIN32
-		iRet = open_fe(&fds.fd_frontend, tune_p.card_dev_path, tune_p.tuner, 1, 0);
+		iRet = open_fe(&fds->fd_frontend, tune_p->card_dev_path, tune_p->tuner, 1, 0);
 #else
-		iRet = open_fe(&fds.fd_dvr, NULL, tune_p.tuner, 1, 1);  /* Under windows, we only support named pipes */
+		iRet = open_fe(&fds->fd_dvr, NULL, tune_p->tuner, 1, 1);  /* Under windows, we only support named pipes */
 #endif
 	}
+	return iRet;
+}
 
-	if (iRet>0)
-	{
+/** @brief Do two adapters read the same input (same file, UDP source or DVB card and tuner)
+ */
+static int adapter_same_input(mumudvb_adapter_t *a, mumudvb_adapter_t *b)
+{
+	tune_p_t *ta=&a->tune_p;
+	tune_p_t *tb=&b->tune_p;
+
+	if (strlen(ta->read_file_path) || strlen(tb->read_file_path))
+		return !strcmp(ta->read_file_path, tb->read_file_path);
+	if (strlen(ta->source_addr) || strlen(tb->source_addr))
+		return !strcmp(ta->source_addr, tb->source_addr) && ta->source_port == tb->source_port;
+	return ta->card == tb->card && ta->tuner == tb->tuner;
+}
+
+/** @brief Set up the T2-MI extraction of the adapters
+ *
+ * The adapters extracting a PLP (t2mi_pid, t2mi_plp) from the same input share this input :
+ * the first one reads it and decapsulates all the T2-MI PIDs and PLPs in one pass,
+ * the packets of each PLP are the input of its adapter (autoconfiguration, channels ...)
+ */
+static int adapters_t2mi_setup(mumudvb_adapter_t **adapters, int num_adapters)
+{
+	mumudvb_adapter_t *adapter, *input, *last;
+	mumu_chan_p_t *input_chan_p;
+	int ipid;
 
-		/*****************************************************/
-		//daemon part two, we write our PID as we are tuned
-		/*****************************************************/
-
-		// We write our pid in a file if we deamonize
-		if (!no_daemon)
-		{
-			int len;
-			len=DEFAULT_PATH_LEN;
-			sprintf(number,"%d",tune_p.card);
-			mumu_string_replace(filename_pid,&len,0,"%card",number);
-			sprintf(number,"%d",tune_p.tuner);
-			mumu_string_replace(filename_pid,&len,0,"%tuner",number);
-			sprintf(number,"%d",server_id);
-			mumu_string_replace(filename_pid,&len,0,"%server",number);;
-			log_message( log_module, MSG_INFO, "The pid will be written in %s", filename_pid);
-			pidfile = fopen (filename_pid, "w");
-			if (pidfile == NULL)
+	for (int iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		adapter=adapters[iadapter];
+		if (adapter->chan_p.t2mi_pid <= 0)
+			continue;
+		t2mi_plp_init(&adapter->t2mi, adapter->chan_p.t2mi_pid, adapter->chan_p.t2mi_plp);
+		input=adapter;
+		for (int jadapter = 0; jadapter < iadapter; jadapter++)
+			if (adapters[jadapter]->chan_p.t2mi_pid > 0 && adapters[jadapter]->t2mi_input == NULL && adapter_same_input(adapters[jadapter], adapter))
 			{
-				log_message( log_module,  MSG_INFO,"%s: %s\n",
-						filename_pid, strerror (errno));
-				exit(ERROR_CREATE_FILE);
+				input=adapters[jadapter];
+				break;
 			}
-			fprintf (pidfile, "%d\n", getpid());
-			fclose (pidfile);
+		if (input != adapter)
+		{
+			adapter->t2mi_input=input;
+			adapter->fds.virtual_input=1;
+			for (last = input; last->t2mi_next; last = last->t2mi_next);
+			last->t2mi_next=adapter;
+			log_message( log_module, MSG_INFO, "Adapter %d: the PLP %d of the T2-MI PID %d is read from the input of adapter %d\n",
+					adapter->id, adapter->chan_p.t2mi_plp, adapter->chan_p.t2mi_pid, input->id);
 		}
-
-#ifndef _WIN32
-		if (strlen(tune_p.read_file_path))
-			iRet = 1; //no tuning if file input
-		else
-			iRet = tune_it(fds.fd_frontend, &tune_p);
-#else
-		/* No tuning on windows at all */
-		iRet = 1;
-#endif
+		if (t2mi_demux_add(&input->t2mi_demux, &adapter->t2mi))
+			return -1;
+		//The input must be filtered on all the T2-MI PIDs
+		input_chan_p=&input->chan_p;
+		for (ipid = 0; ipid < input_chan_p->t2mi_num_input_pids; ipid++)
+			if (input_chan_p->t2mi_input_pids[ipid] == adapter->chan_p.t2mi_pid)
+				break;
+		if (ipid == input_chan_p->t2mi_num_input_pids)
+			input_chan_p->t2mi_input_pids[input_chan_p->t2mi_num_input_pids++]=adapter->chan_p.t2mi_pid;
 	}
-	else
-		iRet =-1;
+	return 0;
+}
 
-	if (iRet < 0)
-	{
-		log_message( log_module,  MSG_INFO, "Tuning issue, card %d\n", tune_p.card);
-		// we close the file descriptors
-		close_card_fd(&fds);
-		set_interrupted(ERROR_TUNE<<8);
-		goto mumudvb_close_goto;
-	}
-	log_message( log_module,  MSG_INFO, "Card %d, tuner %d tuned\n", tune_p.card, tune_p.tuner);
-	tune_p.card_tuned = 1;
-
-	//Thread for showing the strength
-	strength_parameters_t strengthparams;
-	strengthparams.fds = &fds;
-	strengthparams.tune_p = &tune_p;
-	pthread_create(&(signalpowerthread), NULL, show_power_func, &strengthparams);
-	//Thread for reading from the DVB card initialization
-	if(card_buffer.threaded_read)
+/** @brief Write our PID in a file (daemon part two)
+ */
+static void write_pid_file(char *filename_pid, tune_p_t *tune_p, int server_id)
+{
+	FILE *pidfile;
+	char number[10];
+	int len;
+	len=DEFAULT_PATH_LEN;
+	sprintf(number,"%d",tune_p->card);
+	mumu_string_replace(filename_pid,&len,0,"%card",number);
+	sprintf(number,"%d",tune_p->tuner);
+	mumu_string_replace(filename_pid,&len,0,"%tuner",number);
+	sprintf(number,"%d",server_id);
+	mumu_string_replace(filename_pid,&len,0,"%server",number);;
+	log_message( log_module, MSG_INFO, "The pid will be written in %s", filename_pid);
+	pidfile = fopen (filename_pid, "w");
+	if (pidfile == NULL)
 	{
-		cardthreadparams.thread_running=1;
-		cardthreadparams.fds = &fds;
-		cardthreadparams.card_buffer=&card_buffer;
-		pthread_mutex_init(&cardthreadparams.carddatamutex,NULL);
-		pthread_cond_init(&cardthreadparams.threadcond,NULL);
-		cardthreadparams.threadshutdown=0;
+		log_message( log_module,  MSG_INFO,"%s: %s\n",
+				filename_pid, strerror (errno));
+		exit(ERROR_CREATE_FILE);
 	}
-	else
-		cardthreadparams.thread_running=0;
-
-
-
-	/******************************************************/
-	//card tuned
-	/******************************************************/
-#ifndef DISABLE_DVB_API
-	// the card is tuned, we catch signals to close cleanly
-	if (signal (SIGHUP, SignalHandler) == SIG_IGN)
-		signal (SIGHUP, SIG_IGN);
-	if (signal (SIGINT, SignalHandler) == SIG_IGN)
-		signal (SIGINT, SIG_IGN);
-	if (signal (SIGTERM, SignalHandler) == SIG_IGN)
-		signal (SIGTERM, SIG_IGN);
-	struct sigaction act;
-	act.sa_handler = SIG_IGN;
-	sigemptyset (&act.sa_mask);
-	act.sa_flags = 0;
-	if(sigaction (SIGPIPE, &act, NULL)<0)
-		log_message( log_module,  MSG_ERROR,"ErrorSigaction\n");
-#endif
-
-	//We record the starting time
-	gettimeofday (&tv, (struct timezone *) NULL);
-	real_start_time = tv.tv_sec;
-	now = 0;
-
-
-	if(stats_infos.show_traffic)
-		log_message( log_module, MSG_INFO,"The traffic will be shown every %d second%c\n",stats_infos.show_traffic_interval, stats_infos.show_traffic_interval > 1? 's':' ');
-
-
-
-	printf("%s %p\n", __func__,  &chan_p);
-	/******************************************************/
-	// Monitor Thread
-	/******************************************************/
-	monitor_parameters_t monitor_thread_params ={
-			.threadshutdown=0,
-			.wait_time=10,
-			.auto_p=&auto_p,
-			.sap_p=&sap_p,
-			.chan_p=&chan_p,
-			.multi_p=&multi_p,
-			.unicast_vars=&unic_p,
-			.tune_p=&tune_p,
-			.fds=&fds,
-			.stats_infos=&stats_infos,
-#ifdef ENABLE_SCAM_SUPPORT
-			.scam_vars_v=scam_vars_ptr,
-#endif
-			.server_id=server_id,
-			.filename_channels_not_streamed=filename_channels_not_streamed,
-			.filename_channels_streamed=filename_channels_streamed,
-	};
-
-	pthread_create(&monitorthread, NULL, monitor_func, &monitor_thread_params);
-
-
-	// HLS support
-    	hls_thread_parameters_t hls_thread_params ={
-                	.threadshutdown=0,
-                        .unicast_vars=&unic_p,
-                        .strengthparams=&strengthparams,
-    	};
+	fprintf (pidfile, "%d\n", getpid());
+	fclose (pidfile);
+}
 
-	if(unic_p.hls)
-	{
-		if (hls_start(&unic_p)) {
-			log_message( log_module,  MSG_ERROR, "HLS functions failed to inilialize!\n");
-			goto mumudvb_close_goto;
-		}
-    		pthread_create(&hlsthread, NULL, hls_periodic_task, &hls_thread_params);
-	}
+/** @brief Start the CAM support, the autoconfiguration and the rewriting of an adapter, initialize its channels and filters
+ */
+static int adapter_start(mumudvb_adapter_t *adapter)
+{
+	mumu_chan_p_t *chan_p=&adapter->chan_p;
+	tune_p_t *tune_p=&adapter->tune_p;
+	int ichan, ipid, iRet;
+	/** List of mandatory pids */
+	uint8_t mandatory_pid[MAX_MANDATORY_PID_NUMBER];
 
 	/*****************************************************/
 	//scam_support
 	/*****************************************************/
 
 #ifdef ENABLE_SCAM_SUPPORT
-	if(scam_vars.scam_support){
-		if(scam_getcw_start(scam_vars_ptr, &chan_p))
+	if(adapter->scam_vars.scam_support){
+		if(scam_getcw_start(adapter->scam_vars_ptr, chan_p))
 		{
 			log_message("SCAM_GETCW: ", MSG_ERROR,"Cannot initialize scam");
-			scam_vars.scam_support=0;
+			adapter->scam_vars.scam_support=0;
 		}
 		else
 		{
 			//If the scam is properly initialized, we autoconfigure scrambled channels
-			auto_p.autoconf_scrambled=1;
+			adapter->auto_p.autoconf_scrambled=1;
 		}
 	}
 #endif
@@ -1125,17 +1015,17 @@ int main (int argc, char **argv)
 	/*****************************************************/
 
 #ifdef ENABLE_CAM_SUPPORT
-	if(cam_p.cam_support){
+	if(adapter->cam_p.cam_support){
 		//We initialize the cam. If fail, we remove cam support
-		if(cam_start(&cam_p,tune_p.card,&chan_p))
+		if(cam_start(&adapter->cam_p,tune_p->card,chan_p))
 		{
 			log_message("CAM: ", MSG_ERROR,"Cannot initalise cam\n");
-			cam_p.cam_support=0;
+			adapter->cam_p.cam_support=0;
 		}
 		else
 		{
 			//If the cam is properly initialized, we autoconfigure scrambled channels
-			auto_p.autoconf_scrambled=1;
+			adapter->auto_p.autoconf_scrambled=1;
 		}
 	}
 #endif
@@ -1145,52 +1035,57 @@ int main (int argc, char **argv)
 	//memory allocation for MPEG2-TS
 	//packet structures
 	/*****************************************************/
-	iRet=autoconf_init(&auto_p);
+	iRet=autoconf_init(&adapter->auto_p);
 	if(iRet)
 	{
 		set_interrupted(ERROR_GENERIC<<8);
-		goto mumudvb_close_goto;
+		return -1;
 	}
 
 #ifdef ENABLE_SCAM_SUPPORT
 	/*****************************************************/
 	//scam
 	/*****************************************************/
-	if (auto_p.autoconfiguration==AUTOCONF_MODE_NONE)
-		scam_init_no_autoconf(scam_vars_ptr, chan_p.channels,chan_p.number_of_channels);
+	if (adapter->auto_p.autoconfiguration==AUTOCONF_MODE_NONE)
+		scam_init_no_autoconf(adapter->scam_vars_ptr, chan_p->channels,chan_p->number_of_channels);
 
 #endif
 	/*****************************************************/
 	//Rewriting initialization and allocation
 	/*****************************************************/
-	if(rewrite_init(&rewrite_vars))
-		goto mumudvb_close_goto;
+	if(rewrite_init(&adapter->rewrite_vars))
+		return -1;
+	if(adapter->rewrite_vars.full_eit)
+		adapter->strengthparams.eit_cache=&adapter->rewrite_vars.eit_cache;
 	/*****************************************************/
 	//Some initializations
 	/*****************************************************/
-	if(multi_p.rtp_header)
-		multi_p.num_pack=(MAX_UDP_SIZE-TS_PACKET_SIZE)/TS_PACKET_SIZE;
+	if(adapter->multi_p.rtp_header)
+		adapter->multi_p.num_pack=(MAX_UDP_SIZE-TS_PACKET_SIZE)/TS_PACKET_SIZE;
 	else
-		multi_p.num_pack=(MAX_UDP_SIZE)/TS_PACKET_SIZE;
+		adapter->multi_p.num_pack=(MAX_UDP_SIZE)/TS_PACKET_SIZE;
 
 
+	//We restore the services of the previous run to stream them without waiting for the tables
+	autoconf_cache_load(&adapter->auto_p, chan_p, tune_p);
+
 	// initialization of active channels list
-	pthread_mutex_lock(&chan_p.lock);
-	for (ichan = 0; ichan < chan_p.number_of_channels; ichan++)
+	pthread_mutex_lock(&chan_p->lock);
+	for (ichan = 0; ichan < chan_p->number_of_channels; ichan++)
 	{
-		if(mumu_init_chan(&chan_p.channels[ichan])<0)
+		if(mumu_init_chan(&chan_p->channels[ichan])<0)
 		{
-			pthread_mutex_unlock(&chan_p.lock);
-			goto mumudvb_close_goto;
+			pthread_mutex_unlock(&chan_p->lock);
+			return -1;
 		}
 	}
-	pthread_mutex_unlock(&chan_p.lock);
+	pthread_mutex_unlock(&chan_p->lock);
 	//We initialize asked PID table
-	memset (chan_p.asked_pid, 0, sizeof( uint8_t)*8193);//we clear it
+	memset (chan_p->asked_pid, 0, sizeof( uint8_t)*8193);//we clear it
 
 	// We initialize the table for checking the TS discontinuities
 	for (ipid = 0; ipid < 8193; ipid++)
-		chan_p.continuity_counter_pid[ipid]=-1;
+		chan_p->continuity_counter_pid[ipid]=-1;
 
 	//We initialize mandatory PID table
 	memset (mandatory_pid, 0, sizeof( uint8_t)*MAX_MANDATORY_PID_NUMBER);//we clear it
@@ -1215,612 +1110,1098 @@ int main (int argc, char **argv)
 	mandatory_pid[20]=1;
 	for (ipid = 0; ipid < 21; ipid++)
 		if(mandatory_pid[ipid])
-			chan_p.asked_pid[ipid]=PID_ASKED;
+			chan_p->asked_pid[ipid]=PID_ASKED;
 
 	//PSIP : Program and System Information Protocol
 	//Specific to ATSC, this is more or less the equivalent of sdt plus other stuff
-	if(tune_p.fe_type==FE_ATSC)
-		chan_p.asked_pid[PSIP_PID]=PID_ASKED;
+	if(tune_p->fe_type==FE_ATSC)
+		chan_p->asked_pid[PSIP_PID]=PID_ASKED;
+
+	//These PIDs are routed to all the channels
+	memset (chan_p->pid_route_all, 0, sizeof(chan_p->pid_route_all));
+	for (ipid = 0; ipid < MAX_MANDATORY_PID_NUMBER; ipid++)
+		chan_p->pid_route_all[ipid]=mandatory_pid[ipid];
+	if(tune_p->fe_type==FE_ATSC)
+		chan_p->pid_route_all[PSIP_PID]=1;
 
 	/*****************************************************/
 	//Set the filters
 	/*****************************************************/
-	update_chan_filters(&chan_p, tune_p.card_dev_path, tune_p.tuner, &fds);
+	update_chan_filters(chan_p, tune_p->card_dev_path, tune_p->tuner, &adapter->fds);
+	//The main loop reads the routing table without lock
+	adapter->route_reader = chan_route_register_reader(chan_p);
 
 	//We take care of the poll descriptors
-	fds.pfds=NULL;
-	fds.pfdsnum=1;
+	adapter->fds.pfds=NULL;
+	adapter->fds.pfdsnum=1;
 	//+1 for closing the pfd list, see man poll
-	fds.pfds=realloc(fds.pfds,(fds.pfdsnum+1)*sizeof(struct pollfd));
-	if (fds.pfds==NULL)
-	{
-		log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
-		set_interrupted(ERROR_MEMORY<<8);
-		goto mumudvb_close_goto;
-	}
-
-	//We fill the file descriptor information structure. the first one is irrelevant
-	unic_p.fd_info=NULL;
-	unic_p.fd_info=realloc(unic_p.fd_info,(fds.pfdsnum)*sizeof(unicast_fd_info_t));
-	if (unic_p.fd_info==NULL)
+	adapter->fds.pfds=realloc(adapter->fds.pfds,(adapter->fds.pfdsnum+1)*sizeof(struct pollfd));
+	if (adapter->fds.pfds==NULL)
 	{
 		log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
 		set_interrupted(ERROR_MEMORY<<8);
-		goto mumudvb_close_goto;
+		return -1;
 	}
 
 #ifndef _WIN32
 	//File descriptor for polling the DVB card
-	fds.pfds[0].fd = fds.fd_dvr;
+	adapter->fds.pfds[0].fd = adapter->fds.fd_dvr;
 	//POLLIN : data available for read
-	fds.pfds[0].events = POLLIN | POLLPRI;
-	fds.pfds[0].revents = 0;
-	fds.pfds[1].fd = 0;
-	fds.pfds[1].events = POLLIN | POLLPRI;
-	fds.pfds[1].revents = 0;
+	adapter->fds.pfds[0].events = POLLIN | POLLPRI;
+	adapter->fds.pfds[0].revents = 0;
+	adapter->fds.pfds[1].fd = 0;
+	adapter->fds.pfds[1].events = POLLIN | POLLPRI;
+	adapter->fds.pfds[1].revents = 0;
 #endif
+	return 0;
+}
 
-	/*****************************************************/
-	// Init network, we open the sockets
-	/*****************************************************/
-	//We open the socket for the http unicast if needed and we update the poll structure
-	if(unic_p.unicast)
+/** @brief Allocate the reading buffers of an adapter, start the card reading thread if asked
+ */
+static void adapter_alloc_buffers(mumudvb_adapter_t *adapter)
+{
+	card_buffer_t *card_buffer=&adapter->card_buffer;
+	int read_packets;
+
+	//The packets come from the input of another adapter, we only need the T2-MI output buffer
+	if(adapter->t2mi_input)
 	{
-		log_message("Unicast: ", MSG_INFO,"We open the Master http socket for address %s:%d\n",unic_p.ipOut, unic_p.portOut);
-		unicast_create_listening_socket(UNICAST_MASTER, -1, unic_p.ipOut, unic_p.portOut, &unic_p.socketIn, &unic_p);
+		card_buffer=&adapter->t2mi_input->card_buffer;
+		read_packets=card_buffer->dvr_buffer_auto ? card_buffer->dvr_buffer_max : card_buffer->dvr_buffer_size;
+		if(t2mi_plp_alloc(&adapter->t2mi, TS_PACKET_SIZE*read_packets*2))
+			exit(ERROR_MEMORY);
+		return;
 	}
-	update_chan_net(&chan_p, &auto_p, &multi_p, &unic_p, server_id, tune_p.card, tune_p.tuner);
-
-
-
+#ifndef _WIN32
+	//We try to read the packets directly from the driver buffers, not with the reading thread
+	if(card_buffer->dvr_mmap && card_buffer->threaded_read)
+		log_message( log_module,  MSG_INFO, "The DVR mmap API is not used with dvr_thread\n");
+	else if(card_buffer->dvr_mmap && adapter->fds.fd_source == 0)
+		card_mmap_init(adapter->fds.fd_dvr, card_buffer);
+	if(adapter->fds.fd_source == 0)
+		card_buffer_auto_init(adapter->fds.fd_dvr, card_buffer);
+#endif
+	//The read size can grow up to dvr_buffer_max with dvr_buffer_auto
+	read_packets=card_buffer->dvr_buffer_auto ? card_buffer->dvr_buffer_max : card_buffer->dvr_buffer_size;
 
+	//Thread for reading from the DVB card RUNNING
+	if(card_buffer->threaded_read)
+	{
+		//The ring holds max_thread_buffer_size packets, by reads
+		if(dvr_ring_init(&card_buffer->ring, read_packets, card_buffer->max_thread_buffer_size))
+			exit(ERROR_MEMORY);
+		pthread_create(&(adapter->cardthread), NULL, read_card_thread_func, &adapter->cardthreadparams);
+	}
+	//We alloc the buffer, with mmap or the reading thread the reading buffer is given by the read
+	else if(!card_buffer->mmap_num_buffers)
+		card_buffer->reading_buffer=malloc(sizeof(unsigned char)*TS_PACKET_SIZE*read_packets);
+	//The T2-MI buffer holds at least one T2-MI frame
+	if (adapter->chan_p.t2mi_pid > 0 && t2mi_plp_alloc(&adapter->t2mi, TS_PACKET_SIZE*read_packets*2))
+		exit(ERROR_MEMORY);
+}
 
-	/*****************************************************/
-	// init sap
-	/*****************************************************/
+/** @brief Send the packets read from an adapter to its channels
+ */
+static void adapter_process_packets(mumudvb_adapter_t *adapter, unicast_parameters_t *unic_p, int server_id, dump_t *dump)
+{
+	mumu_chan_p_t *chan_p=&adapter->chan_p;
+	card_buffer_t *card_buffer=&adapter->card_buffer;
+	stats_infos_t *stats_infos=&adapter->stats_infos;
+	//MPEG2-TS reception and sort
+	int pid;			/** pid of the current mpeg2 packet */
+	int ScramblingControl;
+	int continuity_counter;
+	int ichan;
+	int iRet;
+	/**Buffer containing one packet*/
+	unsigned char *actual_ts_packet;
+	/**The packets we process : the input or the packets of our PLP*/
+	unsigned char *ts_buffer=card_buffer->reading_buffer;
+	int ipacket;
 
-	iRet=init_sap(&sap_p, multi_p);
-	if(iRet)
+	if(card_buffer->dvr_buffer_size!=1 && stats_infos->show_buffer_stats)
 	{
-		set_interrupted(ERROR_GENERIC<<8);
-		goto mumudvb_close_goto;
+		stats_infos->stats_num_packets_received+=(int) card_buffer->bytes_read/TS_PACKET_SIZE;
+		stats_infos->stats_num_reads++;
 	}
 
-	/*****************************************************/
-	// Information about streamed channels
-	/*****************************************************/
+	/* the packets of our PLP were extracted from the input by t2mi_demux_process */
+	if (chan_p->t2mi_pid > 0 && card_buffer->bytes_read > 0) {
+		/* we got no data from demux */
+		if (adapter->t2mi.bytes == 0) {
+		    card_buffer->bytes_read = 0;
+		    return;
+		}
 
-	if(auto_p.autoconfiguration==AUTOCONF_MODE_NONE)
-		log_streamed_channels(log_module,
-				chan_p.number_of_channels,
-				chan_p.channels,
-				multi_p.multicast_ipv4,
-				multi_p.multicast_ipv6,
-				unic_p.unicast,
-				unic_p.portOut,
-				unic_p.ipOut);
+		card_buffer->bytes_read = adapter->t2mi.bytes;
+		ts_buffer = adapter->t2mi.buffer;
 
-	if(auto_p.autoconfiguration)
-		log_message("Autoconf: ",MSG_INFO,"Autoconfiguration is now ready to work for you !");
+		/* if buffer is damaged, reset demux (we check the first packets) */
+		for (ipacket = 0; ipacket < 4 && (unsigned int)(ipacket * TS_PACKET_SIZE) < adapter->t2mi.bytes; ipacket++)
+			if (ts_buffer[TS_PACKET_SIZE * ipacket] != TS_SYNC_BYTE)
+				break;
+		if (ipacket < 4 && (unsigned int)(ipacket * TS_PACKET_SIZE) < adapter->t2mi.bytes) {
 
+	    	    log_message( log_module, MSG_INFO,"T2-MI: PLP %d buffer out of sync: packet %d starts with %02x\n",
+	    		adapter->t2mi.plp, ipacket, ts_buffer[TS_PACKET_SIZE * ipacket]);
 
-	//Thread for reading from the DVB card RUNNING
-	if(card_buffer.threaded_read)
-	{
-		pthread_create(&(cardthread), NULL, read_card_thread_func, &cardthreadparams);
-		//We alloc the buffers
-		card_buffer.write_buffer_size=card_buffer.max_thread_buffer_size*TS_PACKET_SIZE;
-		card_buffer.buffer1=malloc(sizeof(unsigned char)*card_buffer.write_buffer_size);
-		card_buffer.buffer2=malloc(sizeof(unsigned char)*card_buffer.write_buffer_size);
-		card_buffer.actual_read_buffer=1;
-		card_buffer.reading_buffer=card_buffer.buffer1;
-		card_buffer.writing_buffer=card_buffer.buffer2;
-		cardthreadparams.main_waiting=0;
-		if (chan_p.t2mi_pid > 0) {
-		    if (card_buffer.write_buffer_size < TS_PACKET_SIZE*349) {
-			t2mi_buf_size = sizeof(unsigned char)*TS_PACKET_SIZE*349; /* we must hold at least one t2mi frame! */
-		    } else {
-			t2mi_buf_size = sizeof(unsigned char)*card_buffer.write_buffer_size*2;
-		    }
-		    card_buffer.t2mi_buffer=malloc(t2mi_buf_size);
-		}
-
-	}else
-	{
-		//We alloc the buffer
-		card_buffer.reading_buffer=malloc(sizeof(unsigned char)*TS_PACKET_SIZE*card_buffer.dvr_buffer_size);
-		if (chan_p.t2mi_pid > 0) {
-		    if (card_buffer.dvr_buffer_size < 349) {
-			t2mi_buf_size = sizeof(unsigned char)*TS_PACKET_SIZE*349; /* we must hold at least one t2mi frame! */
-		    } else {
-			t2mi_buf_size = sizeof(unsigned char)*TS_PACKET_SIZE*card_buffer.dvr_buffer_size*2;
-		    }
-		    card_buffer.t2mi_buffer=malloc(t2mi_buf_size);
+	    	    t2mi_plp_reset(&adapter->t2mi);
+	    	    card_buffer->bytes_read = 0;
+	    	    return;
 		}
 	}
 
-
-	/******************************************************/
-	//We open the dump file if any
-	/******************************************************/
-	dump_file = NULL;
-	if(dump_filename)
-	{
-		dump_file = fopen (dump_filename, "w");
-		if (dump_file == NULL)
-		{
-			log_message( log_module,  MSG_ERROR, "%s: %s\n",
-					dump_filename, strerror (errno));
-			free(dump_filename);
-		}
-	}
-#if !defined(ANDROID) && !defined(_WIN32)
-	mlockall(MCL_CURRENT | MCL_FUTURE);
+#ifdef ENABLE_BENCHMARK
+	//One batch out of BENCHMARK_SAMPLE_INTERVAL is timed packet by packet
+	int bench_sample=benchmark_params.duration && adapter->benchmark.sample;
+	uint64_t bench_time=0;
+	if(bench_sample)
+		bench_time=benchmark_now_ns();
 #endif
-	/******************************************************/
-	//Main loop where we get the packets and send them
-	/******************************************************/
-	int poll_ret;
-	/**Buffer containing one packet*/
-	unsigned char *actual_ts_packet;
-	/**We must get a little bit special for PMT rewrite*/
-	unsigned char pmt_ts_packet[TS_PACKET_SIZE];
-	while (!get_interrupted())
+	//If the user asked to dump the streams, the packets are given to the dump thread
+	if(dump)
+		dump_packets(dump, ts_buffer, card_buffer->bytes_read);
+	//We don't hold any routing table between two batches
+	chan_route_quiescent(chan_p, adapter->route_reader);
+	demux_batch_start(&adapter->demux_p, ts_buffer,
+			card_buffer->bytes_read/TS_PACKET_SIZE);
+
+	for(card_buffer->read_buff_pos=0;
+			(card_buffer->read_buff_pos+TS_PACKET_SIZE)<=card_buffer->bytes_read;
+			card_buffer->read_buff_pos+=TS_PACKET_SIZE)//we loop on the subpackets
 	{
-		if(card_buffer.threaded_read)
-		{
-			if(!card_buffer.bytes_in_write_buffer)
-			{
-				pthread_mutex_lock(&cardthreadparams.carddatamutex);
-				cardthreadparams.main_waiting=1;
-				pthread_cond_wait(&cardthreadparams.threadcond,&cardthreadparams.carddatamutex);
-				cardthreadparams.main_waiting=0;
-			}
-			else
-				pthread_mutex_lock(&cardthreadparams.carddatamutex);
+		actual_ts_packet=ts_buffer+card_buffer->read_buff_pos;
 
-			if(card_buffer.bytes_in_write_buffer)
-			{
-				if(card_buffer.actual_read_buffer==1)
-				{
-					card_buffer.reading_buffer=card_buffer.buffer2;
-					card_buffer.writing_buffer=card_buffer.buffer1;
-					card_buffer.actual_read_buffer=2;
-				}
-				else
-				{
-					card_buffer.reading_buffer=card_buffer.buffer1;
-					card_buffer.writing_buffer=card_buffer.buffer2;
-					card_buffer.actual_read_buffer=1;
-				}
-				card_buffer.bytes_read=card_buffer.bytes_in_write_buffer;
-				card_buffer.bytes_in_write_buffer=0;
-			}
-			pthread_mutex_unlock(&cardthreadparams.carddatamutex);
-			/**************************************************************/
-			/* UNICAST HTTP                                               */
-			/**************************************************************/
-			if(unic_p.pfdsnum)
-			{
-				if(mumudvb_poll(unic_p.pfds,unic_p.pfdsnum,0)>0)
-				{
-					iRet=unicast_handle_fd_event(&unic_p, chan_p.channels, chan_p.number_of_channels, &strengthparams, &auto_p, cam_p_ptr, scam_vars_ptr, rewrite_vars.eit_packets);
-					if(iRet)
-					{
-						log_message( log_module,  MSG_ERROR, "unicast fd error %d", iRet);
-						set_interrupted(iRet);
-					}
-				}
-			}
-			/**************************************************************/
-			/* END OF UNICAST HTTP                                        */
-			/**************************************************************/
-		}
-		else
+		/* check for sync byte and transport error bit if requested */
+		if (((actual_ts_packet[0] != TS_SYNC_BYTE) || (actual_ts_packet[1] & 0x80) == 0x80))
 		{
-			/* Poll the open file descriptors : we wait for data*/
-			if (fds.fd_source == 0) {
-#ifndef _WIN32
-				poll_ret = mumudvb_poll(fds.pfds, fds.pfdsnum, DVB_POLL_TIMEOUT);
-#else
-				poll_ret = dvb_poll(fds.fd_dvr, DVB_POLL_TIMEOUT);
-#endif
-			} else {
-				/* TODO poll this if needed */
-				poll_ret = 0;
-			}
-
-			if (poll_ret < 0) {
-				log_message(log_module, MSG_ERROR, "Poll error %d", poll_ret);
-				set_interrupted(poll_ret);
-				continue;
-			}
-
-			/**************************************************************/
-			/* UNICAST HTTP                                               */
-			/**************************************************************/
-			if(unic_p.pfdsnum)
-			{
-				poll_ret=mumudvb_poll(unic_p.pfds,unic_p.pfdsnum,0);
-				if(poll_ret>0)
-				{
-					iRet=unicast_handle_fd_event(&unic_p, chan_p.channels, chan_p.number_of_channels, &strengthparams, &auto_p, cam_p_ptr, scam_vars_ptr,rewrite_vars.eit_packets);
-					if(iRet)
-					{
-						log_message( log_module,  MSG_ERROR, "unicast fd error %d", iRet);
-						set_interrupted(iRet);
-					}
-				}
-			}
-			/**************************************************************/
-			/* END OF UNICAST HTTP                                        */
-			/**************************************************************/
-			if (fds.fd_source > 0) {
-				/* UDP receive */
-				int len = TS_PACKET_SIZE * card_buffer.dvr_buffer_size;
-
-				card_buffer.bytes_read = recvfrom(fds.fd_source, card_buffer.reading_buffer, len, 0, NULL, NULL);
-			} else {
-				if ((card_buffer.bytes_read = card_read(fds.fd_dvr, card_buffer.reading_buffer, &card_buffer)) == 0)
-					continue;
-			}
+			log_message( log_module, MSG_FLOOD,"Error bit set or no sync in TS packet!\n");
+			// Test if we discard the packets with error bit set
+			if (chan_p->filter_transport_error>0) continue;
 		}
 
-		if(card_buffer.dvr_buffer_size!=1 && stats_infos.show_buffer_stats)
+		// Get the PID of the received TS packet
+		pid = ((actual_ts_packet[1] & 0x1f) << 8) | (actual_ts_packet[2]);
+
+		// Check the continuity
+		if(chan_p->check_cc)
 		{
-			stats_infos.stats_num_packets_received+=(int) card_buffer.bytes_read/TS_PACKET_SIZE;
-			stats_infos.stats_num_reads++;
+			continuity_counter=actual_ts_packet[3] & 0x0f;
+			if (chan_p->continuity_counter_pid[pid]!=-1 && chan_p->continuity_counter_pid[pid]!=continuity_counter && ((chan_p->continuity_counter_pid[pid]+1) & 0x0f)!=continuity_counter)
+				adapter->strengthparams.ts_discontinuities++;
+			chan_p->continuity_counter_pid[pid]=continuity_counter;
 		}
 
-		if (chan_p.t2mi_pid > 0 && card_buffer.bytes_read > 0) {
-			int processed = 0;
-			int errorcounter = 0;
+		//Software filtering in case the card doesn't have hardware filtering
+		if(chan_p->asked_pid[8192]==PID_NOT_ASKED && chan_p->asked_pid[pid]==PID_NOT_ASKED && chan_p->t2mi_pid == 0)
+			continue;
 
-			for(card_buffer.read_buff_pos=0;
-			    (card_buffer.read_buff_pos+TS_PACKET_SIZE)<=card_buffer.bytes_read;
-			    card_buffer.read_buff_pos+=TS_PACKET_SIZE)//we loop on the subpackets
+		ScramblingControl = (actual_ts_packet[3] & 0xc0) >> 6;
+		/* 0 = Not scrambled
+         1 = Reserved for future use
+         2 = Scrambled with even key
+         3 = Scrambled with odd key*/
+		/******************************************************/
+		//   PMT UPDATE PART: Autoconf, CAM, SCAM
+		/******************************************************/
+		chan_new_pmt(actual_ts_packet, chan_p, pid);
+		/******************************************************/
+		//   PMT UPDATE PART FINISHED
+		/******************************************************/
+
+		/******************************************************/
+		//   AUTOCONFIGURATION PART
+		/******************************************************/
+		if(!ScramblingControl &&  adapter->auto_p.autoconfiguration)
+		{
+			iRet = autoconf_new_packet(pid, actual_ts_packet, &adapter->auto_p,  &adapter->fds, chan_p, &adapter->tune_p, &adapter->multi_p, unic_p, server_id, adapter->scam_vars_ptr);
+			if(iRet)
 			{
-			    /* check for sync byte and transport error bit if requested */
-			    if((card_buffer.reading_buffer[card_buffer.read_buff_pos] != TS_SYNC_BYTE ||
-				(card_buffer.reading_buffer[card_buffer.read_buff_pos+1] & 0x80) == 0x80) &&
-				chan_p.filter_transport_error > 0)
-			    {
-        			log_message(log_module, MSG_FLOOD, "T2-MI: input TS packet damaged, buf offset %d\n", card_buffer.read_buff_pos);
-        			errorcounter++;
-				continue;
-			    }
-			    /* target t2mi stream pid */
-                    	    if(chan_p.t2mi_pid != (((card_buffer.reading_buffer[card_buffer.read_buff_pos+1] & 0x1f) << 8) | (card_buffer.reading_buffer[card_buffer.read_buff_pos+2]))) {
-                                continue;
-                    	    }
-                    	    processed += processt2(card_buffer.reading_buffer, card_buffer.read_buff_pos, card_buffer.t2mi_buffer, t2_partial_size + processed, t2mi_buf_size, chan_p.t2mi_plp);
-    			}
-
-			/* in case we got too much errors */
-			if (errorcounter * 100 > card_buffer.dvr_buffer_size * 50) {
-		    	    log_message(log_module, MSG_DEBUG,"T2-MI: too many errors in input buffer (%d/%d)\n", errorcounter, card_buffer.dvr_buffer_size);
-
-		    	    t2_partial_size=0;
-			    card_buffer.bytes_read=0;
-
-		    	    t2mi_active=false;
-			    t2mi_first=true;
-		    	    continue;
+				log_message( log_module,  MSG_ERROR, "Autoconf error %d", iRet);
+				set_interrupted(iRet);
 			}
+		}
 
-			/* we got no data from demux */
-			if (processed + t2_partial_size == 0) {
-			    card_buffer.bytes_read = 0;
-			    continue;
-			}
+		/******************************************************/
+		//   AUTOCONFIGURATION PART FINISHED
+		/******************************************************/
 
-			card_buffer.bytes_read = processed + t2_partial_size;
-		    	t2_partial_size=0;
-
-			/* if buffer is damaged, reset demux */
-			if (!((card_buffer.t2mi_buffer[TS_PACKET_SIZE * 0] == TS_SYNC_BYTE) &&
-			      (card_buffer.t2mi_buffer[TS_PACKET_SIZE * 1] == TS_SYNC_BYTE) &&
-			      (card_buffer.t2mi_buffer[TS_PACKET_SIZE * 2] == TS_SYNC_BYTE) &&
-			      (card_buffer.t2mi_buffer[TS_PACKET_SIZE * 3] == TS_SYNC_BYTE)) ) {
-
-		    	    log_message( log_module, MSG_INFO,"T2-MI: buffer out of sync: %02x, %02x, %02x, %02x\n",
-		    		card_buffer.t2mi_buffer[TS_PACKET_SIZE * 0],
-		    		card_buffer.t2mi_buffer[TS_PACKET_SIZE * 1],
-		    		card_buffer.t2mi_buffer[TS_PACKET_SIZE * 2],
-		    		card_buffer.t2mi_buffer[TS_PACKET_SIZE * 3]
-		    	    );
-
-		    	    t2mi_active=false;
-			    t2mi_first=true;
-		    	    continue;
-			}
+		/******************************************************/
+		//Pat rewrite
+		/******************************************************/
+		if( (pid == 0) && //This is a PAT PID
+				adapter->rewrite_vars.rewrite_pat == OPTION_ON ) //AND we asked for rewrite
+		{
+			pat_rewrite_new_global_packet(actual_ts_packet, &adapter->rewrite_vars);
 		}
-
-		for(card_buffer.read_buff_pos=0;
-				(card_buffer.read_buff_pos+TS_PACKET_SIZE)<=card_buffer.bytes_read;
-				card_buffer.read_buff_pos+=TS_PACKET_SIZE)//we loop on the subpackets
+		/******************************************************/
+		//SDT rewrite
+		/******************************************************/
+		if( (pid == 17) && //This is a SDT PID
+				adapter->rewrite_vars.rewrite_sdt == OPTION_ON ) //AND we asked for rewrite
 		{
-			if (chan_p.t2mi_pid > 0) {
-			    actual_ts_packet=card_buffer.t2mi_buffer+card_buffer.read_buff_pos;
-			} else {
-			    actual_ts_packet=card_buffer.reading_buffer+card_buffer.read_buff_pos;
-			}
-
-			//If the user asked to dump the streams it's here that it should be done
-			if(dump_file)
-				if(fwrite(actual_ts_packet,sizeof(unsigned char),TS_PACKET_SIZE,dump_file)<TS_PACKET_SIZE)
-					log_message( log_module,MSG_WARN,"Error while writing the dump : %s", strerror(errno));
-
-			/* check for sync byte and transport error bit if requested */
-			if (((actual_ts_packet[0] != TS_SYNC_BYTE) || (actual_ts_packet[1] & 0x80) == 0x80))
+			//we check the new packet and if it's fully updated we set the skip to 0
+			if(sdt_rewrite_new_global_packet(actual_ts_packet, &adapter->rewrite_vars)==1)
 			{
-				log_message( log_module, MSG_FLOOD,"Error bit set or no sync in TS packet!\n");
-				// Test if we discard the packets with error bit set
-				if (chan_p.filter_transport_error>0) continue;
+				log_message( log_module, MSG_DETAIL,"The SDT version changed, we force the update of all the channels.\n");
+				for (ichan = 0; ichan < chan_p->number_of_channels; ichan++)
+					chan_p->channels[ichan].sdt_rewrite_skip=0; //no lock needed, accessed only by main thread
 			}
+		}
+		/******************************************************/
+		//EIT rewrite
+		/******************************************************/
+		if( (pid == 18) && //This is an EIT PID
+				(adapter->rewrite_vars.rewrite_eit == OPTION_ON || //AND we asked for rewrite
+						adapter->rewrite_vars.store_eit == OPTION_ON )) //OR to store it
+		{
+			eit_rewrite_new_global_packet(actual_ts_packet, &adapter->rewrite_vars);
+		}
 
-			// Get the PID of the received TS packet
-			pid = ((actual_ts_packet[1] & 0x1f) << 8) | (actual_ts_packet[2]);
-
-			// Check the continuity
-			if(chan_p.check_cc)
-			{
-				continuity_counter=actual_ts_packet[3] & 0x0f;
-				if (chan_p.continuity_counter_pid[pid]!=-1 && chan_p.continuity_counter_pid[pid]!=continuity_counter && ((chan_p.continuity_counter_pid[pid]+1) & 0x0f)!=continuity_counter)
-					strengthparams.ts_discontinuities++;
-				chan_p.continuity_counter_pid[pid]=continuity_counter;
-			}
 
-			//Software filtering in case the card doesn't have hardware filtering
-			if(chan_p.asked_pid[8192]==PID_NOT_ASKED && chan_p.asked_pid[pid]==PID_NOT_ASKED && chan_p.t2mi_pid == 0)
-				continue;
+		/******************************************************/
+		//for each channel we'll look if we must send this PID
+		/******************************************************/
+#ifdef ENABLE_BENCHMARK
+		if(bench_sample)
+		{
+			uint64_t channels_start=benchmark_now_ns();
+			demux_new_packet(&adapter->demux_p, card_buffer->read_buff_pos/TS_PACKET_SIZE, actual_ts_packet, pid);
+			adapter->benchmark.sampled_channels_ns+=benchmark_now_ns()-channels_start;
+			continue;
+		}
+#endif
+		demux_new_packet(&adapter->demux_p, card_buffer->read_buff_pos/TS_PACKET_SIZE, actual_ts_packet, pid);
+	}
+#ifdef ENABLE_BENCHMARK
+	if(bench_sample)
+	{
+		adapter->benchmark.sampled_loop_ns+=benchmark_now_ns()-bench_time;
+		adapter->benchmark.sampled_packets+=card_buffer->bytes_read/TS_PACKET_SIZE;
+	}
+	if(benchmark_params.duration)
+		bench_time=benchmark_now_ns();
+#endif
+	//If we use several demux threads, they send the packets to the channels now
+	demux_batch_run(&adapter->demux_p);
+#ifdef ENABLE_BENCHMARK
+	if(benchmark_params.duration)
+		adapter->benchmark.batch_run_ns+=benchmark_now_ns()-bench_time;
+#endif
+	//The clients which had errors can be closed now
+	if(MU_LOAD_ACQUIRE(&unic_p->disconnect_pending))
+		unicast_close_disconnected(unic_p);
 
-			ScramblingControl = (actual_ts_packet[3] & 0xc0) >> 6;
-			/* 0 = Not scrambled
-         1 = Reserved for future use
-         2 = Scrambled with even key
-         3 = Scrambled with odd key*/
-			/******************************************************/
-			//   PMT UPDATE PART: Autoconf, CAM, SCAM
-			/******************************************************/
-			chan_new_pmt(actual_ts_packet, &chan_p, pid);
-			/******************************************************/
-			//   PMT UPDATE PART FINISHED
-			/******************************************************/
-
-			/******************************************************/
-			//   AUTOCONFIGURATION PART
-			/******************************************************/
-			if(!ScramblingControl &&  auto_p.autoconfiguration)
-			{
-				iRet = autoconf_new_packet(pid, actual_ts_packet, &auto_p,  &fds, &chan_p, &tune_p, &multi_p, &unic_p, server_id, scam_vars_ptr);
-				if(iRet)
-				{
-					log_message( log_module,  MSG_ERROR, "Autoconf error %d", iRet);
-					set_interrupted(iRet);
-				}
-			}
+}
 
-			/******************************************************/
-			//   AUTOCONFIGURATION PART FINISHED
-			/******************************************************/
+/** @brief Process the packets read from the input of an adapter
+ *
+ * The PLPs carried by the T2-MI streams of the input are extracted in one pass,
+ * then each adapter sharing this input processes the packets of its PLP.
+ * Only the packets of the first adapter are dumped.
+ */
+static void adapter_process_input(mumudvb_adapter_t *adapter, unicast_parameters_t *unic_p, int server_id, dump_t *dump)
+{
+	mumudvb_adapter_t *shared;
+	/* adapter_process_packets replaces the number of bytes read by the one of the PLP */
+	int input_bytes = adapter->card_buffer.bytes_read;
+
+	if (adapter->t2mi_demux.num_streams) {
+#ifdef ENABLE_BENCHMARK
+		uint64_t bench_time=0;
+		if(benchmark_params.duration)
+			bench_time=benchmark_now_ns();
+#endif
+		t2mi_demux_process(&adapter->t2mi_demux, adapter->card_buffer.reading_buffer,
+				adapter->card_buffer.bytes_read, adapter->chan_p.filter_transport_error);
+#ifdef ENABLE_BENCHMARK
+		if(benchmark_params.duration) {
+			adapter->benchmark.t2mi_ns+=benchmark_now_ns()-bench_time;
+			adapter->benchmark.t2mi_packets+=adapter->card_buffer.bytes_read/TS_PACKET_SIZE;
+		}
+#endif
+	}
+	adapter_process_packets(adapter, unic_p, server_id, dump);
+	for (shared = adapter->t2mi_next; shared; shared = shared->t2mi_next) {
+		shared->card_buffer.bytes_read = input_bytes;
+		adapter_process_packets(shared, unic_p, server_id, NULL);
+	}
+}
 
-			/******************************************************/
-			//Pat rewrite
-			/******************************************************/
-			if( (pid == 0) && //This is a PAT PID
-					rewrite_vars.rewrite_pat == OPTION_ON ) //AND we asked for rewrite
-			{
-				pat_rewrite_new_global_packet(actual_ts_packet, &rewrite_vars);
-			}
-			/******************************************************/
-			//SDT rewrite
-			/******************************************************/
-			if( (pid == 17) && //This is a SDT PID
-					rewrite_vars.rewrite_sdt == OPTION_ON ) //AND we asked for rewrite
-			{
-				//we check the new packet and if it's fully updated we set the skip to 0
-				if(sdt_rewrite_new_global_packet(actual_ts_packet, &rewrite_vars)==1)
-				{
-					log_message( log_module, MSG_DETAIL,"The SDT version changed, we force the update of all the channels.\n");
-					for (ichan = 0; ichan < chan_p.number_of_channels; ichan++)
-						chan_p.channels[ichan].sdt_rewrite_skip=0; //no lock needed, accessed only by main thread
-				}
-			}
-			/******************************************************/
-			//EIT rewrite
-			/******************************************************/
-			if( (pid == 18) && //This is an EIT PID
-					(rewrite_vars.rewrite_eit == OPTION_ON || //AND we asked for rewrite
-							rewrite_vars.store_eit == OPTION_ON )) //OR to store it
-			{
-				eit_rewrite_new_global_packet(actual_ts_packet, &rewrite_vars);
-			}
+/** @brief Read the packets from the input of an adapter (DVB card, file or UDP source)
+ * @return the number of bytes read, 0 if there is no new data
+ */
+static int adapter_read_input(mumudvb_adapter_t *adapter)
+{
+	card_buffer_t *card_buffer=&adapter->card_buffer;
 
+	if (adapter->fds.fd_source > 0) {
+		/* UDP receive, by batches of datagrams */
+		int len = TS_PACKET_SIZE * card_buffer->dvr_buffer_size;
 
-			/******************************************************/
-			//for each channel we'll look if we must send this PID
-			/******************************************************/
-			pthread_mutex_lock(&chan_p.lock);
-			for (ichan = 0; ichan < chan_p.number_of_channels; ichan++)
-			{
-				//We test if the channel is ready (manually configured or autoconf)
-				if(!(chan_p.channels[ichan].channel_ready>0))
-					continue;
+		card_buffer->bytes_read = udp_source_read(&adapter->udp_source, adapter->fds.fd_source, card_buffer->reading_buffer, len);
+		if (card_buffer->bytes_read < 0)
+			card_buffer->bytes_read = 0;
+	} else {
+#ifndef _WIN32
+		if (card_buffer->mmap_num_buffers)
+			card_buffer->bytes_read = card_read_mmap(adapter->fds.fd_dvr, card_buffer);
+		else
+#endif
+		card_buffer->bytes_read = card_read(adapter->fds.fd_dvr, card_buffer->reading_buffer, card_buffer);
+	}
+	return card_buffer->bytes_read;
+}
 
-				//we'll see if we must send this PID for this channel
-				send_packet=0;
+/** @brief Is there a read waiting in the ring of an adapter with a reading thread (dvr_thread) ?
+ */
+static int adapters_rings_used(mumudvb_adapter_t **adapters, int num_adapters)
+{
+	for (int iadapter = 0; iadapter < num_adapters; iadapter++)
+		if(adapters[iadapter]->cardthreadparams.thread_running && dvr_ring_used(&adapters[iadapter]->card_buffer.ring))
+			return 1;
+	return 0;
+}
 
-				//If it's a mandatory PID we send it
-				if((pid<MAX_MANDATORY_PID_NUMBER) && (mandatory_pid[pid]==1))
-					send_packet=1;
-				if ((pid == PSIP_PID) && (tune_p.fe_type==FE_ATSC))
-					send_packet=1;
+#ifdef ENABLE_BENCHMARK
+/** @brief Benchmark mode : read the input file (in a loop) and process the packets, measuring the time
+ */
+static void adapter_benchmark_read(mumudvb_adapter_t *adapter, unicast_parameters_t *unic_p, int server_id)
+{
+	benchmark_t *bench=&adapter->benchmark;
+	mumudvb_adapter_t *shared;
+	uint64_t start, read_end;
+
+	if (!bench->start_ns)
+		benchmark_start(bench);
+	start=benchmark_now_ns();
+	if (adapter_read_input(adapter) == 0) {
+		//End of the file, we start again
+		if (lseek(adapter->fds.fd_dvr, 0, SEEK_SET) == 0)
+			bench->loops++;
+		demux_flush_delayed(&adapter->demux_p);
+		return;
+	}
+	read_end=benchmark_now_ns();
+	bench->sample=!(bench->reads % BENCHMARK_SAMPLE_INTERVAL);
+	adapter_process_input(adapter, unic_p, server_id, NULL);
+	bench->read_ns+=read_end-start;
+	bench->process_ns+=benchmark_now_ns()-read_end;
+	bench->reads++;
+	bench->packets+=adapter->card_buffer.bytes_read/TS_PACKET_SIZE;
+	bench->bytes+=adapter->card_buffer.bytes_read;
+	//The adapters sharing our T2-MI input count the packets extracted for their PLP
+	for (shared = adapter->t2mi_next; shared; shared = shared->t2mi_next) {
+		shared->benchmark.start_ns=bench->start_ns;
+		shared->benchmark.reads++;
+		shared->benchmark.packets+=shared->card_buffer.bytes_read/TS_PACKET_SIZE;
+		shared->benchmark.bytes+=shared->card_buffer.bytes_read;
+	}
+}
+#endif
 
+int main (int argc, char **argv)
+{
+#ifdef _WIN32
+	WSADATA wsaData;
 
-				//if it isn't mandatory wee see if it is in the channel list
-				if(!send_packet)
-					for (ipid = 0; (ipid < chan_p.channels[ichan].pid_i.num_pids)&& !send_packet; ipid++)
-						if ((chan_p.channels[ichan].pid_i.pids[ipid] == pid) || (chan_p.channels[ichan].pid_i.pids[ipid] == 8192)) //We can stream whole transponder using 8192
-						{
-							send_packet=1;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		return -1;
+#endif
 
-						}
+	//Thread information
+	pthread_t monitorthread = pthread_self();
+	pthread_t hlsthread = pthread_self();
 
-				// Do not send TS padding pid (confuses scam)
-				if (pid == TS_PADDING_PID) {
-				    send_packet=0;
-				}
+	//sap announces variables
+	sap_p_t sap_p;
+	init_sap_v(&sap_p);
 
-				/******************************************************/
-				//cam support
-				// If we send the packet, we look if it's a cam pmt pid
-				/******************************************************/
-#ifdef ENABLE_CAM_SUPPORT
-				if((cam_p.cam_support && send_packet==1) &&  //no need to check packets we don't send
-						cam_p.ca_resource_connected &&
-						((now-cam_p.cam_pmt_send_time)>=cam_p.cam_interval_pmt_send ))
-				{
-					if(cam_new_packet(pid, ichan, &cam_p, &chan_p.channels[ichan]))
-						cam_p.cam_pmt_send_time=now; //A packet was sent to the CAM
-				}
+	//unicast
+	//Parameters for HTTP unicast
+	unicast_parameters_t unic_p;
+	init_unicast_v(&unic_p);
+
+	//The adapters, one per configuration file
+	mumudvb_adapter_t *adapters[MAX_ADAPTERS];
+	mumudvb_adapter_t *adapter;
+	int num_adapters;
+	int iadapter;
+	//What the shared HTTP server shows of each adapter
+	unicast_adapter_t unicast_adapters[MAX_ADAPTERS];
+	//Do the adapters have a reading thread (dvr_thread) ?
+	int threaded_read;
+	//The reading threads of all the adapters wake the main thread with this mutex and condition
+	pthread_mutex_t carddatamutex=PTHREAD_MUTEX_INITIALIZER;
+	pthread_cond_t threadcond=PTHREAD_COND_INITIALIZER;
+	int main_waiting=0;
+
+	hls_thread_parameters_t hls_thread_params;
+	memset(&hls_thread_params,0,sizeof(hls_thread_params));
+
+	int no_daemon = 0;
+
+	char filename_pid[DEFAULT_PATH_LEN]=PIDFILE_PATH;
+
+	int server_id = 0; /** The server id for the template %server */
+
+	int iRet;
+
+	struct timeval tv;
+
+	//files
+	char *conf_filenames[MAX_ADAPTERS];
+	int num_conf_files=0;
+	char *dump_filename = NULL;
+	dump_t *dump;
+
+
+	int listingcards=0;
+	//The first adapter gets the options of the command line
+	adapters[0]=adapter_new(0);
+	//Getopt
+	parse_cmd_line(argc,argv,
+			conf_filenames,
+			&num_conf_files,
+			&adapters[0]->tune_p,
+			&adapters[0]->stats_infos,
+			&server_id,
+			&no_daemon,
+			&dump_filename,
+			&listingcards);
+
+
+	//List the detected cards
+	if(listingcards)
+	{
+		print_info ();
+		list_dvb_cards ();
+		exit(0);
+	}
+
+#ifndef _WIN32
+	// DO NOT REMOVE (make MuMuDVB a deamon)
+	if(!no_daemon)
+		if(daemon(42,0))
+		{
+			log_message( log_module,  MSG_WARN, "Cannot daemonize: %s\n",
+					strerror (errno));
+			exit(666); //Right code for a bad daemon no ?
+		}
+
+	//If the user didn't defined a preferred logging way, and we daemonize, we set to syslog (except windows, where we don't, and log to console)
+	if (!no_daemon)
+	{
+		if(log_params.log_type==LOGGING_UNDEFINED)
+		{
+			openlog ("MUMUDVB", LOG_PID, 0);
+			log_params.log_type=LOGGING_SYSLOG;
+			log_params.syslog_initialised=1;
+		}
+	}
+#else
+	no_daemon = 1;
+	log_params.log_type = LOGGING_CONSOLE;
+	log_params.syslog_initialised = 1;
+#endif
+
+	//Display general information
+	print_info ();
+
+	//The CRC32 of the sections, we take the fastest engine which gives the right results
+	if(crc32_init())
+		log_message( log_module,  MSG_WARN, "A CRC32 engine gives wrong results on this CPU, it is not used\n");
+	log_message( log_module,  MSG_DEBUG, "CRC32 engine : %s\n", crc32_engine_name());
+
+	if (num_conf_files == 0)
+	{
+		log_message( log_module,  MSG_ERROR, "No configuration file specified");
+		exit(ERROR_CONF_FILE);
+	}
+#ifdef _WIN32
+	if (num_conf_files > 1)
+	{
+		log_message( log_module,  MSG_ERROR, "Only one configuration file (adapter) is supported on Windows");
+		exit(ERROR_ARGS);
+	}
+#endif
+
+	/******************************************************/
+	// adapters allocation
+	/******************************************************/
+	num_adapters=num_conf_files;
+	if(num_adapters>1)
+		log_message( log_module,  MSG_INFO, "%d configuration files, we serve %d adapters\n", num_adapters, num_adapters);
+	for (iadapter = 1; iadapter < num_adapters; iadapter++)
+	{
+		adapters[iadapter]=adapter_new(iadapter);
+		adapters[iadapter]->tune_p.display_strenght=adapters[0]->tune_p.display_strenght;
+		adapters[iadapter]->stats_infos.show_traffic=adapters[0]->stats_infos.show_traffic;
+	}
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		adapters[iadapter]->conf_filename=conf_filenames[iadapter];
+		//The memory of the channel table is only used by the channels the adapter really has
+		adapters[iadapter]->chan_p.channels=mumu_table_reserve(MAX_CHANNELS*sizeof(mumudvb_channel_t));
+		if(adapters[iadapter]->chan_p.channels==NULL)
+			exit(ERROR_MEMORY);
+		adapters[iadapter]->chan_p.first_channel=iadapter*MAX_CHANNELS;
+		unicast_adapters[iadapter]=(unicast_adapter_t){
+				.id=iadapter,
+				.chan_p=&adapters[iadapter]->chan_p,
+				.strengthparams=&adapters[iadapter]->strengthparams,
+				.auto_p=&adapters[iadapter]->auto_p,
+				.cam_p=adapters[iadapter]->cam_p_ptr,
+				.scam_vars=adapters[iadapter]->scam_vars_ptr,
+				.eit_packets=&adapters[iadapter]->rewrite_vars.eit_packets,
+		};
+	}
+	card_tuned=&adapters[0]->tune_p.card_tuned;
+
+	/******************************************************/
+	// config files reading
+	/******************************************************/
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		if(adapter_read_configuration(adapters[iadapter], &sap_p, &unic_p, &server_id, filename_pid))
+			exit(ERROR_CONF);
+	}
+	//The adapters extracting PLPs from the same input share it
+	if(adapters_t2mi_setup(adapters, num_adapters))
+		exit(ERROR_CONF);
+	//The main thread waits either for the reading threads or for the inputs, not for both
+	threaded_read=adapters[0]->card_buffer.threaded_read;
+	for (iadapter = 1; iadapter < num_adapters; iadapter++)
+	{
+		if(!adapters[iadapter]->t2mi_input && adapters[iadapter]->card_buffer.threaded_read!=threaded_read)
+		{
+			log_message( log_module,  MSG_ERROR, "dvr_thread must be set for all the adapters or for none of them\n");
+			exit(ERROR_CONF);
+		}
+	}
+#ifdef ENABLE_BENCHMARK
+	//The benchmark loops on input files
+	for (iadapter = 0; benchmark_params.duration && iadapter < num_adapters; iadapter++)
+	{
+		if(!strlen(adapters[iadapter]->tune_p.read_file_path) || adapters[iadapter]->card_buffer.threaded_read)
+		{
+			log_message( log_module,  MSG_ERROR, "The benchmark needs a file input (read_file_path) without dvr_thread\n");
+			exit(ERROR_CONF);
+		}
+	}
+#endif
+
+	/*************************************/
+	//End of configuration file reading
+	/*************************************/
+
+	char number[10];
+	//If we specified a string for the unicast port out, we parse it
+	if(unic_p.portOut_str!=NULL)
+	{
+		int len;
+		len=strlen(unic_p.portOut_str)+1;
+		sprintf(number,"%d",adapters[0]->tune_p.card);
+		unic_p.portOut_str=mumu_string_replace(unic_p.portOut_str,&len,1,"%card",number);
+		sprintf(number,"%d",adapters[0]->tune_p.tuner);
+		unic_p.portOut_str=mumu_string_replace(unic_p.portOut_str,&len,1,"%tuner",number);
+		sprintf(number,"%d",server_id);
+		unic_p.portOut_str=mumu_string_replace(unic_p.portOut_str,&len,1,"%server",number);
+		unic_p.portOut=string_comput(unic_p.portOut_str);
+		log_message( "Unicast: ", MSG_DEBUG, "computed unicast master port : %d\n",unic_p.portOut);
+	}
+
+	if(log_params.log_file_path!=NULL)
+	{
+		int len;
+		len=strlen(log_params.log_file_path)+1;
+		sprintf(number,"%d",adapters[0]->tune_p.card);
+		log_params.log_file_path=mumu_string_replace(log_params.log_file_path,&len,1,"%card",number);
+		sprintf(number,"%d",adapters[0]->tune_p.tuner);
+		log_params.log_file_path=mumu_string_replace(log_params.log_file_path,&len,1,"%tuner",number);
+		sprintf(number,"%d",server_id);
+		log_params.log_file_path=mumu_string_replace(log_params.log_file_path,&len,1,"%server",number);
+		log_params.log_file = fopen (log_params.log_file_path, "a");
+		if (log_params.log_file)
+			log_params.log_type |= LOGGING_FILE;
+		else
+			log_message(log_module,MSG_WARN,"Cannot open log file %s: %s\n", log_params.log_file_path, strerror (errno));
+	}
+	/******************************************************/
+	//end of config file reading
+	/******************************************************/
+
+	// Show in log that we are starting
+	log_message( log_module,  MSG_INFO,"========== End of configuration, MuMuDVB version %s is starting ==========",VERSION);
+
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		if(adapter_configure(adapters[iadapter], &sap_p, &unic_p))
+		{
+			set_interrupted(ERROR_CONF<<8);
+			goto mumudvb_close_goto;
+		}
+	}
+
+#ifndef DISABLE_DVB_API
+	/******************************************************/
+	// Card tuning
+	/******************************************************/
+	if (signal (SIGALRM, SignalHandler) == SIG_IGN)
+		signal (SIGALRM, SIG_IGN);
+	if (signal (SIGUSR1, SignalHandler) == SIG_IGN)
+		signal (SIGUSR1, SIG_IGN);
+	if (signal (SIGUSR2, SignalHandler) == SIG_IGN)
+		signal (SIGUSR2, SIG_IGN);
+	if (signal (SIGHUP, SignalHandler) == SIG_IGN)
+		signal (SIGHUP, SIG_IGN);
+#endif
+
+	// We tune the cards, one after the other
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		adapter=adapters[iadapter];
+		log_message( log_module,  MSG_INFO, "Streaming. Freq %f\n", adapter->tune_p.freq);
+		card_tuned=&adapter->tune_p.card_tuned;
+		//We use the input of another adapter, nothing to open or tune
+		if(adapter->t2mi_input)
+		{
+			adapter->tune_p.card_tuned = 1;
+			adapter->strengthparams.tune_p = &adapter->tune_p;
+			adapter->cardthreadparams.thread_running=0;
+			continue;
+		}
+#ifndef DISABLE_DVB_API
+		// alarm for tuning timeout
+		if(adapter->tune_p.tuning_timeout)
+		{
+			alarm (adapter->tune_p.tuning_timeout);
+		}
+#endif
+
+		iRet=adapter_open_input(adapter);
+
+		if (iRet>0)
+		{
+			// We write our pid in a file if we deamonize, as we are tuned
+			if (iadapter==0 && !no_daemon)
+				write_pid_file(filename_pid, &adapter->tune_p, server_id);
+
+#ifndef _WIN32
+			if (strlen(adapter->tune_p.read_file_path) || adapter->fds.fd_source > 0)
+				iRet = 1; //no tuning if file or network input
+			else
+				iRet = tune_it(adapter->fds.fd_frontend, &adapter->tune_p);
+#else
+			/* No tuning on windows at all */
+			iRet = 1;
+#endif
+		}
+		else
+			iRet =-1;
+
+		if (iRet < 0)
+		{
+			log_message( log_module,  MSG_INFO, "Tuning issue, card %d\n", adapter->tune_p.card);
+			// we close the file descriptors
+			close_card_fd(&adapter->fds);
+			set_interrupted(ERROR_TUNE<<8);
+			goto mumudvb_close_goto;
+		}
+		log_message( log_module,  MSG_INFO, "Card %d, tuner %d tuned\n", adapter->tune_p.card, adapter->tune_p.tuner);
+		adapter->tune_p.card_tuned = 1;
+
+		//Thread for showing the strength
+		adapter->strengthparams.fds = &adapter->fds;
+		adapter->strengthparams.tune_p = &adapter->tune_p;
+		if (adapter->fds.fd_source > 0)
+			adapter->strengthparams.udp_source = &adapter->udp_source;
+		else
+			adapter->strengthparams.card_buffer = &adapter->card_buffer;
+		pthread_create(&(adapter->signalpowerthread), NULL, show_power_func, &adapter->strengthparams);
+		//Thread for reading from the DVB card initialization
+		if(adapter->card_buffer.threaded_read)
+		{
+			adapter->cardthreadparams.thread_running=1;
+			adapter->cardthreadparams.fds = &adapter->fds;
+			adapter->cardthreadparams.card_buffer=&adapter->card_buffer;
+			adapter->cardthreadparams.carddatamutex=&carddatamutex;
+			adapter->cardthreadparams.threadcond=&threadcond;
+			adapter->cardthreadparams.main_waiting=&main_waiting;
+			adapter->cardthreadparams.threadshutdown=0;
+		}
+		else
+			adapter->cardthreadparams.thread_running=0;
+	}
+
+
+	/******************************************************/
+	//card tuned
+	/******************************************************/
+#ifndef DISABLE_DVB_API
+	// the card is tuned, we catch signals to close cleanly
+	if (signal (SIGHUP, SignalHandler) == SIG_IGN)
+		signal (SIGHUP, SIG_IGN);
+	if (signal (SIGINT, SignalHandler) == SIG_IGN)
+		signal (SIGINT, SIG_IGN);
+	if (signal (SIGTERM, SignalHandler) == SIG_IGN)
+		signal (SIGTERM, SIG_IGN);
+	struct sigaction act;
+	act.sa_handler = SIG_IGN;
+	sigemptyset (&act.sa_mask);
+	act.sa_flags = 0;
+	if(sigaction (SIGPIPE, &act, NULL)<0)
+		log_message( log_module,  MSG_ERROR,"ErrorSigaction\n");
 #endif
 
-				/******************************************************/
-				//Scam support
-				// copy proper pmt to scam_pmt_packet
-				/******************************************************/
+	//We record the starting time
+	gettimeofday (&tv, (struct timezone *) NULL);
+	real_start_time = tv.tv_sec;
+	now = 0;
+
+
+	if(adapters[0]->stats_infos.show_traffic)
+		log_message( log_module, MSG_INFO,"The traffic will be shown every %d second%c\n",adapters[0]->stats_infos.show_traffic_interval, adapters[0]->stats_infos.show_traffic_interval > 1? 's':' ');
+
+
+
+	/******************************************************/
+	// Monitor Thread, it monitors all the adapters
+	/******************************************************/
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		adapter=adapters[iadapter];
+		adapter->monitor_params=(monitor_parameters_t){
+				.threadshutdown=0,
+				.wait_time=10,
+				.auto_p=&adapter->auto_p,
+				.sap_p=&sap_p,
+				.chan_p=&adapter->chan_p,
+				.multi_p=&adapter->multi_p,
+				.unicast_vars=&unic_p,
+				.tune_p=&adapter->tune_p,
+				.fds=&adapter->fds,
+				.stats_infos=&adapter->stats_infos,
 #ifdef ENABLE_SCAM_SUPPORT
-				if (scam_vars.scam_support && send_packet==1)  //no need to check packets we don't send
-				{
-					scam_new_packet(pid, &chan_p.channels[ichan]);
-				}
+				.scam_vars_v=adapter->scam_vars_ptr,
 #endif
+				.server_id=server_id,
+				.filename_channels_not_streamed=adapter->filename_channels_not_streamed,
+				.filename_channels_streamed=adapter->filename_channels_streamed,
+				.next=(iadapter+1<num_adapters) ? &adapters[iadapter+1]->monitor_params : NULL,
+		};
+	}
 
-				/******************************************************/
-				//Rewrite PMT
-				/******************************************************/
-				if((send_packet==1) && //no need to check packets we don't send
-						(pid == chan_p.channels[ichan].pid_i.pmt_pid) && //This is a PMT PID
-						(chan_p.channels[ichan].pid_i.pmt_pid) && //we have the pmt_pid
-						(rewrite_vars.rewrite_pmt == OPTION_ON ) && //AND we asked for rewrite
-						(chan_p.channels[ichan].pmt_rewrite == 1))  //AND this channel's PMT shouldn't be skipped
-				{
-					send_packet=pmt_rewrite_new_channel_packet(actual_ts_packet, pmt_ts_packet, &chan_p.channels[ichan], ichan);
-				}
+	pthread_create(&monitorthread, NULL, monitor_func, &adapters[0]->monitor_params);
 
-				/******************************************************/
-				//Rewrite PAT
-				/******************************************************/
-				if((send_packet==1) && //no need to check packets we don't send
-						(pid == 0) && //This is a PAT PID
-						rewrite_vars.rewrite_pat == OPTION_ON )  //AND we asked for rewrite
-					send_packet=pat_rewrite_new_channel_packet(actual_ts_packet, &rewrite_vars, &chan_p.channels[ichan], ichan);
-
-				/******************************************************/
-				//Rewrite SDT
-				/******************************************************/
-				if((send_packet==1) && //no need to check packets we don't send
-						(pid == 17) && //This is a SDT PID
-						rewrite_vars.rewrite_sdt == OPTION_ON &&  //AND we asked for rewrite
-						!chan_p.channels[ichan].sdt_rewrite_skip ) //AND the generation was successful
-					send_packet=sdt_rewrite_new_channel_packet(actual_ts_packet, &rewrite_vars, &chan_p.channels[ichan], ichan);
-
-				/******************************************************/
-				//Rewrite EIT
-				/******************************************************/
-				if((send_packet==1) &&//no need to check packets we don't send
-						(pid == 18) && //This is a EIT PID
-						(chan_p.channels[ichan].service_id) && //we have the service_id
-						rewrite_vars.rewrite_eit == OPTION_ON) //AND we asked for EIT sorting
-				{
-					eit_rewrite_new_channel_packet(actual_ts_packet, &rewrite_vars, &chan_p.channels[ichan],
-							&unic_p, scam_vars_ptr);
-					send_packet=0; //for EIT it is sent by the rewrite function itself
-				}
 
-				/******************************************************/
-				// Test if PSI tables filtering is activated
-				/******************************************************/
-				if (send_packet==1 && chan_p.psi_tables_filtering>0 && pid<32)
+	// HLS support
+	hls_thread_params.threadshutdown=0;
+	hls_thread_params.unicast_vars=&unic_p;
+	hls_thread_params.adapters=unicast_adapters;
+	hls_thread_params.num_adapters=num_adapters;
+
+	if(unic_p.hls)
+	{
+		if (hls_start(&unic_p)) {
+			log_message( log_module,  MSG_ERROR, "HLS functions failed to inilialize!\n");
+			goto mumudvb_close_goto;
+		}
+    		pthread_create(&hlsthread, NULL, hls_periodic_task, &hls_thread_params);
+	}
+
+	/*****************************************************/
+	//CAM, autoconfiguration, rewriting, channels and filters
+	/*****************************************************/
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+		if(adapter_start(adapters[iadapter]))
+			goto mumudvb_close_goto;
+
+	/*****************************************************/
+	// Init network, we open the sockets
+	/*****************************************************/
+	//We open the socket for the http unicast if needed and we update the poll structure
+	if(unic_p.unicast)
+	{
+		log_message("Unicast: ", MSG_INFO,"We open the Master http socket for address %s:%d\n",unic_p.ipOut, unic_p.portOut);
+		unicast_create_listening_socket(UNICAST_MASTER, -1, unic_p.ipOut, unic_p.portOut, &unic_p.socketIn, &unic_p);
+	}
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		adapter=adapters[iadapter];
+		update_chan_net(&adapter->chan_p, &adapter->auto_p, &adapter->multi_p, &unic_p, server_id, adapter->tune_p.card, adapter->tune_p.tuner);
+	}
+
+
+
+
+
+	/*****************************************************/
+	// init sap, the announces are shared by the adapters
+	/*****************************************************/
+
+	iRet=init_sap(&sap_p, adapters[0]->multi_p, num_adapters*MAX_CHANNELS);
+	if(iRet)
+	{
+		set_interrupted(ERROR_GENERIC<<8);
+		goto mumudvb_close_goto;
+	}
+
+	/*****************************************************/
+	// Information about streamed channels
+	/*****************************************************/
+
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		adapter=adapters[iadapter];
+		if(adapter->auto_p.autoconfiguration==AUTOCONF_MODE_NONE)
+			log_streamed_channels(log_module,
+					adapter->chan_p.number_of_channels,
+					adapter->chan_p.channels,
+					adapter->multi_p.multicast_ipv4,
+					adapter->multi_p.multicast_ipv6,
+					unic_p.unicast,
+					unic_p.portOut,
+					unic_p.ipOut);
+
+		if(adapter->auto_p.autoconfiguration)
+			log_message("Autoconf: ",MSG_INFO,"Autoconfiguration is now ready to work for you !");
+
+		adapter_alloc_buffers(adapter);
+	}
+
+
+	/******************************************************/
+	//We open the dump file if any, the packets of the first adapter are dumped
+	/******************************************************/
+	dump = NULL;
+	if(dump_filename)
+	{
+		dump = dump_open(dump_filename);
+		if (dump == NULL)
+		{
+			free(dump_filename);
+			dump_filename = NULL;
+		}
+	}
+#if !defined(ANDROID) && !defined(_WIN32)
+#ifdef MCL_ONFAULT
+	//The pages are locked once used, the unused entries of the channel tables stay free
+	if(mlockall(MCL_CURRENT | MCL_FUTURE | MCL_ONFAULT)<0)
+		mlockall(MCL_CURRENT | MCL_FUTURE); //kernel older than 4.4
+#else
+	mlockall(MCL_CURRENT | MCL_FUTURE);
+#endif
+#endif
+	/******************************************************/
+	//Main loop where we get the packets and send them
+	/******************************************************/
+	int poll_ret;
+	int poll_timeout;
+	/** The inputs of all the adapters, polled at once*/
+	struct pollfd pfds[MAX_ADAPTERS];
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		adapter=adapters[iadapter];
+		adapter->demux_p.chan_p=&adapter->chan_p;
+		adapter->demux_p.rewrite_vars=&adapter->rewrite_vars;
+		adapter->demux_p.unicast_vars=&unic_p;
+		adapter->demux_p.cam_p_v=adapter->cam_p_ptr;
+		adapter->demux_p.scam_vars_v=adapter->scam_vars_ptr;
+		adapter->demux_p.multi_p=&adapter->multi_p;
+		if(demux_start(&adapter->demux_p, adapter->route_reader))
+		{
+			set_interrupted(ERROR_GENERIC<<8);
+			goto mumudvb_close_goto;
+		}
+#ifndef _WIN32
+		//The adapters using the input of another one are not polled
+		if (adapter->t2mi_input)
+			pfds[iadapter].fd = -1;
+		else
+			pfds[iadapter].fd = (adapter->fds.fd_source > 0) ? adapter->fds.fd_source : adapter->fds.fd_dvr;
+		//POLLIN : data available for read
+		pfds[iadapter].events = POLLIN | POLLPRI;
+		pfds[iadapter].revents = 0;
+#endif
+	}
+	while (!get_interrupted())
+	{
+		if(threaded_read)
+		{
+			if(!adapters_rings_used(adapters, num_adapters))
+			{
+				//We wait for the reading threads, they wake us at least every DVB_POLL_TIMEOUT
+				pthread_mutex_lock(&carddatamutex);
+				__atomic_store_n(&main_waiting, 1, __ATOMIC_SEQ_CST);
+				if(!adapters_rings_used(adapters, num_adapters))
+					pthread_cond_wait(&threadcond,&carddatamutex);
+				__atomic_store_n(&main_waiting, 0, __ATOMIC_SEQ_CST);
+				pthread_mutex_unlock(&carddatamutex);
+			}
+			/**************************************************************/
+			/* UNICAST HTTP                                               */
+			/**************************************************************/
+			if(unic_p.fdsnum)
+			{
+				iRet=unicast_handle_fd_event(&unic_p, unicast_adapters, num_adapters);
+				if(iRet)
 				{
-					// Keep only PAT and CAT
-					if (chan_p.psi_tables_filtering==1 && pid>1) send_packet=0;
-					// Keep only PAT
-					if (chan_p.psi_tables_filtering==2 && pid>0) send_packet=0;
+					log_message( log_module,  MSG_ERROR, "unicast fd error %d", iRet);
+					set_interrupted(iRet);
 				}
-				mumudvb_channel_t *channel = &chan_p.channels[ichan];
-				/******************************************************/
-				//Ok we must send this packet,
-				// we add it to the channel buffer
-				/******************************************************/
-				if(send_packet==1)
+			}
+			/**************************************************************/
+			/* END OF UNICAST HTTP                                        */
+			/**************************************************************/
+			//One read of each adapter, so an adapter does not delay the others
+			for (iadapter = 0; iadapter < num_adapters; iadapter++)
+			{
+				adapter=adapters[iadapter];
+				card_buffer_t *card_buffer=&adapter->card_buffer;
+				//The adapters using the input of another one have no reading thread
+				if(!adapter->cardthreadparams.thread_running)
+					continue;
+				card_buffer->bytes_read=dvr_ring_get(&card_buffer->ring, &card_buffer->reading_buffer);
+				if(!card_buffer->bytes_read)
 				{
-					/**Special PMT case*/
-					if((pid == chan_p.channels[ichan].pid_i.pmt_pid) && (rewrite_vars.rewrite_pmt == OPTION_ON ) && (chan_p.channels[ichan].pmt_rewrite == 1))
-						buffer_func(channel, pmt_ts_packet, &unic_p, scam_vars_ptr);
-					else
-						buffer_func(channel, actual_ts_packet, &unic_p, scam_vars_ptr);
+					demux_flush_delayed(&adapter->demux_p);
+					continue;
 				}
-
+				adapter_process_input(adapter, &unic_p, server_id, iadapter ? NULL : dump);
+				dvr_ring_release(&card_buffer->ring);
 			}
-			pthread_mutex_unlock(&chan_p.lock);
+			continue;
 		}
 
-		/* in case we got partial packet from t2mi demux, save it */
-		if (chan_p.t2mi_pid > 0 && card_buffer.bytes_read > card_buffer.read_buff_pos) {
-		    t2_partial_size = card_buffer.bytes_read - card_buffer.read_buff_pos;
-		    if (card_buffer.read_buff_pos > 0) {
-			memcpy(card_buffer.t2mi_buffer, card_buffer.t2mi_buffer + card_buffer.read_buff_pos, t2_partial_size);
-		    }
-		} else {
-		    t2_partial_size = 0;
+		/* Poll the open file descriptors : we wait for data*/
+		poll_timeout=DVB_POLL_TIMEOUT;
+		for (iadapter = 0; iadapter < num_adapters; iadapter++)
+			poll_timeout=demux_poll_timeout(&adapters[iadapter]->demux_p, poll_timeout);
+#ifndef _WIN32
+		poll_ret = mumudvb_poll(pfds, num_adapters, poll_timeout);
+#else
+		if (adapters[0]->fds.fd_source == 0)
+			poll_ret = dvb_poll(adapters[0]->fds.fd_dvr, DVB_POLL_TIMEOUT);
+		else
+			poll_ret = 0;
+#endif
+
+		if (poll_ret < 0) {
+			log_message(log_module, MSG_ERROR, "Poll error %d", poll_ret);
+			set_interrupted(poll_ret);
+			continue;
 		}
 
+		/**************************************************************/
+		/* UNICAST HTTP, the server is shared by the adapters         */
+		/**************************************************************/
+		if(unic_p.fdsnum)
+		{
+			iRet=unicast_handle_fd_event(&unic_p, unicast_adapters, num_adapters);
+			if(iRet)
+			{
+				log_message( log_module,  MSG_ERROR, "unicast fd error %d", iRet);
+				set_interrupted(iRet);
+			}
+		}
+		/**************************************************************/
+		/* END OF UNICAST HTTP                                        */
+		/**************************************************************/
+		for (iadapter = 0; iadapter < num_adapters; iadapter++)
+		{
+			adapter=adapters[iadapter];
+#ifndef _WIN32
+			if (!pfds[iadapter].revents) {
+				//No new data, the packets waiting in the channel buffers are sent if they waited too long
+				demux_flush_delayed(&adapter->demux_p);
+				continue;
+			}
+#endif
+#ifdef ENABLE_BENCHMARK
+			if (benchmark_params.duration) {
+				adapter_benchmark_read(adapter, &unic_p, server_id);
+				continue;
+			}
+#endif
+			if (adapter_read_input(adapter) == 0) {
+				//No new data, the packets waiting in the channel buffers are sent if they waited too long
+				demux_flush_delayed(&adapter->demux_p);
+				continue;
+			}
+			adapter_process_input(adapter, &unic_p, server_id, iadapter ? NULL : dump);
+		}
+#ifdef ENABLE_BENCHMARK
+		if (benchmark_params.duration && benchmark_finished(&adapters[0]->benchmark))
+			break;
+#endif
 	}
 	/******************************************************/
 	//End of main loop
 	/******************************************************/
-	if(dump_file)
-		fclose(dump_file);
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+		demux_stop(&adapters[iadapter]->demux_p);
+#ifdef ENABLE_BENCHMARK
+	if (benchmark_params.duration)
+	{
+		for (iadapter = 0; iadapter < num_adapters; iadapter++)
+			benchmark_report(&adapters[iadapter]->benchmark, adapters[iadapter]->tune_p.card);
+		benchmark_crc32();
+	}
+#endif
+	dump_close(dump);
 	gettimeofday (&tv, (struct timezone *) NULL);
 	log_message( log_module,  MSG_INFO,
 			"End of streaming. We streamed during %ldd %ld:%02ld:%02ld\n",(tv.tv_sec - real_start_time )/86400,((tv.tv_sec - real_start_time) % 86400 )/3600,((tv.tv_sec - real_start_time) % 3600)/60,(tv.tv_sec - real_start_time) %60 );
 
-	if(card_buffer.partial_packet_number)
-		log_message( log_module,  MSG_INFO,
-				"We received %d partial packets :-( \n",card_buffer.partial_packet_number );
-	if(card_buffer.overflow_number)
-		log_message( log_module,  MSG_INFO,
-				"We have got %d overflow errors\n",card_buffer.overflow_number );
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		adapter=adapters[iadapter];
+		if(adapter->card_buffer.partial_packet_number)
+			log_message( log_module,  MSG_INFO,
+					"Card %d: we received %d partial packets :-( \n",adapter->tune_p.card,adapter->card_buffer.partial_packet_number );
+		if(adapter->card_buffer.overflow_number)
+			log_message( log_module,  MSG_INFO,
+					"Card %d: we have got %d overflow errors\n",adapter->tune_p.card,adapter->card_buffer.overflow_number );
+		if(adapter->chan_p.t2mi_pid > 0)
+			log_message( log_module,  MSG_INFO,
+					"Adapter %d: T2-MI PID %d PLP %d, %llu baseband frames extracted, %llu resynchronisations\n",
+					adapter->id, adapter->t2mi.pid, adapter->t2mi.plp,
+					(unsigned long long) adapter->t2mi.bbframes,
+					(unsigned long long) adapter->t2mi.resyncs);
+		if(adapter->card_buffer.threaded_read)
+			log_message( log_module,  MSG_INFO,
+					"Card %d: the reading thread ring was full %d times (at most %d reads of %d waiting), %llu packets (%llu bytes) dropped, %llu PSI packets kept\n",
+					adapter->tune_p.card,
+					adapter->card_buffer.thread_full_number,
+					adapter->card_buffer.ring.high_water,
+					adapter->card_buffer.ring.num_slots,
+					adapter->card_buffer.ring.dropped_packets,
+					adapter->card_buffer.ring.dropped_bytes,
+					adapter->card_buffer.ring.kept_packets);
+	}
 	mumudvb_close_goto:
 	//If the thread is not started, we don't send the nonexistent address of monitor_thread_params
-	return mumudvb_close(no_daemon,
-			pthread_equal(monitorthread, pthread_self()) ? NULL:&monitor_thread_params,
-					&rewrite_vars,
-					&auto_p,
+	iRet=mumudvb_close(no_daemon,
+			pthread_equal(monitorthread, pthread_self()) ? NULL:&adapters[0]->monitor_params,
 					&unic_p,
-					&tune_p.strengththreadshutdown,
-					cam_p_ptr,
-					scam_vars_ptr,
-					filename_channels_not_streamed,
-					filename_channels_streamed,
+					&sap_p,
 					filename_pid,
 					get_interrupted(),
-					&chan_p,
-					&signalpowerthread,
+					adapters,
+					num_adapters,
 					&monitorthread,
-					&cardthreadparams,
-					&fds,
-					&card_buffer,
 					&hls_thread_params,
 					&hlsthread);
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		mumu_table_release(adapters[iadapter]->chan_p.channels, MAX_CHANNELS*sizeof(mumudvb_channel_t));
+		free(adapters[iadapter]);
+	}
+	return iRet;
 }
 
 
-
-
-
 #ifndef DISABLE_DVB_API
 /******************************************************
  * Signal Handler Function
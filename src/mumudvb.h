@@ -75,6 +75,11 @@
 /**the maximum channel number*/
 #define MAX_CHANNELS		128
 
+/**the maximum number of adapters served by one process (one configuration file each)*/
+#define MAX_ADAPTERS		8
+/** The maximum number of T2-MI PIDs read from one input */
+#define MAX_T2MI_PIDS		8
+
 /**the maximum number of CA systems*/
 #define MAX_CA_SYSTEMS		32
 
@@ -87,9 +92,26 @@
 
 /**Default Maximum Number of TS packets in the TS buffer*/
 #define DEFAULT_TS_BUFFER_SIZE 20
+/**The default number of DVR buffers with the mmap API*/
+#define DEFAULT_DVR_MMAP_BUFFERS 8
+/**The maximum number of DVR buffers with the mmap API*/
+#define DVR_MMAP_MAX_BUFFERS 32
 
 /**Default Maximum Number of TS packets in the thread buffer*/
 #define DEFAULT_THREAD_BUFFER_SIZE 5000
+/**The minimum number of slots of the thread ring*/
+#define DVR_RING_MIN_SLOTS 4
+/**The time the reading thread waits for a free slot before dropping packets (ms)*/
+#define DVR_RING_BACKPRESSURE_DELAY 20
+
+/**With dvr_buffer_auto, the default maximum number of TS packets read at once*/
+#define DEFAULT_DVR_BUFFER_MAX 1000
+/**With dvr_buffer_auto, the default maximum size of the kernel DVR buffer (bytes)*/
+#define DEFAULT_DVR_KERNEL_BUFFER_MAX (32*1024*1024)
+/**The size of the kernel DVR buffer when it is not set (bytes), see dvb_dmxdev_init*/
+#define DVR_KERNEL_BUFFER_DEFAULT (10*188*1024)
+/**The number of reads between two adaptations of the read size*/
+#define DVR_BUFFER_AUTO_WINDOW 64
 
 #define ALARM_TIME_TIMEOUT 60
 #define ALARM_TIME_TIMEOUT_NO_DIFF 600
@@ -104,6 +126,17 @@ We cannot discover easily the MTU with unconnected UDP
  */
 #define MAX_UDP_SIZE 1320
 
+/**the maximum number of datagrams waiting in a multicast batch (per address family)*/
+#define MULTICAST_BATCH_SIZE 64
+/**the maximum number of datagrams sent as one UDP GSO message*/
+#define MULTICAST_GSO_SEGMENTS 32
+/**the default maximum time a datagram waits in a multicast batch (us)*/
+#define MULTICAST_BATCH_DEFAULT_DELAY 5000
+/**the default number of datagrams of the ring of a channel for the multicast output thread*/
+#define MULTICAST_RING_DEFAULT_SIZE 128
+/**the maximum time a paced datagram can be delayed before the schedule restarts (us)*/
+#define MULTICAST_PACING_MAX_DELAY 50000
+
 /**the max mandatory pid number*/
 #define MAX_MANDATORY_PID_NUMBER   32
 /**config line length*/
@@ -121,6 +154,8 @@ We cannot discover easily the MTU with unconnected UDP
 #define STREAMED_LIST_PATH "/var/run/mumudvb/channels_streamed_adapter%d_tuner%d"
 /**The path for the list of *not* streamed channels*/
 #define NOT_STREAMED_LIST_PATH "/var/run/mumudvb/channels_unstreamed_adapter%d_tuner%d"
+/**The path for the autoconfiguration cache, persistent across reboots*/
+#define AUTOCONF_CACHE_PATH "/var/lib/mumudvb/autoconf_cache_adapter%d_tuner%d"
 /**The path for the cam_info*/
 #define CAM_INFO_LIST_PATH "/var/run/mumudvb/caminfo_adapter%d_tuner%d"
 /** The path for the pid file */
@@ -218,8 +253,16 @@ typedef struct fds_t {
 #endif
 	/** udp source socket */
 	int fd_source;
-	/** demuxer file descriptors */
+	/** Do we use one demuxer file descriptor for all the PIDs (DMX_ADD_PID) */
+	int demux_single_fd;
+	/** The demuxer file descriptor for all the PIDs, 0 if we use one per PID */
+	int fd_demux;
+	/** Is the filter of fd_demux set (its first PID) */
+	int demux_filter_set;
+	/** demuxer file descriptors, one per PID (and for the whole transponder with fd_demux) */
 	int fd_demuxer[8193];
+	/** The packets come from the T2-MI extraction of another adapter, we have no device */
+	int virtual_input;
 	/** poll file descriptors */
 	struct pollfd *pfds;	//  DVR device
 	int pfdsnum;
@@ -249,15 +292,44 @@ typedef struct {
 }ring_buffer_t;
 #endif
 
+/**@brief The ring of packet batches between the card reading thread and the main thread (dvr_thread)
+ *
+ * Each slot holds one read. The reading thread is the only one writing head, the main
+ * thread the only one writing tail, so there is no lock. When the ring is full, the reading
+ * thread waits DVR_RING_BACKPRESSURE_DELAY ms (the kernel buffer holds the packets) then
+ * sheds the load: it reads and drops the packets, keeping the PSI ones if asked.
+ */
+typedef struct dvr_ring_t{
+	unsigned char *data;
+	/** The number of bytes in each slot*/
+	int *slot_bytes;
+	int num_slots;
+	/** The size of a slot in bytes*/
+	int slot_size;
+	/** The number of slots filled (head) and released (tail) since the start*/
+	unsigned int head;
+	unsigned int tail;
+	/** Do we keep the PSI packets (PIDs 0 to 31 and the PMTs) when shedding the load*/
+	int psi_priority;
+	/** The PIDs recognized as PMT while shedding*/
+	uint8_t pmt_pid[8193];
+	/** The read of the packets to shed and the PSI packets kept, waiting for a free slot*/
+	unsigned char *shed_read;
+	unsigned char *shed_kept;
+	int shed_kept_bytes;
+	//statistics
+	/** The maximum number of slots used*/
+	int high_water;
+	unsigned long long dropped_packets;
+	unsigned long long dropped_bytes;
+	/** The PSI packets kept while shedding*/
+	unsigned long long kept_packets;
+}dvr_ring_t;
+
 /**@brief Structure containing the card buffers*/
 typedef struct card_buffer_t{
-	/** The two buffers (we put from the card with one, we read from the other one)*/
-	unsigned char *buffer1,*buffer2;
-	int actual_read_buffer;
 	/**The pointer to the reading buffer*/
 	unsigned char *reading_buffer;
-	/**The pointer to the writing buffer*/
-	unsigned char *writing_buffer;
 	/** The maximum number of packets in the buffer from DVR*/
 	int dvr_buffer_size;
 	/** The position in the DVR buffer */
@@ -266,17 +338,44 @@ typedef struct card_buffer_t{
 	int bytes_read;
 	/** Do the read is made using a thread */
 	int threaded_read;
-	/** The thread data buffer */
-	int bytes_in_write_buffer;
-	int write_buffer_size; /** @todo put a size for each buffer*/
+	/** The ring between the reading thread and the main thread */
+	dvr_ring_t ring;
 	/** The number of partial packets received*/
 	int partial_packet_number;
 	/** The number of overflow errors*/
 	int overflow_number;
 	/**The maximum size of the thread buffer (in packets)*/
 	int max_thread_buffer_size;
-	/* t2-mi demux buffer */
-	unsigned char *t2mi_buffer;
+	/** The number of times the reading thread found its ring full*/
+	int thread_full_number;
+	/** Do we adapt the read size and the kernel DVR buffer to the stream (dvr_buffer_auto) ?*/
+	int dvr_buffer_auto;
+	/** The bounds of the read size in packets, the minimum is the configured dvr_buffer_size*/
+	int dvr_buffer_min;
+	int dvr_buffer_max;
+	/** The size of the kernel DVR buffer in bytes asked in the configuration, 0 for the driver default*/
+	int dvr_kernel_buffer_size;
+	/** The maximum size of the kernel DVR buffer with dvr_buffer_auto*/
+	int dvr_kernel_buffer_max;
+	/** The current size of the kernel DVR buffer, -1 if it cannot be changed*/
+	int kernel_buffer_size;
+	/** The measures of the current window of reads*/
+	int window_reads;
+	int window_full_reads;
+	int window_packets;
+	/** The measures of the last window : percentage of the reads filling the buffer and average read in packets*/
+	int full_reads_percent;
+	int avg_read_packets;
+	/** Do we read the DVR with the DVB mmap API (DMX_REQBUFS) ?*/
+	int dvr_mmap;
+	/** The number of mmap buffers asked*/
+	int dvr_mmap_buffers;
+	/** The mapped buffers, mmap_num_buffers is 0 if we use read()*/
+	unsigned char *mmap_buffers[DVR_MMAP_MAX_BUFFERS];
+	int mmap_buffers_length[DVR_MMAP_MAX_BUFFERS];
+	int mmap_num_buffers;
+	/** The buffer given to the main loop (reading_buffer), -1 if none*/
+	int mmap_dequeued;
 }card_buffer_t;
 
 
@@ -314,6 +413,41 @@ typedef enum chan_status {
 	READY_EXISTING,		//Service OK, flag for detecting removed services
 } chan_status_t;
 
+/** @brief Why the buffer of a channel is sent */
+typedef enum send_reason {
+	SEND_FULL,			//The buffer can't take another packet
+	SEND_DELAY,			//The first packet waited max_buffer_delay
+} send_reason_t;
+
+/** @brief How the multicast datagrams of a channel are paced */
+typedef enum pacing_mode {
+	PACING_NONE,		//The datagrams are sent as soon as they are ready
+	PACING_TXTIME,		//Each datagram is given its departure time (SO_TXTIME)
+	PACING_RATE,		//The socket rate is limited (SO_MAX_PACING_RATE)
+} pacing_mode_t;
+
+/** @brief The multicast pacing of a channel, the rate is estimated from the PCR, see multicast.c */
+typedef struct multicast_pacing_t{
+	pacing_mode_t mode;
+	/** The last PCR base (90kHz), -1 if none yet */
+	int64_t last_pcr;
+	/** The bytes buffered since the last PCR */
+	uint64_t pcr_bytes;
+	/** The estimated stream rate (bit/s), 0 while unknown */
+	uint64_t rate;
+	/** The rate given to the socket with PACING_RATE (bytes/s) */
+	uint64_t socket_rate;
+	/** The departure time of the next datagram (ns) */
+	uint64_t next_departure;
+	/** Paced datagrams, protected by stats_lock */
+	unsigned long datagrams;
+	/** Datagrams which could not keep their slot, the schedule restarted (protected by stats_lock) */
+	unsigned long resync;
+	/** Total and maximum delay given to the datagrams (us, protected by stats_lock) */
+	uint64_t total_delay;
+	uint64_t max_delay;
+}multicast_pacing_t;
+
 /** @brief Structure for storing channels
  *
  * All members are protected by the global lock in chan_p, with the
@@ -323,6 +457,10 @@ typedef enum chan_status {
  *  - buf/nb_bytes, since they are only ever accessed from one thread: SCAM_SEND
  *    if we are using scam, or the main thread otherwise.
  *  - the odd/even keys, since they have their own locking.
+ *
+ * The configuration of the channels (PIDs, readiness, outputs) is only modified
+ * by the main thread, which takes the lock to do so. The main thread packet path
+ * can therefore read it without the lock, together with the routing table.
  */
 typedef struct mumudvb_channel_t{
 	/** Flag to say the channel is ready for streaming */
@@ -440,6 +578,13 @@ typedef struct mumudvb_channel_t{
 	unsigned char buf[MAX_UDP_SIZE];
 	/**number of bytes actually in the buffer*/
 	int nb_bytes;
+	/**when the first packet in the buffer was buffered (us), set only if max_buffer_delay is used*/
+	uint64_t buf_time;
+	/**the maximum time a packet waits in the buffer (us), 0 to wait for a full buffer*/
+	MU_F_V(int,max_buffer_delay)
+	/**number of buffers sent because they were full, or because of max_buffer_delay (protected by stats_lock)*/
+	unsigned long flush_full;
+	unsigned long flush_delay;
 	/**The data sent to this channel*/
 	long sent_data;
 	/** The packet number for rtp*/
@@ -463,12 +608,20 @@ typedef struct mumudvb_channel_t{
 	struct sockaddr_in6 sOut6;
 	/**The multicast output socket*/
 	int socketOut6;
+	/**The multicast batch of the thread sending this channel, NULL to send the datagrams one by one*/
+	struct multicast_batch_t *multicast_batch;
+	/**The ring of the multicast datagrams waiting for the output thread, NULL if the thread sending this channel sends them*/
+	struct multicast_ring_t *multicast_ring;
+	/**The pacing of the multicast datagrams, used when the channel has no batch*/
+	multicast_pacing_t pacing;
 
 
 	/**Unicast clients*/
 	struct unicast_client_t *clients;
 	/**Count of unicast clients*/
 	int num_clients;
+	/**The data waiting to be sent to the unicast clients, shared by the clients*/
+	struct unicast_ring_t *unicast_ring;
 	/**Unicast port (listening socket per channel) */
 	MU_F_V(int,unicast_port)
 	/**Unicast listening socket*/
@@ -539,8 +692,43 @@ typedef struct multi_p_t{
 	char iface6[IF_NAMESIZE+1];
 	/** num mpeg packets in one sent packet */
 	unsigned char num_pack;
+	/** Do we send the datagrams by batches (sendmmsg) ? */
+	int batch;
+	/** The maximum time a datagram waits in the batch (us) */
+	int batch_delay;
+	/** Do we use UDP GSO for the datagrams of the same channel in a batch ? */
+	int gso;
+	/** Do we pace the datagrams of the channels following their PCR ? */
+	int pacing;
+	/** Is the multicast sent by a thread of its own ? */
+	int output_thread;
+	/** The number of datagrams of the ring of each channel for the output thread */
+	int output_ring_size;
 }multi_p_t;
 
+/** @brief The datagrams of a thread waiting to be sent, see multicast.c */
+typedef struct multicast_batch_t multicast_batch_t;
+/** @brief The datagrams of a channel waiting for the output thread, see multicast.c */
+typedef struct multicast_ring_t multicast_ring_t;
+/** @brief The multicast output thread of an adapter, see multicast.c */
+typedef struct multicast_output_t multicast_output_t;
+
+/** @brief The counters of the batched multicast sending */
+typedef struct multicast_batch_stats_t{
+	/** Datagrams sent */
+	unsigned long datagrams;
+	/** sendmmsg calls */
+	unsigned long syscalls;
+	/** Messages containing several datagrams (UDP GSO) */
+	unsigned long gso_messages;
+	/** Datagrams which could not be sent */
+	unsigned long dropped;
+	/** Datagrams sent by the output threads */
+	unsigned long output_datagrams;
+	/** Datagrams dropped because the ring of their channel was full */
+	unsigned long output_dropped;
+}multicast_batch_stats_t;
+
 /** No PSI tables filtering */
 #define PSI_TABLES_FILTERING_NONE 0
 /** Keep only PAT and CAT */
@@ -549,6 +737,47 @@ typedef struct multi_p_t{
 #define PSI_TABLES_FILTERING_PAT_ONLY 2
 
 /** structure containing the channels and the asked pids information*/
+/** Memory ordering for the data shared between threads without lock.
+ * The MSVC volatile accesses already have acquire/release semantics */
+#ifndef _MSC_VER
+#define MU_LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define MU_STORE_RELEASE(p,v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define MU_LOAD_ACQUIRE(p) (*(p))
+#define MU_STORE_RELEASE(p,v) (*(p)=(v))
+#endif
+
+/**the maximum number of threads reading the PID routing table without lock*/
+#define MAX_ROUTE_READERS 32
+
+/** @brief One entry of the PID routing table : a channel carrying a PID
+ * and the position of this PID in the channel list (-1 if the PID is sent
+ * to all the channels without being in their list, ie mandatory PIDs)*/
+typedef struct pid_route_entry_t{
+	int16_t channel;
+	int16_t pid_index;
+}pid_route_entry_t;
+
+/** @brief A version of the PID routing table
+ *
+ * Once published a version is never modified, so the packet path reads it
+ * without taking chan_p->lock (read-copy-update). An update builds a new
+ * version and publishes it, the previous one is freed when all the readers
+ * went through a quiescent state (see chan_route_quiescent).
+ * The channels carrying the PID pid are the entries entries[start[pid]] to entries[start[pid+1]-1]
+ */
+typedef struct chan_route_t{
+	/** Version number, incremented at each update */
+	unsigned int version;
+	/** For a retired table, the version which replaced it */
+	unsigned int retired_by;
+	int start[8194];
+	int num_entries;
+	pid_route_entry_t *entries;
+	/** Next table in the retired list */
+	struct chan_route_t *next;
+}chan_route_t;
+
 typedef struct mumu_chan_p_t{
 	/** Protects all the members, including most of the channels (see the documentation
 	 * for mumudvb_channel_t for details).
@@ -560,17 +789,35 @@ typedef struct mumu_chan_p_t{
 	int filter_transport_error;
 	/** Do we do filtering to keep only PSI tables (without DVB tables) ? **/
 	int psi_tables_filtering;
-	/** The channels array */
-	mumudvb_channel_t channels[MAX_CHANNELS];  /**@todo use realloc*/
+	/** The channels array, MAX_CHANNELS entries reserved by mumu_table_reserve,
+	 * only the memory of the number_of_channels first entries is used*/
+	mumudvb_channel_t *channels;
+	/** The number of our first channel minus one in the HTTP pages and the SAP announces,
+	 * each adapter has MAX_CHANNELS numbers*/
+	int first_channel;
 	//Asked pids //used for filtering
 	/** this array contains the pids we want to filter,*/
 	uint8_t asked_pid[8193];
 	/** The number of TS discontinuities per PID **/
 	int16_t continuity_counter_pid[8193]; //on 16 bits for storing the initial -1
 	uint8_t check_cc;
+	/** PIDs sent with all the channels (mandatory PIDs, PSIP) */
+	uint8_t pid_route_all[8193];
+	/** The current PID routing table, rebuilt by update_chan_pid_route when the PID lists change.
+	 * Read with chan_route_get, no lock needed */
+	chan_route_t * volatile route;
+	/** The previous routing tables, waiting for the readers to release them (protected by lock) */
+	chan_route_t *route_retired;
+	/** Number of registered readers of the routing table */
+	int num_route_readers;
+	/** The last routing table version seen by each reader in a quiescent state */
+	volatile unsigned int route_reader_version[MAX_ROUTE_READERS];
 	/** t2mi demux parameters **/
 	int t2mi_pid;
 	uint8_t t2mi_plp;
+	/** The PIDs of the T2-MI streams read from our input : ours and the ones of the adapters sharing our input */
+	int t2mi_input_pids[MAX_T2MI_PIDS];
+	int t2mi_num_input_pids;
 }mumu_chan_p_t;
 
 
@@ -589,6 +836,12 @@ typedef struct monitor_parameters_t{
 	int server_id;
 	char *filename_channels_not_streamed;
 	char *filename_channels_streamed;
+	/** The monitor parameters of the next adapter, one thread monitors all the adapters*/
+	struct monitor_parameters_t *next;
+	/** The monitor state for this adapter*/
+	double last_updown_check;
+	double time_no_diff;
+	int num_big_buffer_show;
 }monitor_parameters_t;
 
 
@@ -602,10 +855,6 @@ typedef struct mumu_string_t{
 
 #define EMPTY_STRING {NULL,0}
 
-/** global scope variables for T2-MI processiong **/
-extern bool t2mi_active;
-extern bool t2mi_first;
-extern int t2_partial_size;
 #ifdef ENABLE_ARIB_SUPPORT
 extern bool japan_active;
 #endif
@@ -618,13 +867,35 @@ int mumudvb_poll(struct pollfd *, int , int );
 char *mumu_string_replace(char *source, int *length, int can_realloc, char *toreplace, char *replacement);
 int string_comput(char *string);
 uint64_t get_time(void);
-void buffer_func (mumudvb_channel_t *channel, unsigned char *ts_packet, struct unicast_parameters_t *unicast_vars, void *scam_vars_v);
-void send_func(mumudvb_channel_t *channel, uint64_t now_time, struct unicast_parameters_t *unicast_vars);
+void *mumu_table_reserve(size_t size);
+void mumu_table_release(void *table, size_t size);
+void buffer_func (mumudvb_channel_t *channel, unsigned char *ts_packet, int pid_index, struct unicast_parameters_t *unicast_vars, void *scam_vars_v);
+void send_func(mumudvb_channel_t *channel, uint64_t now_time, struct unicast_parameters_t *unicast_vars, multicast_batch_t *multicast_batch, send_reason_t reason);
+multicast_batch_t *multicast_batch_new(multi_p_t *multi_p);
+void multicast_batch_free(multicast_batch_t *batch);
+void multicast_batch_add(multicast_batch_t *batch, mumudvb_channel_t *channel, unsigned char *data, int data_len, uint64_t now_time);
+void multicast_batch_flush(multicast_batch_t *batch);
+void multicast_batch_check(multicast_batch_t *batch, uint64_t now_time);
+uint64_t multicast_batch_deadline(multicast_batch_t *batch);
+multicast_output_t *multicast_output_new(multi_p_t *multi_p);
+int multicast_output_add_channel(multicast_output_t *output, mumudvb_channel_t *channel);
+void multicast_output_wake(multicast_output_t *output);
+void multicast_output_free(multicast_output_t *output);
+void multicast_ring_push(multicast_ring_t *ring, unsigned char *data, int data_len);
+void multicast_pacing_setup(mumudvb_channel_t *channel);
+void multicast_pacing_packet(mumudvb_channel_t *channel, unsigned char *ts_packet);
+void multicast_pacing_send(mumudvb_channel_t *channel, unsigned char *data, int data_len, uint64_t now_time);
 
 int mumu_init_chan(mumudvb_channel_t *chan);
 void chan_update_CAM(mumu_chan_p_t *chan_p, struct auto_p_t *auto_p,  void *scam_vars_v);
 void update_chan_net(mumu_chan_p_t *chan_p, struct auto_p_t *auto_p, multi_p_t *multi_p, struct unicast_parameters_t *unicast_vars, int server_id, int card, int tuner);
 void update_chan_filters(mumu_chan_p_t *chan_p, char *card_base_path, int tuner, fds_t *fds);
+int update_chan_pid_route(mumu_chan_p_t *chan_p);
+int chan_route_register_reader(mumu_chan_p_t *chan_p);
+chan_route_t *chan_route_get(mumu_chan_p_t *chan_p);
+void chan_route_quiescent(mumu_chan_p_t *chan_p, int reader);
+void chan_route_free(mumu_chan_p_t *chan_p);
+int chan_pid_index(mumudvb_channel_t *channel, int pid);
 long int mumu_timing(void);
 
 /** Sets the interrupted flag if value != 0 and it is not already set.
@@ -172,7 +172,7 @@ int chan_pmt_ok(mumudvb_channel_t *channel, mumudvb_ts_packet_t *pmt)
 void chan_new_pmt(unsigned char *ts_packet, mumu_chan_p_t *chan_p, int pid)
 {
 
-	for(int ichan=0;ichan<MAX_CHANNELS;ichan++)
+	for(int ichan=0;ichan<chan_p->number_of_channels;ichan++)
 	{
 		//for the PMT we look only for channels with status READY
 		if(pid &&
@@ -287,7 +287,7 @@ void update_chan_net(mumu_chan_p_t *chan_p, auto_p_t *auto_p, multi_p_t *multi_p
 		{
 			strcpy(tempstring,auto_p->autoconf_unicast_port);
 			int len;len=256;
-			char number[10];
+			char number[12];
 			sprintf(number,"%d",ichan);
 			mumu_string_replace(tempstring,&len,0,"%number",number);
 			sprintf(number,"%d",card);
@@ -307,7 +307,7 @@ void update_chan_net(mumu_chan_p_t *chan_p, auto_p_t *auto_p, multi_p_t *multi_p
 
 		if(multi_p->multicast)
 		{
-			char number[10];
+			char number[12];
 			char ip[80];
 			int len=80;
 			//We store if we send this channel with RTP, later it can be made channel dependent.
@@ -388,7 +388,7 @@ void update_chan_net(mumu_chan_p_t *chan_p, auto_p_t *auto_p, multi_p_t *multi_p
 					unicast_vars->ipOut,
 					chan_p->channels[ichan].unicast_port);
 			unicast_create_listening_socket(UNICAST_LISTEN_CHANNEL,
-					ichan,
+					chan_p->first_channel+ichan,
 					unicast_vars->ipOut,
 					chan_p->channels[ichan].unicast_port,
 					&chan_p->channels[ichan].socketIn,
@@ -442,6 +442,9 @@ void update_chan_net(mumu_chan_p_t *chan_p, auto_p_t *auto_p, multi_p_t *multi_p
 								multi_p->iface6,
 								&chan_p->channels[ichan].sOut6);
 		}
+		//The batched datagrams are not paced
+		if(multi_p->multicast && multi_p->pacing && !multi_p->batch && chan_p->channels[ichan].pacing.mode==PACING_NONE)
+			multicast_pacing_setup(&chan_p->channels[ichan]);
 
 		/******************************************************/
 		//   SCAM START PART
@@ -488,10 +491,9 @@ void update_chan_filters(mumu_chan_p_t *chan_p, char *card_base_path, int tuner,
 			}
 	}
 
-	// T2-MI source pid may not belong to any streamed pid, force it.
-	if (chan_p->t2mi_pid > 0) {
-	    asked_pid[chan_p->t2mi_pid]=PID_ASKED;
-	}
+	// T2-MI source pids may not belong to any streamed pid, force them.
+	for (int ipid = 0; ipid < chan_p->t2mi_num_input_pids; ipid++)
+	    asked_pid[chan_p->t2mi_input_pids[ipid]]=PID_ASKED;
 
 	//Now we compare with the ones for the channels
 	for (int ipid = MAX_MANDATORY_PID_NUMBER; ipid < 8193; ipid++)
@@ -500,10 +502,7 @@ void update_chan_filters(mumu_chan_p_t *chan_p, char *card_base_path, int tuner,
 		if(chan_p->asked_pid[ipid]==PID_ASKED && asked_pid[ipid]!=PID_ASKED && ipid != PSIP_PID)
 		{
 			log_message( log_module,  MSG_INFO, "Update : PID %d does not belong to any channel anymore, we close the filter", ipid);
-#ifndef _WIN32
-			close(fds->fd_demuxer[ipid]);
-#endif
-			fds->fd_demuxer[ipid]=0;
+			unset_filter(fds, ipid);
 			chan_p->asked_pid[ipid]=PID_NOT_ASKED;
 		}
 		//And we look for the PIDs who are now asked
@@ -518,13 +517,223 @@ void update_chan_filters(mumu_chan_p_t *chan_p, char *card_base_path, int tuner,
 		}
 
 	}
-	log_message( log_module, MSG_DETAIL,"Open the new filters");
-	// we open the file descriptors
-	if (create_card_fd (card_base_path, tuner, chan_p->asked_pid, fds) < 0)
+	//Our packets are extracted from the input of another adapter, there is no device to filter
+	if (fds->virtual_input)
+	{
+		for (int ipid = 0; ipid < 8193; ipid++)
+			if (chan_p->asked_pid[ipid] == PID_ASKED)
+				chan_p->asked_pid[ipid] = PID_FILTERED;
+	}
+	else
 	{
-		log_message( log_module, MSG_ERROR,"ERROR : CANNOT open the new descriptors. Some channels will probably not work");
+		log_message( log_module, MSG_DETAIL,"Open the new filters");
+		// we open the file descriptors
+		if (create_card_fd (card_base_path, tuner, chan_p->asked_pid, fds) < 0)
+		{
+			log_message( log_module, MSG_ERROR,"ERROR : CANNOT open the new descriptors. Some channels will probably not work");
+		}
+		set_filters(chan_p->asked_pid, fds);
 	}
-	set_filters(chan_p->asked_pid, fds);
+
+	//The PID lists changed, the routing table has to follow
+	update_chan_pid_route(chan_p);
 
 	pthread_mutex_unlock(&chan_p->lock);
 }
+
+
+/** @brief Return the position of the PID in the channel PID list
+ * The whole transponder PID (8192) matches every PID
+ * @return the index or -1 if the channel doesn't carry this PID
+ */
+int chan_pid_index(mumudvb_channel_t *channel, int pid)
+{
+	for (int ipid = 0; ipid < channel->pid_i.num_pids; ipid++)
+		if ((channel->pid_i.pids[ipid] == pid) || (channel->pid_i.pids[ipid] == 8192)) //We can stream whole transponder using 8192
+			return ipid;
+	return -1;
+}
+
+/** @brief Fill, for each PID, its position in the channel PID list (-1 if absent)
+ * Same result as chan_pid_index for every PID, computed in one go
+ */
+static void chan_fill_pid_index(mumudvb_channel_t *channel, int16_t *pid_index)
+{
+	int wildcard=-1;
+	int ipid;
+	for (ipid = 0; ipid < channel->pid_i.num_pids && wildcard==-1; ipid++)
+		if (channel->pid_i.pids[ipid] == 8192)
+			wildcard=ipid;
+	for (ipid = 0; ipid < 8192; ipid++)
+		pid_index[ipid]=wildcard;
+	//backwards so the first occurrence wins
+	for (ipid = channel->pid_i.num_pids-1; ipid >= 0; ipid--)
+		if (channel->pid_i.pids[ipid] < 8192 && (wildcard==-1 || ipid < wildcard))
+			pid_index[channel->pid_i.pids[ipid]]=ipid;
+}
+
+/** @brief Free the retired routing tables which are not used anymore
+ * A table retired by the version v can be freed once all the readers went
+ * through a quiescent state after v was published.
+ * Must be called with chan_p->lock held
+ */
+static void chan_route_reclaim(mumu_chan_p_t *chan_p)
+{
+	chan_route_t **prev, *old;
+	unsigned int reader_version;
+
+	prev=&chan_p->route_retired;
+	while(*prev)
+	{
+		old=*prev;
+		int in_use=0;
+		for (int ireader = 0; ireader < chan_p->num_route_readers && !in_use; ireader++)
+		{
+			reader_version=MU_LOAD_ACQUIRE(&chan_p->route_reader_version[ireader]);
+			if((int)(reader_version - old->retired_by) < 0) //wrap safe comparison
+				in_use=1;
+		}
+		if(in_use)
+		{
+			prev=&old->next;
+			continue;
+		}
+		*prev=old->next;
+		free(old->entries);
+		free(old);
+	}
+}
+
+/** @brief Register a thread which reads the routing table without lock
+ * @return the reader number to give to chan_route_quiescent, -1 if too many readers
+ */
+int chan_route_register_reader(mumu_chan_p_t *chan_p)
+{
+	int reader;
+	pthread_mutex_lock(&chan_p->lock);
+	if(chan_p->num_route_readers>=MAX_ROUTE_READERS)
+	{
+		pthread_mutex_unlock(&chan_p->lock);
+		log_message( log_module, MSG_ERROR,"Too many routing table readers (max %d)\n", MAX_ROUTE_READERS);
+		return -1;
+	}
+	reader=chan_p->num_route_readers;
+	chan_p->route_reader_version[reader]=chan_p->route ? chan_p->route->version : 0;
+	chan_p->num_route_readers++;
+	pthread_mutex_unlock(&chan_p->lock);
+	return reader;
+}
+
+/** @brief Get the current routing table, no lock needed
+ * The table stays valid until the reader calls chan_route_quiescent
+ */
+chan_route_t *chan_route_get(mumu_chan_p_t *chan_p)
+{
+	return MU_LOAD_ACQUIRE(&chan_p->route);
+}
+
+/** @brief Tell that the reader doesn't hold any reference to a routing table anymore
+ * Typically called between two batches of packets
+ */
+void chan_route_quiescent(mumu_chan_p_t *chan_p, int reader)
+{
+	chan_route_t *route;
+	route=MU_LOAD_ACQUIRE(&chan_p->route);
+	if(route && reader>=0)
+		MU_STORE_RELEASE(&chan_p->route_reader_version[reader], route->version);
+}
+
+/** @brief Free all the routing tables, when no reader is running anymore */
+void chan_route_free(mumu_chan_p_t *chan_p)
+{
+	chan_route_t *old;
+	while(chan_p->route_retired)
+	{
+		old=chan_p->route_retired;
+		chan_p->route_retired=old->next;
+		free(old->entries);
+		free(old);
+	}
+	if(chan_p->route)
+	{
+		free(chan_p->route->entries);
+		free(chan_p->route);
+	}
+	chan_p->route=NULL;
+}
+
+/** @brief Rebuild the PID routing table
+ * For each PID we store the channels carrying it, so the main loop does only
+ * one lookup per packet instead of scanning the PID list of every channel.
+ * The channel readiness is not taken into account, it is checked when sending.
+ * The new table is published as a new version, the readers pick it up at their next lookup.
+ * Must be called with chan_p->lock held, each time the PID lists change
+ */
+int update_chan_pid_route(mumu_chan_p_t *chan_p)
+{
+	int16_t pid_index[8192];
+	int fill_pos[8192];
+	int ichan, ipid, num_entries;
+	chan_route_t *route, *old;
+
+	route=malloc(sizeof(chan_route_t));
+	if(route==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		set_interrupted(ERROR_MEMORY<<8);
+		return -1;
+	}
+	memset(route, 0, sizeof(chan_route_t));
+
+	//First pass, we count the channels for each PID
+	for (ichan = 0; ichan < chan_p->number_of_channels; ichan++)
+	{
+		chan_fill_pid_index(&chan_p->channels[ichan], pid_index);
+		for (ipid = 0; ipid < 8192; ipid++)
+			if((pid_index[ipid]!=-1 || chan_p->pid_route_all[ipid]) && ipid != TS_PADDING_PID)
+				route->start[ipid+1]++;
+	}
+	for (ipid = 0; ipid < 8193; ipid++)
+		route->start[ipid+1]+=route->start[ipid];
+	num_entries=route->start[8193];
+	route->num_entries=num_entries;
+
+	//at least one entry, to avoid a zero size allocation
+	route->entries=malloc((num_entries+1)*sizeof(pid_route_entry_t));
+	if(route->entries==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		free(route);
+		set_interrupted(ERROR_MEMORY<<8);
+		return -1;
+	}
+
+	//Second pass, we fill the table, the channels are in increasing order for each PID
+	memcpy(fill_pos, route->start, sizeof(fill_pos));
+	for (ichan = 0; ichan < chan_p->number_of_channels; ichan++)
+	{
+		chan_fill_pid_index(&chan_p->channels[ichan], pid_index);
+		for (ipid = 0; ipid < 8192; ipid++)
+			if((pid_index[ipid]!=-1 || chan_p->pid_route_all[ipid]) && ipid != TS_PADDING_PID)
+			{
+				route->entries[fill_pos[ipid]].channel=ichan;
+				route->entries[fill_pos[ipid]].pid_index=pid_index[ipid];
+				fill_pos[ipid]++;
+			}
+	}
+
+	//We publish the new version and retire the old one
+	old=chan_p->route;
+	route->version=old ? old->version+1 : 1;
+	MU_STORE_RELEASE(&chan_p->route, route);
+	if(old)
+	{
+		old->retired_by=route->version;
+		old->next=chan_p->route_retired;
+		chan_p->route_retired=old;
+	}
+	chan_route_reclaim(chan_p);
+
+	log_message( log_module, MSG_DEBUG,"PID routing table version %u, %d entries for %d channels\n", route->version, num_entries, chan_p->number_of_channels);
+	return 0;
+}
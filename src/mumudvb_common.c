@@ -35,6 +35,7 @@
 #ifndef _WIN32
 #include <sys/poll.h>
 #include <sys/time.h>
+#include <sys/mman.h>
 #endif
 #include <errno.h>
 #include <string.h>
@@ -44,6 +45,9 @@
 #include "scam_common.h"
 #endif
 #include "hls.h"
+#ifdef ENABLE_BENCHMARK
+#include "benchmark.h"
+#endif
 
 static char *log_module="Common: ";
 
@@ -135,6 +139,51 @@ int mumudvb_poll(struct pollfd *pfds, int pfdsnum,int timeout)
 	return poll_ret;
 }
 
+/** @brief Reserve a zeroed table
+ * The memory of a page is only used once something is written in it, so a table sized for
+ * MAX_CHANNELS entries only costs the entries which are really used (the memory is locked
+ * on fault, see mlockall in main)
+ *
+ * @param size the size of the table
+ * @return the table, NULL if it cannot be reserved
+ */
+void *mumu_table_reserve(size_t size)
+{
+#ifndef _WIN32
+	void *table;
+	table=mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+	if(table==MAP_FAILED)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with mmap : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return NULL;
+	}
+	return table;
+#else
+	void *table;
+	table=calloc(1,size);
+	if(table==NULL)
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+	return table;
+#endif
+}
+
+/** @brief Release a table reserved by mumu_table_reserve
+ *
+ * @param table the table
+ * @param size the size given to mumu_table_reserve
+ */
+void mumu_table_release(void *table, size_t size)
+{
+	if(table==NULL)
+		return;
+#ifndef _WIN32
+	munmap(table, size);
+#else
+	(void) size;
+	free(table);
+#endif
+}
+
 /** @brief replace a string by another
  * @param source
  * @param length the length of the source buffer (including '\0')
@@ -358,12 +407,12 @@ uint64_t get_time(void) {
 #endif
 }
 /** @brief function for buffering demultiplexed data.
+ * pid_index is the position of the packet PID in the channel PID list (-1 if not in the list)
  */
-void buffer_func(mumudvb_channel_t *channel, unsigned char *ts_packet, struct unicast_parameters_t *unicast_vars, void *scam_vars_v)
+void buffer_func(mumudvb_channel_t *channel, unsigned char *ts_packet, int pid_index, struct unicast_parameters_t *unicast_vars, void *scam_vars_v)
 {
     int pid;			/** pid of the current mpeg2 packet */
     int ScramblingControl;
-    int curr_pid = 0;
     int send_packet = 0;
     extern int dont_send_scrambled;
 
@@ -392,49 +441,58 @@ void buffer_func(mumudvb_channel_t *channel, unsigned char *ts_packet, struct un
 
         pid = ((ts_packet[1] & 0x1f) << 8) | (ts_packet[2]);
         ScramblingControl = (ts_packet[3] & 0xc0) >> 6;
-        pthread_mutex_lock(&channel->stats_lock);
-        for (curr_pid = 0; (curr_pid < channel->pid_i.num_pids); curr_pid++) {
-            if ((channel->pid_i.pids[curr_pid] == pid) || (channel->pid_i.pids[curr_pid] == 8192)) //We can stream whole transponder using 8192
-            {
-                if ((ScramblingControl > 0) && (pid != channel->pid_i.pmt_pid))
-                    channel->num_scrambled_packets++;
-
-                //check if the PID is scrambled for determining its state
-                if (ScramblingControl > 0) channel->pid_i.pids_num_scrambled_packets[curr_pid]++;
-
-                //we don't count the PMT pid for up channels
-                if (pid != channel->pid_i.pmt_pid)
-                    channel->num_packet++;
-                break;
-            }
+        //pid_index is the position of the PID in the channel list, given by the routing table
+        if (pid_index >= 0) {
+            pthread_mutex_lock(&channel->stats_lock);
+            if ((ScramblingControl > 0) && (pid != channel->pid_i.pmt_pid))
+                channel->num_scrambled_packets++;
+
+            //check if the PID is scrambled for determining its state
+            if (ScramblingControl > 0) channel->pid_i.pids_num_scrambled_packets[pid_index]++;
+
+            //we don't count the PMT pid for up channels
+            if (pid != channel->pid_i.pmt_pid)
+                channel->num_packet++;
+            pthread_mutex_unlock(&channel->stats_lock);
         }
-        pthread_mutex_unlock(&channel->stats_lock);
         //avoid sending of scrambled channels if we asked to
         send_packet = 1;
         if (dont_send_scrambled && (ScramblingControl > 0) && (channel->pid_i.pmt_pid))
             send_packet = 0;
 
         if (send_packet) {
+            //For the maximum buffering delay, we remember when the buffer started to fill
+            if (!channel->nb_bytes && channel->max_buffer_delay)
+                channel->buf_time = get_time();
             // we fill the channel buffer
             memcpy(channel->buf + channel->nb_bytes, ts_packet, TS_PACKET_SIZE);
             channel->nb_bytes += TS_PACKET_SIZE;
+            if (channel->pacing.mode != PACING_NONE)
+                multicast_pacing_packet(channel, ts_packet);
         }
         //The buffer is full, we send it
         if ((!channel->rtp && ((channel->nb_bytes + TS_PACKET_SIZE) > MAX_UDP_SIZE))
             || (channel->rtp && ((channel->nb_bytes + RTP_HEADER_LEN + TS_PACKET_SIZE) > MAX_UDP_SIZE))) {
             now_time = get_time();
-            send_func(channel, now_time, unicast_vars);
+            send_func(channel, now_time, unicast_vars, channel->multicast_batch, SEND_FULL);
         }
     }
 }
 
 
 /** @brief function for sending demultiplexed data.
+ * If the channel has a multicast ring, the multicast datagram is added to it and sent by the output thread
+ * If multicast_batch is not NULL, the multicast datagram is added to this batch instead of being sent now
+ * The reason is only counted for the statistics
  */
-void send_func(mumudvb_channel_t *channel, uint64_t now_time, struct unicast_parameters_t *unicast_vars)
+void send_func(mumudvb_channel_t *channel, uint64_t now_time, struct unicast_parameters_t *unicast_vars, multicast_batch_t *multicast_batch, send_reason_t reason)
 {
     //For bandwith measurement (traffic)
     pthread_mutex_lock(&channel->stats_lock);
+    if (reason == SEND_DELAY)
+        channel->flush_delay++;
+    else
+        channel->flush_full++;
     channel->sent_data += channel->nb_bytes + 20 + 8; // IP=20 bytes header and UDP=8 bytes header
     if (channel->rtp)
         channel->sent_data += RTP_HEADER_LEN;
@@ -445,6 +503,12 @@ void send_func(mumudvb_channel_t *channel, uint64_t now_time, struct unicast_par
     if ((channel->socketOut4 > 0) || (channel->socketOut6 > 0)) {
         unsigned char *data;
         int data_len;
+        multicast_ring_t *ring = channel->multicast_ring;
+#ifdef ENABLE_SCAM_SUPPORT
+        //The descrambled channels are sent by their own thread, not by the thread of the ring
+        if (channel->scam_support && channel->scam_support_started)
+            ring = NULL;
+#endif
         if (channel->rtp) {
             /****** RTP *******/
             rtp_update_sequence_number(channel, now_time);
@@ -454,10 +518,23 @@ void send_func(mumudvb_channel_t *channel, uint64_t now_time, struct unicast_par
             data = channel->buf;
             data_len = channel->nb_bytes;
         }
-        if (channel->socketOut4)
-            sendudp(channel->socketOut4, &channel->sOut4, data, data_len);
-        if (channel->socketOut6)
-            sendudp6(channel->socketOut6, &channel->sOut6, data, data_len);
+#ifdef ENABLE_BENCHMARK
+        if (benchmark_params.duration && !benchmark_params.network)
+            ; //Null sink, we measure MuMuDVB without the network
+        else
+#endif
+        if (ring)
+            multicast_ring_push(ring, data, data_len);
+        else if (multicast_batch)
+            multicast_batch_add(multicast_batch, channel, data, data_len, now_time);
+        else if (channel->pacing.mode != PACING_NONE)
+            multicast_pacing_send(channel, data, data_len, now_time);
+        else {
+            if (channel->socketOut4)
+                sendudp(channel->socketOut4, &channel->sOut4, data, data_len);
+            if (channel->socketOut6)
+                sendudp6(channel->socketOut6, &channel->sOut6, data, data_len);
+        }
     }
     /*********** UNICAST **************/
     unicast_data_send(channel, unicast_vars);
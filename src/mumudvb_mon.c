@@ -64,6 +64,8 @@
 #include "rtp.h"
 #include "log.h"
 #include "hls.h"
+#include "dump.h"
+#include "mumudvb_mon.h"
 
 #if defined __UCLIBC__ || defined ANDROID || defined(_WIN32)
 #define program_invocation_short_name "mumudvb"
@@ -87,7 +89,7 @@ extern int tuning_no_diff;
 #define close(x) closesocket(x)
 #endif
 
-void parse_cmd_line(int argc, char **argv,char *(*conf_filename),tune_p_t *tune_p,stats_infos_t *stats_infos,int *server_id, int *no_daemon,char **dump_filename, int *listingcards)
+void parse_cmd_line(int argc, char **argv,char **conf_filenames,int *num_conf_files,tune_p_t *tune_p,stats_infos_t *stats_infos,int *server_id, int *no_daemon,char **dump_filename, int *listingcards)
 {
 	const char short_options[] = "c:sdthjvql";
 	const struct option long_options[] = {
@@ -103,6 +105,14 @@ void parse_cmd_line(int argc, char **argv,char *(*conf_filename),tune_p_t *tune_
 			{"list-cards", no_argument, NULL, 'l'},
 			{"card", required_argument, NULL, 'a'},
 			{"dumpfile", required_argument, NULL, 'z'},
+			{"dump_buffer_size", required_argument, NULL, 'Z'},
+			{"dump_rotate_size", required_argument, NULL, 'S'},
+			{"dump_rotate_time", required_argument, NULL, 'T'},
+			{"dump_direct", no_argument, NULL, 'D'},
+#ifdef ENABLE_BENCHMARK
+			{"benchmark", required_argument, NULL, 'B'},
+			{"benchmark_network", no_argument, NULL, 'N'},
+#endif
 			{0, 0, 0, 0}
 	};
 	int c, option_index = 0;
@@ -124,8 +134,14 @@ void parse_cmd_line(int argc, char **argv,char *(*conf_filename),tune_p_t *tune_
 		switch (c)
 		{
 		case 'c':
-			*conf_filename = strdup(optarg);
-			if (!*conf_filename)
+			//Each configuration file is an adapter
+			if(*num_conf_files>=MAX_ADAPTERS)
+			{
+				log_message( log_module, MSG_ERROR,"Too many configuration files, the limit is %d adapters\n",MAX_ADAPTERS);
+				exit(ERROR_ARGS);
+			}
+			conf_filenames[*num_conf_files] = strdup(optarg);
+			if (!conf_filenames[(*num_conf_files)++])
 			{
 				log_message( log_module, MSG_ERROR,"Problem with strdup : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
 				exit(ERROR_MEMORY);
@@ -173,6 +189,36 @@ void parse_cmd_line(int argc, char **argv,char *(*conf_filename),tune_p_t *tune_
 			}
 			log_message( log_module, MSG_WARN,"You've decided to dump the received stream into %s. Be warned, it can grow quite fast", *dump_filename);
 			break;
+		case 'Z':
+			dump_params.ring_size = atoi(optarg);
+			if (dump_params.ring_size <= 0)
+			{
+				log_message( log_module, MSG_ERROR,"The dump buffer size must be positive\n");
+				exit(ERROR_ARGS);
+			}
+			break;
+		case 'S':
+			dump_params.rotate_size = atoi(optarg);
+			break;
+		case 'T':
+			dump_params.rotate_time = atoi(optarg);
+			break;
+		case 'D':
+			dump_params.direct = 1;
+			break;
+#ifdef ENABLE_BENCHMARK
+		case 'B':
+			benchmark_params.duration = atof(optarg);
+			if (benchmark_params.duration <= 0)
+			{
+				log_message( log_module, MSG_ERROR,"The benchmark duration must be positive\n");
+				exit(ERROR_ARGS);
+			}
+			break;
+		case 'N':
+			benchmark_params.network = 1;
+			break;
+#endif
 		default: /* -Wswitch-default */
 			break;
 		}
@@ -185,102 +231,55 @@ void parse_cmd_line(int argc, char **argv,char *(*conf_filename),tune_p_t *tune_
 
 }
 
-/** @brief Clean closing and freeing
- *
- *
+/** @brief Stop the threads of an adapter
  */
-int mumudvb_close(int no_daemon,
-		monitor_parameters_t *monitor_thread_params,
-		rewrite_parameters_t *rewrite_vars,
-		auto_p_t *auto_p,
-		unicast_parameters_t *unicast_vars,
-		volatile int *strengththreadshutdown,
-		void *cam_p_v,
-		void *scam_vars_v,
-		char *filename_channels_not_streamed,
-		char *filename_channels_streamed,
-		char *filename_pid,
-		int Interrupted,
-		mumu_chan_p_t *chan_p,
-		pthread_t *signalpowerthread,
-		pthread_t *monitorthread,
-		card_thread_parameters_t *cardthreadparams,
-		fds_t *fds,
-		card_buffer_t *card_buffer,
-		hls_thread_parameters_t *hls_thread_params,
-		pthread_t *hlsthread)
+static void mumudvb_stop_adapter_threads(mumudvb_adapter_t *adapter)
 {
-
-	int curr_channel;
 	int iRet;
-
-#ifndef ENABLE_CAM_SUPPORT
-	(void) cam_p_v; //to make compiler happy
-#else
-	cam_p_t *cam_p=(cam_p_t *)cam_p_v;
-#endif
-
-#ifndef ENABLE_SCAM_SUPPORT
-	(void) scam_vars_v; //to make compiler happy
-#else
-	scam_parameters_t *scam_vars=(scam_parameters_t *)scam_vars_v;
-#endif
-	if (Interrupted)
-	{
-		if(Interrupted< (1<<8)) //we check if it's a signal or a mumudvb error
-			log_message( log_module,  MSG_INFO, "Caught signal %d - closing cleanly.\n",
-					Interrupted);
-		else
-			log_message( log_module,  MSG_INFO, "Closing cleanly. Error %d\n",Interrupted>>8);
-	}
 #if !defined __UCLIBC__ && !defined ANDROID && !defined(_WIN32)
 	struct timespec ts;
 #endif
 
-	if(!pthread_equal(*signalpowerthread, pthread_self()))
+	if(!pthread_equal(adapter->signalpowerthread, pthread_self()))
 	{
 		log_message(log_module,MSG_DEBUG,"Signal/power Thread closing\n");
-		*strengththreadshutdown=1;
+		adapter->tune_p.strengththreadshutdown=1;
 #if !defined __UCLIBC__ && !defined ANDROID && !defined(_WIN32)
 		clock_gettime(CLOCK_REALTIME, &ts);
 		ts.tv_sec += 5;
-		iRet=pthread_timedjoin_np(*signalpowerthread, NULL, &ts);
+		iRet=pthread_timedjoin_np(adapter->signalpowerthread, NULL, &ts);
 #else
-		iRet=pthread_join(*signalpowerthread, NULL);
+		iRet=pthread_join(adapter->signalpowerthread, NULL);
 #endif
 		if(iRet)
 			log_message(log_module,MSG_WARN,"Signal/power Thread badly closed: %s\n", strerror(iRet));
 
 	}
-	if(cardthreadparams->thread_running)
+	if(adapter->cardthreadparams.thread_running)
 	{
 		log_message(log_module,MSG_DEBUG,"Card reading Thread closing\n");
-		cardthreadparams->threadshutdown=1;
-		pthread_mutex_destroy(&cardthreadparams->carddatamutex);
-		pthread_cond_destroy(&cardthreadparams->threadcond);
-	}
-	//We shutdown the monitoring thread
-	if(!pthread_equal(*monitorthread, pthread_self()))
-	{
-		log_message(log_module,MSG_DEBUG,"Monitor Thread closing\n");
-		monitor_thread_params->threadshutdown=1;
-#if !defined __UCLIBC__ && !defined ANDROID && !defined(_WIN32)
-		clock_gettime(CLOCK_REALTIME, &ts);
-		ts.tv_sec += 5;
-		iRet=pthread_timedjoin_np(*monitorthread, NULL, &ts);
-#else
-		iRet=pthread_join(*monitorthread, NULL);
-#endif
-		if(iRet)
-			log_message(log_module,MSG_WARN,"Monitor Thread badly closed: %s\n", strerror(iRet));
+		adapter->cardthreadparams.threadshutdown=1;
+		//The thread sees the shutdown after at most DVB_POLL_TIMEOUT
+		if(!pthread_equal(adapter->cardthread, pthread_self()))
+			pthread_join(adapter->cardthread, NULL);
 	}
+}
 
-	if(!pthread_equal(*hlsthread, pthread_self()))
-	{
-		log_message(log_module,MSG_DEBUG,"HLS Thread closing\n");
-		hls_thread_params->threadshutdown=1;
-		hls_stop(unicast_vars);
-	}
+/** @brief Close and free what belongs to an adapter
+ */
+static void mumudvb_close_adapter(mumudvb_adapter_t *adapter)
+{
+	int curr_channel;
+	mumu_chan_p_t *chan_p=&adapter->chan_p;
+	rewrite_parameters_t *rewrite_vars=&adapter->rewrite_vars;
+	card_buffer_t *card_buffer=&adapter->card_buffer;
+	fds_t *fds=&adapter->fds;
+#ifdef ENABLE_CAM_SUPPORT
+	cam_p_t *cam_p=&adapter->cam_p;
+#endif
+#ifdef ENABLE_SCAM_SUPPORT
+	scam_parameters_t *scam_vars=&adapter->scam_vars;
+#endif
 
 	for (curr_channel = 0; curr_channel < chan_p->number_of_channels; curr_channel++)
 	{
@@ -311,20 +310,18 @@ int mumudvb_close(int no_daemon,
 
 	}
 
-#ifdef ENABLE_ARIB_SUPPORT
-	/* Close ARIB B24 decoder instance */
-	close_arib_instance();
-#endif
+	chan_route_free(chan_p);
 
 	// we close the file descriptors
 	close_card_fd(fds);
 
 	/* we close the udp input socket */
 	if (fds->fd_source > 0)
+	{
 		close(fds->fd_source);
-
-	//We close the unicast connections and free the clients
-	unicast_freeing(unicast_vars);
+		udp_source_log_stats(&adapter->udp_source);
+	}
+	udp_source_free(&adapter->udp_source);
 
 #ifdef ENABLE_CAM_SUPPORT
 	if(cam_p->cam_support)
@@ -350,13 +347,7 @@ int mumudvb_close(int no_daemon,
 #endif
 
 	//autoconf variables freeing
-	autoconf_freeing(auto_p);
-
-	//sap variables freeing
-	if(monitor_thread_params && monitor_thread_params->sap_p->sap_messages4)
-		free(monitor_thread_params->sap_p->sap_messages4);
-	if(monitor_thread_params && monitor_thread_params->sap_p->sap_messages6)
-		free(monitor_thread_params->sap_p->sap_messages6);
+	autoconf_freeing(&adapter->auto_p);
 
 	//Pat rewrite freeing
 	if(rewrite_vars->full_pat)
@@ -390,59 +381,134 @@ int mumudvb_close(int no_daemon,
 	}
 	if (rewrite_vars->full_eit)
 		free(rewrite_vars->full_eit);
-
-	if (strlen(filename_channels_streamed) && (write_streamed_channels)&&remove (filename_channels_streamed))
+	if (rewrite_vars->eit_cache.hits+rewrite_vars->eit_cache.misses)
+		log_message( log_module,  MSG_DEBUG, "EIT sections : %llu repetitions dropped, %llu sections parsed, %u sections stored\n",
+				(unsigned long long) rewrite_vars->eit_cache.hits,
+				(unsigned long long) rewrite_vars->eit_cache.misses,
+				rewrite_vars->eit_cache.used);
+	psi_cache_free(&rewrite_vars->eit_cache);
+
+	if (strlen(adapter->filename_channels_streamed) && (write_streamed_channels)&&remove (adapter->filename_channels_streamed))
 	{
 		log_message( log_module,  MSG_WARN,
 				"%s: %s\n",
-				filename_channels_streamed, strerror (errno));
+				adapter->filename_channels_streamed, strerror (errno));
 		exit(ERROR_DEL_FILE);
 	}
 
-	if (strlen(filename_channels_not_streamed) && (write_streamed_channels)&&remove (filename_channels_not_streamed))
+	if (strlen(adapter->filename_channels_not_streamed) && (write_streamed_channels)&&remove (adapter->filename_channels_not_streamed))
 	{
 		log_message( log_module,  MSG_WARN,
 				"%s: %s\n",
-				filename_channels_not_streamed, strerror (errno));
+				adapter->filename_channels_not_streamed, strerror (errno));
 		exit(ERROR_DEL_FILE);
 	}
 
-
-	if (!no_daemon)
-	{
-		if (remove (filename_pid))
-		{
-			log_message( log_module,  MSG_INFO, "%s: %s\n",
-					filename_pid, strerror (errno));
-			exit(ERROR_DEL_FILE);
-		}
-	}
-
 	/*free packet buffers*/
 	if (card_buffer->threaded_read) {
-    	    if (card_buffer->buffer1) free(card_buffer->buffer1);
-    	    if (card_buffer->buffer2) free(card_buffer->buffer2);
+    	    dvr_ring_free(&card_buffer->ring);
+    	} else if (card_buffer->mmap_num_buffers) {
+#ifndef _WIN32
+    	    card_mmap_free(card_buffer);
+#endif
     	} else {
     	    if (card_buffer->reading_buffer) free(card_buffer->reading_buffer);
     	}
 
-        if (chan_p->t2mi_pid > 0) {
-    	    if (card_buffer->t2mi_buffer) free(card_buffer->t2mi_buffer);
-        }
+	t2mi_plp_free(&adapter->t2mi);
+	t2mi_demux_free(&adapter->t2mi_demux);
 
 	/*free the file descriptors*/
 	if(fds->pfds) {
 		free(fds->pfds);
 		fds->pfds=NULL;
 	}
-	if(unicast_vars->fd_info) {
-		free(unicast_vars->fd_info);
-		unicast_vars->fd_info=NULL;
+}
+
+/** @brief Clean closing and freeing
+ *
+ *
+ */
+int mumudvb_close(int no_daemon,
+		monitor_parameters_t *monitor_thread_params,
+		unicast_parameters_t *unicast_vars,
+		sap_p_t *sap_p,
+		char *filename_pid,
+		int Interrupted,
+		mumudvb_adapter_t **adapters,
+		int num_adapters,
+		pthread_t *monitorthread,
+		hls_thread_parameters_t *hls_thread_params,
+		pthread_t *hlsthread)
+{
+
+	int iadapter;
+	int iRet;
+
+	if (Interrupted)
+	{
+		if(Interrupted< (1<<8)) //we check if it's a signal or a mumudvb error
+			log_message( log_module,  MSG_INFO, "Caught signal %d - closing cleanly.\n",
+					Interrupted);
+		else
+			log_message( log_module,  MSG_INFO, "Closing cleanly. Error %d\n",Interrupted>>8);
 	}
-	if(unicast_vars->pfds) {
-		free(unicast_vars->pfds);
-		unicast_vars->pfds=NULL;
+#if !defined __UCLIBC__ && !defined ANDROID && !defined(_WIN32)
+	struct timespec ts;
+#endif
+
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+		mumudvb_stop_adapter_threads(adapters[iadapter]);
+
+	//We shutdown the monitoring thread
+	if(!pthread_equal(*monitorthread, pthread_self()))
+	{
+		log_message(log_module,MSG_DEBUG,"Monitor Thread closing\n");
+		monitor_thread_params->threadshutdown=1;
+#if !defined __UCLIBC__ && !defined ANDROID && !defined(_WIN32)
+		clock_gettime(CLOCK_REALTIME, &ts);
+		ts.tv_sec += 5;
+		iRet=pthread_timedjoin_np(*monitorthread, NULL, &ts);
+#else
+		iRet=pthread_join(*monitorthread, NULL);
+#endif
+		if(iRet)
+			log_message(log_module,MSG_WARN,"Monitor Thread badly closed: %s\n", strerror(iRet));
+	}
+
+	if(!pthread_equal(*hlsthread, pthread_self()))
+	{
+		log_message(log_module,MSG_DEBUG,"HLS Thread closing\n");
+		hls_thread_params->threadshutdown=1;
+		hls_stop(unicast_vars);
 	}
+
+	for (iadapter = 0; iadapter < num_adapters; iadapter++)
+		mumudvb_close_adapter(adapters[iadapter]);
+
+#ifdef ENABLE_ARIB_SUPPORT
+	/* Close ARIB B24 decoder instance */
+	close_arib_instance();
+#endif
+
+	//We close the unicast connections and free the clients
+	unicast_freeing(unicast_vars);
+
+	//sap variables freeing
+	mumu_table_release(sap_p->sap_messages4, sizeof(mumudvb_sap_message_t)*sap_p->sap_messages_size);
+	mumu_table_release(sap_p->sap_messages6, sizeof(mumudvb_sap_message_t)*sap_p->sap_messages_size);
+
+	if (!no_daemon)
+	{
+		if (remove (filename_pid))
+		{
+			log_message( log_module,  MSG_INFO, "%s: %s\n",
+					filename_pid, strerror (errno));
+			exit(ERROR_DEL_FILE);
+		}
+	}
+
+	unicast_free_fds(unicast_vars);
 	if(unicast_vars->hls_storage_dir) {
 		free(unicast_vars->hls_storage_dir);
 		unicast_vars->hls_storage_dir=NULL;
@@ -478,37 +544,307 @@ int mumudvb_close(int no_daemon,
 
 }
 
+/** @brief The monitoring of one adapter: traffic, scrambling, up/down detection and streamed channels files
+ * Called with the channels lock held
+ */
+static void monitor_adapter(monitor_parameters_t *params, double monitor_now)
+{
+	int curr_channel;
+#ifdef ENABLE_SCAM_SUPPORT
+	struct scam_parameters_t *scam_vars;
+	scam_vars=(struct scam_parameters_t *) params->scam_vars_v;
+#endif
 
+	/*******************************************/
+	/* compute the bandwidth occupied by        */
+	/* each channel                            */
+	/*******************************************/
+	float time_interval;
+	if(!params->stats_infos->compute_traffic_time)
+		params->stats_infos->compute_traffic_time=monitor_now;
+	if((monitor_now-params->stats_infos->compute_traffic_time)>=params->stats_infos->compute_traffic_interval)
+	{
+		time_interval = (float)(monitor_now - params->stats_infos->compute_traffic_time);
+		params->stats_infos->compute_traffic_time=monitor_now;
+		for (curr_channel = 0; curr_channel < params->chan_p->number_of_channels; curr_channel++)
+		{
+			mumudvb_channel_t *current;
+			current=&params->chan_p->channels[curr_channel];
+			pthread_mutex_lock(&current->stats_lock);
+			if (time_interval!=0)
+				params->chan_p->channels[curr_channel].traffic=((float)params->chan_p->channels[curr_channel].sent_data)/time_interval*1/1000;
+			else
+				params->chan_p->channels[curr_channel].traffic=0;
+			params->chan_p->channels[curr_channel].sent_data=0;
+			pthread_mutex_unlock(&current->stats_lock);
+		}
+	}
 
+	/*******************************************/
+	/*show the bandwidth measurement            */
+	/*******************************************/
+	if(params->stats_infos->show_traffic)
+	{
+		show_traffic(log_module,monitor_now, params->stats_infos, params->chan_p);
+	}
 
 
+	/*******************************************/
+	/* Show the statistics for the big buffer  */
+	/*******************************************/
+	if(params->stats_infos->show_buffer_stats)
+	{
+		if(!params->stats_infos->show_buffer_stats_time)
+			params->stats_infos->show_buffer_stats_time=monitor_now;
+		if((monitor_now-params->stats_infos->show_buffer_stats_time)>=params->stats_infos->show_buffer_stats_interval)
+		{
+			params->stats_infos->show_buffer_stats_time=monitor_now;
+			if (params->stats_infos->stats_num_reads!=0)
+				log_message( log_module,  MSG_DETAIL, "Average packets in the buffer %d\n", params->stats_infos->stats_num_packets_received/params->stats_infos->stats_num_reads);
+			else
+				log_message( log_module,  MSG_DETAIL, "Average packets in the buffer cannot be calculated - No packets read!\n");
+			params->stats_infos->stats_num_packets_received=0;
+			params->stats_infos->stats_num_reads=0;
+			params->num_big_buffer_show++;
+			if(params->num_big_buffer_show==10)
+				params->stats_infos->show_buffer_stats=0;
+		}
+	}
 
+	/*******************************************/
+	/* Check if the channel scrambling state    */
+	/* has changed                             */
+	/*******************************************/
+	// Current thresholds for calculation
+	// (<2%) FULLY_UNSCRAMBLED
+	// (5%<=ratio<=75%) PARTIALLY_UNSCRAMBLED
+	// (>80%) HIGHLY_SCRAMBLED
+	// The gap is an hysteresis to avoid excessive jumping between states
+	for (curr_channel = 0; curr_channel < params->chan_p->number_of_channels; curr_channel++)
+	{
+		mumudvb_channel_t *current;
+		current=&params->chan_p->channels[curr_channel];
+		if(current->channel_ready<READY)
+			continue;
+		pthread_mutex_lock(&current->stats_lock);
+		/* Calculation of the ratio (percentage) of scrambled packets received*/
+		if (current->num_packet >0 && current->num_scrambled_packets>10)
+			current->ratio_scrambled = (int)(current->num_scrambled_packets*100/(current->num_packet));
+		else
+			current->ratio_scrambled = 0;
+
+		/* Test if we have only unscrambled packets (<2%) - scrambled_channel=FULLY_UNSCRAMBLED : fully unscrambled*/
+		if ((current->ratio_scrambled < 2) && (current->scrambled_channel != FULLY_UNSCRAMBLED))
+		{
+			log_message( log_module,  MSG_INFO,
+					"Channel \"%s\" is now fully unscrambled (%d%% of scrambled packets). Card %d\n",
+					current->name, current->ratio_scrambled, params->tune_p->card);
+			current->scrambled_channel = FULLY_UNSCRAMBLED;// update
+		}
+		/* Test if we have partially unscrambled packets (5%<=ratio<=75%) - scrambled_channel=PARTIALLY_UNSCRAMBLED : partially unscrambled*/
+		if ((current->ratio_scrambled >= 5) && (current->ratio_scrambled <= 75) && (current->scrambled_channel != PARTIALLY_UNSCRAMBLED))
+		{
+			log_message( log_module,  MSG_INFO,
+					"Channel \"%s\" is now partially unscrambled (%d%% of scrambled packets). Card %d\n",
+					current->name, current->ratio_scrambled, params->tune_p->card);
+			current->scrambled_channel = PARTIALLY_UNSCRAMBLED;// update
+		}
+		/* Test if we have nearly only scrambled packets (>80%) - scrambled_channel=HIGHLY_SCRAMBLED : highly scrambled*/
+		if ((current->ratio_scrambled > 80) && current->scrambled_channel != HIGHLY_SCRAMBLED)
+		{
+			log_message( log_module,  MSG_INFO,
+					"Channel \"%s\" is now highly scrambled (%d%% of scrambled packets). Card %d\n",
+					current->name, current->ratio_scrambled, params->tune_p->card);
+			current->scrambled_channel = HIGHLY_SCRAMBLED;// update
+		}
+		/* Check the PID scrambling state */
+		int curr_pid;
+		for (curr_pid = 0; curr_pid < current->pid_i.num_pids; curr_pid++)
+		{
+			if (current->pid_i.pids_num_scrambled_packets[curr_pid]>0)
+				current->pid_i.pids_scrambled[curr_pid]=1;
+			else
+				current->pid_i.pids_scrambled[curr_pid]=0;
+			current->pid_i.pids_num_scrambled_packets[curr_pid]=0;
+		}
+		pthread_mutex_unlock(&current->stats_lock);
+	}
 
 
 
 
 
 
+
+	/*******************************************/
+	/* Check if the channel stream state       */
+	/* has changed                             */
+	/*******************************************/
+	if(params->last_updown_check)
+	{
+		/* Check if the channel stream state has changed*/
+		for (curr_channel = 0; curr_channel < params->chan_p->number_of_channels; curr_channel++)
+		{
+			mumudvb_channel_t *current;
+			current=&params->chan_p->channels[curr_channel];
+			if(current->channel_ready<READY)
+				continue;
+			double packets_per_sec;
+			int num_scrambled;
+			pthread_mutex_lock(&current->stats_lock);
+			if(dont_send_scrambled) {
+				num_scrambled=current->num_scrambled_packets;
+			}
+			else
+				num_scrambled=0;
+			if (monitor_now>params->last_updown_check)
+				packets_per_sec=((double)current->num_packet-num_scrambled)/(monitor_now-params->last_updown_check);
+			else
+				packets_per_sec=0;
+			pthread_mutex_unlock(&current->stats_lock);
+			if( params->stats_infos->debug_updown)
+			{
+				log_message( log_module,  MSG_FLOOD,
+						"Channel \"%s\" streamed_channel %f packets/s\n",
+						current->name,packets_per_sec);
+			}
+			if ((packets_per_sec >= params->stats_infos->up_threshold) && (!current->has_traffic))
+			{
+				log_message( log_module,  MSG_INFO,
+						"Channel \"%s\" back.Card %d\n",
+						current->name, params->tune_p->card);
+				current->has_traffic = 1;  // update
+			}
+			else if ((current->has_traffic) && (packets_per_sec < params->stats_infos->down_threshold))
+			{
+				log_message( log_module,  MSG_INFO,
+						"Channel \"%s\" down.Card %d\n",
+						current->name, params->tune_p->card);
+				current->has_traffic = 0;  // update
+			}
+		}
+	}
+	/* reinit */
+	for (curr_channel = 0; curr_channel < params->chan_p->number_of_channels; curr_channel++)
+	{
+		mumudvb_channel_t *current;
+		current=&params->chan_p->channels[curr_channel];
+		if(current->channel_ready<READY)
+			continue;
+		pthread_mutex_lock(&current->stats_lock);
+		params->chan_p->channels[curr_channel].num_packet = 0;
+		params->chan_p->channels[curr_channel].num_scrambled_packets = 0;
+		pthread_mutex_unlock(&current->stats_lock);
+	}
+	params->last_updown_check=monitor_now;
+
+
+
+
+
+	/*******************************************/
+	/* we count active channels                */
+	/*******************************************/
+	int count_of_active_channels=0;
+	for (curr_channel = 0; curr_channel < params->chan_p->number_of_channels; curr_channel++)
+		if (params->chan_p->channels[curr_channel].has_traffic && params->chan_p->channels[curr_channel].channel_ready>=READY )
+			count_of_active_channels++;
+
+	/*Time no diff is the time when we got 0 active channels*/
+	/*if we have active channels, we reinit this counter*/
+	if(count_of_active_channels)
+		params->time_no_diff=0;
+	/*If we don't have active channels and this is the first time, we store the time*/
+	else if(!params->time_no_diff)
+		params->time_no_diff=(long)monitor_now;
+
+
+
+	/*******************************************/
+	/* If we don't stream data for             */
+	/* a too long time, we start tuning        */
+	/*******************************************/
+#ifndef _WIN32
+	if((tuning_no_diff)&& (params->time_no_diff && ((monitor_now-params->time_no_diff)>tuning_no_diff)) && !strlen(params->tune_p->read_file_path) && params->fds->fd_source <= 0 && !params->fds->virtual_input)
+	{
+		log_message( log_module,  MSG_ERROR, "No data from card %d in %ds, start tuning loop.\n", params->tune_p->card, tuning_no_diff);
+		// tune here
+            tune_it(params->fds->fd_frontend, params->tune_p);
+            params->time_no_diff=0;
+	}
+#endif
+
+#ifdef ENABLE_SCAM_SUPPORT
+	if (scam_vars->scam_support) {
+		/*******************************************/
+		/* we check num of packets in ring buffer                */
+		/*******************************************/
+		for (curr_channel = 0; curr_channel < params->chan_p->number_of_channels; curr_channel++) {
+			mumudvb_channel_t *channel = &params->chan_p->channels[curr_channel];
+			if (channel->scam_support && channel->channel_ready>=READY) {
+				//send capmt if needed
+				if (channel->need_scam_ask==CAM_NEED_ASK) {
+					if (channel->scam_support) {
+						pthread_mutex_lock(&channel->scam_pmt_packet->packetmutex);
+						if (channel->scam_pmt_packet->len_full != 0 ) {
+							if (!scam_send_capmt(channel, scam_vars ,params->tune_p->card))
+							{
+								channel->need_scam_ask=CAM_ASKED;
+							}
+						}
+						pthread_mutex_unlock(&channel->scam_pmt_packet->packetmutex);
+					}
+				}
+
+				unsigned int ring_buffer_num_packets = 0;
+				unsigned int to_descramble = 0;
+				unsigned int to_send = 0;
+
+				if (channel->ring_buf) {
+					pthread_mutex_lock(&channel->ring_buf->lock);
+					to_descramble = channel->ring_buf->to_descramble;
+					to_send = channel->ring_buf->to_send;
+					ring_buffer_num_packets = to_descramble + to_send;
+					pthread_mutex_unlock(&channel->ring_buf->lock);
+				}
+				if (ring_buffer_num_packets>=channel->ring_buffer_size)
+					log_message( log_module,  MSG_ERROR, "%s: ring buffer overflow, packets in ring buffer %u, ring buffer size %llu\n",channel->name, ring_buffer_num_packets, (long long unsigned int)channel->ring_buffer_size);
+				else
+					log_message( log_module,  MSG_DEBUG, "%s: packets in ring buffer %u, ring buffer size %llu, to descramble %u, to send %u\n",channel->name, ring_buffer_num_packets, (long long unsigned int)channel->ring_buffer_size, to_descramble, to_send);
+			}
+		}
+	}
+
+#endif
+
+
+
+	/*******************************************/
+	/* generation of the file which says       */
+	/* the streamed channels                   */
+	/*******************************************/
+	if (write_streamed_channels)
+		gen_file_streamed_channels(params->filename_channels_streamed, params->filename_channels_not_streamed, params->chan_p->number_of_channels, params->chan_p->channels);
+}
+
+/** @brief The monitor thread, it monitors all the adapters and sends the SAP announces
+ */
 void *monitor_func(void* arg)
 {
 	monitor_parameters_t  *params;
+	monitor_parameters_t  *adapter;
 	params= (monitor_parameters_t  *) arg;
-	int i,curr_channel;
+	int i;
 	struct timeval tv;
 	double monitor_now;
 	double monitor_start;
-	double last_updown_check=0;
 	double last_flush_time = 0;
-	double time_no_diff=0;
-	int num_big_buffer_show=0;
+	int num_channels;
+	int no_diff_timeout;
 
 	gettimeofday (&tv, (struct timezone *) NULL);
 	monitor_start = tv.tv_sec + tv.tv_usec/1000000;
 	monitor_now = monitor_start;
-#ifdef ENABLE_SCAM_SUPPORT
-	struct scam_parameters_t *scam_vars;
-	scam_vars=(struct scam_parameters_t *) params->scam_vars_v;
-#endif
 	while(!params->threadshutdown)
 	{
 		gettimeofday (&tv, (struct timezone *) NULL);
@@ -521,12 +857,14 @@ void *monitor_func(void* arg)
 #ifndef DISABLE_DVB_API
 		if (received_signal == SIGUSR1) //Display signal strength
 		{
-			params->tune_p->display_strenght = params->tune_p->display_strenght ? 0 : 1;
+			for(adapter=params; adapter; adapter=adapter->next)
+				adapter->tune_p->display_strenght = adapter->tune_p->display_strenght ? 0 : 1;
 			received_signal = 0;
 		}
 		else if (received_signal == SIGUSR2) //Display traffic
 		{
-			params->stats_infos->show_traffic = params->stats_infos->show_traffic ? 0 : 1;
+			for(adapter=params; adapter; adapter=adapter->next)
+				adapter->stats_infos->show_traffic = adapter->stats_infos->show_traffic ? 0 : 1;
 			if(params->stats_infos->show_traffic)
 				log_message( log_module, MSG_INFO,"The traffic will be shown every %d seconds\n",params->stats_infos->show_traffic_interval);
 			else
@@ -541,68 +879,25 @@ void *monitor_func(void* arg)
 		}
 #endif
 
-		pthread_mutex_lock(&params->chan_p->lock);
-
-		/*we are not doing autoconfiguration we can do something else*/
-		/*sap announces*/
-		sap_poll(params->sap_p,params->chan_p->number_of_channels,params->chan_p->channels,*params->multi_p, (long)monitor_now);
-
-
-
-		/*******************************************/
-		/* compute the bandwidth occupied by        */
-		/* each channel                            */
-		/*******************************************/
-		float time_interval;
-		if(!params->stats_infos->compute_traffic_time)
-			params->stats_infos->compute_traffic_time=monitor_now;
-		if((monitor_now-params->stats_infos->compute_traffic_time)>=params->stats_infos->compute_traffic_interval)
-		{
-			time_interval = (float)(monitor_now - params->stats_infos->compute_traffic_time);
-			params->stats_infos->compute_traffic_time=monitor_now;
-			for (curr_channel = 0; curr_channel < params->chan_p->number_of_channels; curr_channel++)
-			{
-				mumudvb_channel_t *current;
-				current=&params->chan_p->channels[curr_channel];
-				pthread_mutex_lock(&current->stats_lock);
-				if (time_interval!=0)
-					params->chan_p->channels[curr_channel].traffic=((float)params->chan_p->channels[curr_channel].sent_data)/time_interval*1/1000;
-				else
-					params->chan_p->channels[curr_channel].traffic=0;
-				params->chan_p->channels[curr_channel].sent_data=0;
-				pthread_mutex_unlock(&current->stats_lock);
-			}
-		}
-
-		/*******************************************/
-		/*show the bandwidth measurement            */
-		/*******************************************/
-		if(params->stats_infos->show_traffic)
+		num_channels=0;
+		for(adapter=params; adapter; adapter=adapter->next)
 		{
-			show_traffic(log_module,monitor_now, params->stats_infos->show_traffic_interval, params->chan_p);
+			pthread_mutex_lock(&adapter->chan_p->lock);
+			/*sap announces, each channel has the message of its number*/
+			sap_update_channels(params->sap_p, adapter->chan_p, *adapter->multi_p);
+			num_channels=adapter->chan_p->first_channel+adapter->chan_p->number_of_channels;
 		}
 
+		/*we are not doing autoconfiguration we can do something else*/
+		/*sap announces*/
+		sap_poll(params->sap_p, num_channels, (long)monitor_now);
 
-		/*******************************************/
-		/* Show the statistics for the big buffer  */
-		/*******************************************/
-		if(params->stats_infos->show_buffer_stats)
+		no_diff_timeout=1;
+		for(adapter=params; adapter; adapter=adapter->next)
 		{
-			if(!params->stats_infos->show_buffer_stats_time)
-				params->stats_infos->show_buffer_stats_time=monitor_now;
-			if((monitor_now-params->stats_infos->show_buffer_stats_time)>=params->stats_infos->show_buffer_stats_interval)
-			{
-				params->stats_infos->show_buffer_stats_time=monitor_now;
-				if (params->stats_infos->stats_num_reads!=0)
-					log_message( log_module,  MSG_DETAIL, "Average packets in the buffer %d\n", params->stats_infos->stats_num_packets_received/params->stats_infos->stats_num_reads);
-				else
-					log_message( log_module,  MSG_DETAIL, "Average packets in the buffer cannot be calculated - No packets read!\n");
-				params->stats_infos->stats_num_packets_received=0;
-				params->stats_infos->stats_num_reads=0;
-				num_big_buffer_show++;
-				if(num_big_buffer_show==10)
-					params->stats_infos->show_buffer_stats=0;
-			}
+			monitor_adapter(adapter, monitor_now);
+			if(!(timeout_no_diff && adapter->time_no_diff && ((monitor_now-adapter->time_no_diff)>timeout_no_diff)))
+				no_diff_timeout=0;
 		}
 
 		/*******************************************/
@@ -623,236 +918,21 @@ void *monitor_func(void* arg)
 			}
 		}
 
-		/*******************************************/
-		/* Check if the channel scrambling state    */
-		/* has changed                             */
-		/*******************************************/
-		// Current thresholds for calculation
-		// (<2%) FULLY_UNSCRAMBLED
-		// (5%<=ratio<=75%) PARTIALLY_UNSCRAMBLED
-		// (>80%) HIGHLY_SCRAMBLED
-		// The gap is an hysteresis to avoid excessive jumping between states
-		for (curr_channel = 0; curr_channel < params->chan_p->number_of_channels; curr_channel++)
-		{
-			mumudvb_channel_t *current;
-			current=&params->chan_p->channels[curr_channel];
-			if(current->channel_ready<READY)
-				continue;
-			pthread_mutex_lock(&current->stats_lock);
-			/* Calculation of the ratio (percentage) of scrambled packets received*/
-			if (current->num_packet >0 && current->num_scrambled_packets>10)
-				current->ratio_scrambled = (int)(current->num_scrambled_packets*100/(current->num_packet));
-			else
-				current->ratio_scrambled = 0;
-
-			/* Test if we have only unscrambled packets (<2%) - scrambled_channel=FULLY_UNSCRAMBLED : fully unscrambled*/
-			if ((current->ratio_scrambled < 2) && (current->scrambled_channel != FULLY_UNSCRAMBLED))
-			{
-				log_message( log_module,  MSG_INFO,
-						"Channel \"%s\" is now fully unscrambled (%d%% of scrambled packets). Card %d\n",
-						current->name, current->ratio_scrambled, params->tune_p->card);
-				current->scrambled_channel = FULLY_UNSCRAMBLED;// update
-			}
-			/* Test if we have partially unscrambled packets (5%<=ratio<=75%) - scrambled_channel=PARTIALLY_UNSCRAMBLED : partially unscrambled*/
-			if ((current->ratio_scrambled >= 5) && (current->ratio_scrambled <= 75) && (current->scrambled_channel != PARTIALLY_UNSCRAMBLED))
-			{
-				log_message( log_module,  MSG_INFO,
-						"Channel \"%s\" is now partially unscrambled (%d%% of scrambled packets). Card %d\n",
-						current->name, current->ratio_scrambled, params->tune_p->card);
-				current->scrambled_channel = PARTIALLY_UNSCRAMBLED;// update
-			}
-			/* Test if we have nearly only scrambled packets (>80%) - scrambled_channel=HIGHLY_SCRAMBLED : highly scrambled*/
-			if ((current->ratio_scrambled > 80) && current->scrambled_channel != HIGHLY_SCRAMBLED)
-			{
-				log_message( log_module,  MSG_INFO,
-						"Channel \"%s\" is now highly scrambled (%d%% of scrambled packets). Card %d\n",
-						current->name, current->ratio_scrambled, params->tune_p->card);
-				current->scrambled_channel = HIGHLY_SCRAMBLED;// update
-			}
-			/* Check the PID scrambling state */
-			int curr_pid;
-			for (curr_pid = 0; curr_pid < current->pid_i.num_pids; curr_pid++)
-			{
-				if (current->pid_i.pids_num_scrambled_packets[curr_pid]>0)
-					current->pid_i.pids_scrambled[curr_pid]=1;
-				else
-					current->pid_i.pids_scrambled[curr_pid]=0;
-				current->pid_i.pids_num_scrambled_packets[curr_pid]=0;
-			}
-			pthread_mutex_unlock(&current->stats_lock);
-		}
-
-
-
-
-
-
-
-		/*******************************************/
-		/* Check if the channel stream state       */
-		/* has changed                             */
-		/*******************************************/
-		if(last_updown_check)
-		{
-			/* Check if the channel stream state has changed*/
-			for (curr_channel = 0; curr_channel < params->chan_p->number_of_channels; curr_channel++)
-			{
-				mumudvb_channel_t *current;
-				current=&params->chan_p->channels[curr_channel];
-				if(current->channel_ready<READY)
-					continue;
-				double packets_per_sec;
-				int num_scrambled;
-				pthread_mutex_lock(&current->stats_lock);
-				if(dont_send_scrambled) {
-					num_scrambled=current->num_scrambled_packets;
-				}
-				else
-					num_scrambled=0;
-				if (monitor_now>last_updown_check)
-					packets_per_sec=((double)current->num_packet-num_scrambled)/(monitor_now-last_updown_check);
-				else
-					packets_per_sec=0;
-				pthread_mutex_unlock(&current->stats_lock);
-				if( params->stats_infos->debug_updown)
-				{
-					log_message( log_module,  MSG_FLOOD,
-							"Channel \"%s\" streamed_channel %f packets/s\n",
-							current->name,packets_per_sec);
-				}
-				if ((packets_per_sec >= params->stats_infos->up_threshold) && (!current->has_traffic))
-				{
-					log_message( log_module,  MSG_INFO,
-							"Channel \"%s\" back.Card %d\n",
-							current->name, params->tune_p->card);
-					current->has_traffic = 1;  // update
-				}
-				else if ((current->has_traffic) && (packets_per_sec < params->stats_infos->down_threshold))
-				{
-					log_message( log_module,  MSG_INFO,
-							"Channel \"%s\" down.Card %d\n",
-							current->name, params->tune_p->card);
-					current->has_traffic = 0;  // update
-				}
-			}
-		}
-		/* reinit */
-		for (curr_channel = 0; curr_channel < params->chan_p->number_of_channels; curr_channel++)
-		{
-			mumudvb_channel_t *current;
-			current=&params->chan_p->channels[curr_channel];
-			if(current->channel_ready<READY)
-				continue;
-			pthread_mutex_lock(&current->stats_lock);
-			params->chan_p->channels[curr_channel].num_packet = 0;
-			params->chan_p->channels[curr_channel].num_scrambled_packets = 0;
-			pthread_mutex_unlock(&current->stats_lock);
-		}
-		last_updown_check=monitor_now;
-
-
-
-
-
-		/*******************************************/
-		/* we count active channels                */
-		/*******************************************/
-		int count_of_active_channels=0;
-		for (curr_channel = 0; curr_channel < params->chan_p->number_of_channels; curr_channel++)
-			if (params->chan_p->channels[curr_channel].has_traffic && params->chan_p->channels[curr_channel].channel_ready>=READY )
-				count_of_active_channels++;
-
-		/*Time no diff is the time when we got 0 active channels*/
-		/*if we have active channels, we reinit this counter*/
-		if(count_of_active_channels)
-			time_no_diff=0;
-		/*If we don't have active channels and this is the first time, we store the time*/
-		else if(!time_no_diff)
-			time_no_diff=(long)monitor_now;
-
-
-
 		/*******************************************/
 		/* If we don't stream data for             */
 		/* a too long time, we exit                */
 		/*******************************************/
-		if((timeout_no_diff)&& (time_no_diff&&((monitor_now-time_no_diff)>timeout_no_diff)))
+		if(no_diff_timeout)
 		{
-			log_message( log_module,  MSG_ERROR,
-					"No data from card %d in %ds, exiting.\n",
-					params->tune_p->card, timeout_no_diff);
+			for(adapter=params; adapter; adapter=adapter->next)
+				log_message( log_module,  MSG_ERROR,
+						"No data from card %d in %ds, exiting.\n",
+						adapter->tune_p->card, timeout_no_diff);
 			set_interrupted(ERROR_NO_DIFF<<8); //the <<8 is to make difference between signals and errors
 		}
 
-		/*******************************************/
-		/* If we don't stream data for             */
-		/* a too long time, we start tuning        */
-		/*******************************************/
-#ifndef _WIN32
-		if((tuning_no_diff)&& (time_no_diff && ((monitor_now-time_no_diff)>tuning_no_diff)) && !strlen(params->tune_p->read_file_path))
-		{
-			log_message( log_module,  MSG_ERROR, "No data from card %d in %ds, start tuning loop.\n", params->tune_p->card, tuning_no_diff);
-			// tune here
-            tune_it(params->fds->fd_frontend, params->tune_p);
-            time_no_diff=0;
-		}
-#endif
-
-#ifdef ENABLE_SCAM_SUPPORT
-		if (scam_vars->scam_support) {
-			/*******************************************/
-			/* we check num of packets in ring buffer                */
-			/*******************************************/
-			for (curr_channel = 0; curr_channel < params->chan_p->number_of_channels; curr_channel++) {
-				mumudvb_channel_t *channel = &params->chan_p->channels[curr_channel];
-				if (channel->scam_support && channel->channel_ready>=READY) {
-					//send capmt if needed
-					if (channel->need_scam_ask==CAM_NEED_ASK) {
-						if (channel->scam_support) {
-							pthread_mutex_lock(&channel->scam_pmt_packet->packetmutex);
-							if (channel->scam_pmt_packet->len_full != 0 ) {
-								if (!scam_send_capmt(channel, scam_vars ,params->tune_p->card))
-								{
-									channel->need_scam_ask=CAM_ASKED;
-								}
-							}
-							pthread_mutex_unlock(&channel->scam_pmt_packet->packetmutex);
-						}
-					}
-
-					unsigned int ring_buffer_num_packets = 0;
-					unsigned int to_descramble = 0;
-					unsigned int to_send = 0;
-
-					if (channel->ring_buf) {
-						pthread_mutex_lock(&channel->ring_buf->lock);
-						to_descramble = channel->ring_buf->to_descramble;
-						to_send = channel->ring_buf->to_send;
-						ring_buffer_num_packets = to_descramble + to_send;
-						pthread_mutex_unlock(&channel->ring_buf->lock);
-					}
-					if (ring_buffer_num_packets>=channel->ring_buffer_size)
-						log_message( log_module,  MSG_ERROR, "%s: ring buffer overflow, packets in ring buffer %u, ring buffer size %llu\n",channel->name, ring_buffer_num_packets, (long long unsigned int)channel->ring_buffer_size);
-					else
-						log_message( log_module,  MSG_DEBUG, "%s: packets in ring buffer %u, ring buffer size %llu, to descramble %u, to send %u\n",channel->name, ring_buffer_num_packets, (long long unsigned int)channel->ring_buffer_size, to_descramble, to_send);
-				}
-			}
-		}
-
-#endif
-
-
-
-		/*******************************************/
-		/* generation of the file which says       */
-		/* the streamed channels                   */
-		/*******************************************/
-		if (write_streamed_channels)
-			gen_file_streamed_channels(params->filename_channels_streamed, params->filename_channels_not_streamed, params->chan_p->number_of_channels, params->chan_p->channels);
-
-
-
-		pthread_mutex_unlock(&params->chan_p->lock);
+		for(adapter=params; adapter; adapter=adapter->next)
+			pthread_mutex_unlock(&adapter->chan_p->lock);
 
 		for(i=0;i<params->wait_time && !params->threadshutdown;i++)
 			usleep(100000);
@@ -861,3 +941,4 @@ void *monitor_func(void* arg)
 	log_message(log_module,MSG_DEBUG, "Monitor thread stopping, it lasted %f seconds\n", monitor_now);
 	return 0;
 }
+
@@ -24,31 +24,80 @@
 #include "log.h"
 #include "hls.h"
 
+#include "demux.h"
+#include "udp_source.h"
+#include "t2mi.h"
+#ifdef ENABLE_BENCHMARK
+#include "benchmark.h"
+#endif
+
+/** @brief Everything about one adapter (one configuration file)
+ *
+ * Each adapter has its own tuning, input, channels, autoconfiguration and demux.
+ * The HTTP server, the unicast clients, the SAP announces and HLS are shared by all the adapters.
+ */
+typedef struct mumudvb_adapter_t{
+	/** The adapter number, in the order of the configuration files */
+	int id;
+	char *conf_filename;
+	fds_t fds;
+	mumu_chan_p_t chan_p;
+	tune_p_t tune_p;
+	auto_p_t auto_p;
+	multi_p_t multi_p;
+	rewrite_parameters_t rewrite_vars;
+	demux_parameters_t demux_p;
+	stats_infos_t stats_infos;
+	card_buffer_t card_buffer;
+	/** The UDP/RTP source, if source_addr is set */
+	udp_source_t udp_source;
+	/** The extraction of our PLP (t2mi_pid, t2mi_plp) */
+	t2mi_plp_t t2mi;
+	/** The T2-MI decapsulation of our input : our PLP and the PLPs of the adapters sharing our input */
+	t2mi_demux_t t2mi_demux;
+	/** The adapter whose input we use (same input and T2-MI), NULL if we read our own input */
+	struct mumudvb_adapter_t *t2mi_input;
+	/** The next adapter sharing our input */
+	struct mumudvb_adapter_t *t2mi_next;
+	/** Our reader number for the routing table of the adapter (main thread) */
+	int route_reader;
+	pthread_t cardthread;
+	card_thread_parameters_t cardthreadparams;
+	pthread_t signalpowerthread;
+	strength_parameters_t strengthparams;
+	monitor_parameters_t monitor_params;
+#ifdef ENABLE_CAM_SUPPORT
+	cam_p_t cam_p;
+#endif
+#ifdef ENABLE_SCAM_SUPPORT
+	scam_parameters_t scam_vars;
+#endif
+	void *cam_p_ptr;
+	void *scam_vars_ptr;
+	char filename_channels_not_streamed[DEFAULT_PATH_LEN];
+	char filename_channels_streamed[DEFAULT_PATH_LEN];
+#ifdef ENABLE_BENCHMARK
+	benchmark_t benchmark;
+#endif
+}mumudvb_adapter_t;
+
 void *monitor_func(void* arg);
 int mumudvb_close(int no_daemon,
 		monitor_parameters_t *monitor_thread_params,
-		rewrite_parameters_t *rewrite_vars,
-		auto_p_t *auto_p,
 		unicast_parameters_t *unicast_vars,
-		volatile int *strengththreadshutdown,
-		void *cam_p_v,
-		void *scam_vars_v,
-		char *filename_channels_not_streamed,
-		char *filename_channels_streamed,
+		sap_p_t *sap_p,
 		char *filename_pid,
 		int Interrupted,
-		mumu_chan_p_t *chan_p,
-		pthread_t *signalpowerthread,
+		mumudvb_adapter_t **adapters,
+		int num_adapters,
 		pthread_t *monitorthread,
-		card_thread_parameters_t *cardthreadparams,
-		fds_t *fds,
-		card_buffer_t *card_buffer,
 		hls_thread_parameters_t *hls_thread_params,
 		pthread_t *hlsthread);
 
 
 void parse_cmd_line(int argc, char **argv,
-		char **conf_filename,
+		char **conf_filenames,
+		int *num_conf_files,
 		tune_p_t *tune_p,
 		stats_infos_t *stats_infos,
 		int *server_id,
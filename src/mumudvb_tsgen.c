@@ -0,0 +1,859 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2010 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief Synthetic transport stream generator, to test MuMuDVB without a DVB card
+ *
+ * It generates N services, each with a video PID carrying the PCR, an audio PID,
+ * a PMT and, if the service is scrambled, a CA descriptor and an ECM PID. The PAT,
+ * SDT and EIT present/following tables describe the services. The packets of each
+ * PID are evenly spaced following the bitrate of the service, the stream can be
+ * written to a file, a pipe or sent over UDP (optionally RTP) at its real rate.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include "errors.h"
+
+extern uint32_t crc32_table[256];
+
+#define TS_PACKET_SIZE 188
+#define TS_SYNC_BYTE 0x47
+/** Packets per datagram and per write */
+#define TSGEN_CHUNK_PACKETS 7
+#define TSGEN_MAX_SERVICES 500
+/** The maximum size of a section body, the section being at most 1024 bytes */
+#define TSGEN_MAX_SECTION_BODY 1000
+#define TSGEN_MAX_RATES 64
+
+#define TSGEN_PAT_PID 0x00
+#define TSGEN_SDT_PID 0x11
+#define TSGEN_EIT_PID 0x12
+#define TSGEN_PMT_PID_BASE 0x1000
+#define TSGEN_ES_PID_BASE 0x100
+#define TSGEN_CA_SYSTEM_ID 0x0100
+
+/** Repetition periods of the tables and of the PCR, in seconds */
+#define TSGEN_PAT_PERIOD 0.1
+#define TSGEN_PMT_PERIOD 0.1
+#define TSGEN_SDT_PERIOD 0.5
+#define TSGEN_EIT_PERIOD 2.0
+#define TSGEN_PCR_PERIOD 0.04
+#define TSGEN_ECM_RATE 10
+#define TSGEN_AUDIO_BITRATE 192000
+
+enum
+{
+	TSGEN_TABLE,
+	TSGEN_VIDEO,
+	TSGEN_AUDIO,
+	TSGEN_ECM,
+};
+
+/** @brief A PID of the generated stream */
+typedef struct tsgen_stream_t{
+	int type;
+	int pid;
+	int service;
+	uint8_t continuity_counter;
+	/** Time between two packets, and time of the next packet (seconds) */
+	double interval;
+	double next;
+	/** For the tables: the packets of the sections, sent in a loop */
+	unsigned char *carousel;
+	int carousel_packets;
+	int carousel_pos;
+	/** For the video: the next PCR and the next frame (PES start) */
+	double next_pcr;
+	double next_frame;
+}tsgen_stream_t;
+
+/** @brief A generated service */
+typedef struct tsgen_service_t{
+	int service_id;
+	int pmt_pid;
+	int video_pid;
+	int audio_pid;
+	int ecm_pid;
+	int scrambled;
+	/** bit/s */
+	double bitrate;
+	char name[32];
+}tsgen_service_t;
+
+/** @brief The generator options and state */
+typedef struct tsgen_t{
+	int num_services;
+	double rates[TSGEN_MAX_RATES];
+	int num_rates;
+	/** Every scrambled_every service is scrambled, 0 for none */
+	int scrambled_every;
+	/** The scrambled packets change of key (even/odd) every crypto_period seconds */
+	double crypto_period;
+	double duration;
+	int pace;
+	int rtp;
+	int transport_stream_id;
+	int original_network_id;
+	char *output;
+	char *udp;
+	tsgen_service_t services[TSGEN_MAX_SERVICES];
+	tsgen_stream_t *streams;
+	int num_streams;
+	int fd;
+	struct sockaddr_storage dest;
+	socklen_t dest_len;
+	uint16_t rtp_seq;
+	unsigned char chunk[12+TSGEN_CHUNK_PACKETS*TS_PACKET_SIZE];
+	int chunk_packets;
+	uint32_t random;
+	uint64_t packets;
+}tsgen_t;
+
+static void usage(char *name)
+{
+	fprintf(stderr, "%s : synthetic transport stream generator for MuMuDVB\n\n"
+			"Usage: %s [options]\n"
+			"-n, --services N      : Number of services (default 4, up to %d)\n"
+			"-r, --rate R[,R...]   : Bitrate of the services in Mbit/s, given to the services in turn (default 4)\n"
+			"-s, --scrambled N     : Every Nth service is scrambled, with a CA descriptor and ECMs (default 0: none)\n"
+			"--crypto_period S     : The scrambled packets change of key every S seconds (default 10)\n"
+			"-d, --duration S      : Duration of the stream in seconds (default 0: endless)\n"
+			"-o, --output FILE     : Write the stream to FILE or a fifo, - for the standard output (default)\n"
+			"-u, --udp ADDR:PORT   : Send the stream over UDP, 7 packets per datagram\n"
+			"--rtp                 : Add a RTP header to the datagrams\n"
+			"-p, --pace            : Send the stream at its bitrate (always done with --udp)\n"
+			"--tsid ID             : Transport stream id (default 1)\n"
+			"--onid ID             : Original network id (default 1)\n"
+			"-h, --help            : Help\n",
+			name, name, TSGEN_MAX_SERVICES);
+}
+
+/** @brief The current time in seconds */
+static double tsgen_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t tsgen_random(tsgen_t *gen)
+{
+	//xorshift32
+	gen->random ^= gen->random << 13;
+	gen->random ^= gen->random >> 17;
+	gen->random ^= gen->random << 5;
+	return gen->random;
+}
+
+/** @brief Write a section : header, body and CRC32
+ * @return the length of the section
+ */
+static int tsgen_section(unsigned char *section, int table_id, int table_id_extension, int section_number, int last_section_number, unsigned char *body, int body_len)
+{
+	int len = 8 + body_len + 4;
+	uint32_t crc32 = 0xffffffff;
+
+	section[0] = table_id;
+	//section syntax indicator, reserved, section_length (after this field)
+	section[1] = 0xb0 | (((len - 3) >> 8) & 0x0f);
+	section[2] = (len - 3) & 0xff;
+	section[3] = table_id_extension >> 8;
+	section[4] = table_id_extension & 0xff;
+	//version 0, current
+	section[5] = 0xc1;
+	section[6] = section_number;
+	section[7] = last_section_number;
+	memcpy(section + 8, body, body_len);
+	for (int i = 0; i < len - 4; i++)
+		crc32 = (crc32 << 8) ^ crc32_table[((crc32 >> 24) ^ section[i]) & 0xff];
+	section[len - 4] = (crc32 >> 24) & 0xff;
+	section[len - 3] = (crc32 >> 16) & 0xff;
+	section[len - 2] = (crc32 >> 8) & 0xff;
+	section[len - 1] = crc32 & 0xff;
+	return len;
+}
+
+/** @brief Add the TS packets of a section to the carousel of a table PID */
+static void tsgen_carousel_add(tsgen_stream_t *stream, unsigned char *section, int len)
+{
+	int pos = 0;
+	int first = 1;
+	while (pos < len)
+	{
+		unsigned char *packet;
+		int payload;
+		stream->carousel = realloc(stream->carousel, (stream->carousel_packets + 1) * TS_PACKET_SIZE);
+		if (stream->carousel == NULL)
+		{
+			fprintf(stderr, "Problem with realloc : %s\n", strerror(errno));
+			exit(ERROR_MEMORY);
+		}
+		packet = stream->carousel + stream->carousel_packets * TS_PACKET_SIZE;
+		stream->carousel_packets++;
+		memset(packet, 0xff, TS_PACKET_SIZE);
+		packet[0] = TS_SYNC_BYTE;
+		packet[1] = (first ? 0x40 : 0) | (stream->pid >> 8);
+		packet[2] = stream->pid & 0xff;
+		packet[3] = 0x10;
+		payload = 4;
+		if (first)
+			packet[payload++] = 0; //pointer field
+		int copy = len - pos;
+		if (copy > TS_PACKET_SIZE - payload)
+			copy = TS_PACKET_SIZE - payload;
+		memcpy(packet + payload, section + pos, copy);
+		pos += copy;
+		first = 0;
+	}
+}
+
+/** @brief Add a table made of entries to a carousel, the entries are split in several sections if needed
+ *
+ * @param header the beginning of the body of each section (before the entries)
+ */
+static void tsgen_carousel_table(tsgen_stream_t *stream, int table_id, int table_id_extension, unsigned char *header, int header_len, unsigned char *entries, int *entry_len, int num_entries)
+{
+	unsigned char body[TSGEN_MAX_SECTION_BODY + 64];
+	unsigned char section[1024 + 64];
+	int num_sections = 0;
+	int first_entry[256];
+	int ientry = 0, pos = 0;
+
+	//We count the sections first, for last_section_number
+	while (ientry < num_entries || num_sections == 0)
+	{
+		int len = header_len;
+		first_entry[num_sections++] = ientry;
+		while (ientry < num_entries && len + entry_len[ientry] <= TSGEN_MAX_SECTION_BODY)
+			len += entry_len[ientry++];
+	}
+	first_entry[num_sections] = num_entries;
+	for (int isection = 0; isection < num_sections; isection++)
+	{
+		int len = header_len;
+		memcpy(body, header, header_len);
+		for (ientry = first_entry[isection]; ientry < first_entry[isection + 1]; ientry++)
+		{
+			memcpy(body + len, entries + pos, entry_len[ientry]);
+			len += entry_len[ientry];
+			pos += entry_len[ientry];
+		}
+		tsgen_carousel_add(stream, section, tsgen_section(section, table_id, table_id_extension, isection, num_sections - 1, body, len));
+	}
+}
+
+static tsgen_stream_t *tsgen_new_stream(tsgen_t *gen, int type, int pid, int service, double bitrate)
+{
+	tsgen_stream_t *stream = &gen->streams[gen->num_streams++];
+	memset(stream, 0, sizeof(tsgen_stream_t));
+	stream->type = type;
+	stream->pid = pid;
+	stream->service = service;
+	if (bitrate > 0)
+		stream->interval = TS_PACKET_SIZE * 8 / bitrate;
+	//The PIDs don't start at the same time
+	stream->next = stream->interval * (tsgen_random(gen) % 1000) / 1000.0;
+	return stream;
+}
+
+/** @brief Once the carousel of a table is built, its packets are spread over the repetition period */
+static void tsgen_table_period(tsgen_stream_t *stream, double period)
+{
+	stream->interval = period / stream->carousel_packets;
+}
+
+/** @brief Write a date in the MJD/BCD format of the EIT */
+static void tsgen_eit_time(unsigned char *buf, time_t t)
+{
+	struct tm tm;
+	int mjd;
+	gmtime_r(&t, &tm);
+	mjd = 40587 + t / 86400;
+	buf[0] = mjd >> 8;
+	buf[1] = mjd & 0xff;
+	buf[2] = ((tm.tm_hour / 10) << 4) | (tm.tm_hour % 10);
+	buf[3] = ((tm.tm_min / 10) << 4) | (tm.tm_min % 10);
+	buf[4] = ((tm.tm_sec / 10) << 4) | (tm.tm_sec % 10);
+}
+
+/** @brief Build the PIDs and the tables */
+static void tsgen_build(tsgen_t *gen)
+{
+	unsigned char header[16];
+	unsigned char *entries;
+	int *entry_len;
+	int pos;
+	tsgen_stream_t *stream;
+	time_t start = time(NULL);
+
+	//PAT, PMT, video, audio and ECM for each service, SDT and EIT
+	gen->streams = calloc(gen->num_services * 4 + 3, sizeof(tsgen_stream_t));
+	entries = malloc(gen->num_services * 256);
+	entry_len = malloc(gen->num_services * 2 * sizeof(int));
+	if (gen->streams == NULL || entries == NULL || entry_len == NULL)
+	{
+		fprintf(stderr, "Problem with malloc : %s\n", strerror(errno));
+		exit(ERROR_MEMORY);
+	}
+
+	for (int iserv = 0; iserv < gen->num_services; iserv++)
+	{
+		tsgen_service_t *service = &gen->services[iserv];
+		service->service_id = iserv + 1;
+		service->pmt_pid = TSGEN_PMT_PID_BASE + iserv;
+		service->video_pid = TSGEN_ES_PID_BASE + iserv * 4;
+		service->audio_pid = service->video_pid + 1;
+		service->ecm_pid = service->video_pid + 2;
+		service->scrambled = gen->scrambled_every && ((iserv + 1) % gen->scrambled_every) == 0;
+		service->bitrate = gen->rates[iserv % gen->num_rates] * 1e6;
+		snprintf(service->name, sizeof(service->name), "Service %d", service->service_id);
+	}
+
+	//PAT
+	stream = tsgen_new_stream(gen, TSGEN_TABLE, TSGEN_PAT_PID, -1, 0);
+	pos = 0;
+	for (int iserv = 0; iserv < gen->num_services; iserv++)
+	{
+		tsgen_service_t *service = &gen->services[iserv];
+		entries[pos++] = service->service_id >> 8;
+		entries[pos++] = service->service_id & 0xff;
+		entries[pos++] = 0xe0 | (service->pmt_pid >> 8);
+		entries[pos++] = service->pmt_pid & 0xff;
+		entry_len[iserv] = 4;
+	}
+	tsgen_carousel_table(stream, 0x00, gen->transport_stream_id, header, 0, entries, entry_len, gen->num_services);
+	tsgen_table_period(stream, TSGEN_PAT_PERIOD);
+
+	//SDT
+	stream = tsgen_new_stream(gen, TSGEN_TABLE, TSGEN_SDT_PID, -1, 0);
+	header[0] = gen->original_network_id >> 8;
+	header[1] = gen->original_network_id & 0xff;
+	header[2] = 0xff;
+	pos = 0;
+	for (int iserv = 0; iserv < gen->num_services; iserv++)
+	{
+		tsgen_service_t *service = &gen->services[iserv];
+		int start_pos = pos;
+		int name_len = strlen(service->name);
+		int desc_len = 2 + 3 + 7 + name_len;
+		entries[pos++] = service->service_id >> 8;
+		entries[pos++] = service->service_id & 0xff;
+		//EIT present/following
+		entries[pos++] = 0xfd;
+		//running, free_CA_mode, descriptors_loop_length
+		entries[pos++] = 0x80 | (service->scrambled ? 0x10 : 0) | (desc_len >> 8);
+		entries[pos++] = desc_len & 0xff;
+		//service descriptor, digital television
+		entries[pos++] = 0x48;
+		entries[pos++] = desc_len - 2;
+		entries[pos++] = 0x01;
+		entries[pos++] = 7;
+		memcpy(entries + pos, "MuMuDVB", 7);
+		pos += 7;
+		entries[pos++] = name_len;
+		memcpy(entries + pos, service->name, name_len);
+		pos += name_len;
+		entry_len[iserv] = pos - start_pos;
+	}
+	tsgen_carousel_table(stream, 0x42, gen->transport_stream_id, header, 3, entries, entry_len, gen->num_services);
+	tsgen_table_period(stream, TSGEN_SDT_PERIOD);
+
+	//EIT present/following, one section for each event
+	stream = tsgen_new_stream(gen, TSGEN_TABLE, TSGEN_EIT_PID, -1, 0);
+	for (int iserv = 0; iserv < gen->num_services; iserv++)
+	{
+		tsgen_service_t *service = &gen->services[iserv];
+		for (int ievent = 0; ievent < 2; ievent++)
+		{
+			unsigned char body[128];
+			unsigned char section[256];
+			char title[32];
+			int title_len = snprintf(title, sizeof(title), "%s %s", service->name, ievent ? "next" : "now");
+			int desc_len = 2 + 3 + 1 + title_len + 1;
+			pos = 0;
+			body[pos++] = gen->transport_stream_id >> 8;
+			body[pos++] = gen->transport_stream_id & 0xff;
+			body[pos++] = gen->original_network_id >> 8;
+			body[pos++] = gen->original_network_id & 0xff;
+			//segment_last_section_number, last_table_id
+			body[pos++] = 1;
+			body[pos++] = 0x4e;
+			//event id, start time, duration 1h
+			body[pos++] = 0;
+			body[pos++] = ievent + 1;
+			tsgen_eit_time(body + pos, start - start % 3600 + ievent * 3600);
+			pos += 5;
+			body[pos++] = 0x01;
+			body[pos++] = 0x00;
+			body[pos++] = 0x00;
+			//running (or not yet), free_CA_mode, descriptors_loop_length
+			body[pos++] = (ievent ? 0x20 : 0x80) | (service->scrambled ? 0x10 : 0) | (desc_len >> 8);
+			body[pos++] = desc_len & 0xff;
+			//short event descriptor
+			body[pos++] = 0x4d;
+			body[pos++] = desc_len - 2;
+			memcpy(body + pos, "eng", 3);
+			pos += 3;
+			body[pos++] = title_len;
+			memcpy(body + pos, title, title_len);
+			pos += title_len;
+			body[pos++] = 0; //text
+			tsgen_carousel_add(stream, section, tsgen_section(section, 0x4e, service->service_id, ievent, 1, body, pos));
+		}
+	}
+	tsgen_table_period(stream, TSGEN_EIT_PERIOD);
+
+	//The services
+	for (int iserv = 0; iserv < gen->num_services; iserv++)
+	{
+		tsgen_service_t *service = &gen->services[iserv];
+		unsigned char body[64];
+		unsigned char section[128];
+		double video_rate;
+
+		stream = tsgen_new_stream(gen, TSGEN_TABLE, service->pmt_pid, iserv, 0);
+		pos = 0;
+		body[pos++] = 0xe0 | (service->video_pid >> 8);
+		body[pos++] = service->video_pid & 0xff;
+		if (service->scrambled)
+		{
+			//program_info_length, CA descriptor
+			body[pos++] = 0xf0;
+			body[pos++] = 6;
+			body[pos++] = 0x09;
+			body[pos++] = 4;
+			body[pos++] = TSGEN_CA_SYSTEM_ID >> 8;
+			body[pos++] = TSGEN_CA_SYSTEM_ID & 0xff;
+			body[pos++] = 0xe0 | (service->ecm_pid >> 8);
+			body[pos++] = service->ecm_pid & 0xff;
+		}
+		else
+		{
+			body[pos++] = 0xf0;
+			body[pos++] = 0;
+		}
+		//MPEG2 video
+		body[pos++] = 0x02;
+		body[pos++] = 0xe0 | (service->video_pid >> 8);
+		body[pos++] = service->video_pid & 0xff;
+		body[pos++] = 0xf0;
+		body[pos++] = 0;
+		//MPEG1 audio, with a language descriptor
+		body[pos++] = 0x03;
+		body[pos++] = 0xe0 | (service->audio_pid >> 8);
+		body[pos++] = service->audio_pid & 0xff;
+		body[pos++] = 0xf0;
+		body[pos++] = 6;
+		body[pos++] = 0x0a;
+		body[pos++] = 4;
+		memcpy(body + pos, "eng", 3);
+		pos += 3;
+		body[pos++] = 0;
+		tsgen_carousel_add(stream, section, tsgen_section(section, 0x02, service->service_id, 0, 0, body, pos));
+		tsgen_table_period(stream, TSGEN_PMT_PERIOD);
+
+		//The audio has a fixed bitrate, the video gets the rest
+		video_rate = service->bitrate - TSGEN_AUDIO_BITRATE - TS_PACKET_SIZE * 8 / TSGEN_PMT_PERIOD;
+		if (service->scrambled)
+			video_rate -= TSGEN_ECM_RATE * TS_PACKET_SIZE * 8;
+		if (video_rate < TSGEN_AUDIO_BITRATE)
+			video_rate = TSGEN_AUDIO_BITRATE;
+		tsgen_new_stream(gen, TSGEN_VIDEO, service->video_pid, iserv, video_rate);
+		tsgen_new_stream(gen, TSGEN_AUDIO, service->audio_pid, iserv, TSGEN_AUDIO_BITRATE);
+		if (service->scrambled)
+			tsgen_new_stream(gen, TSGEN_ECM, service->ecm_pid, iserv, TSGEN_ECM_RATE * TS_PACKET_SIZE * 8);
+	}
+	free(entries);
+	free(entry_len);
+}
+
+/** @brief Send or write the packets waiting in the chunk */
+static int tsgen_flush(tsgen_t *gen)
+{
+	unsigned char *data = gen->chunk + 12;
+	int len = gen->chunk_packets * TS_PACKET_SIZE;
+	int ret;
+
+	if (!gen->chunk_packets)
+		return 0;
+	if (gen->udp)
+	{
+		if (gen->rtp)
+		{
+			uint32_t timestamp = (uint32_t) (tsgen_now() * 90000);
+			data = gen->chunk;
+			len += 12;
+			data[0] = 0x80;
+			data[1] = 33; //MP2T
+			data[2] = gen->rtp_seq >> 8;
+			data[3] = gen->rtp_seq & 0xff;
+			data[4] = timestamp >> 24;
+			data[5] = (timestamp >> 16) & 0xff;
+			data[6] = (timestamp >> 8) & 0xff;
+			data[7] = timestamp & 0xff;
+			memset(data + 8, 0, 4);
+			gen->rtp_seq++;
+		}
+		ret = sendto(gen->fd, data, len, 0, (struct sockaddr *) &gen->dest, gen->dest_len);
+		if (ret < 0 && errno != ENOBUFS && errno != EAGAIN)
+		{
+			fprintf(stderr, "sendto failed : %s\n", strerror(errno));
+			return -1;
+		}
+	}
+	else
+	{
+		while (len > 0)
+		{
+			ret = write(gen->fd, data, len);
+			if (ret < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				if (errno != EPIPE)
+					fprintf(stderr, "write failed : %s\n", strerror(errno));
+				return -1;
+			}
+			data += ret;
+			len -= ret;
+		}
+	}
+	gen->chunk_packets = 0;
+	return 0;
+}
+
+/** @brief Write the next packet of a PID */
+static void tsgen_packet(tsgen_t *gen, tsgen_stream_t *stream, double now, unsigned char *packet)
+{
+	tsgen_service_t *service = stream->service >= 0 ? &gen->services[stream->service] : NULL;
+	int payload = 4;
+
+	if (stream->type == TSGEN_TABLE)
+	{
+		memcpy(packet, stream->carousel + stream->carousel_pos * TS_PACKET_SIZE, TS_PACKET_SIZE);
+		stream->carousel_pos = (stream->carousel_pos + 1) % stream->carousel_packets;
+		packet[3] = 0x10 | stream->continuity_counter;
+		stream->continuity_counter = (stream->continuity_counter + 1) & 0x0f;
+		return;
+	}
+
+	packet[0] = TS_SYNC_BYTE;
+	packet[1] = stream->pid >> 8;
+	packet[2] = stream->pid & 0xff;
+	packet[3] = 0x10 | stream->continuity_counter;
+	stream->continuity_counter = (stream->continuity_counter + 1) & 0x0f;
+
+	if (stream->type == TSGEN_VIDEO && now >= stream->next_pcr)
+	{
+		uint64_t pcr = (uint64_t) (now * 27000000);
+		uint64_t base = pcr / 300;
+		int ext = pcr % 300;
+		//adaptation field with the PCR
+		packet[3] |= 0x20;
+		packet[4] = 7;
+		packet[5] = 0x10;
+		packet[6] = (base >> 25) & 0xff;
+		packet[7] = (base >> 17) & 0xff;
+		packet[8] = (base >> 9) & 0xff;
+		packet[9] = (base >> 1) & 0xff;
+		packet[10] = ((base & 1) << 7) | 0x7e | (ext >> 8);
+		packet[11] = ext & 0xff;
+		payload = 12;
+		stream->next_pcr += TSGEN_PCR_PERIOD;
+		if (stream->next_pcr < now)
+			stream->next_pcr = now + TSGEN_PCR_PERIOD;
+	}
+
+	if (service && service->scrambled && stream->type != TSGEN_ECM)
+	{
+		//The payload is scrambled, with the even (2) or odd (3) key
+		int odd = ((int) (now / gen->crypto_period)) & 1;
+		packet[3] |= (odd ? 0xc0 : 0x80);
+		for (int i = payload; i < TS_PACKET_SIZE; i += 4)
+		{
+			uint32_t r = tsgen_random(gen);
+			memcpy(packet + i, &r, (TS_PACKET_SIZE - i) < 4 ? (TS_PACKET_SIZE - i) : 4);
+		}
+		return;
+	}
+
+	memset(packet + payload, 0xff, TS_PACKET_SIZE - payload);
+	if (stream->type == TSGEN_ECM)
+	{
+		//A fake ECM section
+		packet[1] |= 0x40;
+		packet[payload] = 0;
+		packet[payload + 1] = (((int) (now / gen->crypto_period)) & 1) ? 0x81 : 0x80;
+		packet[payload + 2] = 0x70;
+		packet[payload + 3] = 0x10;
+		return;
+	}
+	if (now >= stream->next_frame)
+	{
+		//PES header with a PTS, one frame every 40ms
+		uint64_t pts = (uint64_t) (now * 90000) + 9000;
+		packet[1] |= 0x40;
+		packet[payload + 0] = 0x00;
+		packet[payload + 1] = 0x00;
+		packet[payload + 2] = 0x01;
+		packet[payload + 3] = stream->type == TSGEN_VIDEO ? 0xe0 : 0xc0;
+		packet[payload + 4] = 0x00;
+		packet[payload + 5] = 0x00;
+		packet[payload + 6] = 0x80;
+		packet[payload + 7] = 0x80;
+		packet[payload + 8] = 5;
+		packet[payload + 9] = 0x21 | ((pts >> 29) & 0x0e);
+		packet[payload + 10] = (pts >> 22) & 0xff;
+		packet[payload + 11] = 0x01 | ((pts >> 14) & 0xfe);
+		packet[payload + 12] = (pts >> 7) & 0xff;
+		packet[payload + 13] = 0x01 | ((pts << 1) & 0xfe);
+		stream->next_frame += 0.04;
+		if (stream->next_frame < now)
+			stream->next_frame = now + 0.04;
+	}
+}
+
+/** @brief Open the output : file, standard output or UDP socket */
+static int tsgen_open(tsgen_t *gen)
+{
+	if (gen->udp)
+	{
+		struct addrinfo hints = { 0, };
+		struct addrinfo *result = NULL;
+		char *port = strrchr(gen->udp, ':');
+		int rv;
+		if (port == NULL)
+		{
+			fprintf(stderr, "The UDP destination must be ADDR:PORT\n");
+			return -1;
+		}
+		*port++ = '\0';
+		//IPv6 addresses can be given between brackets
+		if (gen->udp[0] == '[' && gen->udp[strlen(gen->udp) - 1] == ']')
+		{
+			gen->udp[strlen(gen->udp) - 1] = '\0';
+			gen->udp++;
+		}
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_DGRAM;
+		hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+		rv = getaddrinfo(gen->udp, port, &hints, &result);
+		if (rv != 0)
+		{
+			fprintf(stderr, "getaddrinfo failed : %s\n", gai_strerror(rv));
+			return -1;
+		}
+		gen->fd = socket(result->ai_family, SOCK_DGRAM, 0);
+		if (gen->fd < 0)
+		{
+			fprintf(stderr, "socket failed : %s\n", strerror(errno));
+			freeaddrinfo(result);
+			return -1;
+		}
+		memcpy(&gen->dest, result->ai_addr, result->ai_addrlen);
+		gen->dest_len = result->ai_addrlen;
+		freeaddrinfo(result);
+		gen->pace = 1;
+	}
+	else if (gen->output == NULL || !strcmp(gen->output, "-"))
+		gen->fd = STDOUT_FILENO;
+	else
+	{
+		gen->fd = open(gen->output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (gen->fd < 0)
+		{
+			fprintf(stderr, "Cannot open %s : %s\n", gen->output, strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	tsgen_t gen;
+	const char short_options[] = "n:r:s:d:o:u:ph";
+	const struct option long_options[] = {
+			{"services", required_argument, NULL, 'n'},
+			{"rate", required_argument, NULL, 'r'},
+			{"scrambled", required_argument, NULL, 's'},
+			{"crypto_period", required_argument, NULL, 'c'},
+			{"duration", required_argument, NULL, 'd'},
+			{"output", required_argument, NULL, 'o'},
+			{"udp", required_argument, NULL, 'u'},
+			{"rtp", no_argument, NULL, 'R'},
+			{"pace", no_argument, NULL, 'p'},
+			{"tsid", required_argument, NULL, 't'},
+			{"onid", required_argument, NULL, 'i'},
+			{"help", no_argument, NULL, 'h'},
+			{0, 0, 0, 0}
+	};
+	int c, option_index = 0;
+	double total_rate = 0;
+	double start, now = 0;
+	char *rate_str;
+
+	memset(&gen, 0, sizeof(tsgen_t));
+	gen.num_services = 4;
+	gen.rates[0] = 4;
+	gen.num_rates = 1;
+	gen.crypto_period = 10;
+	gen.transport_stream_id = 1;
+	gen.original_network_id = 1;
+	gen.random = 0x12345678;
+
+	while ((c = getopt_long(argc, argv, short_options, long_options, &option_index)) != -1)
+	{
+		switch (c)
+		{
+		case 'n':
+			gen.num_services = atoi(optarg);
+			if (gen.num_services < 1 || gen.num_services > TSGEN_MAX_SERVICES)
+			{
+				fprintf(stderr, "The number of services must be between 1 and %d\n", TSGEN_MAX_SERVICES);
+				exit(ERROR_ARGS);
+			}
+			break;
+		case 'r':
+			gen.num_rates = 0;
+			for (rate_str = strtok(optarg, ","); rate_str != NULL && gen.num_rates < TSGEN_MAX_RATES; rate_str = strtok(NULL, ","))
+			{
+				gen.rates[gen.num_rates] = atof(rate_str);
+				if (gen.rates[gen.num_rates] <= 0)
+				{
+					fprintf(stderr, "Bad bitrate %s\n", rate_str);
+					exit(ERROR_ARGS);
+				}
+				gen.num_rates++;
+			}
+			if (!gen.num_rates)
+			{
+				fprintf(stderr, "No bitrate given\n");
+				exit(ERROR_ARGS);
+			}
+			break;
+		case 's':
+			gen.scrambled_every = atoi(optarg);
+			break;
+		case 'c':
+			gen.crypto_period = atof(optarg);
+			if (gen.crypto_period <= 0)
+				gen.crypto_period = 10;
+			break;
+		case 'd':
+			gen.duration = atof(optarg);
+			break;
+		case 'o':
+			gen.output = optarg;
+			break;
+		case 'u':
+			gen.udp = optarg;
+			break;
+		case 'R':
+			gen.rtp = 1;
+			break;
+		case 'p':
+			gen.pace = 1;
+			break;
+		case 't':
+			gen.transport_stream_id = atoi(optarg);
+			break;
+		case 'i':
+			gen.original_network_id = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			exit(ERROR_ARGS);
+		}
+	}
+	if (optind < argc)
+	{
+		usage(argv[0]);
+		exit(ERROR_ARGS);
+	}
+
+	if (tsgen_open(&gen))
+		exit(ERROR_CREATE_FILE);
+	tsgen_build(&gen);
+	for (int istream = 0; istream < gen.num_streams; istream++)
+		total_rate += TS_PACKET_SIZE * 8 / gen.streams[istream].interval;
+	fprintf(stderr, "%d services (%d scrambled), %d PIDs, %.2f Mbit/s\n",
+			gen.num_services,
+			gen.scrambled_every ? gen.num_services / gen.scrambled_every : 0,
+			gen.num_streams,
+			total_rate / 1e6);
+
+	start = tsgen_now();
+	while (!gen.duration || now < gen.duration)
+	{
+		tsgen_stream_t *stream = &gen.streams[0];
+		//The PID whose packet is the next one
+		for (int istream = 1; istream < gen.num_streams; istream++)
+			if (gen.streams[istream].next < stream->next)
+				stream = &gen.streams[istream];
+		now = stream->next;
+		stream->next += stream->interval;
+
+		tsgen_packet(&gen, stream, now, gen.chunk + 12 + gen.chunk_packets * TS_PACKET_SIZE);
+		gen.packets++;
+		if (++gen.chunk_packets < TSGEN_CHUNK_PACKETS)
+			continue;
+		if (gen.pace)
+		{
+			double delay = start + now - tsgen_now();
+			if (delay > 0)
+			{
+				struct timespec ts;
+				ts.tv_sec = (time_t) delay;
+				ts.tv_nsec = (long) ((delay - ts.tv_sec) * 1e9);
+				nanosleep(&ts, NULL);
+			}
+		}
+		if (tsgen_flush(&gen))
+			break;
+	}
+	tsgen_flush(&gen);
+	fprintf(stderr, "%llu packets, %.1f s of stream\n", (unsigned long long) gen.packets, now);
+	if (gen.fd != STDOUT_FILENO)
+		close(gen.fd);
+	for (int istream = 0; istream < gen.num_streams; istream++)
+		free(gen.streams[istream].carousel);
+	free(gen.streams);
+	return 0;
+}
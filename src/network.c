@@ -479,7 +479,9 @@ int makeTCPclientsocket(char *szAddr, unsigned short port)
 	/* free the result here */
 	freeaddrinfo(result);
 
-	iRet = listen(iSocket,10);
+	//The connections are accepted by the main loop, between two reads of the card,
+	//so we let the system keep a lot of them waiting in the meantime
+	iRet = listen(iSocket,SOMAXCONN);
 	if (iRet < 0)
 	{
 		log_message( log_module,  MSG_ERROR,"listen failed : %s\n",strerror(errno));
@@ -0,0 +1,205 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2013 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief Cache of the PSI/SI sections already processed
+ *
+ * The tables are repeated continuously but change rarely. The reader of a table stores
+ * each section it processed, keyed by (PID, table_id, table_id_extension, section_number),
+ * with its version and CRC32. When a section is complete, the section assembly (see ts.c)
+ * looks it up : if the version and the CRC32 are the same, it is a repetition and it is
+ * dropped before its CRC32 is checked and before the reader parses it.
+ *
+ * Dropping a repetition without checking its CRC32 is safe : if it was corrupted, the reader
+ * already has the good one.
+ *
+ * The entries are in an open addressing hash table with linear probing.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "psi_cache.h"
+#include "log.h"
+
+static char *log_module="PSI cache: ";
+
+//The sections with the long syntax have at least 8 bytes of header and a CRC32
+#define PSI_CACHE_MIN_LEN 12
+#define PSI_CACHE_KEY(pid,table_id,extension,section_number) \
+	((1ULL<<56)|((uint64_t)(pid)<<40)|((uint64_t)(table_id)<<24)|((uint64_t)(extension)<<8)|(section_number))
+
+/** @brief The key of a section, 0 if the section has no version nor CRC32 (short syntax) */
+static uint64_t psi_cache_section_key(int pid, const unsigned char *section)
+{
+	if(!(section[1]&0x80))
+		return 0;
+	return PSI_CACHE_KEY(pid&0x1fff, section[0], (section[3]<<8)|section[4], section[6]);
+}
+
+static unsigned int psi_cache_home(psi_cache_t *cache, uint64_t key)
+{
+	uint64_t h=key*0x9E3779B97F4A7C15ULL;
+	return (h^(h>>32))&(cache->size-1);
+}
+
+/** @brief Find the entry of a key, NULL if it is not stored */
+static psi_cache_entry_t *psi_cache_find(psi_cache_t *cache, uint64_t key)
+{
+	unsigned int i;
+
+	if(!cache->size)
+		return NULL;
+	for(i=psi_cache_home(cache, key);cache->entries[i].key;i=(i+1)&(cache->size-1))
+		if(cache->entries[i].key==key)
+			return &cache->entries[i];
+	return NULL;
+}
+
+/** @brief Double the size of the table (or allocate it) */
+static int psi_cache_grow(psi_cache_t *cache)
+{
+	psi_cache_entry_t *old=cache->entries;
+	unsigned int old_size=cache->size;
+	unsigned int size=old_size ? 2*old_size : PSI_CACHE_INITIAL_SIZE;
+
+	cache->entries=calloc(size, sizeof(psi_cache_entry_t));
+	if(cache->entries==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		cache->entries=old;
+		return -1;
+	}
+	cache->size=size;
+	for(unsigned int j=0;j<old_size;j++)
+	{
+		unsigned int i;
+		if(!old[j].key)
+			continue;
+		for(i=psi_cache_home(cache, old[j].key);cache->entries[i].key;i=(i+1)&(size-1));
+		cache->entries[i]=old[j];
+	}
+	free(old);
+	return 0;
+}
+
+/** @brief Is this complete section a repetition of the one stored
+ *
+ * @param pid the PID of the section
+ * @param section the section, starting with the table_id
+ * @param len the length of the section, CRC32 included
+ * @return 1 if the key, version and CRC32 are the same as the stored section
+ */
+int psi_cache_hit(psi_cache_t *cache, int pid, const unsigned char *section, int len)
+{
+	psi_cache_entry_t *entry;
+	uint64_t key;
+
+	if(len<PSI_CACHE_MIN_LEN || !(key=psi_cache_section_key(pid, section)))
+		return 0;
+	entry=psi_cache_find(cache, key);
+	if(entry &&
+			entry->version==(section[5]&0x3f) &&
+			entry->crc32==(((uint32_t)section[len-4]<<24)|(section[len-3]<<16)|(section[len-2]<<8)|section[len-1]))
+	{
+		cache->hits++;
+		return 1;
+	}
+	cache->misses++;
+	return 0;
+}
+
+/** @brief Store a section processed by the reader, it replaces the previous one with the same key
+ *
+ * @return 0 if stored, -1 if the section cannot be cached or if there is no memory
+ */
+int psi_cache_store(psi_cache_t *cache, int pid, const unsigned char *section, int len)
+{
+	psi_cache_entry_t *entry;
+	uint64_t key;
+
+	if(len<PSI_CACHE_MIN_LEN || !(key=psi_cache_section_key(pid, section)))
+		return -1;
+	entry=psi_cache_find(cache, key);
+	if(entry==NULL)
+	{
+		unsigned int i;
+		if(2*(cache->used+1)>cache->size && psi_cache_grow(cache))
+			return -1;
+		for(i=psi_cache_home(cache, key);cache->entries[i].key;i=(i+1)&(cache->size-1));
+		entry=&cache->entries[i];
+		entry->key=key;
+		cache->used++;
+	}
+	entry->version=section[5]&0x3f;
+	entry->crc32=((uint32_t)section[len-4]<<24)|(section[len-3]<<16)|(section[len-2]<<8)|section[len-1];
+	return 0;
+}
+
+/** @brief Is a section with this key and version stored, only the header of the section is read
+ *
+ * Used on the first TS packet of a section, before it is complete
+ */
+int psi_cache_known(psi_cache_t *cache, int pid, const unsigned char *section)
+{
+	psi_cache_entry_t *entry;
+	uint64_t key;
+
+	if(!(key=psi_cache_section_key(pid, section)))
+		return 0;
+	entry=psi_cache_find(cache, key);
+	return entry && entry->version==(section[5]&0x3f);
+}
+
+/** @brief Remove a section, when the reader drops it */
+void psi_cache_forget(psi_cache_t *cache, int pid, uint8_t table_id, uint16_t extension, uint8_t section_number)
+{
+	psi_cache_entry_t *entry;
+	unsigned int i, j, home;
+
+	entry=psi_cache_find(cache, PSI_CACHE_KEY(pid&0x1fff, table_id, extension, section_number));
+	if(entry==NULL)
+		return;
+	//We move back the following entries which would not be found anymore
+	i=entry-cache->entries;
+	for(j=(i+1)&(cache->size-1);cache->entries[j].key;j=(j+1)&(cache->size-1))
+	{
+		home=psi_cache_home(cache, cache->entries[j].key);
+		if(((j-home)&(cache->size-1)) >= ((j-i)&(cache->size-1)))
+		{
+			cache->entries[i]=cache->entries[j];
+			i=j;
+		}
+	}
+	cache->entries[i].key=0;
+	cache->used--;
+}
+
+void psi_cache_free(psi_cache_t *cache)
+{
+	free(cache->entries);
+	memset(cache, 0, sizeof(psi_cache_t));
+}
@@ -0,0 +1,68 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2013 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief Cache of the PSI/SI sections already processed
+ */
+
+#ifndef _PSI_CACHE_H
+#define _PSI_CACHE_H
+
+#include <stdint.h>
+
+/** The initial number of entries of the cache (power of two), it grows when half full */
+#define PSI_CACHE_INITIAL_SIZE 1024
+
+/** @brief The last section processed for a (PID, table_id, table_id_extension, section_number) */
+typedef struct psi_cache_entry_t{
+	/** The PID, table id, extension and section number, 0 if the entry is free */
+	uint64_t key;
+	uint32_t crc32;
+	/** The version number and the current_next_indicator (byte 5 of the section) */
+	uint8_t version;
+}psi_cache_entry_t;
+
+/** @brief The sections processed by a reader of a PSI/SI table
+ *
+ * A section with the same key, version and CRC32 as the one stored is a repetition,
+ * the reader already has it.
+ */
+typedef struct psi_cache_t{
+	psi_cache_entry_t *entries;
+	/** The number of entries (power of two) and the number of used ones */
+	unsigned int size;
+	unsigned int used;
+	//statistics
+	uint64_t hits;
+	uint64_t misses;
+}psi_cache_t;
+
+int psi_cache_hit(psi_cache_t *cache, int pid, const unsigned char *section, int len);
+int psi_cache_store(psi_cache_t *cache, int pid, const unsigned char *section, int len);
+int psi_cache_known(psi_cache_t *cache, int pid, const unsigned char *section);
+void psi_cache_forget(psi_cache_t *cache, int pid, uint8_t table_id, uint16_t extension, uint8_t section_number);
+void psi_cache_free(psi_cache_t *cache);
+
+#endif
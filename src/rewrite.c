@@ -127,6 +127,7 @@ int rewrite_init(rewrite_parameters_t *rewr_p)
 		}
 		memset (rewr_p->full_eit, 0, sizeof( mumudvb_ts_packet_t));//we clear it
 		pthread_mutex_init(&rewr_p->full_eit->packetmutex,NULL);
+		rewr_p->full_eit->cache=&rewr_p->eit_cache;
 	}
 
 return 0;
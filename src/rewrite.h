@@ -41,6 +41,7 @@
 #include "mumudvb.h"
 #include "ts.h"
 #include "unicast_http.h"
+#include "psi_cache.h"
 #include <stdint.h>
 
 #define MAX_EIT_SECTIONS 256
@@ -125,6 +126,8 @@ typedef struct rewrite_parameters_t{
 	int eit_needs_update;
 	/** The Complete EIT PID  which we are storing*/
 	mumudvb_ts_packet_t *full_eit;
+	/** The EIT sections stored, their repetitions are not reassembled again */
+	psi_cache_t eit_cache;
 
 	eit_packet_t *eit_packets;
 
@@ -138,11 +141,11 @@ int read_rewrite_configuration(rewrite_parameters_t *rewrite_vars, char *substri
 int pmt_rewrite_new_channel_packet(unsigned char *ts_packet, unsigned char *pmt_ts_packet, mumudvb_channel_t *channel, int curr_channel);
 
 void pat_rewrite_new_global_packet(unsigned char *ts_packet, rewrite_parameters_t *rewrite_vars);
-int pat_rewrite_new_channel_packet(unsigned char *ts_packet, rewrite_parameters_t *rewrite_vars, mumudvb_channel_t *channel, int curr_channel);
+int pat_rewrite_new_channel_packet(unsigned char *ts_packet, rewrite_parameters_t *rewrite_vars, mumudvb_channel_t *channel, int curr_channel, int continuity_counter);
 
 
 int sdt_rewrite_new_global_packet(unsigned char *ts_packet, rewrite_parameters_t *rewrite_vars);
-int sdt_rewrite_new_channel_packet(unsigned char *ts_packet, rewrite_parameters_t *rewrite_vars, mumudvb_channel_t *channel, int curr_channel);
+int sdt_rewrite_new_channel_packet(unsigned char *ts_packet, rewrite_parameters_t *rewrite_vars, mumudvb_channel_t *channel, int curr_channel, int continuity_counter);
 
 void set_continuity_counter(unsigned char *buf,int continuity_counter);
 
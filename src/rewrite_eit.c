@@ -125,11 +125,13 @@ eit_packet_t *eit_new_packet(rewrite_parameters_t *rewrite_vars, int sid, uint8_
 {
 	eit_packet_t *actual_eit=rewrite_vars->eit_packets;
 
-	//go to the last one or return the already found
-	while(actual_eit && actual_eit->next!=NULL)
+	//go to the last one or return the already found (the last one included)
+	while(actual_eit)
 	{
 		if((actual_eit->service_id==sid)&&(actual_eit->table_id==table_id))
 			return actual_eit;
+		if(actual_eit->next==NULL)
+			break;
 		actual_eit=actual_eit->next;
 	}
 
@@ -212,6 +214,9 @@ int eit_need_update(rewrite_parameters_t *rewrite_vars, unsigned char *buf, int
     	sent is currently applicable.*/
 		if(eit->current_next_indicator == 0)
 			return 0;
+		//The sections stored are in the cache, we avoid the search in the list
+		if(raw && psi_cache_known(&rewrite_vars->eit_cache, HILO(((ts_header_t *)buf)->pid), (unsigned char *)eit))
+			return 0;
 
 		eit_packet=eit_find_by_tsid(rewrite_vars,HILO(eit->service_id),eit->table_id);
 		if(eit_packet==NULL)
@@ -262,6 +267,8 @@ void eit_rewrite_new_global_packet(unsigned char *ts_packet, rewrite_parameters_
 			//We check if we have to store this new EIT packet (CRC32 can make false alarms)
 			if(!eit_need_update(rewrite_vars,rewrite_vars->full_eit->data_full,0))
 			{
+				//Nothing to do with this section, we don't want to reassemble it again
+				psi_cache_store(&rewrite_vars->eit_cache, rewrite_vars->full_eit->pid, rewrite_vars->full_eit->data_full, rewrite_vars->full_eit->len_full);
 				break;
 			}
 
@@ -282,6 +289,9 @@ void eit_rewrite_new_global_packet(unsigned char *ts_packet, rewrite_parameters_
 						eit_packet->version,
 						eit->version_number);
 				//New version so we clear all contents
+				for(int i=0;i<MAX_EIT_SECTIONS;i++)
+					if(eit_packet->sections_stored[i])
+						psi_cache_forget(&rewrite_vars->eit_cache, rewrite_vars->full_eit->pid, eit_packet->table_id, eit_packet->service_id, i);
 				eit_free_packet_contents(eit_packet);
 			}
 
@@ -302,6 +312,7 @@ void eit_rewrite_new_global_packet(unsigned char *ts_packet, rewrite_parameters_
 			memcpy(eit_packet->full_eit_sections[eit->section_number], rewrite_vars->full_eit,sizeof( mumudvb_ts_packet_t));
 			//We store that we saw this section number
 			eit_packet->sections_stored[eit->section_number]=1;
+			psi_cache_store(&rewrite_vars->eit_cache, rewrite_vars->full_eit->pid, rewrite_vars->full_eit->data_full, rewrite_vars->full_eit->len_full);
 			log_message( log_module, MSG_DETAIL,"Full EIT updated. sid %d section number %d, last_section_number %d\n",
 					eit_packet->service_id,
 					eit->section_number,
@@ -436,7 +447,7 @@ void eit_rewrite_new_channel_packet(unsigned char *ts_packet, rewrite_parameters
 			data_left_to_send=0;
 		}
 		//NOW we fill the channel buffer for sending
-		buffer_func(channel, send_buf, unicast_vars, scam_vars_v);
+		buffer_func(channel, send_buf, chan_pid_index(channel, 18), unicast_vars, scam_vars_v);
 	}
 
 	//We update which section we want to send
@@ -43,9 +43,9 @@
 #include "ts.h"
 #include "rewrite.h"
 #include "log.h"
+#include "crc32.h"
 #include <stdint.h>
 
-extern uint32_t crc32_table[256];
 static char *log_module = "PMT rewrite: ";
 
 /**
@@ -182,10 +182,7 @@ int pmt_channel_rewrite(mumudvb_channel_t *channel) {
 	//CRC32 calculation inspired by the xine project
 	//Now we must adjust the CRC32
 	//we compute the CRC32
-	crc32 = 0xffffffff;
-	for (i = 0; i < new_section_length - 1; i++) {
-		crc32 = (crc32 << 8) ^ crc32_table[((crc32 >> 24) ^ buf_dest[i + TS_HEADER_LEN]) & 0xff];
-	}
+	crc32=crc32_update(CRC32_INIT, buf_dest+TS_HEADER_LEN, new_section_length-1);
 
 	//We write the CRC32 to the buffer
 	buf_dest[buf_dest_pos] = (crc32 >> 24) & 0xff;
@@ -37,9 +37,9 @@
 #include "ts.h"
 #include "rewrite.h"
 #include "log.h"
+#include "crc32.h"
 #include <stdint.h>
 
-extern uint32_t       crc32_table[256];
 
 static char *log_module="SDT rewrite: ";
 
@@ -278,11 +278,7 @@ int sdt_channel_rewrite(rewrite_parameters_t *rewrite_vars, mumudvb_channel_t *c
 	//CRC32 calculation inspired by the xine project
 	//Now we must adjust the CRC32
 	//we compute the CRC32
-	crc32=0xffffffff;
-	int i;
-	for(i = 0; i < new_section_length-1; i++) {
-		crc32 = (crc32 << 8) ^ crc32_table[((crc32 >> 24) ^ buf_dest[i+TS_HEADER_LEN])&0xff];
-	}
+	crc32=crc32_update(CRC32_INIT, buf_dest+TS_HEADER_LEN, new_section_length-1);
 
 
 	//We write the CRC32 to the buffer
@@ -395,8 +391,9 @@ int sdt_rewrite_new_global_packet(unsigned char *ts_packet, rewrite_parameters_t
 
 /** @brief This function is called when a new SDT packet for a channel is there and we asked for rewrite
  * This function copy the rewritten SDT to the buffer. And checks if the SDT was changed so the rewritten version have to be updated
+ * continuity_counter is the SDT continuity counter at the time this packet was received
  */
-int sdt_rewrite_new_channel_packet(unsigned char *ts_packet, rewrite_parameters_t *rewrite_vars, mumudvb_channel_t *channel, int curr_channel)
+int sdt_rewrite_new_channel_packet(unsigned char *ts_packet, rewrite_parameters_t *rewrite_vars, mumudvb_channel_t *channel, int curr_channel, int continuity_counter)
 {
 	if(rewrite_vars->full_sdt_ok ) //the global full sdt is ok
 	{
@@ -421,7 +418,7 @@ int sdt_rewrite_new_channel_packet(unsigned char *ts_packet, rewrite_parameters_
 			/*We send the rewritten SDT from channel->generated_sdt*/
 			memcpy(ts_packet,channel->generated_sdt,TS_PACKET_SIZE);
 			//To avoid the duplicates, we have to update the continuity counter
-			set_continuity_counter(ts_packet,rewrite_vars->sdt_continuity_counter);
+			set_continuity_counter(ts_packet,continuity_counter);
 		}
 		else
 		{
@@ -171,22 +171,21 @@ int read_sap_configuration(sap_p_t *sap_p, mumudvb_channel_t *c_chan, char *subs
 
 
 /** @brief init the sap
- * Alloc the memory for the messages, open the socket
+ * Reserve the memory for the messages, open the socket
+ * @param max_channels the number of channel numbers the announces are made for, only the
+ * memory of the messages which are really sent is used
  */
-int init_sap(sap_p_t *sap_p, multi_p_t multi_p)
+int init_sap(sap_p_t *sap_p, multi_p_t multi_p, int max_channels)
 {
 	if(sap_p->sap == OPTION_ON)
 	{
+		sap_p->sap_messages_size=max_channels;
 		if(multi_p.multicast_ipv4)
 		{
 			log_message( log_module,  MSG_DETAIL,  "init sap v4\n");
-			sap_p->sap_messages4=malloc(sizeof(mumudvb_sap_message_t)*MAX_CHANNELS);
+			sap_p->sap_messages4=mumu_table_reserve(sizeof(mumudvb_sap_message_t)*max_channels);
 			if(sap_p->sap_messages4==NULL)
-			{
-				log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
 				return -1;
-			}
-			memset (sap_p->sap_messages4, 0, sizeof( mumudvb_sap_message_t)*MAX_CHANNELS);//we clear it
 			//For sap announces, we open the socket
 			//See the README about multicast_auto_join
 			if(multi_p.auto_join)
@@ -197,13 +196,9 @@ int init_sap(sap_p_t *sap_p, multi_p_t multi_p)
 		if(multi_p.multicast_ipv6)
 		{
 			log_message( log_module,  MSG_DETAIL,  "init sap v6\n");
-			sap_p->sap_messages6=malloc(sizeof(mumudvb_sap_message_t)*MAX_CHANNELS);
+			sap_p->sap_messages6=mumu_table_reserve(sizeof(mumudvb_sap_message_t)*max_channels);
 			if(sap_p->sap_messages6==NULL)
-			{
-				log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
 				return -1;
-			}
-			memset (sap_p->sap_messages6, 0, sizeof( mumudvb_sap_message_t)*MAX_CHANNELS);//we clear it
 			//For sap announces, we open the socket
 			//See the README about multicast_auto_join
 			if(multi_p.auto_join)
@@ -615,36 +610,47 @@ int sap_add_program(mumudvb_channel_t *channel, sap_p_t *sap_p, mumudvb_sap_mess
 }
 
 
-/** @brief Sap function called periodically
- * This function checks if there is sap messages to send
- * @param number_of_channels the number of channels
- * @param channels the channels
+/** @brief Update the sap messages of the channels of an adapter
+ * All the channels the first time, then the channels which changed
+ * The message of a channel is the one of its number in the HTTP pages
  * @param sap_p the sap variables
+ * @param chan_p the channels of the adapter
  * @param multi_p the multicast variables
- * @param now the time
  */
-void sap_poll(sap_p_t *sap_p,int number_of_channels,mumudvb_channel_t  *channels, multi_p_t multi_p, long now)
+void sap_update_channels(sap_p_t *sap_p, mumu_chan_p_t *chan_p, multi_p_t multi_p)
 {
 	int curr_channel;
+	mumudvb_channel_t *channels=chan_p->channels;
+	//we check if SAP is initialized
+	if(sap_p->sap_messages4==NULL && sap_p->sap_messages6==NULL)
+		return;
+	if(sap_p->sap != OPTION_ON)
+		return;
+	for (curr_channel = 0; curr_channel < chan_p->number_of_channels; curr_channel++)
+		if((!sap_p->sap_last_time_sent || channels[curr_channel].sap_need_update) && (channels[curr_channel].channel_ready>=READY))
+			sap_update(&channels[curr_channel], sap_p, chan_p->first_channel+curr_channel, multi_p);
+}
+
+
+/** @brief Sap function called periodically, after sap_update_channels
+ * This function checks if there is sap messages to send
+ * @param sap_p the sap variables
+ * @param num_messages the number of messages to look at
+ * @param now the time
+ */
+void sap_poll(sap_p_t *sap_p, int num_messages, long now)
+{
 	//we check if SAP is initialized
 	if(sap_p->sap_messages4==NULL && sap_p->sap_messages6==NULL)
 		return;
 	if(sap_p->sap == OPTION_ON)
 	{
+		// the first time we are here, all the channels have just been initialized
 		if(!sap_p->sap_last_time_sent)
-		{
-			// it's the first time we are here, we initialize all the channels
-			for (curr_channel = 0; curr_channel < number_of_channels; curr_channel++)
-				if(channels[curr_channel].channel_ready>=READY)
-					sap_update(&channels[curr_channel], sap_p, curr_channel, multi_p);
 			sap_p->sap_last_time_sent=now-sap_p->sap_interval-1;
-		}
-		for (curr_channel = 0; curr_channel < number_of_channels; curr_channel++)
-			if(channels[curr_channel].sap_need_update && (channels[curr_channel].channel_ready>=READY))
-				sap_update(&channels[curr_channel], sap_p, curr_channel, multi_p);
 		if((now-sap_p->sap_last_time_sent)>=sap_p->sap_interval)
 		{
-			sap_send(sap_p, number_of_channels);
+			sap_send(sap_p, num_messages);
 			sap_p->sap_last_time_sent=now;
 		}
 	}
@@ -75,6 +75,8 @@ typedef struct sap_p_t{
   mumudvb_sap_message_t *sap_messages4; 
   /**the sap messages array*/
   mumudvb_sap_message_t *sap_messages6; 
+  /**the number of entries of the sap messages arrays*/
+  int sap_messages_size;
   /**do we send sap announces ?*/
   option_status_t sap; 
   /**Interval between two sap announces in second*/
@@ -107,10 +109,11 @@ typedef struct sap_p_t{
 }sap_p_t;
 
 void init_sap_v(sap_p_t *sap_vars);
-int init_sap(sap_p_t *sap_vars, multi_p_t multi_p);
+int init_sap(sap_p_t *sap_vars, multi_p_t multi_p, int max_channels);
 void sap_send(sap_p_t *sap_vars, int num_messages);
 int sap_update(mumudvb_channel_t *channel, sap_p_t *sap_vars, int curr_channel, multi_p_t multi_p);
 int read_sap_configuration(sap_p_t *sap_vars, mumudvb_channel_t *c_chan, char *substring);
-void sap_poll(sap_p_t *sap_vars,int number_of_channels,mumudvb_channel_t  *channels, multi_p_t multi_p, long now);
+void sap_update_channels(sap_p_t *sap_vars, mumu_chan_p_t *chan_p, multi_p_t multi_p);
+void sap_poll(sap_p_t *sap_vars, int num_messages, long now);
 
 #endif
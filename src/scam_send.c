@@ -156,7 +156,7 @@ void *sendthread_func(void* arg)
     if ((!channel->rtp && ((channel->nb_bytes + TS_PACKET_SIZE) > MAX_UDP_SIZE))
       ||(channel->rtp && ((channel->nb_bytes + RTP_HEADER_LEN + TS_PACKET_SIZE) > MAX_UDP_SIZE)))
     {
-      send_func(channel, send_time, unicast_vars);
+      send_func(channel, send_time, unicast_vars, NULL, SEND_FULL);
     }
   }
   free(arg);
@@ -30,166 +30,393 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
+#include <errno.h>
 
-#include "mumudvb.h"
+#include "t2mi.h"
 #include "log.h"
 #include <stdint.h>
 
 static char *log_module = "T2MI: ";
 
-bool t2mi_active=false;
-bool t2mi_first=true;
-int t2_partial_size=0;
+/** @brief Initialize the extraction of a PLP, the buffer is allocated by t2mi_plp_alloc */
+void t2mi_plp_init(t2mi_plp_t *plp, int pid, uint8_t plp_id)
+{
+	memset(plp, 0, sizeof(t2mi_plp_t));
+	plp->pid=pid;
+	plp->plp=plp_id;
+	plp->first=true;
+}
 
-int t2packetpos=0;
-char t2packet[TS_PACKET_SIZE*349]; /* will fit Maximal T2 payload + header */
+/** @brief Allocate the output buffer of a PLP, it must hold at least one T2-MI frame */
+int t2mi_plp_alloc(t2mi_plp_t *plp, unsigned int buffer_size)
+{
+	if (buffer_size < T2MI_MAX_PACKET_SIZE)
+		buffer_size = T2MI_MAX_PACKET_SIZE;
+	plp->buffer=malloc(buffer_size);
+	if (plp->buffer==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return -1;
+	}
+	plp->buffer_size=buffer_size;
+	return 0;
+}
 
-/* rewritten by [anp/hsw], original code taken from https://github.com/newspaperman/t2-mi */
-int processt2(unsigned char* input_buf, unsigned int input_buf_offset, unsigned char* output_buf, unsigned int output_buf_offset, unsigned int output_buf_size, uint8_t plpId) {
+void t2mi_plp_free(t2mi_plp_t *plp)
+{
+	if (plp->buffer)
+		free(plp->buffer);
+	plp->buffer=NULL;
+	plp->buffer_size=0;
+}
+
+/** @brief Drop the extracted data, we wait for the next sync of the PLP */
+void t2mi_plp_reset(t2mi_plp_t *plp)
+{
+	plp->first=true;
+	plp->partial_size=0;
+	plp->bytes=0;
+	plp->resyncs++;
+}
+
+/** @brief Add a PLP to the decapsulation of an input, the streams are created for each new PID */
+int t2mi_demux_add(t2mi_demux_t *demux, t2mi_plp_t *plp)
+{
+	t2mi_stream_t *stream;
+
+	if (!demux->pid_stream[plp->pid]) {
+		if (demux->num_streams >= MAX_T2MI_PIDS) {
+			log_message(log_module, MSG_ERROR, "Too many T2-MI PIDs on the same input (max %d)\n", MAX_T2MI_PIDS);
+			return -1;
+		}
+		stream=calloc(1, sizeof(t2mi_stream_t));
+		if (stream==NULL) {
+			log_message( log_module, MSG_ERROR,"Problem with calloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+			return -1;
+		}
+		stream->pid=plp->pid;
+		demux->streams[demux->num_streams]=stream;
+		demux->num_streams++;
+		demux->pid_stream[plp->pid]=demux->num_streams;
+	}
+	stream=demux->streams[demux->pid_stream[plp->pid]-1];
+	if (stream->num_plps >= T2MI_MAX_PLPS) {
+		log_message(log_module, MSG_ERROR, "Too many PLPs extracted from the T2-MI PID %d (max %d)\n", plp->pid, T2MI_MAX_PLPS);
+		return -1;
+	}
+	stream->plps[stream->num_plps]=plp;
+	stream->num_plps++;
+	return 0;
+}
+
+void t2mi_demux_free(t2mi_demux_t *demux)
+{
+	for (int i = 0; i < demux->num_streams; i++)
+		free(demux->streams[i]);
+	memset(demux, 0, sizeof(t2mi_demux_t));
+}
+
+/** @brief A reading position in the fragments of a T2-MI packet */
+typedef struct t2mi_cursor_t{
+	t2mi_fragment_t *fragment;
+	t2mi_fragment_t *end;
+	unsigned int offset;
+}t2mi_cursor_t;
+
+static void t2mi_cursor_init(t2mi_cursor_t *cursor, t2mi_stream_t *stream)
+{
+	cursor->fragment=stream->fragments;
+	cursor->end=stream->fragments+stream->num_fragments;
+	cursor->offset=0;
+}
+
+/** @brief Copy the next bytes of the T2-MI packet, or skip them if dst is NULL */
+static void t2mi_cursor_copy(t2mi_cursor_t *cursor, unsigned char *dst, unsigned int len)
+{
+	unsigned int n;
+
+	while (len && cursor->fragment < cursor->end) {
+		n = cursor->fragment->len - cursor->offset;
+		if (n > len)
+			n = len;
+		if (dst) {
+			memcpy(dst, cursor->fragment->data + cursor->offset, n);
+			dst += n;
+		}
+		len -= n;
+		cursor->offset += n;
+		if (cursor->offset == cursor->fragment->len) {
+			cursor->fragment++;
+			cursor->offset = 0;
+		}
+	}
+}
+
+/** @brief Give a whole TS packet to the adapter of the PLP */
+static int t2mi_plp_output(t2mi_plp_t *plp, const unsigned char *packet)
+{
+	if (plp->bytes + TS_PACKET_SIZE > plp->buffer_size) {
+		log_message(log_module, MSG_DETAIL, "PLP %d: position out of buffer bounds: %u + %u > %u\n",
+				plp->plp, plp->bytes, TS_PACKET_SIZE, plp->buffer_size);
+		return -1;
+	}
+	memcpy(plp->buffer + plp->bytes, packet, TS_PACKET_SIZE);
+	plp->bytes += TS_PACKET_SIZE;
+	return 0;
+}
+
+/** @brief Extract the TS packets of a baseband frame to the buffer of the PLP
+ *
+ * The user packets are copied from the fragments of the T2-MI packet straight to the buffer of the PLP,
+ * only the packet cut at the end of the frame is kept aside
+ * @param stream the stream, its T2-MI packet carries a baseband frame of the PLP
+ * @param header the first bytes of the T2-MI packet (T2-MI header and BB header)
+ */
+static void t2mi_extract_bbframe(t2mi_stream_t *stream, const unsigned char *header, t2mi_plp_t *plp)
+{
+	t2mi_cursor_t cursor;
+
+	plp->bbframes++;
+	/* extract TS packet from T2-MI payload */
+	/* Sync distance (bits) in the BB header then points to the first CRC-8 present in the data field */
+	unsigned int syncd = (header[16] << 8) + header[17];
+	syncd >>= 3;
+
+	/* user packet len (bits) = sync byte + payload, CRC-8 of payload replaces next sync byte */
+	unsigned int upl = (header[13] << 8) + header[14];
+	upl >>= 3;
+	upl+=19;
+	/* we cannot read after the end of the received packet */
+	if (upl > stream->pos)
+		upl = stream->pos;
+
+	unsigned int dnp=0;
+
+	if(header[9]&0x4) {
+		dnp=1; // Deleted Null Packet
+	}
+
+	t2mi_cursor_init(&cursor, stream);
+	t2mi_cursor_copy(&cursor, NULL, 19);
+
+	if(syncd==0x1FFF ) { /* maximal sync value (in bytes) : no packet starts in this frame */
+		log_message(log_module, MSG_DEBUG, "sync value 0x1FFF!\n");
+		unsigned int maxsync = upl - 19;
+		if (!plp->first && plp->partial_size && plp->partial_size + maxsync <= TS_PACKET_SIZE) {
+			t2mi_cursor_copy(&cursor, plp->partial + plp->partial_size, maxsync);
+			plp->partial_size += maxsync;
+			if (plp->partial_size == TS_PACKET_SIZE) {
+				t2mi_plp_output(plp, plp->partial);
+				plp->partial_size = 0;
+			}
+		} else {
+			plp->partial_size = 0;
+		}
+		return;
+	}
+
+	/* the beginning of the frame completes the packet cut at the end of the previous frame */
+	unsigned int syncd_size = (syncd > dnp) ? syncd - dnp : 0;
+	if (!plp->first && (plp->partial_size || syncd_size)) {
+		if (plp->partial_size && plp->partial_size + syncd_size == TS_PACKET_SIZE) {
+			t2mi_cursor_copy(&cursor, plp->partial + plp->partial_size, syncd_size);
+			t2mi_plp_output(plp, plp->partial);
+		} else {
+			/* detect unaligned packet : drop packet; TODO: check if we can add padding instead of dropping */
+			log_message(log_module, MSG_DETAIL, "PLP %d: unaligned packet, %u + %u bytes\n", plp->plp, plp->partial_size, syncd_size);
+		}
+	}
+	plp->partial_size = 0;
+	plp->first=false;
 
+	unsigned int t2_copy_pos=19+syncd;
+	t2mi_cursor_init(&cursor, stream);
+	t2mi_cursor_copy(&cursor, NULL, t2_copy_pos);
+
+	/* copy T2-MI packet payload to output, add sync bytes */
+	for(; t2_copy_pos + 187 <= upl; t2_copy_pos+=(187+dnp)) {
+		/* fullsize TS frame */
+		if (plp->bytes + TS_PACKET_SIZE > plp->buffer_size) {
+			log_message(log_module, MSG_DETAIL, "PLP %d: position (full TS) out of buffer bounds: in %u, out %u + %u > %u\n",
+					plp->plp, t2_copy_pos, plp->bytes, TS_PACKET_SIZE, plp->buffer_size);
+			return;
+		}
+		plp->buffer[plp->bytes] = TS_SYNC_BYTE;
+		t2mi_cursor_copy(&cursor, plp->buffer + plp->bytes + 1, 187);
+		plp->bytes += TS_PACKET_SIZE;
+		if (dnp)
+			t2mi_cursor_copy(&cursor, NULL, dnp);
+	}
+	if(t2_copy_pos < upl )  {
+		/* partial TS frame, we will fill rest of frame at next call */
+		plp->partial[0] = TS_SYNC_BYTE;
+		plp->partial_size = upl - t2_copy_pos + 1;
+		t2mi_cursor_copy(&cursor, plp->partial + 1, plp->partial_size - 1);
+	}
+}
+
+/** @brief The T2-MI packet continues after the end of the input buffer, we copy its fragments to the kept buffer */
+static void t2mi_stream_keep(t2mi_stream_t *stream)
+{
+	int i = (stream->kept_size > 0) ? 1 : 0;
+
+	for (; i < stream->num_fragments; i++) {
+		memcpy(stream->kept + stream->kept_size, stream->fragments[i].data, stream->fragments[i].len);
+		stream->kept_size += stream->fragments[i].len;
+	}
+	if (stream->kept_size) {
+		stream->fragments[0].data = stream->kept;
+		stream->fragments[0].len = stream->kept_size;
+		stream->num_fragments = 1;
+	}
+}
+
+/** @brief Drop the current T2-MI packet of a stream */
+static void t2mi_stream_reset(t2mi_stream_t *stream)
+{
+	stream->active=false;
+	stream->pos=0;
+	stream->num_fragments=0;
+	stream->kept_size=0;
+}
+
+/** @brief Add a part of the T2-MI packet */
+static void t2mi_stream_add(t2mi_stream_t *stream, const unsigned char *data, unsigned int len)
+{
+	if (stream->pos + len > T2MI_MAX_PACKET_SIZE) {
+		log_message(log_module, MSG_DEBUG, "T2-MI packet too long on PID %d, dropped\n", stream->pid);
+		t2mi_stream_reset(stream);
+		return;
+	}
+	if (stream->num_fragments == T2MI_MAX_FRAGMENTS)
+		t2mi_stream_keep(stream);
+	stream->fragments[stream->num_fragments].data = data;
+	stream->fragments[stream->num_fragments].len = len;
+	stream->num_fragments++;
+	stream->pos += len;
+}
+
+/** @brief A T2-MI packet is complete, we give its baseband frame to the PLP it belongs to */
+static void t2mi_stream_packet_end(t2mi_stream_t *stream)
+{
+	unsigned char header[19];
+	t2mi_cursor_t cursor;
+
+	if (stream->pos >= sizeof(header)) {
+		t2mi_cursor_init(&cursor, stream);
+		t2mi_cursor_copy(&cursor, header, sizeof(header));
+		/* select source PLP */
+		for (int i = 0; i < stream->num_plps; i++)
+			if (header[7] == stream->plps[i]->plp)
+				t2mi_extract_bbframe(stream, header, stream->plps[i]);
+	}
+	/* end of processing t2-mi packet */
+	t2mi_stream_reset(stream);
+}
+
+/* rewritten by [anp/hsw], original code taken from https://github.com/newspaperman/t2-mi */
+/** @brief Reassemble the T2-MI packets of a stream from one TS packet */
+static void t2mi_stream_process(t2mi_stream_t *stream, unsigned char *ts_packet)
+{
 	unsigned int payload_start_offset=0;
-	output_buf+=output_buf_offset;
 
 	/* lookup for adaptation field control bits in TS input stream */
-        switch(((input_buf[input_buf_offset + 3])&0x30)>>4) {
-    	    case 0x03:	/* 11b = adaptation field followed by payload */
-		/* number of bytes in AF, following this byte */
-                payload_start_offset=(uint8_t)(input_buf[input_buf_offset + 4]) + 1;
-                if(payload_start_offset > 183) {
-            		log_message(log_module, MSG_DEBUG, "wrong AF len in input stream: %d\n", payload_start_offset);
-                        return 0;
-                }
-            break;
-
-            case 0x02:	/* 10b = adaptation field only, no payload */
-                return 0;
-            break;
-
-            case 0x00:	/* 00b = reserved! */
-            	log_message(log_module, MSG_DEBUG, "wrong AF (00) in input stream, accepting as ordinary packet\n");
-            break;
-            
-            default: /* -Wswitch-default */
-            break;
+	switch(((ts_packet[3])&0x30)>>4) {
+		case 0x03:	/* 11b = adaptation field followed by payload */
+			/* number of bytes in AF, following this byte */
+			payload_start_offset=(uint8_t)(ts_packet[4]) + 1;
+			if(payload_start_offset > 183) {
+				log_message(log_module, MSG_DEBUG, "wrong AF len in input stream: %d\n", payload_start_offset);
+				return;
+			}
+			break;
+
+		case 0x02:	/* 10b = adaptation field only, no payload */
+			return;
+
+		case 0x00:	/* 00b = reserved! */
+			log_message(log_module, MSG_DEBUG, "wrong AF (00) in input stream, accepting as ordinary packet\n");
+			break;
+
+		default: /* -Wswitch-default */
+			break;
 	}
 
 	/* source buffer pointer to beginning of payload in packet */
-        unsigned char* buf = input_buf + input_buf_offset + 4 + payload_start_offset;
-        unsigned int len = TS_PACKET_SIZE - 4 - payload_start_offset;
-
-        unsigned int output_bytes=0;
+	unsigned char* buf = ts_packet + 4 + payload_start_offset;
+	unsigned int len = TS_PACKET_SIZE - 4 - payload_start_offset;
 
 	/* check for payload unit start indicator */
-        if((((input_buf[input_buf_offset + 1])&0x40)>>4)==0x04) {
-                unsigned int offset=1;
-                offset+=(uint8_t)(buf[0]);
-                if(t2mi_active) {
-                        if( 1 < offset && offset < 184) {
-                                memcpy(&t2packet[t2packetpos],&buf[1],offset-1);
-                        } else if (offset >= 184) {
-            			log_message(log_module, MSG_DEBUG, "invalid payload offset: %u\n", offset);
-            			return 0;
-                        }
-                        
-			/* select source PLP */
-                        if(t2packet[7]==plpId) {
-                    		/* extract TS packet from T2-MI payload */
-				/* Sync distance (bits) in the BB header then points to the first CRC-8 present in the data field */
-                                unsigned int syncd = ((uint8_t)(t2packet[16]) << 8) + (uint8_t)(t2packet[17]);
-                                syncd >>= 3;
-
-				/* user packet len (bits) = sync byte + payload, CRC-8 of payload replaces next sync byte */
-                                unsigned int upl = ((uint8_t)(t2packet[13]) << 8) + (uint8_t)(t2packet[14]);
-                                upl >>= 3;
-                                upl+=19;
-
-                                unsigned int dnp=0;
-
-                                if(t2packet[9]&0x4) {
-                        	    dnp=1; // Deleted Null Packet
-                        	}
-                                if(syncd==0x1FFF ) { /* maximal sync value (in bytes) */
-            				log_message(log_module, MSG_DEBUG, "sync value 0x1FFF!\n");
-					unsigned int maxsync = upl - 19;
-                                        if (output_buf_offset + output_bytes + maxsync > output_buf_size) {
-	                            		log_message(log_module, MSG_DETAIL, "position (max sync) out of buffer bounds: %u + %u + %u > %u\n",
-	                            								    output_buf_offset, output_bytes, maxsync, output_buf_size);
-	                                	goto t2_copy_end;
-                                        }
-                                        else if (upl > 19) {
-                                                memcpy(output_buf + output_bytes, &t2packet[19], maxsync);
-                                                output_bytes+=maxsync;
-                                        }
-
-                                } else {
-                                        if (!t2mi_first && syncd > 0) {
-                                    	    unsigned int syncd_size = syncd - dnp;
-                                            if (syncd_size > (sizeof(t2packet)-19) || output_buf_offset + output_bytes + syncd_size > output_buf_size) {
-	                                	    log_message(log_module, MSG_DETAIL, "position (syncd) out of buffer bounds: %u + %u + %u > %u\n",
-	                                							    output_buf_offset, output_bytes, syncd_size, output_buf_size);
-	                                	    goto t2_copy_end;
-                                            }
-                                            memcpy(output_buf + output_bytes, &t2packet[19], syncd_size);
-                                            output_bytes+=syncd_size;
-                                        }
-
-					/* detect unaligned packet in buffer */
-                                        unsigned int output_part = (output_buf_offset + output_bytes) % TS_PACKET_SIZE;
-                                        if (output_part > 0) {
-                                    	    log_message(log_module, MSG_DETAIL, "unaligned packet in buffer pos %u/%u\n", output_buf_offset, output_bytes);
-                                    	    output_bytes -= output_part; /* drop packet; TODO: check if we can add padding instead of dropping */
-                                        }
-
-                                        t2mi_first=false;
-                                        unsigned int t2_copy_pos=19+syncd;
-
-                                        /* copy T2-MI packet payload to output, add sync bytes */
-                                        for(; t2_copy_pos < upl - 187; t2_copy_pos+=(187+dnp)) {
-                                    		/* fullsize TS frame */
-                                                if (t2_copy_pos > ((sizeof(t2packet) - 187)) || output_buf_offset + output_bytes + TS_PACKET_SIZE > output_buf_size) {
-                                        	    log_message(log_module, MSG_DETAIL, "position (full TS) out of buffer bounds: in %u, out %u + %u + %u > %u\n",
-                                        							    t2_copy_pos, output_buf_offset, output_bytes, TS_PACKET_SIZE, output_buf_size);
-                                        	    goto t2_copy_end;
-                                                }
-                                                output_buf[output_bytes] = TS_SYNC_BYTE;
-                                                output_bytes++;
-                                                memcpy(output_buf + output_bytes, &t2packet[t2_copy_pos], 187);
-                                                output_bytes+=187;
-                                        }
-                                        if(t2_copy_pos < upl )  {
-                                    		/* partial TS frame, we will fill rest of frame at next call */
-                                    		unsigned int part_size = upl - t2_copy_pos;
-                                                if (t2_copy_pos > (sizeof(t2packet)-(part_size+1)) || output_buf_offset + output_bytes + part_size + 1 > output_buf_size) {
-                                        	    log_message(log_module, MSG_DETAIL, "position (part TS) out of buffer bounds: in %u, out %u + %u + %u > %u\n",
-                                        							    t2_copy_pos, output_buf_offset, output_bytes, part_size + 1, output_buf_size);
-                                        	    goto t2_copy_end;
-                                                }
-                                                output_buf[output_bytes] = TS_SYNC_BYTE;
-                                                output_bytes++;
-                                                memcpy(output_buf + output_bytes, &t2packet[t2_copy_pos], part_size);
-                                                output_bytes+=part_size;
-                                        }
-                                }
-                                t2_copy_end: ; /* exit to prevent output buffer overflow in case of invalid pointers recieved in input stream */
-                        }
-                        t2mi_active=false;
-                        memset(&t2packet, 0, sizeof(t2packet)); // end of processing t2-mi packet, clear it
-                }
-
-                if((buf[offset])==0x0) { //Baseband Frame
+	if(ts_packet[1]&0x40) {
+		unsigned int offset=1;
+		offset+=(uint8_t)(buf[0]);
+		if(stream->active) {
+			if (offset >= 184) {
+				log_message(log_module, MSG_DEBUG, "invalid payload offset: %u\n", offset);
+				return;
+			}
+			if (offset > 1)
+				t2mi_stream_add(stream, &buf[1], offset-1);
+			t2mi_stream_packet_end(stream);
+		}
+
+		if(offset < len && (buf[offset])==0x0) { //Baseband Frame
 			/*	TODO: padding
 				pad (pad_len bits) shall be filled with between 0 and 7 bits of padding such that the T2-MI packet is always an integer
-				number of bytes in length, i.e. payload_len+pad_len shall be a multiple of 8. Each padding bit shall have the value 0. 
+				number of bytes in length, i.e. payload_len+pad_len shall be a multiple of 8. Each padding bit shall have the value 0.
 			*/
-                        if(len > offset) {
-                                memcpy(t2packet,&buf[offset],len-offset);
-                                t2packetpos=len-offset;
-                                t2mi_active=true;
-                        }
-                }
-        } else if(t2mi_active) {
-                memcpy(t2packet+t2packetpos,buf,len);
-                t2packetpos+=len;
-        }
-        return output_bytes;
+			stream->active=true;
+			t2mi_stream_add(stream, &buf[offset], len-offset);
+		}
+	} else if(stream->active) {
+		t2mi_stream_add(stream, buf, len);
+	}
+}
+
+/** @brief Extract all the PLPs of an input buffer, in one pass
+ *
+ * The extracted packets are written to the buffer of each PLP, the number of bytes is given by plp->bytes
+ */
+void t2mi_demux_process(t2mi_demux_t *demux, unsigned char *buf, unsigned int len, int filter_transport_error)
+{
+	unsigned int pos;
+	int errorcounter = 0;
+	int pid;
+
+	for (int i = 0; i < demux->num_streams; i++)
+		for (int j = 0; j < demux->streams[i]->num_plps; j++)
+			demux->streams[i]->plps[j]->bytes = 0;
+
+	for(pos=0; (pos+TS_PACKET_SIZE)<=len; pos+=TS_PACKET_SIZE)//we loop on the subpackets
+	{
+		/* check for sync byte and transport error bit if requested */
+		if((buf[pos] != TS_SYNC_BYTE || (buf[pos+1] & 0x80) == 0x80) && filter_transport_error > 0)
+		{
+			log_message(log_module, MSG_FLOOD, "input TS packet damaged, buf offset %d\n", pos);
+			errorcounter++;
+			continue;
+		}
+		/* target t2mi stream pid */
+		pid = ((buf[pos+1] & 0x1f) << 8) | buf[pos+2];
+		if (!demux->pid_stream[pid])
+			continue;
+		t2mi_stream_process(demux->streams[demux->pid_stream[pid]-1], buf+pos);
+	}
+
+	/* in case we got too much errors */
+	if (errorcounter * 100 > (int)(len/TS_PACKET_SIZE) * 50) {
+		log_message(log_module, MSG_DEBUG,"too many errors in input buffer (%d/%d)\n", errorcounter, len/TS_PACKET_SIZE);
+		for (int i = 0; i < demux->num_streams; i++) {
+			t2mi_stream_reset(demux->streams[i]);
+			for (int j = 0; j < demux->streams[i]->num_plps; j++)
+				t2mi_plp_reset(demux->streams[i]->plps[j]);
+		}
+		return;
+	}
+
+	/* the input buffer will be reused, we keep the packets which are not complete */
+	for (int i = 0; i < demux->num_streams; i++)
+		if (demux->streams[i]->active)
+			t2mi_stream_keep(demux->streams[i]);
 }
@@ -0,0 +1,108 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2013 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief T2-MI stream support
+ */
+
+#ifndef _T2MI_H
+#define _T2MI_H
+
+#include <stdint.h>
+
+#include "mumudvb.h"
+
+/** The maximum size of a T2-MI packet (maximal T2 payload + header) */
+#define T2MI_MAX_PACKET_SIZE (TS_PACKET_SIZE*349)
+/** The number of PLPs extracted from one input, one per adapter */
+#define T2MI_MAX_PLPS MAX_ADAPTERS
+/** The number of fragments of a T2-MI packet before they are kept in the stream buffer */
+#define T2MI_MAX_FRAGMENTS (T2MI_MAX_PACKET_SIZE/(TS_PACKET_SIZE-4)+2)
+
+/** @brief The extraction of one PLP, its TS packets are the input of one adapter */
+typedef struct t2mi_plp_t{
+	/** The PID of the T2-MI stream */
+	int pid;
+	/** The PLP we extract */
+	uint8_t plp;
+	/** We wait for the first sync of the PLP */
+	bool first;
+	/** The extracted TS packets, only whole packets */
+	unsigned char *buffer;
+	unsigned int buffer_size;
+	/** The number of bytes extracted from the last read */
+	unsigned int bytes;
+	/** The TS packet cut at the end of the last baseband frame, completed by the next one */
+	unsigned char partial[TS_PACKET_SIZE];
+	unsigned int partial_size;
+	//statistics
+	uint64_t bbframes;
+	uint64_t resyncs;
+}t2mi_plp_t;
+
+/** @brief A part of a T2-MI packet : a TS payload in the input buffer, or the part kept from the previous reads */
+typedef struct t2mi_fragment_t{
+	const unsigned char *data;
+	unsigned int len;
+}t2mi_fragment_t;
+
+/** @brief The reassembly of the T2-MI packets of one PID
+ *
+ * The T2-MI packet is not copied : it is a list of fragments in the input buffer.
+ * It is copied to the kept buffer only if it continues after the end of the input buffer.
+ */
+typedef struct t2mi_stream_t{
+	int pid;
+	/** A T2-MI packet is being received */
+	bool active;
+	/** The number of bytes received for the current packet */
+	unsigned int pos;
+	int num_fragments;
+	t2mi_fragment_t fragments[T2MI_MAX_FRAGMENTS];
+	/** The beginning of the current packet, received in the previous reads (the first fragment) */
+	unsigned char kept[T2MI_MAX_PACKET_SIZE];
+	unsigned int kept_size;
+	/** The PLPs extracted from this stream */
+	int num_plps;
+	t2mi_plp_t *plps[T2MI_MAX_PLPS];
+}t2mi_stream_t;
+
+/** @brief The T2-MI decapsulation of one input : all the PIDs and PLPs are extracted in one pass over the buffer */
+typedef struct t2mi_demux_t{
+	int num_streams;
+	t2mi_stream_t *streams[MAX_T2MI_PIDS];
+	/** The stream of each PID (index+1), 0 if the PID doesn't carry T2-MI */
+	uint8_t pid_stream[8193];
+}t2mi_demux_t;
+
+void t2mi_plp_init(t2mi_plp_t *plp, int pid, uint8_t plp_id);
+int t2mi_plp_alloc(t2mi_plp_t *plp, unsigned int buffer_size);
+void t2mi_plp_free(t2mi_plp_t *plp);
+void t2mi_plp_reset(t2mi_plp_t *plp);
+int t2mi_demux_add(t2mi_demux_t *demux, t2mi_plp_t *plp);
+void t2mi_demux_free(t2mi_demux_t *demux);
+void t2mi_demux_process(t2mi_demux_t *demux, unsigned char *buf, unsigned int len, int filter_transport_error);
+
+#endif
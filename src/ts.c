@@ -31,9 +31,10 @@
 #include "ts.h"
 #include "mumudvb.h"
 #include "log.h"
+#include "crc32.h"
+#include "psi_cache.h"
 
 #include <stdint.h>
-extern uint32_t       crc32_table[256];
 static char *log_module="TS: ";
 
 
@@ -375,8 +376,14 @@ void add_ts_packet_data(unsigned char *buf, mumudvb_ts_packet_t *pkt, int data_l
 		//We check if the packet is full
 		if(ts_partial_full(pkt))
 		{
-			//The partial packet is full, we check the CRC32
-			if(ts_check_crc32(pkt))
+			//The partial packet is full, if the reader already has it we drop it, otherwise we check the CRC32
+			if(pkt->cache && psi_cache_hit(pkt->cache, pkt->pid, pkt->data_partial, pkt->len_partial))
+			{
+				log_message(log_module, MSG_FLOOD, "Section already processed, PID %d, we drop it\n", pkt->pid);
+				pkt->len_partial=0;
+				pkt->status_partial=EMPTY;
+			}
+			else if(ts_check_crc32(pkt))
 				ts_move_part_to_full(pkt); //Everything is perfect, the packet full is ok
 		}
 
@@ -430,8 +437,7 @@ void ts_move_part_to_full(mumudvb_ts_packet_t *pkt)
  */
 int ts_check_raw_crc32(unsigned char *data)
 {
-	int i,len;
-	uint32_t crc32;
+	int len;
 	tbl_h_t *tbl_struct;
 	tbl_struct=(tbl_h_t *)data;
 
@@ -443,15 +449,9 @@ int ts_check_raw_crc32(unsigned char *data)
 	len=HILO(tbl_struct->section_length)+BYTES_BFR_SEC_LEN;
 
 	//CRC32 calculation
-	//Test of the crc32
-	crc32=0xffffffff;
-	//we compute the CRC32
 	//we have two ways: either we compute until the end and it should be 0
 	//either we exclude the 4 last bits and in should be equal to the 4 last bits
-	for(i = 0; i < len; i++) {
-		crc32 = (crc32 << 8) ^ crc32_table[((crc32 >> 24) ^ data[i])&0xff];
-	}
-	return (crc32 == 0);
+	return (crc32_update(CRC32_INIT, data, len) == 0);
 }
 
 /**@brief Checking of the CRC32
@@ -856,6 +856,8 @@ typedef struct {
   int pid;
   /**the countinuity counter, incremented in each packet*/
   int cc;
+  /** The sections already processed by the reader, the repetitions are dropped (NULL : no cache, see psi_cache.c) */
+  struct psi_cache_t *cache;
 
   /** If we have threads, the lock on the packet */
   pthread_mutex_t packetmutex;
@@ -0,0 +1,421 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2010 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief Reception of the transport stream from a UDP/RTP source
+ *
+ * The datagrams are received by batches (recvmmsg when available). The RTP
+ * header, if any, is removed. With RTP, the datagrams received out of order
+ * are held in a small window until the missing ones come, the missing ones
+ * are counted as lost when the window is full.
+ */
+
+#define _CRT_SECURE_NO_WARNINGS
+#define _GNU_SOURCE //in order to use recvmmsg
+
+#include "udp_source.h"
+#include "errors.h"
+#include "log.h"
+#include <string.h>
+#include <errno.h>
+#include <stdlib.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+static char *log_module="UDP source: ";
+
+/** Initialize the UDP source variables*/
+void init_udp_source_v(udp_source_t *source)
+{
+	memset(source, 0, sizeof(udp_source_t));
+	source->batch=UDP_SOURCE_DEFAULT_BATCH;
+	source->rtp=UDP_SOURCE_RTP_AUTO;
+	source->reorder_window=UDP_SOURCE_DEFAULT_REORDER_WINDOW;
+}
+
+/** @brief Read a line of the configuration file to check if there is a UDP source parameter
+ *
+ * @param source the UDP source parameters
+ * @param substring The currrent line
+ */
+int read_udp_source_configuration(udp_source_t *source, char *substring)
+{
+	char delimiteurs[] = CONFIG_FILE_SEPARATOR;
+	if (!strcmp (substring, "source_batch"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		source->batch = atoi (substring);
+		if(source->batch < 1)
+			source->batch = 1;
+		if(source->batch > UDP_SOURCE_MAX_BATCH)
+		{
+			log_message( log_module, MSG_WARN,"source_batch too big, we use %d\n", UDP_SOURCE_MAX_BATCH);
+			source->batch = UDP_SOURCE_MAX_BATCH;
+		}
+	}
+	else if (!strcmp (substring, "source_rtp"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		if (!strncmp (substring, "auto", 4))
+			source->rtp = UDP_SOURCE_RTP_AUTO;
+		else
+			source->rtp = atoi (substring) ? UDP_SOURCE_RTP_ON : UDP_SOURCE_RTP_OFF;
+	}
+	else if (!strcmp (substring, "source_reorder_window"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		source->reorder_window = atoi (substring);
+		if(source->reorder_window < 0)
+			source->reorder_window = 0;
+		if(source->reorder_window > UDP_SOURCE_MAX_REORDER_WINDOW)
+		{
+			log_message( log_module, MSG_WARN,"source_reorder_window too big, we use %d\n", UDP_SOURCE_MAX_REORDER_WINDOW);
+			source->reorder_window = UDP_SOURCE_MAX_REORDER_WINDOW;
+		}
+	}
+	else if (!strcmp (substring, "source_rcvbuf"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		source->rcvbuf = atoi (substring);
+		if(source->rcvbuf < 0)
+			source->rcvbuf = 0;
+	}
+	else
+		return 0; //Nothing concerning the UDP source, we return 0 to explore the other possibilities
+
+	return 1;//We found something for the UDP source, we tell main to go for the next line
+}
+
+/** @brief Allocate the datagram buffers and set the socket receive buffer
+ *
+ * @param source the UDP source
+ * @param fd the socket
+ */
+int udp_source_open(udp_source_t *source, int fd)
+{
+	//We can hold one datagram more than the window before releasing the oldest
+	source->num_slots=source->batch+source->reorder_window+1;
+	source->slots=malloc(source->num_slots*UDP_SOURCE_SLOT_SIZE);
+	source->free_slots=malloc(source->num_slots*sizeof(int));
+	if(source->slots==NULL || source->free_slots==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return ERROR_MEMORY<<8;
+	}
+	for(int islot=0;islot<source->num_slots;islot++)
+		source->free_slots[islot]=islot;
+	source->num_free_slots=source->num_slots;
+
+	if(source->rcvbuf)
+	{
+		if(setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (const char *)&source->rcvbuf, sizeof(int)) < 0)
+			log_message( log_module, MSG_WARN,"setsockopt SO_RCVBUF failed : %s\n", strerror(errno));
+		else
+			log_message( log_module, MSG_DEBUG,"Socket receive buffer set to %d bytes\n", source->rcvbuf);
+	}
+#ifndef HAVE_RECVMMSG
+	if(source->batch>1)
+		log_message( log_module, MSG_INFO,"recvmmsg is not available on this system, the datagrams will be received one by one\n");
+#endif
+	log_message( log_module, MSG_DEBUG,"%d datagrams per read, RTP %s, reorder window %d datagrams\n",
+			source->batch,
+			source->rtp==UDP_SOURCE_RTP_AUTO ? "auto" : (source->rtp ? "on" : "off"),
+			source->reorder_window);
+	return 0;
+}
+
+/** @brief The size of the reading buffer needed by udp_source_read
+ *
+ * A read gives at most one batch and the datagrams released from the window
+ */
+int udp_source_buffer_size(udp_source_t *source)
+{
+	return (source->batch+source->reorder_window+1)*UDP_SOURCE_SLOT_SIZE;
+}
+
+/** @brief Find the TS packets in a datagram, remove the RTP header
+ *
+ * @return the length of the TS packets, -1 if the datagram is not a transport stream
+ */
+static int udp_source_payload(udp_source_t *source, unsigned char *data, int len, int *offset, int *is_rtp, uint16_t *seq)
+{
+	int hdr_len;
+	*offset=0;
+	*is_rtp=0;
+	if(source->rtp!=UDP_SOURCE_RTP_ON && len>0 && data[0]==TS_SYNC_BYTE)
+	{
+		//Raw transport stream
+		return len-len%TS_PACKET_SIZE;
+	}
+	if(source->rtp==UDP_SOURCE_RTP_OFF || len<RTP_HEADER_LEN || (data[0]&0xC0)!=0x80)
+		return -1;
+	//RTP version 2, fixed header, CSRC list and extension
+	hdr_len=RTP_HEADER_LEN+4*(data[0]&0x0F);
+	if((data[0]&0x10) && hdr_len+4<=len)
+		hdr_len+=4+4*((data[hdr_len+2]<<8)|data[hdr_len+3]);
+	//padding
+	if(data[0]&0x20)
+		len-=data[len-1];
+	if(hdr_len>=len || data[hdr_len]!=TS_SYNC_BYTE)
+		return -1;
+	*offset=hdr_len;
+	*is_rtp=1;
+	*seq=(data[2]<<8)|data[3];
+	len-=hdr_len;
+	return len-len%TS_PACKET_SIZE;
+}
+
+/** @brief Copy the TS packets of a datagram in the reading buffer */
+static int udp_source_output(udp_source_t *source, unsigned char *data, int len, unsigned char *buffer, int buffer_size, int *buffer_pos)
+{
+	if(*buffer_pos+len>buffer_size)
+	{
+		source->errors++;
+		return -1;
+	}
+	memcpy(buffer+*buffer_pos, data, len);
+	*buffer_pos+=len;
+	return 0;
+}
+
+/** @brief Send the held datagrams which are next in the sequence */
+static void udp_source_release(udp_source_t *source, unsigned char *buffer, int buffer_size, int *buffer_pos)
+{
+	int found;
+	do
+	{
+		found=0;
+		for(int iheld=0;iheld<source->num_held;iheld++)
+		{
+			udp_source_held_t *held=&source->held[iheld];
+			if(held->seq!=source->next_seq)
+				continue;
+			udp_source_output(source, source->slots+held->slot*UDP_SOURCE_SLOT_SIZE+held->offset, held->len, buffer, buffer_size, buffer_pos);
+			source->free_slots[source->num_free_slots++]=held->slot;
+			source->held[iheld]=source->held[--source->num_held];
+			source->next_seq++;
+			found=1;
+			break;
+		}
+	}while(found);
+}
+
+/** @brief The window is full, we give up waiting for the datagrams before the oldest held one */
+static void udp_source_skip_missing(udp_source_t *source, unsigned char *buffer, int buffer_size, int *buffer_pos)
+{
+	int oldest=0;
+	for(int iheld=1;iheld<source->num_held;iheld++)
+		if((int16_t)(source->held[iheld].seq-source->held[oldest].seq)<0)
+			oldest=iheld;
+	source->lost+=(uint16_t)(source->held[oldest].seq-source->next_seq);
+	source->next_seq=source->held[oldest].seq;
+	udp_source_release(source, buffer, buffer_size, buffer_pos);
+}
+
+/** @brief Put a datagram at its place in the sequence
+ *
+ * @return 1 if the datagram is held (its slot is kept)
+ */
+static int udp_source_sequence(udp_source_t *source, int slot, int offset, int len, uint16_t seq, unsigned char *buffer, int buffer_size, int *buffer_pos)
+{
+	int16_t diff;
+	unsigned char *data=source->slots+slot*UDP_SOURCE_SLOT_SIZE+offset;
+
+	if(!source->seq_valid)
+	{
+		source->seq_valid=1;
+		source->next_seq=seq;
+	}
+	diff=(int16_t)(seq-source->next_seq);
+	if(diff>UDP_SOURCE_RESYNC_GAP || diff< -UDP_SOURCE_RESYNC_GAP)
+	{
+		//The source restarted, we send what we have and start again from this datagram
+		log_message( log_module, MSG_DEBUG,"RTP sequence jump from %d to %d, resync\n", source->next_seq, seq);
+		while(source->num_held)
+			udp_source_skip_missing(source, buffer, buffer_size, buffer_pos);
+		source->next_seq=seq;
+		diff=0;
+	}
+
+	if(diff<0)
+	{
+		//Already sent or given up
+		source->late++;
+		return 0;
+	}
+	if(source->reorder_window==0)
+	{
+		//No reordering, we only count
+		source->lost+=diff;
+		udp_source_output(source, data, len, buffer, buffer_size, buffer_pos);
+		source->next_seq=seq+1;
+		return 0;
+	}
+	if(diff==0)
+	{
+		if(source->num_held)
+			source->reordered++;
+		udp_source_output(source, data, len, buffer, buffer_size, buffer_pos);
+		source->next_seq++;
+		udp_source_release(source, buffer, buffer_size, buffer_pos);
+		return 0;
+	}
+	//A datagram is missing, we hold this one
+	for(int iheld=0;iheld<source->num_held;iheld++)
+		if(source->held[iheld].seq==seq)
+		{
+			source->late++;
+			return 0;
+		}
+	source->held[source->num_held++]=(udp_source_held_t){
+		.slot=slot,
+		.seq=seq,
+		.offset=offset,
+		.len=len,
+	};
+	if(source->num_held>source->reorder_window)
+		udp_source_skip_missing(source, buffer, buffer_size, buffer_pos);
+	return 1;
+}
+
+/** @brief Read the datagrams waiting on the socket and put their TS packets in the buffer
+ *
+ * @param source the UDP source
+ * @param fd the socket
+ * @param buffer the reading buffer
+ * @param buffer_size its size, at least udp_source_buffer_size
+ * @return the number of bytes written in the buffer, -1 on error
+ */
+int udp_source_read(udp_source_t *source, int fd, unsigned char *buffer, int buffer_size)
+{
+	int recv_slots[UDP_SOURCE_MAX_BATCH];
+	int recv_len[UDP_SOURCE_MAX_BATCH];
+	int num, received;
+	int buffer_pos=0;
+
+	num=source->batch;
+	if(num>source->num_free_slots)
+		num=source->num_free_slots;
+	for(int i=0;i<num;i++)
+		recv_slots[i]=source->free_slots[--source->num_free_slots];
+
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr msgs[UDP_SOURCE_MAX_BATCH];
+	struct iovec iovecs[UDP_SOURCE_MAX_BATCH];
+	memset(msgs, 0, num*sizeof(struct mmsghdr));
+	for(int i=0;i<num;i++)
+	{
+		iovecs[i].iov_base=source->slots+recv_slots[i]*UDP_SOURCE_SLOT_SIZE;
+		iovecs[i].iov_len=UDP_SOURCE_SLOT_SIZE;
+		msgs[i].msg_hdr.msg_iov=&iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen=1;
+	}
+	//The main loop polled the socket, we take what is there without waiting
+	received=recvmmsg(fd, msgs, num, MSG_DONTWAIT, NULL);
+	for(int i=0;i<received;i++)
+	{
+		recv_len[i]=msgs[i].msg_len;
+		if(msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+			recv_len[i]=-1;
+	}
+#else
+	received=0;
+	if(num)
+	{
+		received=recvfrom(fd, (char *)source->slots+recv_slots[0]*UDP_SOURCE_SLOT_SIZE, UDP_SOURCE_SLOT_SIZE, 0, NULL, NULL);
+		if(received>=0)
+		{
+			recv_len[0]=received;
+			received=1;
+		}
+	}
+#endif
+	if(received<0)
+	{
+		for(int i=0;i<num;i++)
+			source->free_slots[source->num_free_slots++]=recv_slots[i];
+		if(errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR)
+			return 0;
+		log_message( log_module, MSG_WARN,"Error when receiving from the source : %s\n", strerror(errno));
+		return -1;
+	}
+	source->recv_calls++;
+	source->datagrams+=received;
+
+	for(int i=0;i<num;i++)
+	{
+		int slot=recv_slots[i];
+		int offset, len, is_rtp;
+		uint16_t seq=0;
+		if(i>=received)
+		{
+			source->free_slots[source->num_free_slots++]=slot;
+			continue;
+		}
+		len=-1;
+		if(recv_len[i]>0)
+			len=udp_source_payload(source, source->slots+slot*UDP_SOURCE_SLOT_SIZE, recv_len[i], &offset, &is_rtp, &seq);
+		if(len<=0)
+		{
+			source->errors++;
+			source->free_slots[source->num_free_slots++]=slot;
+			continue;
+		}
+		if(is_rtp && !source->rtp_seen)
+		{
+			source->rtp_seen=1;
+			log_message( log_module, MSG_INFO,"The source sends RTP, the headers are removed\n");
+		}
+		if(is_rtp && udp_source_sequence(source, slot, offset, len, seq, buffer, buffer_size, &buffer_pos))
+			continue;
+		if(!is_rtp)
+			udp_source_output(source, source->slots+slot*UDP_SOURCE_SLOT_SIZE, len, buffer, buffer_size, &buffer_pos);
+		source->free_slots[source->num_free_slots++]=slot;
+	}
+	return buffer_pos;
+}
+
+/** @brief Display the statistics of the source */
+void udp_source_log_stats(udp_source_t *source)
+{
+	if(!source->recv_calls)
+		return;
+	log_message( log_module, MSG_INFO,"%llu datagrams (%.1f per read), %llu lost, %llu reordered, %llu late, %llu errors\n",
+			source->datagrams,
+			(double)source->datagrams/source->recv_calls,
+			source->lost,
+			source->reordered,
+			source->late,
+			source->errors);
+}
+
+void udp_source_free(udp_source_t *source)
+{
+	free(source->slots);
+	source->slots=NULL;
+	free(source->free_slots);
+	source->free_slots=NULL;
+}
@@ -0,0 +1,105 @@
+/*
+ * MuMuDVB - Stream a DVB transport stream.
+ *
+ * (C) 2004-2010 Brice DUBOST
+ *
+ * The latest version can be found at http://mumudvb.net
+ *
+ * Copyright notice:
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**@file
+ * @brief Reception of the transport stream from a UDP/RTP source (source_addr)
+ */
+
+#ifndef _UDP_SOURCE_H
+#define _UDP_SOURCE_H
+
+#include "mumudvb.h"
+
+/** The size of the buffer of one datagram, bigger datagrams are truncated */
+#define UDP_SOURCE_SLOT_SIZE 2048
+/** The default number of datagrams received by one system call */
+#define UDP_SOURCE_DEFAULT_BATCH 32
+#define UDP_SOURCE_MAX_BATCH 256
+/** The default number of datagrams held to put them back in the RTP sequence order */
+#define UDP_SOURCE_DEFAULT_REORDER_WINDOW 8
+#define UDP_SOURCE_MAX_REORDER_WINDOW 64
+/** A bigger jump of the RTP sequence number is a restart of the source, not a loss */
+#define UDP_SOURCE_RESYNC_GAP 1000
+
+enum
+{
+	UDP_SOURCE_RTP_AUTO=-1,
+	UDP_SOURCE_RTP_OFF,
+	UDP_SOURCE_RTP_ON,
+};
+
+/** @brief A datagram waiting for the missing datagrams before it */
+typedef struct udp_source_held_t{
+	int slot;
+	uint16_t seq;
+	/** The TS packets in the slot */
+	int offset;
+	int len;
+}udp_source_held_t;
+
+/** @brief The UDP/RTP source of an adapter */
+typedef struct udp_source_t{
+	/** Number of datagrams received by one system call */
+	int batch;
+	/** Do the datagrams have a RTP header : UDP_SOURCE_RTP_AUTO, UDP_SOURCE_RTP_OFF or UDP_SOURCE_RTP_ON */
+	int rtp;
+	/** Number of datagrams held at most to wait for a missing one, 0 to not reorder */
+	int reorder_window;
+	/** The size of the socket receive buffer in bytes, 0 for the default */
+	int rcvbuf;
+	/** The datagram buffers */
+	unsigned char *slots;
+	int num_slots;
+	int *free_slots;
+	int num_free_slots;
+	udp_source_held_t held[UDP_SOURCE_MAX_REORDER_WINDOW+1];
+	int num_held;
+	/** The next RTP sequence number we expect */
+	uint16_t next_seq;
+	int seq_valid;
+	/** To say once that the source is RTP */
+	int rtp_seen;
+	//statistics
+	unsigned long long datagrams;
+	unsigned long long recv_calls;
+	/** Datagrams missing in the RTP sequence */
+	unsigned long long lost;
+	/** Datagrams received out of order and put back in order */
+	unsigned long long reordered;
+	/** Datagrams dropped because they came after their place in the sequence, or twice */
+	unsigned long long late;
+	/** Datagrams which are not a transport stream (or truncated) */
+	unsigned long long errors;
+}udp_source_t;
+
+void init_udp_source_v(udp_source_t *source);
+int read_udp_source_configuration(udp_source_t *source, char *substring);
+int udp_source_open(udp_source_t *source, int fd);
+int udp_source_buffer_size(udp_source_t *source);
+int udp_source_read(udp_source_t *source, int fd, unsigned char *buffer, int buffer_size);
+void udp_source_log_stats(udp_source_t *source);
+void udp_source_free(udp_source_t *source);
+
+#endif
@@ -58,6 +58,7 @@
 #include "mumudvb.h"
 #include "errors.h"
 #include "log.h"
+#include "hls.h"
 
 
 
@@ -74,25 +75,9 @@ unicast_client_t *unicast_add_client(unicast_parameters_t *unicast_vars, int Soc
 {
 
 	unicast_client_t *client;
-	unicast_client_t *prev_client;
 	log_message( log_module, MSG_FLOOD,"We create a client associated with the socket %d\n",Socket);
-	//We allocate a new client
-	if(unicast_vars->clients==NULL)
-	{
-		log_message( log_module, MSG_FLOOD,"first client\n");
-		client=unicast_vars->clients=calloc(1, sizeof(unicast_client_t));
-		prev_client=NULL;
-	}
-	else
-	{
-		log_message( log_module, MSG_FLOOD,"there is already clients\n");
-		client=unicast_vars->clients;
-		while(client->next!=NULL)
-			client=client->next;
-		client->next=calloc(1, sizeof(unicast_client_t));
-		prev_client=client;
-		client=client->next;
-	}
+	//We allocate a new client, it will be put at the beginning of the list
+	client=calloc(1, sizeof(unicast_client_t));
 	if(client==NULL)
 	{
 		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
@@ -147,15 +132,20 @@ unicast_client_t *unicast_add_client(unicast_parameters_t *unicast_vars, int Soc
 	client->chan_ptr=NULL;
 	client->askedChannel=-1;
 	client->consecutive_errors=0;
-	client->next=NULL;
-	client->prev=prev_client;
+	client->disconnect=0;
+	client->hls_segment=NULL;
 	client->chan_next=NULL;
 	client->chan_prev=NULL;
 	//We init the queue
-	client->queue.data_bytes_in_queue=0;
-	client->queue.packets_in_queue=0;
-	client->queue.first=NULL;
-	client->queue.last=NULL;
+	//the position in the channel ring is set when the client is added to a channel
+	memset(&client->queue,0,sizeof(unicast_queue_header_t));
+
+	//We add the client to the list
+	client->prev=NULL;
+	client->next=unicast_vars->clients;
+	if(unicast_vars->clients!=NULL)
+		unicast_vars->clients->prev=client;
+	unicast_vars->clients=client;
 
 	unicast_vars->client_number++;
 
@@ -222,7 +212,11 @@ int unicast_del_client(unicast_parameters_t *unicast_vars, unicast_client_t *cli
 
 	if(client->buffer)
 		free(client->buffer);
-	unicast_queue_clear(&client->queue);
+	if(client->hls_segment)
+		hls_segment_release(client->hls_segment);
+	//The client doesn't use the channel ring anymore
+	if(client->chan_ptr!=NULL)
+		unicast_ring_release(client->chan_ptr);
 	free(client);
 
 	unicast_vars->client_number--;
@@ -235,11 +229,13 @@ int unicast_del_client(unicast_parameters_t *unicast_vars, unicast_client_t *cli
 
 /** @brief This function add an unicast client to a channel
  *
+ * @param unicast_vars the unicast parameters
  * @param client the client
  * @param channel the channel
  */
-int channel_add_unicast_client(unicast_client_t *client,mumudvb_channel_t *channel)
+int channel_add_unicast_client(unicast_parameters_t *unicast_vars, unicast_client_t *client,mumudvb_channel_t *channel)
 {
+	unicast_ring_t *ring;
 	unicast_client_t *last_client;
 	int iRet;
 	char addr_buf[IPV6_CHAR_LEN];
@@ -254,6 +250,13 @@ int channel_add_unicast_client(unicast_client_t *client,mumudvb_channel_t *chann
 		return -1;
 	}
 
+	//The client starts with the live data
+	ring=unicast_ring_get(channel, unicast_vars->queue_max_size);
+	if(ring==NULL)
+		return -1;
+	memset(&client->queue,0,sizeof(unicast_queue_header_t));
+	client->queue.position=ring->head;
+
 	client->chan_next=NULL;
 	// Increment the number of client connections
     channel->num_clients++;
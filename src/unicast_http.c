@@ -67,6 +67,10 @@
 #include "tune.h"
 #include "autoconf.h"
 #include "rewrite.h"
+#include "hls.h"
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
 #ifdef ENABLE_CAM_SUPPORT
 #include "cam.h"
 #endif
@@ -85,48 +89,43 @@ static char *log_module="Unicast : ";
 
 //from unicast_client.c
 unicast_client_t *unicast_add_client(unicast_parameters_t *unicast_vars, int Socket);
-int channel_add_unicast_client(unicast_client_t *client,mumudvb_channel_t *channel);
+int channel_add_unicast_client(unicast_parameters_t *unicast_vars, unicast_client_t *client,mumudvb_channel_t *channel);
 
 unicast_client_t *unicast_accept_connection(unicast_parameters_t *unicast_vars, int socketIn);
-void unicast_close_connection(unicast_parameters_t *unicast_vars, int Socket);
+void unicast_close_connection(unicast_parameters_t *unicast_vars, unicast_client_t *client);
 
 int
-unicast_send_streamed_channels_list (int number_of_channels, mumudvb_channel_t *channels, int Socket, char *host);
+unicast_send_streamed_channels_list (unicast_adapter_t *adapters, int num_adapters, int Socket, char *host);
 int
 unicast_send_index_page  (int Socket);
 int
-unicast_send_play_list_unicast (int number_of_channels, mumudvb_channel_t *channels, int Socket, int unicast_portOut, int perport, unicast_parameters_t *unicast_vars);
+unicast_send_play_list_unicast (unicast_adapter_t *adapters, int num_adapters, int Socket, int unicast_portOut, int perport, unicast_parameters_t *unicast_vars);
 int
-unicast_send_play_list_multicast (int number_of_channels, mumudvb_channel_t* channels, int Socket, int vlc, unicast_parameters_t *unicast_vars);
+unicast_send_play_list_multicast (unicast_adapter_t *adapters, int num_adapters, int Socket, int vlc, unicast_parameters_t *unicast_vars);
 int
-unicast_send_streamed_channels_list_js (int number_of_channels, mumudvb_channel_t *channels, void* cam_p_v, int Socket);
+unicast_send_streamed_channels_list_js (unicast_adapter_t *adapters, int num_adapters, int Socket);
 int
 unicast_send_signal_power_js (int Socket, strength_parameters_t *strengthparams);
 int
-unicast_send_channel_traffic_js (int number_of_channels, mumudvb_channel_t *channels, int Socket);
+unicast_send_channel_traffic_js (unicast_adapter_t *adapters, int num_adapters, int Socket);
 int
-unicast_send_json_state (int number_of_channels, mumudvb_channel_t* channels, int Socket, strength_parameters_t* strengthparams, auto_p_t* auto_p, void* cam_p_v, void* scam_vars_v);
+unicast_send_json_state (unicast_adapter_t *adapters, int num_adapters, int Socket);
 int
-unicast_send_prometheus (int number_of_channels, mumudvb_channel_t* channels, int Socket, strength_parameters_t* strengthparams);
+unicast_send_prometheus (unicast_adapter_t *adapters, int num_adapters, int Socket);
 int
-unicast_send_xml_state (int number_of_channels, mumudvb_channel_t* channels, int Socket, strength_parameters_t* strengthparams, auto_p_t* auto_p, void* cam_p_v, void* scam_vars_v);
+unicast_send_xml_state (unicast_adapter_t *adapters, int num_adapters, int Socket);
 int
 unicast_send_cam_menu (int Socket, void *cam_p);
 int
 unicast_send_cam_action (int Socket, char *Key, void *cam_p);
 int
-unicast_send_EIT (eit_packet_t *eit_packets, int Socket);
+unicast_send_EIT (unicast_adapter_t *adapters, int num_adapters, int service_id, int Socket);
 
 
 int unicast_handle_message(unicast_parameters_t* unicast_vars,
 		unicast_client_t* client,
-		mumudvb_channel_t* channels,
-		int number_of_channels,
-		strength_parameters_t* strengthparams,
-		auto_p_t* auto_p,
-		void* cam_p,
-		void* scam_vars,
-		eit_packet_t *eit_packets);
+		unicast_adapter_t *adapters,
+		int num_adapters);
 
 #define REPLY_HEADER 0
 #define REPLY_BODY 1
@@ -145,9 +144,10 @@ void init_unicast_v(unicast_parameters_t *unicast_vars)
 				.consecutive_errors_timeout=UNICAST_CONSECUTIVE_ERROR_TIMEOUT,
 				.max_clients=-1,
 				.queue_max_size=UNICAST_DEFAULT_QUEUE_MAX,
+				.send_budget=UNICAST_DEFAULT_SEND_BUDGET,
 				.socket_sendbuf_size=0,
 				.flush_on_eagain=0,
-				.pfdsnum=0,
+				.fdsnum=0,
 				.playlist_ignore_dead=0,
 				.playlist_ignore_scrambled_ratio=0,
 				.hls=0,
@@ -156,7 +156,14 @@ void init_unicast_v(unicast_parameters_t *unicast_vars)
 				.hls_rotate_iframe=0,
 				.hls_storage_dir=NULL,
 				.hls_playlist_name=NULL,
+				.hls_persist=1,
+				.hls_segment_max_size=HLS_DEFAULT_SEGMENT_MAX_SIZE,
 	 };
+	 unicast_vars->listen_fds=NULL;
+#ifdef HAVE_SYS_EPOLL_H
+	 unicast_vars->epfd=-1;
+#else
+	 unicast_vars->fd_info=NULL;
 	 unicast_vars->pfds=NULL;
 	 //+1 for closing the pfd list, see man poll
 	 unicast_vars->pfds=malloc(sizeof(struct pollfd));
@@ -169,8 +176,9 @@ void init_unicast_v(unicast_parameters_t *unicast_vars)
 	 unicast_vars->pfds[0].fd = 0;
 	 unicast_vars->pfds[0].events = POLLIN | POLLPRI;
 	 unicast_vars->pfds[0].revents = 0;
+#endif
 
-	 unicast_vars->hls_storage_dir = malloc(MAX_NAME_LEN);
+ unicast_vars->hls_storage_dir = malloc(MAX_NAME_LEN);
 	 if (unicast_vars->hls_storage_dir==NULL)
 	 {
 		 log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
@@ -241,6 +249,15 @@ int read_unicast_configuration(unicast_parameters_t *unicast_vars, mumudvb_chann
 		substring = strtok (NULL, delimiteurs);
 		unicast_vars->queue_max_size = atoi (substring);
 	}
+	else if (!strcmp (substring, "unicast_send_budget"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		unicast_vars->send_budget = atoi (substring);
+		if (unicast_vars->send_budget < MAX_UDP_SIZE) {
+			log_message( log_module,  MSG_WARN,"Unicast send budget \"%d\" is lower than %d, forcing to %d!\n", unicast_vars->send_budget, MAX_UDP_SIZE, MAX_UDP_SIZE);
+			unicast_vars->send_budget = MAX_UDP_SIZE;
+		}
+	}
 	else if (!strcmp (substring, "port_http"))
 	{
 		substring = strtok (NULL, "=");
@@ -351,6 +368,21 @@ int read_unicast_configuration(unicast_parameters_t *unicast_vars, mumudvb_chann
                 strncpy(unicast_vars->hls_playlist_name,strtok(substring,"\n"),MAX_NAME_LEN-1);
                 unicast_vars->hls_playlist_name[MAX_NAME_LEN-1]='\0';
         }
+	else if (!strcmp (substring, "hls_persist"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		unicast_vars->hls_persist = atoi (substring);
+	}
+	else if (!strcmp (substring, "hls_segment_max_size"))
+	{
+		substring = strtok (NULL, delimiteurs);
+		int max_size = atoi (substring);
+		if (max_size < HLS_SEGMENT_MIN_CAPACITY) {
+			log_message( log_module,  MSG_WARN,"HLS segment max size \"%d\" is lower than %d, forcing to %d!\n", max_size, HLS_SEGMENT_MIN_CAPACITY, HLS_SEGMENT_MIN_CAPACITY);
+			max_size = HLS_SEGMENT_MIN_CAPACITY;
+		}
+		unicast_vars->hls_segment_max_size = max_size;
+	}
 
 	else
 		return 0; //Nothing concerning tuning, we return 0 to explore the other possibilities
@@ -361,43 +393,282 @@ int read_unicast_configuration(unicast_parameters_t *unicast_vars, mumudvb_chann
 
 
 
-/** @brief Create a listening socket and add it to the list of polling file descriptors if success
+/** @brief Start watching a socket for incoming connections or messages
+ *
+ * @param unicast_vars the unicast parameters
+ * @param fd_info the socket information, given back with the events of this socket
+ */
+static int unicast_watch_fd(unicast_parameters_t *unicast_vars, unicast_fd_info_t *fd_info)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	struct epoll_event event;
+
+	if(unicast_vars->epfd<0)
+	{
+		unicast_vars->epfd=epoll_create(UNICAST_EPOLL_EVENTS);
+		if(unicast_vars->epfd<0)
+		{
+			log_message( log_module, MSG_ERROR,"epoll_create failed : %s\n",strerror(errno));
+			return -1;
+		}
+	}
+	memset(&event,0,sizeof(struct epoll_event));
+	//The clients are edge triggered : when we get an event we read until EAGAIN
+	//The listening sockets stay level triggered, we will see them again if we stop accepting too early
+	event.events=EPOLLIN | EPOLLPRI;
+	if(fd_info->type==UNICAST_CLIENT)
+		event.events|=EPOLLET;
+	event.data.ptr=fd_info;
+	if(epoll_ctl(unicast_vars->epfd, EPOLL_CTL_ADD, fd_info->fd, &event)<0)
+	{
+		log_message( log_module, MSG_ERROR,"epoll_ctl EPOLL_CTL_ADD failed for socket %d : %s\n",fd_info->fd,strerror(errno));
+		return -1;
+	}
+#else
+	struct pollfd *pfds;
+	unicast_fd_info_t **fd_infos;
+
+	pfds=realloc(unicast_vars->pfds,(unicast_vars->fdsnum+2)*sizeof(struct pollfd));
+	if (pfds==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return -1;
+	}
+	unicast_vars->pfds=pfds;
+	fd_infos=realloc(unicast_vars->fd_info,(unicast_vars->fdsnum+1)*sizeof(unicast_fd_info_t *));
+	if (fd_infos==NULL)
+	{
+		log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+		return -1;
+	}
+	unicast_vars->fd_info=fd_infos;
+	fd_info->pfds_index=unicast_vars->fdsnum;
+	unicast_vars->pfds[fd_info->pfds_index].fd = fd_info->fd;
+	unicast_vars->pfds[fd_info->pfds_index].events = POLLIN | POLLPRI;
+	if(fd_info->type==UNICAST_CLIENT)
+		unicast_vars->pfds[fd_info->pfds_index].events |= POLLHUP | POLLERR; //We also poll the deconnections
+	unicast_vars->pfds[fd_info->pfds_index].revents = 0;
+	unicast_vars->pfds[fd_info->pfds_index+1].fd = 0;
+	unicast_vars->pfds[fd_info->pfds_index+1].events = POLLIN | POLLPRI;
+	unicast_vars->pfds[fd_info->pfds_index+1].revents = 0;
+	unicast_vars->fd_info[fd_info->pfds_index]=fd_info;
+#endif
+	unicast_vars->fdsnum++;
+	log_message( log_module, MSG_DEBUG, "unicast : number of watched sockets : %d\n", unicast_vars->fdsnum);
+	return 0;
+}
+
+/** @brief Stop watching a socket, it must be done before closing it
+ *
+ * @param unicast_vars the unicast parameters
+ * @param fd_info the socket information
+ */
+static void unicast_unwatch_fd(unicast_parameters_t *unicast_vars, unicast_fd_info_t *fd_info)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	struct epoll_event event;
+	memset(&event,0,sizeof(struct epoll_event));
+	if(epoll_ctl(unicast_vars->epfd, EPOLL_CTL_DEL, fd_info->fd, &event)<0)
+		log_message( log_module, MSG_DEBUG,"epoll_ctl EPOLL_CTL_DEL failed for socket %d : %s\n",fd_info->fd,strerror(errno));
+#else
+	int last=unicast_vars->fdsnum-1;
+	//We move the last fd to the deleted one
+	unicast_vars->pfds[fd_info->pfds_index]=unicast_vars->pfds[last];
+	unicast_vars->fd_info[fd_info->pfds_index]=unicast_vars->fd_info[last];
+	unicast_vars->fd_info[fd_info->pfds_index]->pfds_index=fd_info->pfds_index;
+	//last one set to 0 for poll()
+	unicast_vars->pfds[last].fd=0;
+	unicast_vars->pfds[last].events=POLLIN|POLLPRI;
+	unicast_vars->pfds[last].revents=0; //We clear it to avoid nasty bugs ...
+#endif
+	unicast_vars->fdsnum--;
+}
+
+/** @brief Also watch when a client socket can be written, for sending a file
+ *
+ * @param unicast_vars the unicast parameters
+ * @param fd_info the socket information
+ */
+static int unicast_watch_fd_write(unicast_parameters_t *unicast_vars, unicast_fd_info_t *fd_info)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	struct epoll_event event;
+	memset(&event,0,sizeof(struct epoll_event));
+	event.events=EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLET;
+	event.data.ptr=fd_info;
+	if(epoll_ctl(unicast_vars->epfd, EPOLL_CTL_MOD, fd_info->fd, &event)<0)
+	{
+		log_message( log_module, MSG_ERROR,"epoll_ctl EPOLL_CTL_MOD failed for socket %d : %s\n",fd_info->fd,strerror(errno));
+		return -1;
+	}
+#else
+	unicast_vars->pfds[fd_info->pfds_index].events |= POLLOUT;
+#endif
+	return 0;
+}
+
+/** @brief Send the HLS segment of a client from memory, as much as the socket accepts
+ *
+ * @return 1 if the segment is sent, 0 if we have to wait for the socket, -1 on error
+ */
+static int unicast_client_send_segment(unicast_client_t *client)
+{
+	hls_segment_t *segment=client->hls_segment;
+	int sent_len;
+
+	//The segment is complete, its data doesn't change while we hold it
+	while(client->hls_offset < segment->size)
+	{
+		sent_len=write(client->Socket, (char *)segment->data + client->hls_offset, segment->size - client->hls_offset);
+		if(sent_len<0)
+		{
+			if(errno==EAGAIN || errno==EWOULDBLOCK)
+				return 0;
+			if(errno==EINTR)
+				continue;
+			log_message( log_module, MSG_DEBUG,"Error when sending a segment to socket %d : %s\n", client->Socket, strerror(errno));
+			return -1;
+		}
+		if(sent_len==0)
+			return -1;
+		client->hls_offset+=sent_len;
+	}
+	return 1;
+}
+
+/** @brief Answer a HLS request : a playlist or a segment, both from memory
+ *
+ * @param unicast_vars the unicast parameters
+ * @param client the client
+ * @param name the requested name, without the /hls/ prefix
+ * @return 0 if the segment is being sent, -2 to close the connection
+ */
+static int unicast_send_hls(unicast_parameters_t *unicast_vars, unicast_client_t *client, char *name)
+{
+	struct unicast_reply* reply;
+	char header[256];
+	int len,iRet;
+
+	if(client->hls_segment!=NULL || client->chan_ptr!=NULL)
+		return -2;
+	len=strlen(name);
+	if(len>5 && !strcmp(name+len-5, ".m3u8"))
+	{
+		reply = unicast_reply_init();
+		if (NULL == reply)
+			return -2;
+		if(hls_playlist_get(unicast_vars, name, reply))
+		{
+			log_message( log_module, MSG_DEBUG,"HLS playlist %s not found\n", name);
+			unicast_reply_write(reply, HTTP_404_REPLY_HTML, VERSION);
+			unicast_reply_send(reply, client->Socket, 404, "text/html");
+		}
+		else
+			unicast_reply_send(reply, client->Socket, 200, "application/vnd.apple.mpegurl");
+		unicast_reply_free(reply);
+		return -2; //We close the connection afterwards
+	}
+
+	client->hls_segment=hls_segment_get(name);
+	if(client->hls_segment==NULL)
+	{
+		log_message( log_module, MSG_DEBUG,"HLS segment %s not found\n", name);
+		reply = unicast_reply_init();
+		if (NULL == reply)
+			return -2;
+		unicast_reply_write(reply, HTTP_404_REPLY_HTML, VERSION);
+		unicast_reply_send(reply, client->Socket, 404, "text/html");
+		unicast_reply_free(reply);
+		return -2;
+	}
+	client->hls_offset=0;
+	len=snprintf(header, sizeof(header),
+			"HTTP/1.0 200 OK\r\n"
+			"Access-Control-Allow-Origin: *\r\n"
+			"Server: mumudvb/" VERSION "\r\n"
+			"Content-type: video/mp2t\r\n"
+			"Content-length: %u\r\n"
+			"\r\n", client->hls_segment->size);
+	iRet=write(client->Socket, header, len);
+	if(iRet!=len)
+	{
+		log_message( log_module, MSG_INFO,"Error when sending the HTTP reply\n");
+		return -2;
+	}
+	log_message( log_module, MSG_DEBUG,"HLS segment %s, %u bytes\n", name, client->hls_segment->size);
+	iRet=unicast_client_send_segment(client);
+	if(iRet)
+		return -2; //Sent or error, we close the connection
+	//The rest will be sent when the socket can be written
+	if(unicast_watch_fd_write(unicast_vars, &client->fd_info))
+		return -2;
+	return 0;
+}
+
+/** @brief Stop watching the sockets and free their information
+ * The client sockets must have been closed before (see unicast_freeing)
+ *
+ * @param unicast_vars the unicast parameters
+ */
+void unicast_free_fds(unicast_parameters_t *unicast_vars)
+{
+	unicast_fd_info_t *fd_info;
+	unicast_fd_info_t *next_fd_info;
+
+	for(fd_info=unicast_vars->listen_fds; fd_info != NULL; fd_info=next_fd_info)
+	{
+		next_fd_info=fd_info->next;
+		free(fd_info);
+	}
+	unicast_vars->listen_fds=NULL;
+	unicast_vars->fdsnum=0;
+#ifdef HAVE_SYS_EPOLL_H
+	if(unicast_vars->epfd>=0)
+		close(unicast_vars->epfd);
+	unicast_vars->epfd=-1;
+#else
+	if(unicast_vars->fd_info) {
+		free(unicast_vars->fd_info);
+		unicast_vars->fd_info=NULL;
+	}
+	if(unicast_vars->pfds) {
+		free(unicast_vars->pfds);
+		unicast_vars->pfds=NULL;
+	}
+#endif
+}
+
+/** @brief Create a listening socket and add it to the watched file descriptors if success
  *
  *
  *
  */
 int unicast_create_listening_socket(int socket_type, int socket_channel, char *ipOut, int port, int *socketIn, unicast_parameters_t *unicast_vars)
 {
+	unicast_fd_info_t *fd_info;
+
 	*socketIn = makeTCPclientsocket(ipOut, port);
 
-	//We add them to the poll descriptors
+	//We add them to the watched descriptors
 	if(*socketIn>0)
 	{
-		unicast_vars->pfdsnum++;
-		log_message( log_module, MSG_DEBUG, "unicast : unicast_vars->pfdsnum : %d\n", unicast_vars->pfdsnum);
-		unicast_vars->pfds=realloc(unicast_vars->pfds,(unicast_vars->pfdsnum+1)*sizeof(struct pollfd));
-		if (unicast_vars->pfds==NULL)
+		fd_info=calloc(1, sizeof(unicast_fd_info_t));
+		if (fd_info==NULL)
 		{
-			log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+			log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
 			return -1;
 		}
-		unicast_vars->pfds[unicast_vars->pfdsnum-1].fd = *socketIn;
-		unicast_vars->pfds[unicast_vars->pfdsnum-1].events = POLLIN | POLLPRI;
-		unicast_vars->pfds[unicast_vars->pfdsnum-1].revents = 0;
-		unicast_vars->pfds[unicast_vars->pfdsnum].fd = 0;
-		unicast_vars->pfds[unicast_vars->pfdsnum].events = POLLIN | POLLPRI;
-		unicast_vars->pfds[unicast_vars->pfdsnum].revents = 0;
-		//Information about the descriptor
-		unicast_vars->fd_info=realloc(unicast_vars->fd_info,(unicast_vars->pfdsnum)*sizeof(unicast_fd_info_t));
-		if (unicast_vars->fd_info==NULL)
+		fd_info->type=socket_type;
+		fd_info->fd=*socketIn;
+		fd_info->channel=socket_channel;
+		fd_info->client=NULL;
+		if(unicast_watch_fd(unicast_vars, fd_info))
 		{
-			log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
+			free(fd_info);
 			return -1;
 		}
-		//Master connection
-		unicast_vars->fd_info[unicast_vars->pfdsnum-1].type=socket_type;
-		unicast_vars->fd_info[unicast_vars->pfdsnum-1].channel=socket_channel;
-		unicast_vars->fd_info[unicast_vars->pfdsnum-1].client=NULL;
+		fd_info->next=unicast_vars->listen_fds;
+		unicast_vars->listen_fds=fd_info;
 	}
 	else
 	{
@@ -409,115 +680,157 @@ int unicast_create_listening_socket(int socket_type, int socket_channel, char *i
 
 }
 
-/** @brief Handle an "event" on the unicast file descriptors
+/** @brief Handle an event on one of the unicast sockets
  * If the event is on an already open client connection, it handle the message
- * If the event is on the master connection, it accepts the new connection
- * If the event is on a channel specific socket, it accepts the new connection and starts streaming
+ * If the event is on the master connection, it accepts the new connections
+ * If the event is on a channel specific socket, it accepts the new connections and starts streaming
  *
+ * With epoll the client sockets are edge triggered, so we read until there is nothing left
  */
-int unicast_handle_fd_event(unicast_parameters_t *unicast_vars,
-		mumudvb_channel_t *channels,
-		int number_of_channels,
-		strength_parameters_t *strengthparams,
-		auto_p_t *auto_p,
-		void *cam_p,
-		void *scam_vars,
-		eit_packet_t *eit_packets)
+static void unicast_handle_socket_event(unicast_parameters_t *unicast_vars,
+		unicast_fd_info_t *fd_info,
+		int hangup,
+		int readable,
+		int writable,
+		unicast_adapter_t *adapters,
+		int num_adapters)
 {
 	int iRet;
-	//We look what happened for which connection
-	int actual_fd;
-
 
-	for(actual_fd=0;actual_fd<unicast_vars->pfdsnum;actual_fd++)
+	if(hangup && (fd_info->type==UNICAST_CLIENT))
 	{
-		iRet=0;
-		if(((unicast_vars->pfds[actual_fd].revents&POLLHUP)||(unicast_vars->pfds[actual_fd].revents&POLLERR))
-				&&(unicast_vars->fd_info[actual_fd].type==UNICAST_CLIENT))
+		log_message( log_module, MSG_DEBUG,"We've got a POLLHUP or POLLERR. socket %d we close the connection \n", fd_info->fd );
+		unicast_close_connection(unicast_vars,fd_info->client);
+		return;
+	}
+	if(writable && (fd_info->type==UNICAST_CLIENT) && (fd_info->client->hls_segment!=NULL))
+	{
+		//We continue sending the segment, the connection is closed at the end
+		if(unicast_client_send_segment(fd_info->client))
 		{
-			log_message( log_module, MSG_DEBUG,"We've got a POLLHUP or POLLERR. Actual_fd %d socket %d we close the connection \n", actual_fd, unicast_vars->pfds[actual_fd].fd );
-			unicast_close_connection(unicast_vars,unicast_vars->pfds[actual_fd].fd);
-			//We check if we have to parse unicast_vars->pfds[actual_fd].revents (the last fd moved to the actual one)
-			if(unicast_vars->pfds[actual_fd].revents)
-				actual_fd--;//Yes, we force the loop to see it
+			unicast_close_connection(unicast_vars,fd_info->client);
+			return;
 		}
-		if((unicast_vars->pfds[actual_fd].revents&POLLIN)||(unicast_vars->pfds[actual_fd].revents&POLLPRI))
+	}
+	if(!readable)
+		return;
+	if((fd_info->type==UNICAST_MASTER)||
+			(fd_info->type==UNICAST_LISTEN_CHANNEL))
+	{
+		//Event on the master connection or listening channel
+		//New connections, we accept them
+		unicast_client_t *tempClient;
+		do
 		{
-			if((unicast_vars->fd_info[actual_fd].type==UNICAST_MASTER)||
-					(unicast_vars->fd_info[actual_fd].type==UNICAST_LISTEN_CHANNEL))
+			log_message( log_module, MSG_FLOOD,"New client\n");
+			//we accept the incoming connection
+			tempClient=unicast_accept_connection(unicast_vars, fd_info->fd);
+
+			if(tempClient!=NULL)
 			{
-				//Event on the master connection or listening channel
-				//New connection, we accept the connection
-				log_message( log_module, MSG_FLOOD,"New client\n");
-				int tempSocket;
-				unicast_client_t *tempClient;
-				//we accept the incoming connection
-				tempClient=unicast_accept_connection(unicast_vars, unicast_vars->pfds[actual_fd].fd);
-
-				if(tempClient!=NULL)
+				//client connection
+				tempClient->fd_info.type=UNICAST_CLIENT;
+				tempClient->fd_info.fd=tempClient->Socket;
+				tempClient->fd_info.channel=-1;
+				tempClient->fd_info.client=tempClient;
+				if(unicast_watch_fd(unicast_vars, &tempClient->fd_info))
 				{
-					tempSocket=tempClient->Socket;
-					unicast_vars->pfdsnum++;
-					unicast_vars->pfds=realloc(unicast_vars->pfds,(unicast_vars->pfdsnum+1)*sizeof(struct pollfd));
-					if (unicast_vars->pfds==NULL)
-					{
-						log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
-						set_interrupted(ERROR_MEMORY<<8);
-						return -1;
-					}
-					//We poll the new socket
-					unicast_vars->pfds[unicast_vars->pfdsnum-1].fd = tempSocket;
-					unicast_vars->pfds[unicast_vars->pfdsnum-1].events = POLLIN | POLLPRI | POLLHUP | POLLERR; //We also poll the deconnections
-					unicast_vars->pfds[unicast_vars->pfdsnum-1].revents = 0;
-					unicast_vars->pfds[unicast_vars->pfdsnum].fd = 0;
-					unicast_vars->pfds[unicast_vars->pfdsnum].events = POLLIN | POLLPRI;
-					unicast_vars->pfds[unicast_vars->pfdsnum].revents = 0;
-
-					//Information about the descriptor
-					unicast_vars->fd_info=realloc(unicast_vars->fd_info,(unicast_vars->pfdsnum)*sizeof(unicast_fd_info_t));
-					if (unicast_vars->fd_info==NULL)
-					{
-						log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
-						set_interrupted(ERROR_MEMORY<<8);
-						return -1;
-					}
-					//client connection
-					unicast_vars->fd_info[unicast_vars->pfdsnum-1].type=UNICAST_CLIENT;
-					unicast_vars->fd_info[unicast_vars->pfdsnum-1].channel=-1;
-					unicast_vars->fd_info[unicast_vars->pfdsnum-1].client=tempClient;
-
+					unicast_del_client(unicast_vars, tempClient);
+					return;
+				}
 
-					log_message( log_module, MSG_FLOOD,"Number of clients : %d\n", unicast_vars->client_number);
+				log_message( log_module, MSG_FLOOD,"Number of clients : %d\n", unicast_vars->client_number);
 
-					if(unicast_vars->fd_info[actual_fd].type==UNICAST_LISTEN_CHANNEL)
-					{
-						//Event on a channel connection, we open a new socket for this client and
-						//we store the wanted channel for when we will get the GET
-						log_message( log_module, MSG_DEBUG,"Connection on a channel socket the client  will get the channel %d\n", unicast_vars->fd_info[actual_fd].channel);
-						tempClient->askedChannel=unicast_vars->fd_info[actual_fd].channel;
-					}
-				}
-			}
-			else if(unicast_vars->fd_info[actual_fd].type==UNICAST_CLIENT)
-			{
-				//Event on a client connection i.e. the client asked something
-				log_message( log_module, MSG_FLOOD,"New message for socket %d\n", unicast_vars->pfds[actual_fd].fd);
-				iRet=unicast_handle_message(unicast_vars,unicast_vars->fd_info[actual_fd].client, channels, number_of_channels, strengthparams, auto_p, cam_p, scam_vars,eit_packets);
-				if (iRet==-2 ) //iRet==-2 --> 0 received data or error, we close the connection
+				if(fd_info->type==UNICAST_LISTEN_CHANNEL)
 				{
-					unicast_close_connection(unicast_vars,unicast_vars->pfds[actual_fd].fd);
-					//We check if we have to parse unicast_vars->pfds[actual_fd].revents (the last fd moved to the actual one)
-					if(unicast_vars->pfds[actual_fd].revents)
-						actual_fd--;//Yes, we force the loop to see it again
+					//Event on a channel connection, we open a new socket for this client and
+					//we store the wanted channel for when we will get the GET
+					log_message( log_module, MSG_DEBUG,"Connection on a channel socket the client  will get the channel %d\n", fd_info->channel);
+					tempClient->askedChannel=fd_info->channel;
 				}
 			}
-			else
-			{
-				log_message( log_module, MSG_WARN,"File descriptor with bad type, please contact\n Debug information : actual_fd %d unicast_vars->fd_info[actual_fd].type %d\n",
-						actual_fd, unicast_vars->fd_info[actual_fd].type);
-			}
-		}
+#ifdef HAVE_SYS_EPOLL_H
+		}while(tempClient!=NULL);
+#else
+		}while(0);
+#endif
 	}
+	else if(fd_info->type==UNICAST_CLIENT)
+	{
+		//Event on a client connection i.e. the client asked something
+		log_message( log_module, MSG_FLOOD,"New message for socket %d\n", fd_info->fd);
+		do
+		{
+			iRet=unicast_handle_message(unicast_vars,fd_info->client, adapters, num_adapters);
+#ifndef HAVE_SYS_EPOLL_H
+			break;
+#endif
+		}while(iRet==0);
+		if (iRet==-2 ) //iRet==-2 --> 0 received data or error, we close the connection
+			unicast_close_connection(unicast_vars,fd_info->client);
+	}
+	else
+	{
+		log_message( log_module, MSG_WARN,"File descriptor with bad type, please contact\n Debug information : socket %d type %d\n",
+				fd_info->fd, fd_info->type);
+	}
+}
+
+/** @brief Handle the "events" on the unicast file descriptors
+ * We check without waiting which sockets are ready and we handle them
+ *
+ */
+int unicast_handle_fd_event(unicast_parameters_t *unicast_vars,
+		unicast_adapter_t *adapters,
+		int num_adapters)
+{
+#ifdef HAVE_SYS_EPOLL_H
+	struct epoll_event events[UNICAST_EPOLL_EVENTS];
+	int num_events,i;
+
+	if(unicast_vars->epfd<0)
+		return 0;
+	do
+	{
+		num_events=epoll_wait(unicast_vars->epfd, events, UNICAST_EPOLL_EVENTS, 0);
+	}while((num_events<0)&&(errno==EINTR));
+	if(num_events<0)
+	{
+		log_message( log_module, MSG_ERROR,"epoll_wait failed : %s\n",strerror(errno));
+		return -1;
+	}
+	//Only the sockets which got an event, an event cannot close another client
+	for(i=0;i<num_events;i++)
+		unicast_handle_socket_event(unicast_vars, (unicast_fd_info_t *)events[i].data.ptr,
+				events[i].events&(EPOLLHUP|EPOLLERR),
+				events[i].events&(EPOLLIN|EPOLLPRI),
+				events[i].events&EPOLLOUT,
+				adapters, num_adapters);
+#else
+	//We look what happened for which connection
+	int actual_fd;
+	unicast_fd_info_t *fd_info;
+	short revents;
+
+	if(mumudvb_poll(unicast_vars->pfds,unicast_vars->fdsnum,0)<=0)
+		return 0;
+	for(actual_fd=0;actual_fd<unicast_vars->fdsnum;actual_fd++)
+	{
+		revents=unicast_vars->pfds[actual_fd].revents;
+		if(!revents)
+			continue;
+		unicast_vars->pfds[actual_fd].revents=0;
+		fd_info=unicast_vars->fd_info[actual_fd];
+		unicast_handle_socket_event(unicast_vars, fd_info,
+				revents&(POLLHUP|POLLERR),
+				revents&(POLLIN|POLLPRI),
+				revents&POLLOUT,
+				adapters, num_adapters);
+		//If the socket was closed, the last fd was moved to the actual one, we force the loop to see it
+		if((actual_fd<unicast_vars->fdsnum)&&(unicast_vars->fd_info[actual_fd]!=fd_info))
+			actual_fd--;
+	}
+#endif
 	return 0;
 
 }
@@ -543,6 +856,8 @@ unicast_client_t *unicast_accept_connection(unicast_parameters_t *unicast_vars,
 	fromSocket = accept(socketIn, (struct sockaddr *)&fromAddrIn, &l);
 	if (fromSocket < 0)
 	{
+		if(errno==EAGAIN || errno==EWOULDBLOCK)
+			return NULL; //No more pending connections
 		log_message( log_module, MSG_WARN,"Error when accepting the incoming connection : %s\n", strerror(errno));
 		return NULL;
 	}
@@ -607,82 +922,95 @@ unicast_client_t *unicast_accept_connection(unicast_parameters_t *unicast_vars,
 /** @brief Close an unicast connection and delete the client
  *
  * @param unicast_vars the unicast parameters
- * @param fds The polling file descriptors
- * @param Socket The socket of the client we want to disconnect
+ * @param client The client we want to disconnect
  */
-void unicast_close_connection(unicast_parameters_t *unicast_vars, int Socket)
+void unicast_close_connection(unicast_parameters_t *unicast_vars, unicast_client_t *client)
 {
+	log_message( log_module, MSG_FLOOD,"We close the connection\n");
+	unicast_unwatch_fd(unicast_vars, &client->fd_info);
+	//We delete the client
+	unicast_del_client(unicast_vars, client);
+	log_message( log_module, MSG_FLOOD,"Number of clients : %d\n", unicast_vars->client_number);
 
-	int actual_fd;
-	actual_fd=0;
-	//We find the FD correspondig to this client
-	while((actual_fd<unicast_vars->pfdsnum) && (unicast_vars->pfds[actual_fd].fd!=Socket))
-		actual_fd++;
+}
 
-	if(actual_fd==unicast_vars->pfdsnum)
-	{
-		log_message( log_module, MSG_ERROR,"close connection : we did't find the file descriptor this should never happend, please contact\n");
-		actual_fd=0;
-		//We find the FD correspondig to this client
-		while(actual_fd<unicast_vars->pfdsnum)
-		{
-			log_message( log_module, MSG_ERROR,"unicast_vars->pfds[actual_fd].fd %d Socket %d \n", unicast_vars->pfds[actual_fd].fd,Socket);
-			actual_fd++;
-		}
-		return;
-	}
 
-	log_message( log_module, MSG_FLOOD,"We close the connection\n");
-	//We delete the client
-	unicast_del_client(unicast_vars, unicast_vars->fd_info[actual_fd].client);
-	//We move the last fd to the actual/deleted one, and decrease the number of fds by one
-	unicast_vars->pfds[actual_fd].fd = unicast_vars->pfds[unicast_vars->pfdsnum-1].fd;
-	unicast_vars->pfds[actual_fd].events = unicast_vars->pfds[unicast_vars->pfdsnum-1].events;
-	unicast_vars->pfds[actual_fd].revents = unicast_vars->pfds[unicast_vars->pfdsnum-1].revents;
-	//we move the file descriptor information
-	unicast_vars->fd_info[actual_fd] = unicast_vars->fd_info[unicast_vars->pfdsnum-1];
-	//last one set to 0 for poll()
-	unicast_vars->pfds[unicast_vars->pfdsnum-1].fd=0;
-	unicast_vars->pfds[unicast_vars->pfdsnum-1].events=POLLIN|POLLPRI;
-	unicast_vars->pfds[unicast_vars->pfdsnum-1].revents=0; //We clear it to avoid nasty bugs ...
-	unicast_vars->pfdsnum--;
-	unicast_vars->pfds=realloc(unicast_vars->pfds,(unicast_vars->pfdsnum+1)*sizeof(struct pollfd));
-	if (unicast_vars->pfds==NULL)
-	{
-		log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
-		set_interrupted(ERROR_MEMORY<<8);
-	}
-	unicast_vars->fd_info=realloc(unicast_vars->fd_info,(unicast_vars->pfdsnum)*sizeof(unicast_fd_info_t));
-	if (unicast_vars->fd_info==NULL)
+
+
+/** @brief Close the connections of the clients marked for disconnection
+ * The clients are marked when sending the data, which can be done by several threads
+ *
+ * @param unicast_vars the unicast parameters
+ */
+void unicast_close_disconnected(unicast_parameters_t *unicast_vars)
+{
+	unicast_client_t *actual_client;
+	unicast_client_t *temp_client;
+
+	MU_STORE_RELEASE(&unicast_vars->disconnect_pending,0);
+	actual_client=unicast_vars->clients;
+	while(actual_client!=NULL)
 	{
-		log_message( log_module, MSG_ERROR,"Problem with realloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
-		set_interrupted(ERROR_MEMORY<<8);
+		temp_client=actual_client->next;
+		if(actual_client->disconnect)
+			unicast_close_connection(unicast_vars,actual_client);
+		actual_client=temp_client;
 	}
-	log_message( log_module, MSG_FLOOD,"Number of clients : %d\n", unicast_vars->client_number);
-
 }
 
 
 
 
+/** @brief Find the adapter which owns a channel
+ *
+ * @param channel the number of the channel in the HTTP pages (starting at 1)
+ * @return the adapter, NULL if no adapter has this channel
+ */
+static unicast_adapter_t *unicast_channel_adapter(unicast_adapter_t *adapters, int num_adapters, int channel)
+{
+	for(int iadapter=0;iadapter<num_adapters;iadapter++)
+	{
+		mumu_chan_p_t *chan_p=adapters[iadapter].chan_p;
+		if(channel>chan_p->first_channel && channel<=chan_p->first_channel+chan_p->number_of_channels)
+			return &adapters[iadapter];
+	}
+	return NULL;
+}
+
+/** @brief Find the adapter a page is asked for
+ * The pages about an adapter (signal, EIT, CAM) take the parameter channel=[channel number]
+ * to be served by the adapter which owns this channel, without it they are served by the first adapter
+ *
+ * @param request the asked path
+ * @param channel the asked channel, 0 if none
+ * @return the adapter, NULL if the asked channel doesn't exist
+ */
+static unicast_adapter_t *unicast_request_adapter(unicast_adapter_t *adapters, int num_adapters, char *request, int *channel)
+{
+	char *end,*param;
+
+	*channel=0;
+	end=strchr(request,' ');
+	param=strstr(request,"channel=");
+	if(param==NULL || (end!=NULL && param>end))
+		return &adapters[0];
+	*channel=atoi(param+strlen("channel="));
+	return unicast_channel_adapter(adapters, num_adapters, *channel);
+}
+
 /** @brief Deal with an incoming message on the unicast client connection
  * This function will store and answer the HTTP requests
  *
  *
  * @param unicast_vars the unicast parameters
  * @param client The client from which the message was received
- * @param channels the channel array
- * @param number_of_channels quite explicit ...
+ * @param adapters the adapters, the requested channel is searched in all of them
+ * @param num_adapters the number of adapters
  */
 int unicast_handle_message(unicast_parameters_t *unicast_vars,
 		unicast_client_t *client,
-		mumudvb_channel_t *channels,
-		int number_of_channels,
-		strength_parameters_t *strengthparams,
-		auto_p_t *auto_p,
-		void *cam_p,
-		void *scam_vars,
-		eit_packet_t *eit_packets)
+		unicast_adapter_t *adapters,
+		int num_adapters)
 {
 	int received_len;
 	(void) unicast_vars;
@@ -717,6 +1045,8 @@ int unicast_handle_message(unicast_parameters_t *unicast_vars,
 
 	if(received_len==-1)
 	{
+		if(errno==EAGAIN || errno==EWOULDBLOCK)
+			return 1; //Nothing more to read for the moment
 		log_message( log_module, MSG_ERROR,"Problem with recv : %s\n",strerror(errno));
 		return -1;
 	}
@@ -732,6 +1062,8 @@ int unicast_handle_message(unicast_parameters_t *unicast_vars,
 		char *substring=NULL;
 		int requested_channel;
 		int iRet;
+		unicast_adapter_t *adapter;
+		mumudvb_channel_t *channel;
 		requested_channel=0;
 		pos=0;
 		err404=0;
@@ -776,7 +1108,7 @@ int unicast_handle_message(unicast_parameters_t *unicast_vars,
 				else
 				{
 					requested_channel=atoi(substring);
-					if(requested_channel && requested_channel<=number_of_channels)
+					if(requested_channel>0 && unicast_channel_adapter(adapters, num_adapters, requested_channel)!=NULL)
 						log_message( log_module, MSG_DEBUG,"Channel by number, number %d\n",requested_channel);
 					else
 					{
@@ -804,10 +1136,14 @@ int unicast_handle_message(unicast_parameters_t *unicast_vars,
 				{
 					int requested_sid;
 					requested_sid=atoi(substring);
-					for(int current_channel=0; current_channel<number_of_channels;current_channel++)
+					for(int iadapter=0; iadapter<num_adapters;iadapter++)
 					{
-						if(channels[current_channel].service_id == requested_sid)
-							requested_channel=current_channel+1;
+						mumu_chan_p_t *chan_p=adapters[iadapter].chan_p;
+						for(int current_channel=0; current_channel<chan_p->number_of_channels;current_channel++)
+						{
+							if(chan_p->channels[current_channel].service_id == requested_sid)
+								requested_channel=chan_p->first_channel+current_channel+1;
+						}
 					}
 					if(requested_channel)
 						log_message( log_module, MSG_DEBUG,"Channel by service id,  service_id %d number %d\n", requested_sid, requested_channel);
@@ -852,13 +1188,17 @@ int unicast_handle_message(unicast_parameters_t *unicast_vars,
                     requested_channel_name[MAX_NAME_LEN-1] = '\0';
                     process_channel_name(requested_channel_name);
 
-                    for(int current_channel=0; current_channel<number_of_channels;current_channel++)
+                    for(int iadapter=0; iadapter<num_adapters;iadapter++)
                     {
-                        strcpy(current_channel_name, channels[current_channel].name);
-                        process_channel_name(current_channel_name);
-
-                        if(strcasecmp(current_channel_name, requested_channel_name) == 0)
-                            requested_channel=current_channel+1;
+                        mumu_chan_p_t *chan_p=adapters[iadapter].chan_p;
+                        for(int current_channel=0; current_channel<chan_p->number_of_channels;current_channel++)
+                        {
+                            strcpy(current_channel_name, chan_p->channels[current_channel].name);
+                            process_channel_name(current_channel_name);
+
+                            if(strcasecmp(current_channel_name, requested_channel_name) == 0)
+                                requested_channel=chan_p->first_channel+current_channel+1;
+                        }
                     }
                     if(requested_channel)
                         log_message( log_module, MSG_DEBUG,"Channel by name, name `%s` number `%d`\n", requested_channel_name, requested_channel);
@@ -883,85 +1223,121 @@ int unicast_handle_message(unicast_parameters_t *unicast_vars,
 				else
 					substring=NULL;
 				log_message( log_module, MSG_DETAIL,"Channel list\n");
-				unicast_send_streamed_channels_list (number_of_channels, channels, client->Socket, substring);
+				unicast_send_streamed_channels_list (adapters, num_adapters, client->Socket, substring);
 				return -2; //We close the connection afterwards
 			}
 			//playlist, m3u
 			else if(strstr(client->buffer +pos ,"/playlist.m3u ")==(client->buffer +pos))
 			{
 				log_message( log_module, MSG_DETAIL,"play list\n");
-				unicast_send_play_list_unicast (number_of_channels, channels, client->Socket, unicast_vars->portOut, 0, unicast_vars );
+				unicast_send_play_list_unicast (adapters, num_adapters, client->Socket, unicast_vars->portOut, 0, unicast_vars );
 				return -2; //We close the connection afterwards
 			}
 			//playlist, m3u
 			else if(strstr(client->buffer +pos ,"/playlist_port.m3u ")==(client->buffer +pos))
 			{
 				log_message( log_module, MSG_DETAIL,"play list\n");
-				unicast_send_play_list_unicast (number_of_channels, channels, client->Socket, unicast_vars->portOut, 1, unicast_vars );
+				unicast_send_play_list_unicast (adapters, num_adapters, client->Socket, unicast_vars->portOut, 1, unicast_vars );
 				return -2; //We close the connection afterwards
 			}
 			else if(strstr(client->buffer +pos ,"/playlist_multicast.m3u ")==(client->buffer +pos))
 			{
 				log_message( log_module, MSG_DETAIL,"play list\n");
-				unicast_send_play_list_multicast (number_of_channels, channels, client->Socket, 0, unicast_vars );
+				unicast_send_play_list_multicast (adapters, num_adapters, client->Socket, 0, unicast_vars );
 				return -2; //We close the connection afterwards
 			}
 			else if(strstr(client->buffer +pos ,"/playlist_multicast_vlc.m3u ")==(client->buffer +pos))
 			{
 				log_message( log_module, MSG_DETAIL,"play list\n");
-				unicast_send_play_list_multicast (number_of_channels, channels, client->Socket, 1, unicast_vars );
+				unicast_send_play_list_multicast (adapters, num_adapters, client->Socket, 1, unicast_vars );
 				return -2; //We close the connection afterwards
 			}
 			//statistics, text version
 			else if(strstr(client->buffer +pos ,"/channels_list.json ")==(client->buffer +pos))
 			{
 				log_message( log_module, MSG_DETAIL,"Channel list Json\n");
-				unicast_send_streamed_channels_list_js (number_of_channels, channels, scam_vars, client->Socket);
+				unicast_send_streamed_channels_list_js (adapters, num_adapters, client->Socket);
 				return -2; //We close the connection afterwards
 			}
 			else if(strstr(client->buffer +pos ,"/monitor/state.json ")==(client->buffer +pos))
 			{
 				log_message( log_module, MSG_DETAIL,"HTTP request for state in Json\n");
-				unicast_send_json_state(number_of_channels, channels, client->Socket, strengthparams, auto_p, cam_p, scam_vars);
+				unicast_send_json_state(adapters, num_adapters, client->Socket);
 				return -2; //We close the connection afterwards
 			}
-			else if(strstr(client->buffer +pos ,"/monitor/signal_power.json ")==(client->buffer +pos))
+			else if((strstr(client->buffer +pos ,"/monitor/signal_power.json ")==(client->buffer +pos))||
+					(strstr(client->buffer +pos ,"/monitor/signal_power.json?")==(client->buffer +pos)))
 			{
 				log_message( log_module, MSG_DETAIL,"Signal power json\n");
-				unicast_send_signal_power_js(client->Socket, strengthparams);
-				return -2; //We close the connection afterwards
+				adapter=unicast_request_adapter(adapters, num_adapters, client->buffer+pos, &requested_channel);
+				requested_channel=0;
+				if(adapter==NULL)
+					err404=1;
+				else
+				{
+					unicast_send_signal_power_js(client->Socket, adapter->strengthparams);
+					return -2; //We close the connection afterwards
+				}
 			}
 			else if(strstr(client->buffer +pos ,"/monitor/channels_traffic.json ")==(client->buffer +pos))
 			{
 				log_message( log_module, MSG_DETAIL,"Channel traffic json\n");
-				unicast_send_channel_traffic_js(number_of_channels, channels, client->Socket);
+				unicast_send_channel_traffic_js(adapters, num_adapters, client->Socket);
 				return -2; //We close the connection afterwards
 			}
 			else if(strstr(client->buffer +pos ,"/monitor/state.xml ")==(client->buffer +pos))
 			{
 				log_message( log_module, MSG_DETAIL,"HTTP request for XML State\n");
-				unicast_send_xml_state(number_of_channels, channels, client->Socket, strengthparams, auto_p, cam_p, scam_vars);
+				unicast_send_xml_state(adapters, num_adapters, client->Socket);
 				return -2; //We close the connection afterwards
 			}
 			//statistics, text version
-			else if(strstr(client->buffer +pos ,"/monitor/EIT.json ")==(client->buffer +pos))
+			else if((strstr(client->buffer +pos ,"/monitor/EIT.json ")==(client->buffer +pos))||
+					(strstr(client->buffer +pos ,"/monitor/EIT.json?")==(client->buffer +pos)))
 			{
 				log_message( log_module, MSG_DETAIL,"EIT Json\n");
-				unicast_send_EIT (eit_packets,  client->Socket);
-				return -2; //We close the connection afterwards
+				adapter=unicast_request_adapter(adapters, num_adapters, client->buffer+pos, &requested_channel);
+				if(adapter==NULL)
+					err404=1;
+				else if(requested_channel)
+				{
+					//Only the EIT of this channel, from the adapter which receives it
+					unicast_send_EIT (adapter, 1, adapter->chan_p->channels[requested_channel-1-adapter->chan_p->first_channel].service_id, client->Socket);
+					return -2; //We close the connection afterwards
+				}
+				else
+				{
+					unicast_send_EIT (adapters, num_adapters, 0, client->Socket);
+					return -2; //We close the connection afterwards
+				}
 			}
-			else if(strstr(client->buffer +pos ,"/cam/menu.xml ")==(client->buffer +pos))
+			else if((strstr(client->buffer +pos ,"/cam/menu.xml ")==(client->buffer +pos))||
+					(strstr(client->buffer +pos ,"/cam/menu.xml?")==(client->buffer +pos)))
 			{
 				log_message( log_module, MSG_DETAIL,"HTTP request for CAM menu display \n");
-				unicast_send_cam_menu(client->Socket, cam_p);
-				return -2; //We close the connection afterwards
+				adapter=unicast_request_adapter(adapters, num_adapters, client->buffer+pos, &requested_channel);
+				requested_channel=0;
+				if(adapter==NULL)
+					err404=1;
+				else
+				{
+					unicast_send_cam_menu(client->Socket, adapter->cam_p);
+					return -2; //We close the connection afterwards
+				}
 			}
 			else if(strstr(client->buffer +pos ,"/cam/action.xml?key=")==(client->buffer +pos))
 			{
 				log_message( log_module, MSG_DETAIL,"HTTP request for CAM menu action\n");
+				adapter=unicast_request_adapter(adapters, num_adapters, client->buffer+pos, &requested_channel);
+				requested_channel=0;
 				pos+=strlen("/cam/action.xml?key=");
-				unicast_send_cam_action(client->Socket,client->buffer+pos, cam_p);
-				return -2; //We close the connection afterwards
+				if(adapter==NULL)
+					err404=1;
+				else
+				{
+					unicast_send_cam_action(client->Socket,client->buffer+pos, adapter->cam_p);
+					return -2; //We close the connection afterwards
+				}
 			}
 			else if((strstr(client->buffer +pos ,"/index.html")==(client->buffer +pos))||
 					(strstr(client->buffer +pos ,"/index.htm")==(client->buffer +pos))||
@@ -971,11 +1347,25 @@ int unicast_handle_message(unicast_parameters_t *unicast_vars,
 				unicast_send_index_page(client->Socket);
 				return -2; //We close the connection afterwards
 			}
+			//HLS playlists and segments
+			else if(unicast_vars->hls && strstr(client->buffer +pos ,"/hls/")==(client->buffer +pos))
+			{
+				pos+=strlen("/hls/");
+				substring = strtok (client->buffer+pos, " ");
+				if(substring == NULL)
+					err404=1;
+				else
+				{
+					log_message( log_module, MSG_DETAIL,"HLS request for %s\n", substring);
+					if(unicast_send_hls(unicast_vars, client, substring))
+						return -2; //We close the connection afterwards
+				}
+			}
             //Prometheus exporter
             else if(strstr(client->buffer +pos ,"/metrics")==(client->buffer +pos))
             {
                 log_message( log_module, MSG_DETAIL,"HTTP request for prometheus data\n");
-                unicast_send_prometheus(number_of_channels, channels, client->Socket, strengthparams);
+                unicast_send_prometheus(adapters, num_adapters, client->Socket);
                 return -2; //We close the connection afterwards
             }
 			//Not implemented path --> 404
@@ -1002,8 +1392,12 @@ int unicast_handle_message(unicast_parameters_t *unicast_vars,
 			//We have found a channel, we add the client
 			if(requested_channel)
 			{
-				if(!channel_add_unicast_client(client,&channels[requested_channel-1]))
-					client->chan_ptr=&channels[requested_channel-1];
+				adapter=unicast_channel_adapter(adapters, num_adapters, requested_channel);
+				if(adapter==NULL)
+					return -2;
+				channel=&adapter->chan_p->channels[requested_channel-1-adapter->chan_p->first_channel];
+				if(!channel_add_unicast_client(unicast_vars,client,channel))
+					client->chan_ptr=channel;
 				else
 					return -2;
 			}
@@ -1203,13 +1597,13 @@ int unicast_reply_send(struct unicast_reply *reply, int socket, int code, const
 
 /** @brief Send a basic html file containing the list of streamed channels
  *
- * @param number_of_channels the number of channels
- * @param channels the channels array
+ * @param adapters the adapters
+ * @param num_adapters the number of adapters
  * @param Socket the socket on wich the information have to be sent
  * @param host The server ip address/name (got in the HTTP GET request)
  */
 int
-unicast_send_streamed_channels_list (int number_of_channels, mumudvb_channel_t *channels, int Socket, char *host)
+unicast_send_streamed_channels_list (unicast_adapter_t *adapters, int num_adapters, int Socket, char *host)
 {
 
 	struct unicast_reply* reply = unicast_reply_init();
@@ -1220,22 +1614,27 @@ unicast_send_streamed_channels_list (int number_of_channels, mumudvb_channel_t *
 
 	unicast_reply_write(reply, HTTP_CHANNELS_REPLY_START);
 
-	for (int curr_channel = 0; curr_channel < number_of_channels; curr_channel++)
-		if (channels[curr_channel].channel_ready>=READY)
-		{
-			if(host)
-				unicast_reply_write(reply, "Channel number %d : %s<br>Unicast link : <a href=\"http://%s/bysid/%d\">http://%s/bysid/%d</a><br>Multicast ip : %s:%d<br><br>\r\n",
-						curr_channel+1,
-						channels[curr_channel].name,
-						host,channels[curr_channel].service_id,
-						host,channels[curr_channel].service_id,
-						channels[curr_channel].ip4Out,channels[curr_channel].portOut);
-			else
-				unicast_reply_write(reply, "Channel number %d : \"%s\"<br>Multicast ip : %s:%d<br><br>\r\n",
-						curr_channel+1,
-						channels[curr_channel].name,
-						channels[curr_channel].ip4Out,channels[curr_channel].portOut);
-		}
+	for (int iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		mumudvb_channel_t *channels=adapters[iadapter].chan_p->channels;
+		int first_channel=adapters[iadapter].chan_p->first_channel;
+		for (int curr_channel = 0; curr_channel < adapters[iadapter].chan_p->number_of_channels; curr_channel++)
+			if (channels[curr_channel].channel_ready>=READY)
+			{
+				if(host)
+					unicast_reply_write(reply, "Channel number %d : %s<br>Unicast link : <a href=\"http://%s/bysid/%d\">http://%s/bysid/%d</a><br>Multicast ip : %s:%d<br><br>\r\n",
+							first_channel+curr_channel+1,
+							channels[curr_channel].name,
+							host,channels[curr_channel].service_id,
+							host,channels[curr_channel].service_id,
+							channels[curr_channel].ip4Out,channels[curr_channel].portOut);
+				else
+					unicast_reply_write(reply, "Channel number %d : \"%s\"<br>Multicast ip : %s:%d<br><br>\r\n",
+							first_channel+curr_channel+1,
+							channels[curr_channel].name,
+							channels[curr_channel].ip4Out,channels[curr_channel].portOut);
+			}
+	}
 	unicast_reply_write(reply, HTTP_CHANNELS_REPLY_END);
 
 	unicast_reply_send(reply, Socket, 200, "text/html");
@@ -1251,13 +1650,13 @@ unicast_send_streamed_channels_list (int number_of_channels, mumudvb_channel_t *
 
 /** @brief Send a basic text file containig the playlist
  *
- * @param number_of_channels the number of channels
- * @param channels the channels array
+ * @param adapters the adapters
+ * @param num_adapters the number of adapters
  * @param Socket the socket on wich the information have to be sent
  * @param perport says if the channel have to be given by the url /bysid or by their port
  */
 int
-unicast_send_play_list_unicast (int number_of_channels, mumudvb_channel_t *channels, int Socket, int unicast_portOut, int perport, unicast_parameters_t *unicast_vars)
+unicast_send_play_list_unicast (unicast_adapter_t *adapters, int num_adapters, int Socket, int unicast_portOut, int perport, unicast_parameters_t *unicast_vars)
 {
 	int curr_channel,iRet;
 	struct sockaddr_storage tempSocketAddr;
@@ -1282,35 +1681,39 @@ unicast_send_play_list_unicast (int number_of_channels, mumudvb_channel_t *chann
 	unicast_reply_write(reply, "#EXTM3U\r\n");
 
 	//"#EXTINF:0,title\r\nURL"
-	for (curr_channel = 0; curr_channel < number_of_channels; curr_channel++)
-		if (channels[curr_channel].channel_ready>=READY
-		    && (channels[curr_channel].has_traffic == 1 || unicast_vars->playlist_ignore_dead == 0)
-		    && (channels[curr_channel].ratio_scrambled < unicast_vars->playlist_ignore_scrambled_ratio || unicast_vars->playlist_ignore_scrambled_ratio == 0)
-		)
-		{
-			char addr_buf[IPV6_CHAR_LEN] = { 0, };
-			char http_buf[IPV6_CHAR_LEN] = { 0, };
+	for (int iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		mumudvb_channel_t *channels=adapters[iadapter].chan_p->channels;
+		for (curr_channel = 0; curr_channel < adapters[iadapter].chan_p->number_of_channels; curr_channel++)
+			if (channels[curr_channel].channel_ready>=READY
+			    && (channels[curr_channel].has_traffic == 1 || unicast_vars->playlist_ignore_dead == 0)
+			    && (channels[curr_channel].ratio_scrambled < unicast_vars->playlist_ignore_scrambled_ratio || unicast_vars->playlist_ignore_scrambled_ratio == 0)
+			)
+			{
+				char addr_buf[IPV6_CHAR_LEN] = { 0, };
+				char http_buf[IPV6_CHAR_LEN] = { 0, };
 
-			getnameinfo((struct sockaddr *)&tempSocketAddr, sizeof(struct sockaddr_storage), addr_buf, sizeof(addr_buf), NULL, 0, NI_NUMERICHOST | NI_NUMERICSERV);
-			/* IPv6 requires address in []'s */
-			snprintf(http_buf, IPV6_CHAR_LEN, (tempSocketAddr.ss_family == AF_INET6) ? "[%s]" : "%s", addr_buf);
+				getnameinfo((struct sockaddr *)&tempSocketAddr, sizeof(struct sockaddr_storage), addr_buf, sizeof(addr_buf), NULL, 0, NI_NUMERICHOST | NI_NUMERICSERV);
+				/* IPv6 requires address in []'s */
+				snprintf(http_buf, IPV6_CHAR_LEN, (tempSocketAddr.ss_family == AF_INET6) ? "[%s]" : "%s", addr_buf);
 
-			if(!perport)
-			{
-				unicast_reply_write(reply, "#EXTINF:0,%s\r\nhttp://%s:%d/bysid/%d\r\n",
-						channels[curr_channel].name,
-						http_buf,
-						unicast_portOut ,
-						channels[curr_channel].service_id);
-			}
-			else if(channels[curr_channel].unicast_port)
-			{
-				unicast_reply_write(reply, "#EXTINF:0,%s\r\nhttp://%s:%d/\r\n",
-						channels[curr_channel].name,
-						http_buf,
-						channels[curr_channel].unicast_port);
+				if(!perport)
+				{
+					unicast_reply_write(reply, "#EXTINF:0,%s\r\nhttp://%s:%d/bysid/%d\r\n",
+							channels[curr_channel].name,
+							http_buf,
+							unicast_portOut ,
+							channels[curr_channel].service_id);
+				}
+				else if(channels[curr_channel].unicast_port)
+				{
+					unicast_reply_write(reply, "#EXTINF:0,%s\r\nhttp://%s:%d/\r\n",
+							channels[curr_channel].name,
+							http_buf,
+							channels[curr_channel].unicast_port);
+				}
 			}
-		}
+	}
 
 	unicast_reply_send(reply, Socket, 200, "audio/x-mpegurl");
 
@@ -1360,6 +1763,7 @@ unicast_send_index_page (int Socket)
 	unicast_reply_write(reply, "<br>  <a href=\"/monitor/EIT.json\">Contents of the EIT tables (json)</a><br><br>\r\n");
 	unicast_reply_write(reply, "<br>  <a href=\"/cam/menu.xml\">CAM menu</a><br><br>\r\n");
 	unicast_reply_write(reply, "<br> make an action on the cam menu : /cam/action.xml?key=<br><br>\r\n");
+	unicast_reply_write(reply, "<br> signal, EIT and CAM of the adapter of a channel : add ?channel=[channel number] (&amp;channel= for the CAM action)<br><br>\r\n");
 
 
 
@@ -1380,12 +1784,12 @@ unicast_send_index_page (int Socket)
 
 /** @brief Send a basic text file containig the playlist
  *
- * @param number_of_channels the number of channels
- * @param channels the channels array
+ * @param adapters the adapters
+ * @param num_adapters the number of adapters
  * @param Socket the socket on wich the information have to be sent
  */
 int
-unicast_send_play_list_multicast (int number_of_channels, mumudvb_channel_t *channels, int Socket, int vlc, unicast_parameters_t *unicast_vars)
+unicast_send_play_list_multicast (unicast_adapter_t *adapters, int num_adapters, int Socket, int vlc, unicast_parameters_t *unicast_vars)
 {
 	int curr_channel;
 	char urlheader[4];
@@ -1407,21 +1811,25 @@ unicast_send_play_list_multicast (int number_of_channels, mumudvb_channel_t *cha
 
 
 	//"#EXTINF:0,title\r\nURL"
-	for (curr_channel = 0; curr_channel < number_of_channels; curr_channel++)
-		if (channels[curr_channel].channel_ready>=READY && (channels[curr_channel].has_traffic == 1 || unicast_vars->playlist_ignore_dead == 0))
-		{
-			if(channels[curr_channel].rtp)
-				strcpy(urlheader,"rtp");
-			else
-				strcpy(urlheader,"udp");
-
-			unicast_reply_write(reply, "#EXTINF:0,%s\r\n%s://%s%s:%d\r\n",
-					channels[curr_channel].name,
-					urlheader,
-					vlcchar,
-					channels[curr_channel].ip4Out,
-					channels[curr_channel].portOut);
-		}
+	for (int iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		mumudvb_channel_t *channels=adapters[iadapter].chan_p->channels;
+		for (curr_channel = 0; curr_channel < adapters[iadapter].chan_p->number_of_channels; curr_channel++)
+			if (channels[curr_channel].channel_ready>=READY && (channels[curr_channel].has_traffic == 1 || unicast_vars->playlist_ignore_dead == 0))
+			{
+				if(channels[curr_channel].rtp)
+					strcpy(urlheader,"rtp");
+				else
+					strcpy(urlheader,"udp");
+
+				unicast_reply_write(reply, "#EXTINF:0,%s\r\n%s://%s%s:%d\r\n",
+						channels[curr_channel].name,
+						urlheader,
+						vlcchar,
+						channels[curr_channel].ip4Out,
+						channels[curr_channel].portOut);
+			}
+	}
 
 	unicast_reply_send(reply, Socket, 200, "audio/x-mpegurl");
 
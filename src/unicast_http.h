@@ -43,6 +43,8 @@ enum
 
 
 #define RECV_BUFFER_MULTIPLE 100
+/**@brief the maximum number of socket events handled at once*/
+#define UNICAST_EPOLL_EVENTS 64
 /**@brief the timeout for disconnecting a client with only consecutive errors*/
 #define UNICAST_CONSECUTIVE_ERROR_TIMEOUT 5
 
@@ -106,6 +108,30 @@ enum
                       "\r\n"
 
 
+/** @brief The information on the unicast file descriptors/sockets
+ * There is three kind of descriptors :
+  * The master connection : this connection will interpret the HTTP path asked, to give the channel, the channel list or debugging information
+  * Client connections : This is the connections for connected clients
+  * Channel listening connections : When a client connect to one of these sockets, the associated channel will be given directly without interpreting the PATH
+ *
+ * This information is attached to the socket when it is watched, so an event gives it directly.
+ * The information of a client socket is part of the client, the one of a listening socket is allocated
+ */
+typedef struct unicast_fd_info_t{
+  /**The fd/socket type*/
+  int type;
+  /** The socket*/
+  int fd;
+  /** The channel if it's a channel socket*/
+  int channel;
+  /** The client if it's a client socket*/
+  struct unicast_client_t *client;
+  /** The position in the polling file descriptors, when we don't have epoll*/
+  int pfds_index;
+  /** Next listening socket*/
+  struct unicast_fd_info_t *next;
+}unicast_fd_info_t;
+
 /** @brief A client connected to the unicast connection.
  *
  *There is two chained list of client : a global one wich contain all the clients. Another one in each channel wich contain the associated clients.
@@ -139,25 +165,17 @@ typedef struct unicast_client_t{
   unicast_queue_header_t queue;
   /** The latest write error for this client*/
   int last_write_error;
+  /** The client had too many errors, it will be disconnected by the main thread*/
+  int disconnect;
+  /** The information on the client socket*/
+  unicast_fd_info_t fd_info;
+  /** The HLS segment being sent to the client, NULL if none*/
+  struct hls_segment *hls_segment;
+  /** The position in this segment*/
+  unsigned int hls_offset;
 }unicast_client_t;
 
 
-/** @brief The information on the unicast file descriptors/sockets
- * There is three kind of descriptors :
-  * The master connection : this connection will interpret the HTTP path asked, to give the channel, the channel list or debugging information
-  * Client connections : This is the connections for connected clients
-  * Channel listening connections : When a client connect to one of these sockets, the associated channel will be given directly without interpreting the PATH
- *
- * The numbering of this socket information is the same as the file descriptors numbering
- */
-typedef struct unicast_fd_info_t{
-  /**The fd/socket type*/
-  int type;
-  /** The channel if it's a channel socket*/
-  int channel;
-  /** The client if it's a client socket*/
-  unicast_client_t *client;
-}unicast_fd_info_t;
 
 
 /** @brief The parameters for unicast
@@ -183,17 +201,29 @@ typedef struct unicast_parameters_t{
   int max_clients;
   /** The timeout before disconnecting a client which does only errors*/
   int consecutive_errors_timeout;
+  /** Some clients are waiting to be disconnected*/
+  volatile int disconnect_pending;
   /** The maximum size of the queue */
   int queue_max_size;
+  /** The maximum number of bytes sent to a client per new packet */
+  int send_budget;
   /** The socket SO_SNDBUF size*/
   int socket_sendbuf_size;
   /** Debug : do we flush the queue when we get eagain errors ? */
   int flush_on_eagain;
-  /** The information on the file descriptors : ie the type of FD, the client associated if it's a client fd, the channel if it's a channel fd */
-  unicast_fd_info_t *fd_info;
+  /** The listening sockets : the master one and the channel ones */
+  unicast_fd_info_t *listen_fds;
+  /** The number of watched file descriptors*/
+  int fdsnum;
+#ifdef HAVE_SYS_EPOLL_H
+  /** The epoll file descriptor watching the listening and client sockets*/
+  int epfd;
+#else
+  /** The information on the file descriptors, with the same numbering as the polling file descriptors */
+  unicast_fd_info_t **fd_info;
   /**File descriptors for pooling*/
   struct pollfd *pfds;	//unicast http clients
-  int pfdsnum;
+#endif
   int playlist_ignore_dead;
   int playlist_ignore_scrambled_ratio;
   int hls;
@@ -202,6 +232,10 @@ typedef struct unicast_parameters_t{
   int hls_rotate_iframe;
   char *hls_storage_dir;
   char *hls_playlist_name;
+  /** Write the segments and playlists in hls_storage_dir, they are always served from memory*/
+  int hls_persist;
+  /** The maximum size of a segment in memory*/
+  unsigned int hls_segment_max_size;
 }unicast_parameters_t;
 
 
@@ -223,20 +257,34 @@ int unicast_create_listening_socket(int socket_type, int socket_channel, char *i
 
 struct strength_parameters_t; //just to avoid including dvb.h for one structure
 struct eit_packet_t; //just to avoid including rewrite.h for one structure
+
+/** @brief What the HTTP server shows of an adapter
+ * The HTTP server is shared by all the adapters, each page or channel is served from the adapter which owns it
+ */
+typedef struct unicast_adapter_t{
+	/** The number of the adapter (order of the configuration files)*/
+	int id;
+	/** The channels, chan_p->first_channel gives the number of the first one in the HTTP pages*/
+	mumu_chan_p_t *chan_p;
+	struct strength_parameters_t *strengthparams;
+	struct auto_p_t *auto_p;
+	void *cam_p;
+	void *scam_vars;
+	/** The list of the stored EIT tables, it can be changed by the rewrite*/
+	struct eit_packet_t **eit_packets;
+}unicast_adapter_t;
+
 int unicast_handle_fd_event(unicast_parameters_t *unicast_vars,
-		mumudvb_channel_t *channels,
-		int number_of_channels,
-		struct strength_parameters_t *strengthparams,
-		struct auto_p_t *auto_p,
-		void *cam_vars,
-		void *scam_vars,
-		struct eit_packet_t *eit_packets);
+		unicast_adapter_t *adapters,
+		int num_adapters);
 
 int unicast_del_client(unicast_parameters_t *unicast_vars, unicast_client_t *client);
+void unicast_close_disconnected(unicast_parameters_t *unicast_vars);
 
-int channel_add_unicast_client(unicast_client_t *client,mumudvb_channel_t *channel);
+int channel_add_unicast_client(unicast_parameters_t *unicast_vars, unicast_client_t *client,mumudvb_channel_t *channel);
 
 void unicast_freeing(unicast_parameters_t *unicast_vars);
+void unicast_free_fds(unicast_parameters_t *unicast_vars);
 
 int read_unicast_configuration(unicast_parameters_t *unicast_vars, mumudvb_channel_t *c_chan, char *substring);
 
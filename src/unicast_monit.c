@@ -39,6 +39,7 @@
 #include "tune.h"
 #include "rewrite.h"
 #include "autoconf.h"
+#include "udp_source.h"
 #ifndef _WIN32
 #include <sys/time.h>
 #endif
@@ -87,20 +88,22 @@ int unicast_send_client_list_js (unicast_client_t *unicast_client, struct unicas
 	return 0;
 }
 /**
- * @brief Send the json channel list
+ * @brief Send the json channel list of an adapter, each channel is followed by a comma
  *
- * @param number_of_channels the number of channels
- * @param channels the channels array
+ * @param adapter the adapter
  * @param reply the unicast_reply where we will write the info.
+ * @return the number of listed channels
  *
  **/
-int unicast_send_channel_list_js (int number_of_channels, mumudvb_channel_t *channels, void *scam_vars_v, struct unicast_reply *reply)
+static int unicast_send_adapter_channels_js (unicast_adapter_t *adapter, struct unicast_reply *reply)
 {
 	int curr_channel;
-#ifndef ENABLE_SCAM_SUPPORT
-    (void) scam_vars_v; //to make compiler happy
-#else
-	scam_parameters_t *scam_vars=(scam_parameters_t *)scam_vars_v;
+	int listed_channels=0;
+	int number_of_channels=adapter->chan_p->number_of_channels;
+	mumudvb_channel_t *channels=adapter->chan_p->channels;
+	multicast_pacing_t *pacing;
+#ifdef ENABLE_SCAM_SUPPORT
+	scam_parameters_t *scam_vars=(scam_parameters_t *)adapter->scam_vars;
 #endif
 
 	for (curr_channel = 0; curr_channel < number_of_channels; curr_channel++)
@@ -108,7 +111,9 @@ int unicast_send_channel_list_js (int number_of_channels, mumudvb_channel_t *cha
 		                //We give only channels which are ready
 		if(channels[curr_channel].channel_ready<READY)
 			continue;
-		unicast_reply_write(reply, "\n\t{\n\t\"number\": %d,\n", curr_channel + 1);
+		listed_channels++;
+		unicast_reply_write(reply, "\n\t{\n\t\"number\": %d,\n", adapter->chan_p->first_channel + curr_channel + 1);
+		unicast_reply_write(reply, "\t\"adapter\": %d,\n", adapter->id);
 		unicast_reply_write(reply, "\t\"lcn\": %d,\n", channels[curr_channel].logical_channel_number);
 		unicast_reply_write(reply, "\t\"name\": \"%s\",\n", channels[curr_channel].name);
 		unicast_reply_write(reply, "\t\"sap_group\": \"%s\",\n", channels[curr_channel].sap_group);
@@ -123,6 +128,17 @@ int unicast_send_channel_list_js (int number_of_channels, mumudvb_channel_t *cha
 		unicast_reply_write(reply, "\t\"service_id\": %d,\n", channels[curr_channel].service_id);
 		unicast_reply_write(reply, "\t\"service_type\": \"%s\",\n", service_type_to_str(channels[curr_channel].service_type));
 		unicast_reply_write(reply, "\t\"pids_num\": %d,\n", channels[curr_channel].pid_i.num_pids);
+		pthread_mutex_lock(&channels[curr_channel].stats_lock);
+		unicast_reply_write(reply, "\t\"flush_full\": %lu,\n", channels[curr_channel].flush_full);
+		unicast_reply_write(reply, "\t\"flush_delay\": %lu,\n", channels[curr_channel].flush_delay);
+		pacing = &channels[curr_channel].pacing;
+		unicast_reply_write(reply, "\t\"pacing_rate\": %llu,\n", (unsigned long long) pacing->rate);
+		unicast_reply_write(reply, "\t\"pacing_datagrams\": %lu,\n", pacing->datagrams);
+		unicast_reply_write(reply, "\t\"pacing_resync\": %lu,\n", pacing->resync);
+		unicast_reply_write(reply, "\t\"pacing_avg_delay_us\": %llu,\n", (unsigned long long) (pacing->datagrams ? pacing->total_delay / pacing->datagrams : 0));
+		unicast_reply_write(reply, "\t\"pacing_max_delay_us\": %llu,\n", (unsigned long long) pacing->max_delay);
+		unicast_reply_write(reply, "\t\"pacing_accuracy\": %.2f,\n", pacing->datagrams ? 100.0 * (pacing->datagrams - pacing->resync) / pacing->datagrams : 100.0);
+		pthread_mutex_unlock(&channels[curr_channel].stats_lock);
 		// SCAM information
 #ifdef ENABLE_SCAM_SUPPORT
 		if (scam_vars->scam_support) {
@@ -163,7 +179,24 @@ int unicast_send_channel_list_js (int number_of_channels, mumudvb_channel_t *cha
 			unicast_reply_write(reply, "\t\t{}\n");
 		unicast_reply_write(reply, "\t\t]\n\t},\n");
 	}
-	if(number_of_channels>0)
+	return listed_channels;
+}
+
+/**
+ * @brief Send the json channel list of all the adapters
+ *
+ * @param adapters the adapters
+ * @param num_adapters the number of adapters
+ * @param reply the unicast_reply where we will write the info.
+ *
+ **/
+int unicast_send_channel_list_js (unicast_adapter_t *adapters, int num_adapters, struct unicast_reply *reply)
+{
+	int listed_channels=0;
+
+	for (int iadapter = 0; iadapter < num_adapters; iadapter++)
+		listed_channels+=unicast_send_adapter_channels_js(&adapters[iadapter], reply);
+	if(listed_channels>0)
 		reply->used_body -= 2; // dirty hack to erase the last comma
 	else
 		unicast_reply_write(reply, "{}\n");
@@ -172,18 +205,12 @@ int unicast_send_channel_list_js (int number_of_channels, mumudvb_channel_t *cha
 
 /** @brief Send a basic JSON file containig the list of streamed channels
  *
- * @param number_of_channels the number of channels
- * @param channels the channels array
+ * @param adapters the adapters
+ * @param num_adapters the number of adapters
  * @param Socket the socket on wich the information have to be sent
  */
-int unicast_send_streamed_channels_list_js (int number_of_channels, mumudvb_channel_t *channels, void *scam_vars_v, int Socket)
+int unicast_send_streamed_channels_list_js (unicast_adapter_t *adapters, int num_adapters, int Socket)
 {
-#ifndef ENABLE_SCAM_SUPPORT
-		(void) scam_vars_v; //to make compiler happy
-#else
-        scam_parameters_t *scam_vars=(scam_parameters_t *)scam_vars_v;
-#endif
-
 	/***************************** PLEASE KEEP IN SYNC WITH THE XML VERSIONS ************************/
 
 	struct unicast_reply* reply = unicast_reply_init();
@@ -192,11 +219,7 @@ int unicast_send_streamed_channels_list_js (int number_of_channels, mumudvb_chan
 		return -1;
 	}
 	unicast_reply_write(reply, "[\n");
-#ifndef ENABLE_SCAM_SUPPORT
-	unicast_send_channel_list_js (number_of_channels, channels, scam_vars_v, reply);
-#else
-	unicast_send_channel_list_js (number_of_channels, channels, scam_vars, reply);
-#endif
+	unicast_send_channel_list_js (adapters, num_adapters, reply);
 	unicast_reply_write(reply, "]\n");
 
 	unicast_reply_send(reply, Socket, 200, "application/json");
@@ -238,8 +261,15 @@ void
 unicast_send_EIT_section (mumudvb_ts_packet_t *eit_section, int num, struct unicast_reply* reply);
 
 
+/** @brief Send the EIT tables stored by the adapters
+ *
+ * @param adapters the adapters
+ * @param num_adapters the number of adapters
+ * @param service_id only the tables of this service, 0 for all
+ * @param Socket the socket on wich the information have to be sent
+ */
 int
-unicast_send_EIT (eit_packet_t *eit_packets, int Socket)
+unicast_send_EIT (unicast_adapter_t *adapters, int num_adapters, int service_id, int Socket)
 {
 	struct unicast_reply* reply = unicast_reply_init();
 	if (NULL == reply)
@@ -250,33 +280,40 @@ unicast_send_EIT (eit_packet_t *eit_packets, int Socket)
 	// JSON header
 	unicast_reply_write(reply, "{\n");
 
-	eit_packet_t *actual_eit=eit_packets;
+	eit_packet_t *actual_eit;
 	int i;
+	int first_table=1;
 	unicast_reply_write(reply, "\"EIT_tables\":[\n");
-	while(actual_eit!=NULL)
+	for(int iadapter=0;iadapter<num_adapters;iadapter++)
 	{
-		unicast_reply_write(reply, "{\n");
-		unicast_reply_write(reply, "\t\"sid\" : \"%d\",\n",actual_eit->service_id);
-		unicast_reply_write(reply, "\t\"table_id\" : %d,\n",actual_eit->table_id);
-		unicast_reply_write(reply, "\t\"version\" : %d,\n",actual_eit->version);
-		unicast_reply_write(reply, "\t\"last_section_number\" : %d,\n",actual_eit->last_section_number);
-		int first_section;
-		first_section=1;
-		unicast_reply_write(reply, "\"EIT_sections\":[\n");
-		for(i=0;i<=actual_eit->last_section_number;i++)
-			if(actual_eit->sections_stored[i])
-			{
-				if(!first_section)
-					unicast_reply_write(reply, ",");
-				else
-					first_section=0;
-				unicast_send_EIT_section(actual_eit->full_eit_sections[i],i ,reply);
-			}
-		unicast_reply_write(reply, "]\n");
-		unicast_reply_write(reply, "}");
-		actual_eit=actual_eit->next;
-		if(actual_eit!=NULL)
-			unicast_reply_write(reply, ",\n");
+		for(actual_eit=*adapters[iadapter].eit_packets;actual_eit!=NULL;actual_eit=actual_eit->next)
+		{
+			if(service_id && actual_eit->service_id!=service_id)
+				continue;
+			if(!first_table)
+				unicast_reply_write(reply, ",\n");
+			first_table=0;
+			unicast_reply_write(reply, "{\n");
+			unicast_reply_write(reply, "\t\"adapter\" : %d,\n",adapters[iadapter].id);
+			unicast_reply_write(reply, "\t\"sid\" : \"%d\",\n",actual_eit->service_id);
+			unicast_reply_write(reply, "\t\"table_id\" : %d,\n",actual_eit->table_id);
+			unicast_reply_write(reply, "\t\"version\" : %d,\n",actual_eit->version);
+			unicast_reply_write(reply, "\t\"last_section_number\" : %d,\n",actual_eit->last_section_number);
+			int first_section;
+			first_section=1;
+			unicast_reply_write(reply, "\"EIT_sections\":[\n");
+			for(i=0;i<=actual_eit->last_section_number;i++)
+				if(actual_eit->sections_stored[i])
+				{
+					if(!first_section)
+						unicast_reply_write(reply, ",");
+					else
+						first_section=0;
+					unicast_send_EIT_section(actual_eit->full_eit_sections[i],i ,reply);
+				}
+			unicast_reply_write(reply, "]\n");
+			unicast_reply_write(reply, "}");
+		}
 	}
 	unicast_reply_write(reply, "]\n");
 	// Ending JSON content
@@ -295,12 +332,12 @@ unicast_send_EIT (eit_packet_t *eit_packets, int Socket)
 
 /** @brief Send a basic JSON file containig the channel traffic
  *
- * @param number_of_channels the number of channels
- * @param channels the channels array
+ * @param adapters the adapters
+ * @param num_adapters the number of adapters
  * @param Socket the socket on wich the information have to be sent
  */
 int
-unicast_send_channel_traffic_js (int number_of_channels, mumudvb_channel_t *channels, int Socket)
+unicast_send_channel_traffic_js (unicast_adapter_t *adapters, int num_adapters, int Socket)
 {
 	int curr_channel;
 	extern long real_start_time;
@@ -313,10 +350,18 @@ unicast_send_channel_traffic_js (int number_of_channels, mumudvb_channel_t *chan
 
 	if ((time((time_t*)0L) - real_start_time) >= 10) //10 seconds for the traffic calculation to be done
 	{
+		int listed_channels=0;
 		unicast_reply_write(reply, "[");
-		for (curr_channel = 0; curr_channel < number_of_channels; curr_channel++)
-			unicast_reply_write(reply, "{\"number\":%d, \"name\":\"%s\", \"traffic\":%.2f},\n", curr_channel+1, channels[curr_channel].name, channels[curr_channel].traffic);
-		if(number_of_channels>0)
+		for (int iadapter = 0; iadapter < num_adapters; iadapter++)
+		{
+			mumudvb_channel_t *channels=adapters[iadapter].chan_p->channels;
+			for (curr_channel = 0; curr_channel < adapters[iadapter].chan_p->number_of_channels; curr_channel++)
+			{
+				unicast_reply_write(reply, "{\"number\":%d, \"name\":\"%s\", \"traffic\":%.2f},\n", adapters[iadapter].chan_p->first_channel+curr_channel+1, channels[curr_channel].name, channels[curr_channel].traffic);
+				listed_channels++;
+			}
+		}
+		if(listed_channels>0)
 			reply->used_body -= 2; // dirty hack to erase the last comma
 		else
 			unicast_reply_write(reply, "{}\n");
@@ -332,57 +377,21 @@ unicast_send_channel_traffic_js (int number_of_channels, mumudvb_channel_t *chan
 	return 0;
 }
 
-/** @brief Send a full json state of the mumudvb instance
+/** @brief Write the tuner, autoconfiguration, CAM and SCAM state of an adapter in json, each block is followed by a comma
  *
- * @param number_of_channels the number of channels
- * @param channels the channels array
- * @param Socket the socket on wich the information have to be sent
- * @param fds the frontend device structure
+ * @param adapter the adapter
+ * @param reply the unicast_reply where we will write the info.
  */
-int
-unicast_send_json_state (int number_of_channels, mumudvb_channel_t *channels, int Socket, strength_parameters_t *strengthparams, auto_p_t *auto_p, void *cam_p_v, void *scam_vars_v)
+static void unicast_send_adapter_state_js (unicast_adapter_t *adapter, struct unicast_reply *reply)
 {
-	/***************************** PLEASE KEEP IN SYNC WITH THE XML VERSIONS ************************/
-#ifndef ENABLE_CAM_SUPPORT
-	(void) cam_p_v; //to make compiler happy
-#else
-	cam_p_t *cam_p=(cam_p_t *)cam_p_v;
+	strength_parameters_t *strengthparams=adapter->strengthparams;
+	auto_p_t *auto_p=adapter->auto_p;
+#ifdef ENABLE_CAM_SUPPORT
+	cam_p_t *cam_p=(cam_p_t *)adapter->cam_p;
 #endif
-
-#ifndef ENABLE_SCAM_SUPPORT
-	(void) scam_vars_v; //to make compiler happy
-#else
-	scam_parameters_t *scam_vars=(scam_parameters_t *)scam_vars_v;
+#ifdef ENABLE_SCAM_SUPPORT
+	scam_parameters_t *scam_vars=(scam_parameters_t *)adapter->scam_vars;
 #endif
-	// Prepare the HTTP reply
-	struct unicast_reply* reply = unicast_reply_init();
-	if (NULL == reply) {
-		log_message( log_module, MSG_INFO,"Error when creating the HTTP reply\n");
-		return -1;
-	}
-
-	// Date time formatting
-	time_t rawtime;
-	time (&rawtime);
-	char sdatetime[25];
-	snprintf(sdatetime,25,"%s",ctime(&rawtime));
-
-	// JSON header
-	unicast_reply_write(reply, "{\n");
-
-	// ****************** SERVER ************************
-	unicast_reply_write(reply, "\"mumudvb\":{\n");
-
-	// Mumudvb information
-	unicast_reply_write(reply, "\t\"version\" : \"%s\",\n",VERSION);
-	unicast_reply_write(reply, "\t\"pid\" : %d,\n", getpid());
-
-	// Uptime
-	extern long real_start_time;
-	struct timeval tv;
-	gettimeofday (&tv, (struct timezone *) NULL);
-	unicast_reply_write(reply, "\t\"global_uptime\" : %d\n",(tv.tv_sec - real_start_time));
-	unicast_reply_write(reply, "},\n");
 
 	// ****************** TUNE ************************
 	unicast_reply_write(reply, "\"tune\":{\n");
@@ -460,6 +469,37 @@ unicast_send_json_state (int number_of_channels, mumudvb_channel_t *channels, in
 	unicast_reply_write(reply, "\t\"frontend_signal\" : %d,\n",strengthparams->strength);
 	unicast_reply_write(reply, "\t\"frontend_snr\" : %d,\n",strengthparams->snr);
 	unicast_reply_write(reply, "\t\"frontend_ub\" : %d,\n",strengthparams->ub);
+	if(strengthparams->udp_source)
+	{
+		unicast_reply_write(reply, "\t\"source_datagrams\" : %llu,\n",strengthparams->udp_source->datagrams);
+		unicast_reply_write(reply, "\t\"source_lost\" : %llu,\n",strengthparams->udp_source->lost);
+		unicast_reply_write(reply, "\t\"source_reordered\" : %llu,\n",strengthparams->udp_source->reordered);
+		unicast_reply_write(reply, "\t\"source_late\" : %llu,\n",strengthparams->udp_source->late);
+		unicast_reply_write(reply, "\t\"source_errors\" : %llu,\n",strengthparams->udp_source->errors);
+	}
+	if(strengthparams->card_buffer)
+	{
+		unicast_reply_write(reply, "\t\"dvr_read_size\" : %d,\n",strengthparams->card_buffer->dvr_buffer_size);
+		unicast_reply_write(reply, "\t\"dvr_avg_read\" : %d,\n",strengthparams->card_buffer->avg_read_packets);
+		unicast_reply_write(reply, "\t\"dvr_full_reads_percent\" : %d,\n",strengthparams->card_buffer->full_reads_percent);
+		unicast_reply_write(reply, "\t\"dvr_kernel_buffer_size\" : %d,\n",strengthparams->card_buffer->kernel_buffer_size);
+		unicast_reply_write(reply, "\t\"dvr_overflows\" : %d,\n",strengthparams->card_buffer->overflow_number);
+		unicast_reply_write(reply, "\t\"dvr_thread_full\" : %d,\n",strengthparams->card_buffer->thread_full_number);
+		if(strengthparams->card_buffer->threaded_read)
+		{
+			unicast_reply_write(reply, "\t\"dvr_thread_ring_high_water\" : %d,\n",strengthparams->card_buffer->ring.high_water);
+			unicast_reply_write(reply, "\t\"dvr_thread_ring_slots\" : %d,\n",strengthparams->card_buffer->ring.num_slots);
+			unicast_reply_write(reply, "\t\"dvr_thread_dropped_packets\" : %llu,\n",strengthparams->card_buffer->ring.dropped_packets);
+			unicast_reply_write(reply, "\t\"dvr_thread_dropped_bytes\" : %llu,\n",strengthparams->card_buffer->ring.dropped_bytes);
+			unicast_reply_write(reply, "\t\"dvr_thread_kept_psi_packets\" : %llu,\n",strengthparams->card_buffer->ring.kept_packets);
+		}
+	}
+	if(strengthparams->eit_cache)
+	{
+		unicast_reply_write(reply, "\t\"eit_cache_hits\" : %llu,\n",(unsigned long long) strengthparams->eit_cache->hits);
+		unicast_reply_write(reply, "\t\"eit_cache_misses\" : %llu,\n",(unsigned long long) strengthparams->eit_cache->misses);
+		unicast_reply_write(reply, "\t\"eit_cache_sections\" : %u,\n",strengthparams->eit_cache->used);
+	}
 	unicast_reply_write(reply, "\t\"ts_discontinuities\" : %u\n",strengthparams->ts_discontinuities);
 
 	unicast_reply_write(reply, "},\n");
@@ -479,6 +519,7 @@ unicast_send_json_state (int number_of_channels, mumudvb_channel_t *channels, in
 		unicast_reply_write(reply, "\t\"sdt_version\" : %d,\n",auto_p->sdt_version);
 		unicast_reply_write(reply, "\t\"nit_version\" : %d,\n",auto_p->nit_version);
 		unicast_reply_write(reply, "\t\"psip_version\" : %d,\n",auto_p->psip_version);
+		unicast_reply_write(reply, "\t\"cache_restored\" : %d,\n",auto_p->cache_restored);
 		unicast_reply_write(reply, "\t\"finished\" : %d",
 				auto_p->pat_all_sections_seen && (auto_p->sdt_all_sections_seen || auto_p->psip_all_sections_seen) && auto_p->nit_all_sections_seen);
 
@@ -526,14 +567,82 @@ unicast_send_json_state (int number_of_channels, mumudvb_channel_t *channels, in
 	unicast_reply_write(reply, "\t\"send_default_delay\" : %u\n",0);
 #endif
 	unicast_reply_write(reply, "},\n");
+}
+
+/** @brief Send a full json state of the mumudvb instance
+ * The tune, autoconfiguration, cam and scam blocks are the ones of the first adapter,
+ * the adapters list has them for every adapter
+ *
+ * @param adapters the adapters
+ * @param num_adapters the number of adapters
+ * @param Socket the socket on wich the information have to be sent
+ */
+int
+unicast_send_json_state (unicast_adapter_t *adapters, int num_adapters, int Socket)
+{
+	/***************************** PLEASE KEEP IN SYNC WITH THE XML VERSIONS ************************/
+	// Prepare the HTTP reply
+	struct unicast_reply* reply = unicast_reply_init();
+	if (NULL == reply) {
+		log_message( log_module, MSG_INFO,"Error when creating the HTTP reply\n");
+		return -1;
+	}
+
+	// Date time formatting
+	time_t rawtime;
+	time (&rawtime);
+	char sdatetime[25];
+	snprintf(sdatetime,25,"%s",ctime(&rawtime));
+
+	// JSON header
+	unicast_reply_write(reply, "{\n");
+
+	// ****************** SERVER ************************
+	unicast_reply_write(reply, "\"mumudvb\":{\n");
+
+	// Mumudvb information
+	unicast_reply_write(reply, "\t\"version\" : \"%s\",\n",VERSION);
+	unicast_reply_write(reply, "\t\"pid\" : %d,\n", getpid());
+
+	// Uptime
+	extern long real_start_time;
+	struct timeval tv;
+	gettimeofday (&tv, (struct timezone *) NULL);
+	unicast_reply_write(reply, "\t\"global_uptime\" : %d\n",(tv.tv_sec - real_start_time));
+	unicast_reply_write(reply, "},\n");
+
+	// The first adapter, kept at the top for the clients made for one adapter
+	unicast_send_adapter_state_js(&adapters[0], reply);
+
+	// ****************** MULTICAST ************************
+	// Batched sending counters, written by the sending threads, read without lock
+	extern multicast_batch_stats_t multicast_batch_stats;
+	multicast_batch_stats_t batch_stats=multicast_batch_stats;
+	unicast_reply_write(reply, "\"multicast\":{\n");
+	unicast_reply_write(reply, "\t\"batch_datagrams\" : %lu,\n",batch_stats.datagrams);
+	unicast_reply_write(reply, "\t\"batch_syscalls\" : %lu,\n",batch_stats.syscalls);
+	unicast_reply_write(reply, "\t\"batch_gso_messages\" : %lu,\n",batch_stats.gso_messages);
+	unicast_reply_write(reply, "\t\"batch_dropped\" : %lu,\n",batch_stats.dropped);
+	unicast_reply_write(reply, "\t\"output_datagrams\" : %lu,\n",batch_stats.output_datagrams);
+	unicast_reply_write(reply, "\t\"output_dropped\" : %lu,\n",batch_stats.output_dropped);
+	unicast_reply_write(reply, "\t\"datagrams_per_syscall\" : %.2f\n",
+			batch_stats.syscalls ? (double)batch_stats.datagrams/batch_stats.syscalls : 0.0);
+	unicast_reply_write(reply, "},\n");
+
+	// ****************** ADAPTERS ************************
+	unicast_reply_write(reply, "\"adapters\": [\n");
+	for (int iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		unicast_reply_write(reply, "{\n\"id\" : %d,\n", adapters[iadapter].id);
+		unicast_send_adapter_state_js(&adapters[iadapter], reply);
+		reply->used_body -= 2; // dirty hack to erase the last comma
+		unicast_reply_write(reply, (iadapter < num_adapters-1) ? "\n},\n" : "\n}\n");
+	}
+	unicast_reply_write(reply, "],\n");
 
 	// Channels list
 	unicast_reply_write(reply,"\"channels\": [");
-#ifndef ENABLE_SCAM_SUPPORT
-	unicast_send_channel_list_js (number_of_channels, channels, scam_vars_v, reply);
-#else
-	unicast_send_channel_list_js (number_of_channels, channels, scam_vars, reply);
-#endif
+	unicast_send_channel_list_js (adapters, num_adapters, reply);
 	unicast_reply_write(reply, "]\n");
 
 	// Ending JSON content
@@ -552,15 +661,15 @@ unicast_send_json_state (int number_of_channels, mumudvb_channel_t *channels, in
 
 /** @brief Send a full prometheus export of the mumudvb instance
  *
- * @param number_of_channels the number of channels
- * @param channels the channels array
+ * @param adapters the adapters, the signal of each one is labelled with its number
+ * @param num_adapters the number of adapters
  * @param Socket the socket on wich the information have to be sent
- * @param strengthparams the structure for the strength params
  */
 int
-unicast_send_prometheus (int number_of_channels, mumudvb_channel_t *channels, int Socket, strength_parameters_t *strengthparams)
+unicast_send_prometheus (unicast_adapter_t *adapters, int num_adapters, int Socket)
 {
     int curr_channel;
+    int iadapter;
     // Prepare the HTTP reply
     struct unicast_reply* reply = unicast_reply_init();
     if (NULL == reply) {
@@ -570,20 +679,27 @@ unicast_send_prometheus (int number_of_channels, mumudvb_channel_t *channels, in
 
     //Signal parameters
     unicast_reply_write(reply, "# TYPE bit_error_rate gauge\n");
-    unicast_reply_write(reply, "bit_error_rate %d\n",strengthparams->ber);
+    for (iadapter = 0; iadapter < num_adapters; iadapter++)
+        unicast_reply_write(reply, "bit_error_rate{adapter=\"%d\"} %d\n",adapters[iadapter].id,adapters[iadapter].strengthparams->ber);
     unicast_reply_write(reply, "# TYPE signal_strength gauge\n");
-    unicast_reply_write(reply, "signal_strength %d\n",strengthparams->strength);
+    for (iadapter = 0; iadapter < num_adapters; iadapter++)
+        unicast_reply_write(reply, "signal_strength{adapter=\"%d\"} %d\n",adapters[iadapter].id,adapters[iadapter].strengthparams->strength);
     unicast_reply_write(reply, "# TYPE signal_to_noise_ratio gauge\n");
-    unicast_reply_write(reply, "signal_to_noise_ratio %d\n",strengthparams->snr);
+    for (iadapter = 0; iadapter < num_adapters; iadapter++)
+        unicast_reply_write(reply, "signal_to_noise_ratio{adapter=\"%d\"} %d\n",adapters[iadapter].id,adapters[iadapter].strengthparams->snr);
 
     // Channels list
     unicast_reply_write(reply, "# TYPE number_of_clients gauge\n");
-    for (curr_channel = 0; curr_channel < number_of_channels; curr_channel++)
+    for (iadapter = 0; iadapter < num_adapters; iadapter++)
     {
-        //We give only channels which are ready
-        if(channels[curr_channel].channel_ready<READY)
-            continue;
-        unicast_reply_write(reply, "number_of_clients{name=\"%s\"} %d\n", channels[curr_channel].name, channels[curr_channel].num_clients);
+        mumudvb_channel_t *channels=adapters[iadapter].chan_p->channels;
+        for (curr_channel = 0; curr_channel < adapters[iadapter].chan_p->number_of_channels; curr_channel++)
+        {
+            //We give only channels which are ready
+            if(channels[curr_channel].channel_ready<READY)
+                continue;
+            unicast_reply_write(reply, "number_of_clients{name=\"%s\",adapter=\"%d\"} %d\n", channels[curr_channel].name, adapters[iadapter].id, channels[curr_channel].num_clients);
+        }
     }
     unicast_reply_send(reply, Socket, 200, "text/plain");
 
@@ -626,31 +742,31 @@ int unicast_send_client_list_xml (unicast_client_t *unicast_client, struct unica
 
 
 /**
- * @brief send the channel list in xml
+ * @brief send the channel list of an adapter in xml
  *
- * @param number_of_channels the number of channels
- * @param channels the channels array
+ * @param adapter the adapter
  * @param reply the unicast_reply where we will write the info.
  *
  **/
-int unicast_send_channel_list_xml (int number_of_channels, mumudvb_channel_t *channels, void *scam_vars_v, struct unicast_reply *reply)
+int unicast_send_channel_list_xml (unicast_adapter_t *adapter, struct unicast_reply *reply)
 {
 
-#ifndef ENABLE_SCAM_SUPPORT
-    (void) scam_vars_v; //to make compiler happy
-#else
-    scam_parameters_t *scam_vars=(scam_parameters_t *)scam_vars_v;
+#ifdef ENABLE_SCAM_SUPPORT
+    scam_parameters_t *scam_vars=(scam_parameters_t *)adapter->scam_vars;
 #endif
 
 	// Channels list
 	int curr_channel;
+	int number_of_channels=adapter->chan_p->number_of_channels;
+	mumudvb_channel_t *channels=adapter->chan_p->channels;
+	multicast_pacing_t *pacing;
 
 	for (curr_channel = 0; curr_channel < number_of_channels; curr_channel++)
 	{
 		//We give only channels which are ready
 		if(channels[curr_channel].channel_ready<READY)
 			continue;
-		unicast_reply_write(reply, "\t<channel number=\"%d\" is_up=\"%d\">\n",curr_channel+1,channels[curr_channel].has_traffic);
+		unicast_reply_write(reply, "\t<channel number=\"%d\" is_up=\"%d\" adapter=\"%d\">\n",adapter->chan_p->first_channel+curr_channel+1,channels[curr_channel].has_traffic,adapter->id);
 		unicast_reply_write(reply, "\t\t<lcn>%d</lcn>\n",channels[curr_channel].logical_channel_number);
 		unicast_reply_write(reply, "\t\t<name><![CDATA[%s]]></name>\n",channels[curr_channel].name);
 		unicast_reply_write(reply, "\t\t<service_type type=\"%d\"><![CDATA[%s]]></service_type>\n",channels[curr_channel].service_type,service_type_to_str(channels[curr_channel].service_type));
@@ -667,6 +783,16 @@ int unicast_send_channel_list_xml (int number_of_channels, mumudvb_channel_t *ch
 		unicast_reply_write(reply, "\t\t<pcr_pid>%d</pcr_pid>\n",channels[curr_channel].pid_i.pcr_pid);
 		unicast_reply_write(reply, "\t\t<unicast_port>%d</unicast_port>\n",channels[curr_channel].unicast_port);
 		unicast_reply_write(reply, "\t\t<unicast_client_count>%d</unicast_client_count>\n", channels[curr_channel].num_clients);
+		pthread_mutex_lock(&channels[curr_channel].stats_lock);
+		unicast_reply_write(reply, "\t\t<flush_full>%lu</flush_full>\n", channels[curr_channel].flush_full);
+		unicast_reply_write(reply, "\t\t<flush_delay>%lu</flush_delay>\n", channels[curr_channel].flush_delay);
+		pacing = &channels[curr_channel].pacing;
+		unicast_reply_write(reply, "\t\t<pacing rate=\"%llu\" datagrams=\"%lu\" resync=\"%lu\" avg_delay_us=\"%llu\" max_delay_us=\"%llu\" accuracy=\"%.2f\"/>\n",
+				(unsigned long long) pacing->rate, pacing->datagrams, pacing->resync,
+				(unsigned long long) (pacing->datagrams ? pacing->total_delay / pacing->datagrams : 0),
+				(unsigned long long) pacing->max_delay,
+				pacing->datagrams ? 100.0 * (pacing->datagrams - pacing->resync) / pacing->datagrams : 100.0);
+		pthread_mutex_unlock(&channels[curr_channel].stats_lock);
 		// SCAM information
 #ifdef ENABLE_SCAM_SUPPORT
 		if (scam_vars->scam_support) {
@@ -705,58 +831,21 @@ int unicast_send_channel_list_xml (int number_of_channels, mumudvb_channel_t *ch
 	return 0;
 }
 
-/** @brief Send a full XML state of the mumudvb instance
+/** @brief Write the tuner, autoconfiguration, CAM and SCAM state of an adapter in XML
  *
- * @param number_of_channels the number of channels
- * @param channels the channels array
- * @param Socket the socket on wich the information have to be sent
- * @param fds the frontend device structure
+ * @param adapter the adapter
+ * @param reply the unicast_reply where we will write the info.
  */
-int
-unicast_send_xml_state (int number_of_channels, mumudvb_channel_t *channels, int Socket, strength_parameters_t *strengthparams, auto_p_t *auto_p, void *cam_p_v, void *scam_vars_v)
+static void unicast_send_adapter_state_xml (unicast_adapter_t *adapter, struct unicast_reply *reply)
 {
-
-	/***************************** PLEASE KEEP IN SYNC WITH THE JSON VERSIONS ************************/
-#ifndef ENABLE_CAM_SUPPORT
-	(void) cam_p_v; //to make compiler happy
-#else
-	cam_p_t *cam_p=(cam_p_t *)cam_p_v;
+	strength_parameters_t *strengthparams=adapter->strengthparams;
+	auto_p_t *auto_p=adapter->auto_p;
+#ifdef ENABLE_CAM_SUPPORT
+	cam_p_t *cam_p=(cam_p_t *)adapter->cam_p;
 #endif
-
-#ifndef ENABLE_SCAM_SUPPORT
-	(void) scam_vars_v; //to make compiler happy
-#else
-	scam_parameters_t *scam_vars=(scam_parameters_t *)scam_vars_v;
+#ifdef ENABLE_SCAM_SUPPORT
+	scam_parameters_t *scam_vars=(scam_parameters_t *)adapter->scam_vars;
 #endif
-	// Prepare the HTTP reply
-	struct unicast_reply* reply = unicast_reply_init();
-	if (NULL == reply) {
-		log_message( log_module, MSG_INFO,"Error when creating the HTTP reply\n");
-		return -1;
-	}
-
-	// Date time formatting
-	time_t rawtime;
-	time (&rawtime);
-	char sdatetime[25];
-	snprintf(sdatetime,25,"%s",ctime(&rawtime));
-
-	// XML header
-	unicast_reply_write(reply, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n");
-
-	// Starting XML content
-	unicast_reply_write(reply, "<mumudvb card=\"%d\" frontend=\"%d\">\n",strengthparams->tune_p->card,strengthparams->tune_p->tuner);
-	unicast_reply_write(reply, "<card_path><![CDATA[%s]]></card_path>\n",strengthparams->tune_p->card_dev_path);
-
-	// Mumudvb information
-	unicast_reply_write(reply, "\t<global_version><![CDATA[%s]]></global_version>\n",VERSION);
-	unicast_reply_write(reply, "\t<global_pid>%d</global_pid>\n", getpid());
-
-	// Uptime
-	extern long real_start_time;
-	struct timeval tv;
-	gettimeofday (&tv, (struct timezone *) NULL);
-	unicast_reply_write(reply, "\t<global_uptime>%d</global_uptime>\n",(tv.tv_sec - real_start_time));
 
 	// Frontend setup
 	unicast_reply_write(reply, "\t<frontend_name><![CDATA[%s]]></frontend_name>\n",strengthparams->tune_p->fe_name);
@@ -827,6 +916,37 @@ unicast_send_xml_state (int number_of_channels, mumudvb_channel_t *channels, int
 	unicast_reply_write(reply, "\t<frontend_signal>%d</frontend_signal>\n",strengthparams->strength);
 	unicast_reply_write(reply, "\t<frontend_snr>%d</frontend_snr>\n",strengthparams->snr);
 	unicast_reply_write(reply, "\t<frontend_ub>%d</frontend_ub>\n",strengthparams->ub);
+	if(strengthparams->udp_source)
+	{
+		unicast_reply_write(reply, "\t<source_datagrams>%llu</source_datagrams>\n",strengthparams->udp_source->datagrams);
+		unicast_reply_write(reply, "\t<source_lost>%llu</source_lost>\n",strengthparams->udp_source->lost);
+		unicast_reply_write(reply, "\t<source_reordered>%llu</source_reordered>\n",strengthparams->udp_source->reordered);
+		unicast_reply_write(reply, "\t<source_late>%llu</source_late>\n",strengthparams->udp_source->late);
+		unicast_reply_write(reply, "\t<source_errors>%llu</source_errors>\n",strengthparams->udp_source->errors);
+	}
+	if(strengthparams->card_buffer)
+	{
+		unicast_reply_write(reply, "\t<dvr_read_size>%d</dvr_read_size>\n",strengthparams->card_buffer->dvr_buffer_size);
+		unicast_reply_write(reply, "\t<dvr_avg_read>%d</dvr_avg_read>\n",strengthparams->card_buffer->avg_read_packets);
+		unicast_reply_write(reply, "\t<dvr_full_reads_percent>%d</dvr_full_reads_percent>\n",strengthparams->card_buffer->full_reads_percent);
+		unicast_reply_write(reply, "\t<dvr_kernel_buffer_size>%d</dvr_kernel_buffer_size>\n",strengthparams->card_buffer->kernel_buffer_size);
+		unicast_reply_write(reply, "\t<dvr_overflows>%d</dvr_overflows>\n",strengthparams->card_buffer->overflow_number);
+		unicast_reply_write(reply, "\t<dvr_thread_full>%d</dvr_thread_full>\n",strengthparams->card_buffer->thread_full_number);
+		if(strengthparams->card_buffer->threaded_read)
+		{
+			unicast_reply_write(reply, "\t<dvr_thread_ring_high_water>%d</dvr_thread_ring_high_water>\n",strengthparams->card_buffer->ring.high_water);
+			unicast_reply_write(reply, "\t<dvr_thread_ring_slots>%d</dvr_thread_ring_slots>\n",strengthparams->card_buffer->ring.num_slots);
+			unicast_reply_write(reply, "\t<dvr_thread_dropped_packets>%llu</dvr_thread_dropped_packets>\n",strengthparams->card_buffer->ring.dropped_packets);
+			unicast_reply_write(reply, "\t<dvr_thread_dropped_bytes>%llu</dvr_thread_dropped_bytes>\n",strengthparams->card_buffer->ring.dropped_bytes);
+			unicast_reply_write(reply, "\t<dvr_thread_kept_psi_packets>%llu</dvr_thread_kept_psi_packets>\n",strengthparams->card_buffer->ring.kept_packets);
+		}
+	}
+	if(strengthparams->eit_cache)
+	{
+		unicast_reply_write(reply, "\t<eit_cache_hits>%llu</eit_cache_hits>\n",(unsigned long long) strengthparams->eit_cache->hits);
+		unicast_reply_write(reply, "\t<eit_cache_misses>%llu</eit_cache_misses>\n",(unsigned long long) strengthparams->eit_cache->misses);
+		unicast_reply_write(reply, "\t<eit_cache_sections>%u</eit_cache_sections>\n",strengthparams->eit_cache->used);
+	}
 	unicast_reply_write(reply, "\t<ts_discontinuities>%u</ts_discontinuities>\n",strengthparams->ts_discontinuities);
 
 
@@ -842,6 +962,7 @@ unicast_send_xml_state (int number_of_channels, mumudvb_channel_t *channels, int
 		unicast_reply_write(reply, "\t\t<sdt_version>%d</sdt_version>\n",auto_p->sdt_version);
 		unicast_reply_write(reply, "\t\t<nit_version>%d</nit_version>\n",auto_p->nit_version);
 		unicast_reply_write(reply, "\t\t<psip_version>%d</psip_version>\n",auto_p->psip_version);
+		unicast_reply_write(reply, "\t\t<cache_restored>%d</cache_restored>\n",auto_p->cache_restored);
 		unicast_reply_write(reply, "\t</autoconfiguration_detected_parameters>\n");
 		unicast_reply_write(reply, "\t<autoconfiguration_finished>%d</autoconfiguration_finished>\n",
 				auto_p->pat_all_sections_seen && (auto_p->sdt_all_sections_seen || auto_p->psip_all_sections_seen) && auto_p->nit_all_sections_seen);
@@ -880,9 +1001,78 @@ unicast_send_xml_state (int number_of_channels, mumudvb_channel_t *channels, int
 	unicast_reply_write(reply, "\t<decsa_default_delay>%u</decsa_default_delay>\n",0);
 	unicast_reply_write(reply, "\t<send_default_delay>%u</send_default_delay>\n",0);
 #endif
+}
+
+/** @brief Send a full XML state of the mumudvb instance
+ * The frontend, autoconfiguration, cam and scam elements are the ones of the first adapter,
+ * the adapter elements have them for every adapter
+ *
+ * @param adapters the adapters
+ * @param num_adapters the number of adapters
+ * @param Socket the socket on wich the information have to be sent
+ */
+int
+unicast_send_xml_state (unicast_adapter_t *adapters, int num_adapters, int Socket)
+{
+
+	/***************************** PLEASE KEEP IN SYNC WITH THE JSON VERSIONS ************************/
+	strength_parameters_t *strengthparams=adapters[0].strengthparams;
+	// Prepare the HTTP reply
+	struct unicast_reply* reply = unicast_reply_init();
+	if (NULL == reply) {
+		log_message( log_module, MSG_INFO,"Error when creating the HTTP reply\n");
+		return -1;
+	}
+
+	// Date time formatting
+	time_t rawtime;
+	time (&rawtime);
+	char sdatetime[25];
+	snprintf(sdatetime,25,"%s",ctime(&rawtime));
+
+	// XML header
+	unicast_reply_write(reply, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n");
+
+	// Starting XML content
+	unicast_reply_write(reply, "<mumudvb card=\"%d\" frontend=\"%d\">\n",strengthparams->tune_p->card,strengthparams->tune_p->tuner);
+	unicast_reply_write(reply, "<card_path><![CDATA[%s]]></card_path>\n",strengthparams->tune_p->card_dev_path);
+
+	// Mumudvb information
+	unicast_reply_write(reply, "\t<global_version><![CDATA[%s]]></global_version>\n",VERSION);
+	unicast_reply_write(reply, "\t<global_pid>%d</global_pid>\n", getpid());
+
+	// Uptime
+	extern long real_start_time;
+	struct timeval tv;
+	gettimeofday (&tv, (struct timezone *) NULL);
+	unicast_reply_write(reply, "\t<global_uptime>%d</global_uptime>\n",(tv.tv_sec - real_start_time));
+
+	// The first adapter, kept at the top for the clients made for one adapter
+	unicast_send_adapter_state_xml(&adapters[0], reply);
+
+	// Batched multicast sending counters, written by the sending threads, read without lock
+	extern multicast_batch_stats_t multicast_batch_stats;
+	multicast_batch_stats_t batch_stats=multicast_batch_stats;
+	unicast_reply_write(reply, "\t<multicast_batch_datagrams>%lu</multicast_batch_datagrams>\n",batch_stats.datagrams);
+	unicast_reply_write(reply, "\t<multicast_batch_syscalls>%lu</multicast_batch_syscalls>\n",batch_stats.syscalls);
+	unicast_reply_write(reply, "\t<multicast_batch_gso_messages>%lu</multicast_batch_gso_messages>\n",batch_stats.gso_messages);
+	unicast_reply_write(reply, "\t<multicast_batch_dropped>%lu</multicast_batch_dropped>\n",batch_stats.dropped);
+	unicast_reply_write(reply, "\t<multicast_output_datagrams>%lu</multicast_output_datagrams>\n",batch_stats.output_datagrams);
+	unicast_reply_write(reply, "\t<multicast_output_dropped>%lu</multicast_output_dropped>\n",batch_stats.output_dropped);
+	unicast_reply_write(reply, "\t<multicast_datagrams_per_syscall>%.2f</multicast_datagrams_per_syscall>\n",
+			batch_stats.syscalls ? (double)batch_stats.datagrams/batch_stats.syscalls : 0.0);
+
+	// The adapters
+	for (int iadapter = 0; iadapter < num_adapters; iadapter++)
+	{
+		unicast_reply_write(reply, "\t<adapter id=\"%d\" card=\"%d\" frontend=\"%d\">\n",adapters[iadapter].id,adapters[iadapter].strengthparams->tune_p->card,adapters[iadapter].strengthparams->tune_p->tuner);
+		unicast_send_adapter_state_xml(&adapters[iadapter], reply);
+		unicast_reply_write(reply, "\t</adapter>\n");
+	}
 
 	// channel list
-	unicast_send_channel_list_xml (number_of_channels, channels, scam_vars_v, reply);
+	for (int iadapter = 0; iadapter < num_adapters; iadapter++)
+		unicast_send_channel_list_xml (&adapters[iadapter], reply);
 
 	// Ending XML content
 	unicast_reply_write(reply, "</mumudvb>\n");
@@ -33,6 +33,8 @@
 #include <errno.h>
 #ifndef _WIN32
 #include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #else
 #include <process.h> /* for getpid() */
@@ -49,196 +51,244 @@
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL (0)
 #endif
+struct iovec {
+	void *iov_base;
+	size_t iov_len;
+};
 #endif
 
 static char *log_module="Unicast : ";
 
-int unicast_queue_remove_data(unicast_queue_header_t *header);
-int unicast_queue_add_data(unicast_queue_header_t *header, unsigned char *data, int data_len);
-int unicast_queue_requeue(unicast_queue_header_t *header, unsigned char *data, int data_len);
-unsigned char *unicast_queue_get_data(unicast_queue_header_t* , int* );
-void unicast_close_connection(unicast_parameters_t *unicast_vars, int Socket);
-
-/** @brief Send the buffer for the channel
+/** @brief Send a list of buffers with one system call if possible
  *
- * This function is called when a buffer for a channel is full and have to be sent to the clients
+ * @return the number of bytes written or -1 if nothing could be written
+ */
+static int unicast_send_iov(int Socket, struct iovec *iov, int iovcnt)
+{
+#ifndef _WIN32
+	struct msghdr msg;
+	memset(&msg,0,sizeof(struct msghdr));
+	msg.msg_iov=iov;
+	msg.msg_iovlen=iovcnt;
+	return sendmsg(Socket, &msg, MSG_NOSIGNAL);
+#else
+	int i,written_len,total_len=0;
+	for(i=0;i<iovcnt;i++)
+	{
+		written_len=send(Socket,(const char *)iov[i].iov_base, iov[i].iov_len,MSG_NOSIGNAL);
+		if(written_len<0)
+			return total_len ? total_len : -1;
+		total_len+=written_len;
+		if(written_len<(int)iov[i].iov_len)
+			break;
+	}
+	return total_len;
+#endif
+}
+
+/** @brief Send the data waiting in the ring to a client
  *
+ * The end of the segment partially sent, if any, and the following segments are sent
+ * together with sendmsg, up to send_budget bytes. A client catching up is limited by
+ * its socket, not by the number of send calls
  */
-void unicast_data_send(mumudvb_channel_t *actual_channel, unicast_parameters_t *unicast_vars)
+static void unicast_client_send(unicast_client_t *actual_client, unicast_ring_t *ring, unicast_parameters_t *unicast_vars)
 {
 	char addr_buf[IPV6_CHAR_LEN] = { 0, };
+	unicast_queue_header_t *queue=&actual_client->queue;
+	struct iovec iov[UNICAST_SEND_MAX_IOV];
+	int iovcnt;
+	int written_len;
+	int buffer_len;
+	int budget;
+	int from_partial;
+	int segment_len;
+	uint64_t position;
+	struct timeval tv;
+
+	//The client is too slow, the oldest segments were overwritten
+	if(ring->head - queue->position > (uint64_t) ring->num_segments)
+	{
+		queue->lost_segments+=ring->head - ring->num_segments - queue->position;
+		queue->position=ring->head - ring->num_segments;
+		if(!queue->full)
+		{
+			queue->full=1;
+			socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
 
-	if(actual_channel->clients)
+			log_message(log_module, MSG_DETAIL, "The queue is full, we now throw away the oldest packets for client %s\n", addr_buf);
+		}
+	}
+
+	budget=unicast_vars->send_budget;
+	while(budget>0)
 	{
-		unicast_client_t *actual_client;
-		unicast_client_t *temp_client;
-		int written_len;
-		unsigned char *buffer;
-		int buffer_len;
-		int data_from_queue;
-		int packets_left;
-		struct timeval tv;
+		//We gather the data to send
+		iovcnt=0;
+		buffer_len=0;
+		from_partial=0;
+		if(queue->partial_pos < queue->partial_length)
+		{
+			from_partial=1;
+			iov[0].iov_base=queue->partial + queue->partial_pos;
+			iov[0].iov_len=queue->partial_length - queue->partial_pos;
+			buffer_len+=iov[0].iov_len;
+			iovcnt++;
+		}
+		for(position=queue->position; position != ring->head && iovcnt < UNICAST_SEND_MAX_IOV; position++)
+		{
+			segment_len=ring->data_length[position % ring->num_segments];
+			if(iovcnt && buffer_len+segment_len > budget)
+				break;
+			iov[iovcnt].iov_base=ring->data + (position % ring->num_segments) * MAX_UDP_SIZE;
+			iov[iovcnt].iov_len=segment_len;
+			buffer_len+=segment_len;
+			iovcnt++;
+		}
+		if(!iovcnt)
+			break; //Nothing more to send
 
-		actual_client=actual_channel->clients;
-		while(actual_client!=NULL)
+		//we send the data
+		written_len=unicast_send_iov(actual_client->Socket, iov, iovcnt);
+		if(written_len>0)
 		{
-			buffer=actual_channel->buf;
-			buffer_len=actual_channel->nb_bytes;
-			data_from_queue=0;
-			if(actual_client->queue.packets_in_queue!=0)
+			//We skip what was written, the rest of a segment partially sent is kept by the client, the ring can overwrite the segment
+			int remaining=written_len;
+			int i=0;
+			if(from_partial)
 			{
-				//already some packets in the queue we enqueue the new one and try to send the queued ones
-				data_from_queue=1;
-				packets_left=UNICAST_MULTIPLE_QUEUE_SEND;
-				if((actual_client->queue.data_bytes_in_queue+buffer_len)< unicast_vars->queue_max_size)
-					unicast_queue_add_data(&actual_client->queue, buffer, buffer_len );
+				if(remaining < (int)iov[0].iov_len)
+					queue->partial_pos+=remaining;
 				else
+					queue->partial_length=queue->partial_pos=0;
+				remaining-=(remaining < (int)iov[0].iov_len) ? remaining : (int)iov[0].iov_len;
+				i=1;
+			}
+			for(;i<iovcnt && remaining>0;i++)
+			{
+				if(remaining < (int)iov[i].iov_len)
 				{
-					if(!actual_client->queue.full)
-					{
-						actual_client->queue.full=1;
-						socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
-
-						log_message(log_module, MSG_DETAIL, "The queue is full, we now throw away new packets for client %s\n", addr_buf);
-					}
+					memcpy(queue->partial, (unsigned char *)iov[i].iov_base+remaining, iov[i].iov_len-remaining);
+					queue->partial_length=iov[i].iov_len-remaining;
+					queue->partial_pos=0;
+					remaining=0;
 				}
-				buffer=unicast_queue_get_data(&actual_client->queue, &buffer_len);
+				else
+					remaining-=iov[i].iov_len;
+				queue->position++;
 			}
-			else
-				packets_left=1;
+			budget-=written_len;
+			//The client accepts data again
+			if (actual_client->consecutive_errors)
+			{
+				socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
 
-			while(packets_left>0)
+				log_message(log_module, MSG_DETAIL, "We can write again to client %s\n", addr_buf);
+				actual_client->consecutive_errors=0;
+				actual_client->last_write_error=0;
+				log_message( log_module, MSG_DEBUG,"We start dequeuing packets Bytes in queue: %d\n",
+						unicast_queue_bytes(queue, ring));
+			}
+		}
+		//We check if all the data was successfully written
+		if(written_len<buffer_len)
+		{
+			//No !
+			if(written_len==-1)
 			{
-				//we send the data
-				written_len=send(actual_client->Socket,(const char *)buffer, buffer_len,MSG_NOSIGNAL);
-				//We check if all the data was successfully written
-				if(written_len<buffer_len)
+				if(errno != actual_client->last_write_error)
 				{
-					//No !
-					packets_left=0; //we don't send more packets to this client
-					if(written_len==-1)
-					{
-						if(errno != actual_client->last_write_error)
-						{
-							socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
-
-							log_message(log_module, MSG_DEBUG, "New error when writing to client %s : %s\n",
-									addr_buf,
-									strerror(errno));
-							actual_client->last_write_error=errno;
-							written_len=0;
-						}
-					}
-					else
-					{
-						socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
-
-						log_message( log_module, MSG_DEBUG,"Not all the data was written to %s. Asked len : %d, written len %d\n",
-								addr_buf,
-								actual_channel->nb_bytes,
-								written_len);
-					}
-					if(!(unicast_vars->flush_on_eagain &&(errno==EAGAIN)))//Debug feature : we can drop data if eagain error
-					{
-						//No drop on eagain or no eagain
-						if(!data_from_queue)
-						{
-							//We store the non sent data in the queue
-							if((actual_client->queue.data_bytes_in_queue+buffer_len-written_len)< unicast_vars->queue_max_size)
-							{
-								unicast_queue_add_data(&actual_client->queue, buffer+written_len, buffer_len-written_len);
-								log_message( log_module, MSG_DEBUG,"We start queuing packets ... \n");
-							}
-						}
-						else if(written_len > 0)
-						{
-							unicast_queue_remove_data(&actual_client->queue);
-							unicast_queue_requeue(&actual_client->queue, buffer+written_len, buffer_len-written_len);
-							log_message( log_module, MSG_DEBUG,"We requeue the non sent data ... \n");
-						}
-					}else{
-						//this is an EAGAIN error and we want to drop the data
-						if(!data_from_queue)
-						{
-							//Not from the queue we dont do anything
-							log_message( log_module, MSG_DEBUG,"We drop not from queue ... \n");
-						}
-						else
-						{
-							unicast_queue_clear(&actual_client->queue);
-							log_message( log_module, MSG_DEBUG,"Eagain error we flush the queue ... \n");
-						}
-					}
+					socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
 
-					if(!actual_client->consecutive_errors)
-					{
-						socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
+					log_message(log_module, MSG_DEBUG, "New error when writing to client %s : %s\n",
+							addr_buf,
+							strerror(errno));
+					actual_client->last_write_error=errno;
+				}
+				written_len=0;
+			}
+			else
+			{
+				socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
 
-						log_message( log_module, MSG_DETAIL,"Error when writing to client %s : %s\n",
-								addr_buf,
-								strerror(errno));
-						gettimeofday (&tv, (struct timezone *) NULL);
-						actual_client->first_error_time = tv.tv_sec;
-						actual_client->consecutive_errors=1;
-					}
-					else
-					{
-						//We have errors, we check if we reached the timeout
-						gettimeofday (&tv, (struct timezone *) NULL);
-						if((unicast_vars->consecutive_errors_timeout > 0) && (tv.tv_sec - actual_client->first_error_time) > unicast_vars->consecutive_errors_timeout)
-						{
-							socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
+				log_message( log_module, MSG_DEBUG,"Not all the data was written to %s. Asked len : %d, written len %d\n",
+						addr_buf,
+						buffer_len,
+						written_len);
+			}
+			if(unicast_vars->flush_on_eagain &&(errno==EAGAIN))//Debug feature : we can drop data if eagain error
+			{
+				//this is an EAGAIN error and we want to drop the data
+				log_message( log_module, MSG_DEBUG,"Eagain error we flush the queue ... \n");
+				queue->position=ring->head;
+			}
 
-							log_message(log_module, MSG_INFO, "Consecutive errors when writing to client %s during too much time, we disconnect\n", addr_buf);
-							temp_client=actual_client->chan_next;
-							unicast_close_connection(unicast_vars,actual_client->Socket);
-							actual_client=temp_client;
-						}
-					}
-				}
-				else
+			//If some data was written, the socket is only full, this is not an error
+			if(written_len>0)
+				break; //we don't send more to this client
+			if(!actual_client->consecutive_errors)
+			{
+				socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
+
+				log_message( log_module, MSG_DETAIL,"Error when writing to client %s : %s\n",
+						addr_buf,
+						strerror(errno));
+				gettimeofday (&tv, (struct timezone *) NULL);
+				actual_client->first_error_time = tv.tv_sec;
+				actual_client->consecutive_errors=1;
+			}
+			else
+			{
+				//We have errors, we check if we reached the timeout
+				gettimeofday (&tv, (struct timezone *) NULL);
+				if((unicast_vars->consecutive_errors_timeout > 0) && (tv.tv_sec - actual_client->first_error_time) > unicast_vars->consecutive_errors_timeout)
 				{
-					//data successfully written
-					if (actual_client->consecutive_errors)
-					{
-						socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
-
-						log_message(log_module, MSG_DETAIL, "We can write again to client %s\n", addr_buf);
-						actual_client->consecutive_errors=0;
-						actual_client->last_write_error=0;
-						if(data_from_queue)
-							log_message( log_module, MSG_DEBUG,"We start dequeuing packets Packets in queue: %d. Bytes in queue: %d\n",
-									actual_client->queue.packets_in_queue,
-									actual_client->queue.data_bytes_in_queue);
-					}
-					packets_left--;
-					if(data_from_queue)
-					{
-						//The data was successfully sent, we can dequeue it
-						unicast_queue_remove_data(&actual_client->queue);
-						if(actual_client->queue.packets_in_queue!=0)
-						{
-							//log_message( log_module, MSG_DEBUG,"Still packets in the queue,next one\n");
-							//still packets in the queue, we continue sending
-							if(packets_left)
-								buffer=unicast_queue_get_data(&actual_client->queue, &buffer_len);
-						}
-						else //queue now empty
-						{
-							packets_left=0;
-							socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
+					socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
 
-							log_message(log_module, MSG_DEBUG, "The queue is now empty :) client %s\n", addr_buf);
-						}
-					}
+					log_message(log_module, MSG_INFO, "Consecutive errors when writing to client %s during too much time, we disconnect\n", addr_buf);
+					//We can be called from several threads, the main thread will close the connection
+					actual_client->disconnect=1;
+					MU_STORE_RELEASE(&unicast_vars->disconnect_pending,1);
 				}
 			}
+			break; //The socket is full, we don't send more to this client
+		}
+		//data successfully written
+		if(queue->position == ring->head && queue->full)
+		{
+			queue->full=0;
+			socket_to_string(actual_client->Socket, addr_buf, sizeof(addr_buf));
 
-			if(actual_client) //Can be null if the client was destroyed
-				actual_client=actual_client->chan_next;
+			log_message(log_module, MSG_DEBUG, "The queue is now empty :) client %s\n", addr_buf);
 		}
 	}
+}
+
+/** @brief Send the buffer for the channel
+ *
+ * This function is called when a buffer for a channel is full and have to be sent to the clients
+ * The buffer is written once in the ring of the channel, then each client sends from its position
+ */
+void unicast_data_send(mumudvb_channel_t *actual_channel, unicast_parameters_t *unicast_vars)
+{
+	unicast_client_t *actual_client;
+	unicast_ring_t *ring=actual_channel->unicast_ring;
+
+	if(!actual_channel->clients || ring==NULL)
+		return;
 
+	//We add the new segment to the ring
+	memcpy(ring->data + (ring->head % ring->num_segments) * MAX_UDP_SIZE, actual_channel->buf, actual_channel->nb_bytes);
+	ring->data_length[ring->head % ring->num_segments]=actual_channel->nb_bytes;
+	ring->head++;
+
+	for(actual_client=actual_channel->clients; actual_client!=NULL; actual_client=actual_client->chan_next)
+	{
+		//This client will be disconnected, no need to send
+		if(actual_client->disconnect)
+			continue;
+		unicast_client_send(actual_client, ring, unicast_vars);
+	}
 }
 
 
@@ -246,126 +296,67 @@ void unicast_data_send(mumudvb_channel_t *actual_channel, unicast_parameters_t *
 
 /* ================= QUEUE ======================*/
 
-/** @brief Add data to a queue
+/** @brief Get the ring of a channel for a new client, it is created for the first client
  *
+ * @param channel the channel
+ * @param queue_max_size the size of the ring in bytes
  */
-int unicast_queue_add_data(unicast_queue_header_t *header, unsigned char *data, int data_len)
+unicast_ring_t *unicast_ring_get(mumudvb_channel_t *channel, int queue_max_size)
 {
-	unicast_queue_data_t *dest;
-	if(header->packets_in_queue == 0)
+	unicast_ring_t *ring=channel->unicast_ring;
+	if(ring==NULL)
 	{
-		//first packet in the queue
-		header->first=malloc(sizeof(unicast_queue_data_t));
-		if(header->first==NULL)
+		ring=calloc(1, sizeof(unicast_ring_t));
+		if(ring==NULL)
 		{
 			log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
-			return -1;
+			return NULL;
 		}
-		dest=header->first;
-		header->last=header->first;
-	}
-	else
-	{
-		//already packets in the queue
-		header->last->next=malloc(sizeof(unicast_queue_data_t));
-		if(header->last->next==NULL)
+		ring->num_segments=queue_max_size/MAX_UDP_SIZE;
+		if(ring->num_segments<UNICAST_MIN_RING_SEGMENTS)
+			ring->num_segments=UNICAST_MIN_RING_SEGMENTS;
+		ring->data_length=malloc(ring->num_segments*sizeof(int));
+		ring->data=malloc(ring->num_segments*MAX_UDP_SIZE);
+		if(ring->data_length==NULL || ring->data==NULL)
 		{
 			log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
-			return -1;
+			free(ring->data_length);
+			free(ring->data);
+			free(ring);
+			return NULL;
 		}
-		dest=header->last->next;
-		header->last=dest;
+		channel->unicast_ring=ring;
 	}
-	dest->next=NULL;
-	dest->data=malloc(sizeof(unsigned char)*data_len);
-	if(dest->data==NULL)
-	{
-		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
-		return -1;
-	}
-	memcpy(dest->data,data,data_len);
-	dest->data_length=data_len;
-	header->packets_in_queue++;
-	header->data_bytes_in_queue+=data_len;
-	//log_message( log_module, MSG_DEBUG,"queuing new packet. Packets in queue: %d. Bytes in queue: %d\n",header->packets_in_queue,header->data_bytes_in_queue);
-	return 0;
+	ring->refcount++;
+	return ring;
 }
 
-/** @brief Get data from a queue
+/** @brief A client of the channel doesn't use the ring anymore, it is freed with the last client
  *
+ * @param channel the channel
  */
-unsigned char *unicast_queue_get_data(unicast_queue_header_t *header, int *data_len)
+void unicast_ring_release(mumudvb_channel_t *channel)
 {
-	if(header->packets_in_queue == 0)
+	unicast_ring_t *ring=channel->unicast_ring;
+	if(ring==NULL)
+		return;
+	ring->refcount--;
+	if(ring->refcount<=0)
 	{
-		log_message( log_module, MSG_ERROR,"BUG : Cannot dequeue an empty queue\n");
-		return NULL;
+		free(ring->data_length);
+		free(ring->data);
+		free(ring);
+		channel->unicast_ring=NULL;
 	}
-
-	*data_len=header->first->data_length;
-	return header->first->data;
 }
 
-
-/** @brief Remove the first packet of the queue
+/** @brief Number of bytes waiting to be sent to the client
  *
  */
-int unicast_queue_remove_data(unicast_queue_header_t *header)
+int unicast_queue_bytes(unicast_queue_header_t *header, unicast_ring_t *ring)
 {
-	unicast_queue_data_t *tobedeleted;
-	if(header->packets_in_queue == 0)
-	{
-		log_message( log_module, MSG_ERROR,"BUG : Cannot remove from an empty queue\n");
-		return -1;
-	}
-	tobedeleted=header->first;
-	header->first=header->first->next;
-	header->packets_in_queue--;
-	header->full=0;
-	header->data_bytes_in_queue-=tobedeleted->data_length;
-	free(tobedeleted->data);
-	free(tobedeleted);
-	return 0;
-}
-
-/** @brief Clear the queue
- *
- */
-void unicast_queue_clear(unicast_queue_header_t *header)
-{
-	while(header->packets_in_queue > 0)
-		unicast_queue_remove_data(header);
-}
-
-
-int unicast_queue_requeue(unicast_queue_header_t *header, unsigned char *data, int data_len)
-{
-	int last_pkt_size;
-	unicast_queue_data_t *dest;
-	unsigned char *tempbuf;
-
-	if(header->packets_in_queue == 0)
-	{
-		log_message(log_module, MSG_ERROR, "BUG: unicast_queue_requeue() called with no packets in the queue\n");
-		return -1;
-	}
-
-	tempbuf = malloc(sizeof(unsigned char)*data_len);
-	if(tempbuf == NULL)
-	{
-		log_message( log_module, MSG_ERROR,"Problem with malloc : %s file : %s line %d\n",strerror(errno),__FILE__,__LINE__);
-		return -1;
-	}
-	memcpy(tempbuf, data, data_len);
-
-	dest=header->first;
-	last_pkt_size = dest->data_length;
-
-	free(dest->data);
-	dest->data = tempbuf;
-
-	dest->data_length = data_len;
-	header->data_bytes_in_queue -= last_pkt_size;
-	header->data_bytes_in_queue += data_len;
-	return 0;
+	int bytes=header->partial_length-header->partial_pos;
+	for(uint64_t position=header->position; position!=ring->head; position++)
+		bytes+=ring->data_length[position % ring->num_segments];
+	return bytes;
 }
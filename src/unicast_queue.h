@@ -28,45 +28,55 @@
 #ifndef _UNICAST_QUEUE_H
 #define _UNICAST_QUEUE_H
 
-#define UNICAST_DEFAULT_QUEUE_MAX 1024*512
-/**How many packets we try to send from the queue per new packet. This value MUST be at least 2*/
-#define UNICAST_MULTIPLE_QUEUE_SEND 3
+#include "mumudvb.h"
 
-/** @brief A data packet in queue.
+#define UNICAST_DEFAULT_QUEUE_MAX 1024*512
+/**The minimum number of segments in the ring of a channel*/
+#define UNICAST_MIN_RING_SEGMENTS 3
+/**How many bytes we try to send to a client per new packet, a client catching up sends its backlog by chunks of this size*/
+#define UNICAST_DEFAULT_SEND_BUDGET 256*1024
+/**The maximum number of segments sent with one system call*/
+#define UNICAST_SEND_MAX_IOV 64
+
+/** @brief The data sent to the clients of a channel.
  *
+ * The data is written once per channel in this ring of segments, each client
+ * only keeps its position in the ring. The ring is shared by the clients of the
+ * channel (refcount) and freed when the last client leaves. A client lagging by
+ * more than the ring size loses the oldest segments.
  */
-typedef struct unicast_queue_data_t{
-  int data_length;
+typedef struct unicast_ring_t{
+  /** Number of clients using the ring*/
+  int refcount;
+  /** Number of segments in the ring*/
+  int num_segments;
+  /** Sequence number of the next segment written, the segment n is at n % num_segments*/
+  uint64_t head;
+  /** The length of each segment*/
+  int *data_length;
+  /** The segments, MAX_UDP_SIZE bytes each*/
   unsigned char *data;
-  struct unicast_queue_data_t *next;
-}unicast_queue_data_t;
+}unicast_ring_t;
 
-/** @brief The header of a data queue.
+/** @brief The position of a client in the ring of its channel.
  *
  */
 typedef struct unicast_queue_header_t{
-  int packets_in_queue;
-  int data_bytes_in_queue;
+  /** Sequence number of the next segment to send*/
+  uint64_t position;
+  /** Did we lose segments (for logging)*/
   int full;
-  unicast_queue_data_t *first;
-  unicast_queue_data_t *last;
+  /** Number of segments lost because the client was too slow*/
+  unsigned long lost_segments;
+  /** The end of a segment partially sent, it must be sent before the next segment*/
+  unsigned char partial[MAX_UDP_SIZE];
+  int partial_length;
+  int partial_pos;
 }unicast_queue_header_t;
 
 
-
-void unicast_queue_clear(unicast_queue_header_t *header);
-
-
-
-
-
-
-
-
-
-
-
-
-
+unicast_ring_t *unicast_ring_get(mumudvb_channel_t *channel, int queue_max_size);
+void unicast_ring_release(mumudvb_channel_t *channel);
+int unicast_queue_bytes(unicast_queue_header_t *header, unicast_ring_t *ring);
 
 #endif
\ No newline at end of file